@@ -0,0 +1,47 @@
+# training run of the instrumented build, cmake -P with
+#   -DBIN=<instrumented build dir> -DSOURCE_DIR=<repository> -DPROFILE_DIR=<dir>
+#   -DCOMPILER_ID=<GNU|Clang> [-DPROFDATA=<llvm-profdata>]
+#
+# the workload is what the emulator spends its time on: the CP/M exercisers on the
+# interpreter, and the recorded movies replayed headless on the interpreter, the recompiled
+# blocks and the batched lanes. exit codes are ignored, a budget cut short still counts as training
+
+set(FrameHashes ${SOURCE_DIR}/tests/frame_hashes)
+set(Scratch ${BIN}/pgo_training)
+
+file(REMOVE_RECURSE ${PROFILE_DIR} ${Scratch})
+file(MAKE_DIRECTORY ${PROFILE_DIR} ${Scratch})
+
+function(train)
+  string(REPLACE ";" " " line "${ARGN}")
+  message(STATUS "pgo training: ${line}")
+  execute_process(COMMAND ${ARGN} WORKING_DIRECTORY ${Scratch} OUTPUT_QUIET ERROR_QUIET)
+endfunction()
+
+train(${BIN}/cpm_conformance ${SOURCE_DIR}/cpu_tests --budget 300000000)
+train(${BIN}/cpm_conformance ${SOURCE_DIR}/cpu_tests TST8080.COM 8080PRE.COM --eager-flags)
+train(${BIN}/frame_hashes record ${FrameHashes}/test_rom.bin ${FrameHashes}/test_rom.movie ${Scratch}/test_rom.hashes)
+train(${BIN}/frame_hashes record ${FrameHashes}/test_rom.bin ${FrameHashes}/test_rom.movie ${Scratch}/test_rom.hashes --no-idle-skip)
+train(${BIN}/frame_hashes_recompiled check ${FrameHashes}/test_rom.bin ${FrameHashes}/test_rom.movie ${FrameHashes}/test_rom.hashes)
+train(${BIN}/batch_check ${FrameHashes}/test_rom.bin ${FrameHashes}/test_rom.movie --lanes 32 --frames 300)
+if(EXISTS ${SOURCE_DIR}/invaders/invaders.h)
+  train(${BIN}/frame_hashes record ${SOURCE_DIR}/invaders ${FrameHashes}/invaders.movie ${Scratch}/invaders.hashes --no-idle-skip)
+endif()
+
+# clang writes raw profiles that have to be merged, gcc's .gcda files are used as they are
+if(COMPILER_ID MATCHES "Clang")
+  file(GLOB raw_profiles ${PROFILE_DIR}/*.profraw)
+  if(NOT raw_profiles)
+    message(FATAL_ERROR "pgo training wrote no profiles to ${PROFILE_DIR}")
+  endif()
+  execute_process(COMMAND ${PROFDATA} merge -output=${PROFILE_DIR}/default.profdata ${raw_profiles}
+    RESULT_VARIABLE merged)
+  if(NOT merged EQUAL 0)
+    message(FATAL_ERROR "llvm-profdata merge failed")
+  endif()
+else()
+  file(GLOB_RECURSE profiles ${PROFILE_DIR}/*.gcda)
+  if(NOT profiles)
+    message(FATAL_ERROR "pgo training wrote no profiles to ${PROFILE_DIR}")
+  endif()
+endif()
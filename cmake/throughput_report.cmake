@@ -0,0 +1,57 @@
+# runs the throughput tool of every build and compares them to the first, cmake -P with
+#   -DBUILDS=<dir;dir;...> -DSOURCE_DIR=<repository> [-DARGS=<extra throughput arguments>]
+#
+# a build is named after its CMAKE_BUILD_TYPE, PGO and LTO settings (from its CMakeCache.txt)
+
+set(FrameHashes ${SOURCE_DIR}/tests/frame_hashes)
+
+function(cache_value dir name out)
+  file(STRINGS ${dir}/CMakeCache.txt line REGEX "^${name}:[A-Z]+=")
+  string(REGEX REPLACE "^[^=]*=" "" value "${line}")
+  set(${out} "${value}" PARENT_SCOPE)
+endfunction()
+
+set(rows "")
+set(base_mips "")
+set(base_fps "")
+foreach(dir ${BUILDS})
+  if(NOT EXISTS ${dir}/throughput)
+    message(STATUS "${dir}: no throughput binary, skipped")
+    continue()
+  endif()
+  cache_value(${dir} CMAKE_BUILD_TYPE type)
+  cache_value(${dir} PGO pgo)
+  cache_value(${dir} ENABLE_LTO lto)
+  set(name "${type}")
+  if(lto AND NOT type STREQUAL "Debug")
+    string(APPEND name " lto")
+  endif()
+  if(pgo AND NOT pgo STREQUAL "OFF")
+    string(TOLOWER "${pgo}" pgo)
+    string(APPEND name " pgo-${pgo}")
+  endif()
+
+  execute_process(COMMAND ${dir}/throughput ${SOURCE_DIR}/cpu_tests/8080EXM.COM
+      ${FrameHashes}/test_rom.bin ${FrameHashes}/test_rom.movie ${ARGS}
+    OUTPUT_VARIABLE output RESULT_VARIABLE result)
+  string(REGEX MATCH "throughput: ([0-9.]+) MIPS, ([0-9.]+) frames/s" matched "${output}")
+  if(NOT result EQUAL 0 OR NOT matched)
+    message(FATAL_ERROR "${dir}/throughput failed:\n${output}")
+  endif()
+  set(mips ${CMAKE_MATCH_1})
+  set(fps ${CMAKE_MATCH_2})
+  if(base_mips STREQUAL "")
+    set(base_mips ${mips})
+    set(base_fps ${fps})
+  endif()
+  # cmake math is integer only, the ratios are in hundredths
+  string(REPLACE "." "" mips_tenths ${mips})
+  string(REPLACE "." "" base_tenths ${base_mips})
+  math(EXPR mips_ratio "${mips_tenths} * 100 / ${base_tenths}")
+  math(EXPR fps_ratio "${fps} * 100 / ${base_fps}")
+  set(row "${name}                              ")
+  string(SUBSTRING "${row}" 0 30 row)
+  string(APPEND rows "${row} ${mips} MIPS (${mips_ratio}%)   ${fps} frames/s (${fps_ratio}%)   ${dir}\n")
+endforeach()
+
+message("\nthroughput, single threaded, relative to the first build:\n${rows}")
@@ -0,0 +1,51 @@
+# trace_diff against a reference that differs in one register, cmake -P with
+#   -DTRACE_DIFF=<trace_diff> -DPROGRAM=<program.COM> -DWORK_DIR=<dir> -DINSTRUCTION=<index>
+#
+# exports the program's text trace, imports it unchanged (check must pass, so the text
+# format is what another emulator has to write) and again with B changed after instruction
+# INSTRUCTION: check must fail there and name B
+
+file(REMOVE_RECURSE ${WORK_DIR})
+file(MAKE_DIRECTORY ${WORK_DIR})
+
+function(trace_diff expected_result output)
+  execute_process(COMMAND ${TRACE_DIFF} ${ARGN} RESULT_VARIABLE result OUTPUT_VARIABLE out ERROR_VARIABLE out)
+  if(NOT result EQUAL expected_result)
+    string(REPLACE ";" " " line "${ARGN}")
+    message(FATAL_ERROR "trace_diff ${line} returned ${result}, expected ${expected_result}:\n${out}")
+  endif()
+  set(${output} "${out}" PARENT_SCOPE)
+endfunction()
+
+trace_diff(0 out export ${PROGRAM} ${WORK_DIR}/reference.txt)
+trace_diff(0 out import ${WORK_DIR}/reference.txt ${WORK_DIR}/reference.trc --interval 64)
+trace_diff(0 out check ${PROGRAM} ${WORK_DIR}/reference.trc)
+
+file(STRINGS ${WORK_DIR}/reference.txt lines)
+list(LENGTH lines count)
+if(count LESS_EQUAL INSTRUCTION)
+  message(FATAL_ERROR "${PROGRAM} runs ${count} instructions, not past ${INSTRUCTION}")
+endif()
+list(GET lines ${INSTRUCTION} line)
+if(line MATCHES " B=00 ")
+  string(REPLACE " B=00 " " B=01 " changed "${line}")
+else()
+  string(REGEX REPLACE " B=[0-9A-F][0-9A-F] " " B=00 " changed "${line}")
+endif()
+list(REMOVE_AT lines ${INSTRUCTION})
+list(INSERT lines ${INSTRUCTION} "${changed}")
+string(REPLACE ";" "\n" text "${lines}")
+file(WRITE ${WORK_DIR}/diverged.txt "# ${PROGRAM} with B changed after instruction ${INSTRUCTION}\n${text}\n")
+
+# the whole window in full names the instruction, checkpoints only the window it is in
+trace_diff(0 out import ${WORK_DIR}/diverged.txt ${WORK_DIR}/diverged.trc --full 0:${count})
+trace_diff(1 out check ${PROGRAM} ${WORK_DIR}/diverged.trc)
+if(NOT out MATCHES "trace diverged at instruction ${INSTRUCTION}\n.*differs in: B\n")
+  message(FATAL_ERROR "the divergence after instruction ${INSTRUCTION} was not reported there:\n${out}")
+endif()
+trace_diff(0 out import ${WORK_DIR}/diverged.txt ${WORK_DIR}/diverged.trc --interval 64)
+trace_diff(1 out check ${PROGRAM} ${WORK_DIR}/diverged.trc)
+math(EXPR window_start "${INSTRUCTION} / 64 * 64")
+if(NOT out MATCHES "checkpoint mismatch in instructions \\[${window_start}, ")
+  message(FATAL_ERROR "the divergence after instruction ${INSTRUCTION} was not reported in its checkpoint:\n${out}")
+endif()
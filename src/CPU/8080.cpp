@@ -1,5 +1,10 @@
 #include "8080.hpp"
+#include "frame_hash.hpp"
 #include <unistd.h>
+#include <sys/stat.h>
+#include <mutex>
+#include <chrono>
+#include <thread>
 
 #define BLACK_FONT 0, 0, 0, 255
 #define WHITE_FONT 255, 255, 255, 255
@@ -12,39 +17,48 @@ string get_hex_string(int num) {
   return stream.str();
 }
 
-_8080::_8080() {
+_8080::_8080(bool headless) {
+  map_invaders_ports();
+  schedule_frame(0);
+
+  // headless instances (tests / tools) never touch SDL
+  if (headless) {
+    return;
+  }
+
   TTF_Init();
   SDL_Init(SDL_INIT_VIDEO);
 
-  memory = (u8*) malloc(sizeof(u8) * TOTAL_BYTES_OF_MEM);
-  memset(memory, 0, TOTAL_BYTES_OF_MEM);
-
-  regs = new Registers();
   screen = new Screen();
-  window = SDL_CreateWindow("Instructions", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,  window_w, window_h, SDL_WINDOW_SHOWN);
-  
-  // shift to correct position
-  int window_x;
-  int window_y;
-  SDL_GetWindowPosition(window, &window_x, &window_y);
-  SDL_SetWindowPosition(window, window_x * 0.3, window_y * 0.3);
-  renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
+  register_pane = new RegisterPane();
 
+  // the game still runs without the sample set, the missing sounds are just silent
+  audio = new Audio();
+  audio->load_samples();
+  audio->open_device();
 }
 
 _8080::~_8080() {
-  SDL_DestroyWindow(window);
-  delete[] memory;
+  delete capture;
+  delete audio;
+  delete register_pane;
+  // screen goes last since it shuts SDL down
+  delete screen;
+  delete video;
+  delete run_ahead_state;
+  for (_8080* child : spare_children) {
+    delete child;
+  }
 }
 
-void _8080::load_rom(const string& file_path, u16 start_address) {
+bool _8080::load_rom(const string& file_path, u16 start_address) {
   
   // Open file in binary mode
   ifstream romFile(file_path, ios::binary);
 
   if (!romFile) {
     cerr << "Error: could not open ROM file " << file_path << endl;
-    return;  
+    return false;
   }
 
   // Get the size of the file by shifting pointer to end
@@ -60,165 +74,568 @@ void _8080::load_rom(const string& file_path, u16 start_address) {
   
   if (!romFile) {
     std::cerr << "Error: failed to read the entire ROM file" << std::endl;
-    return;
+    return false;
   }
 
   romFile.close();
 
   // Copy the ROM data into memory starting at specified starting adress
-  for (std::size_t i = 0; i < size; ++i) {
-    memory[start_address + i] = buffer[i];
+  memory.write_block(start_address, (const u8*) buffer.data(), size);
+  return true;
+}
+
+// the 4 ROM chips of the invaders set (invaders.h, .g, .f, .e) from a folder
+bool _8080::load_invaders(const string& folder) {
+  bool loaded = load_rom(folder + "invaders.h", INVADERS_H_START);
+  loaded = load_rom(folder + "invaders.g", INVADERS_G_START) && loaded;
+  loaded = load_rom(folder + "invaders.f", INVADERS_F_START) && loaded;
+  loaded = load_rom(folder + "invaders.e", INVADERS_E_START) && loaded;
+  regs.pc = PROGRAM_START;
+  return loaded;
+}
+
+bool _8080::load_program(const string& rom) {
+  struct stat info;
+  if (stat(rom.c_str(), &info) != 0) {
+    log_error("could not find %s", rom.c_str());
+    return false;
   }
+  if (S_ISDIR(info.st_mode)) {
+    return load_invaders(rom.back() == '/' ? rom : rom + '/');
+  }
+  regs.pc = PROGRAM_START;
+  return load_rom(rom, PROGRAM_START);
 }
 
-void _8080::fill_background() {
-  SDL_SetRenderDrawColor(renderer, BLACK_FONT);
-  SDL_RenderClear(renderer);
-  SDL_SetRenderDrawColor(renderer, WHITE_FONT);
+// the idle loop seen last may not be in the new memory
+void _8080::share_memory(_8080& source) {
+  memory.share(source.memory);
+  idle = IdleLoop();
 }
 
-void _8080::draw_instructions() {
+// code holds DISASSEMBLY_BYTES of memory from pc
+void _8080::draw_instructions(u16 pc, const u8* code) {
   int x = 0;
   int y = 0;
   SDL_Color color = {255, 255, 255};
-  u16 temp = regs->pc;
+  u16 temp = pc;
   int instructions_to_draw = 35;
 
   for (int i = 0; i < instructions_to_draw; i++){
-    u32 instruction = memory[temp + i];
+    u32 instruction = code[(u16) (temp + i - pc)];
     int index = temp + i;
     if (instruction_list[int(instruction)] == 2){
       temp += 1;
-      instruction = (instruction << 8) | memory[temp + i];
+      instruction = (instruction << 8) | code[(u16) (temp + i - pc)];
     } else if (instruction_list[int(instruction)] == 3) {
       temp += 1;
-      instruction = (instruction << 8) | memory[temp + i];
+      instruction = (instruction << 8) | code[(u16) (temp + i - pc)];
       temp += 1;
-      instruction = (instruction << 8) | memory[temp + i];
+      instruction = (instruction << 8) | code[(u16) (temp + i - pc)];
     }
     string instruction_text = get_hex_string(index) + ": 0x" + get_hex_string(instruction);
-    SDL_Surface* text = TTF_RenderText_Solid(regs->font, instruction_text.c_str(), color);
-    SDL_Texture* texture = SDL_CreateTextureFromSurface( renderer, text );
+    SDL_Surface* text = TTF_RenderText_Solid(register_pane->font, instruction_text.c_str(), color);
+    SDL_Texture* texture = SDL_CreateTextureFromSurface( screen->renderer, text );
     SDL_Rect text_rect = {x, y, text->w, text->h};
-    SDL_RenderCopy(renderer, texture, NULL, &text_rect);
+    SDL_RenderCopy(screen->renderer, texture, NULL, &text_rect);
     y += 20;
     SDL_DestroyTexture( texture );
     SDL_FreeSurface( text ); 
   } 
-  SDL_RenderPresent(renderer);
 }
 
-void _8080::render() {
-  // render all screens
-  screen->render_screen(this);
-  fill_background();
-  draw_instructions();
-  regs->render_regs();
+// emulation thread: the game screen from the run-ahead frame, the debug windows from the
+// real one
+void _8080::fill_video_frame(VideoFrame* frame) {
+  regs.sync_flags();
+  frame->frame = frames;
+  frame->regs = regs;
+  for (int i = 0; i < DISASSEMBLY_BYTES; i++) {
+    frame->code[i] = memory[(u16) (regs.pc + i)];
+  }
+  if (run_ahead > 0) {
+    begin_run_ahead();
+    memory.read_block(VRAM_START, frame->vram, VRAM_BYTES);
+    end_run_ahead();
+  } else {
+    memory.read_block(VRAM_START, frame->vram, VRAM_BYTES);
+  }
 }
 
+// main thread, only touches the published frame; every pane goes into the one window and
+// it is presented once
+void _8080::render(const VideoFrame& frame) {
+  screen->begin_frame();
+  screen->render_screen(frame.vram);
+  if (screen->show_disassembly) {
+    screen->set_viewport(&screen->disassembly_pane);
+    draw_instructions(frame.regs.pc, frame.code);
+  }
+  if (screen->show_registers) {
+    screen->set_viewport(&screen->registers_pane);
+    register_pane->render_regs(screen->renderer, frame.regs);
+  }
+  screen->present();
+}
+
+// CP/M programs are loaded at 0x100 with the BDOS entry (0x0005) intercepted in step_test
+void _8080::load_test(const string& file_path) {
+  load_rom(file_path, 0x100);
+  regs.pc = 0x0100;
+  memory.write(0x0006, 0x00);
+  memory.write(0x0007, 0x24);
+}
+
+// a CP/M program signals completion by jumping to the warm boot vector at 0x0000
+bool _8080::test_finished() {
+  return regs.pc == 0x0000;
+}
+
+// services a BDOS call if the pc is at the entry point, then runs one instruction
+void _8080::step_test() {
+  if (regs.pc == 0x0005) {
+    handleCPMCall();
+    // system reset went to the warm boot vector, the program is over
+    if (test_finished()) {
+      return;
+    }
+  }
+  u8 opcode = fetch_byte();
+  execute_instruction(opcode);
+}
+
+// runs the program to the end, or until stop()
 void _8080::run_test() {
   log_log();
+  emulating = true;
   int instruction_count = 0;
-  while (regs->pc != 0x00) {
-    if (regs->pc == 0x0005) {
-      if (regs->c == 0x02) {
-        log_log_nonewl("%c", regs->e);
-      } 
-      else if (regs->c == 0x09) {
-        while (memory[regs->de] != '$') {
-          log_log_nonewl("%c", memory[regs->de]);
-          regs->de++;
-        }
-      } 
-      else {
-        log_error("Unknown c in test interrupt");
-        exit(1);
-      }
-      RET();
-    }
-
+  while (!test_finished() && emulating.load(memory_order_relaxed)) {
     // if (instruction_count > 1000){
     //   render();
     //   instruction_count = 0;
     // }
-    // printf("PC: 0x%04X\n", regs->pc);
-    u8 opcode = fetch_byte();
-    // cout << "opcode is 0x" << hex << setw(2) << setfill('0') << static_cast<int>(opcode) << endl;
-    // cin.get();
-    execute_instruction(opcode);
+    // printf("PC: 0x%04X\n", regs.pc);
+    step_test();
     instruction_count ++;
-    // SDL_Delay(0);
   }
   log_log();
 }
 
-#define TICK_INTERVAL 15
-static u32 next_time;
-
-uint32_t time_left() {
-    u32 now;
+// runs until the program finishes or the budget is spent, returns the instructions executed
+u64 _8080::run_test(u64 instruction_budget) {
+  u64 executed = 0;
+  while (executed < instruction_budget && !test_finished()) {
+    step_test();
+    executed++;
+  }
+  return executed;
+}
 
-    now = SDL_GetTicks();
-    if (next_time <= now)
-        return 0;
-    else
-        return next_time - now;
+// one video frame: the mid screen interrupt, then the vblank interrupt
+// frame n spans cycles [n * CYCLES_PER_SECOND / 60, (n + 1) * CYCLES_PER_SECOND / 60), computed
+// from the frame number so the 33333.3 cycle frames never drift
+void _8080::schedule_frame(u64 frame) {
+  u64 start = frame * CYCLES_PER_SECOND / FRAMES_PER_SECOND;
+  u64 end = (frame + 1) * CYCLES_PER_SECOND / FRAMES_PER_SECOND;
+  scheduler.schedule(start + (end - start) / 2, EVENT_MID_SCREEN);
+  scheduler.schedule(end, EVENT_VBLANK);
 }
 
-void _8080::run() {
+// a halted CPU does nothing until the next interrupt, so HLT jumps straight to the deadline
+void _8080::run_until(u64 deadline) {
+  while (cycles < deadline) {
+    if (halted) {
+      halted_cycles += deadline - cycles;
+      cycles = deadline;
+      break;
+    }
+    u16 pc = regs.pc;
+    u16 offset = pc - (recompiled ? recompiled->rom_start : 0);
+    if (recompiled && offset < recompiled->rom_size && recompiled_blocks[offset]) {
+      const RecompiledBlock* block = recompiled_blocks[offset];
+      if (block->run(this, deadline) && regs.pc < block->last && skip_idle_loops) {
+        check_idle_loop(block->last, deadline);
+      }
+      continue;
+    }
+    // last is the instruction that may have jumped, the final one of a fused idiom
+    u16 last = pc;
+    if (!fuse_instructions || !run_fused(pc, deadline, &last)) {
+      u8 opcode = fetch_byte();
+      execute_instruction(opcode);
+    }
+    if (regs.pc < last && skip_idle_loops) {
+      check_idle_loop(last, deadline);
+    }
+  }
+}
 
-  SDL_Event event;
-  int open_windows = 3;
-  bool running = true;
-  next_time = SDL_GetTicks() + TICK_INTERVAL;
+// the blocks are only valid for the exact ROM they were generated from
+bool _8080::use_recompiled(const RecompiledProgram* program) {
+  recompiled = nullptr;
+  recompiled_blocks.clear();
+  if (!program) {
+    return true;
+  }
+  vector<u8> rom(program->rom_size);
+  memory.read_block(program->rom_start, rom.data(), rom.size());
+  u64 rom_hash = hash_bytes(rom.data(), rom.size());
+  if (rom_hash != program->rom_hash) {
+    log_warn("%s was generated from a different ROM, staying on the interpreter", program->name);
+    return false;
+  }
+  recompiled_blocks.assign(program->rom_size, nullptr);
+  for (size_t i = 0; i < program->num_blocks; i++) {
+    const RecompiledBlock& block = program->blocks[i];
+    recompiled_blocks[block.start - program->rom_start] = &block;
+  }
+  recompiled = program;
+  return true;
+}
 
-  while (running) {
-    cycles = 0;
+// superinstructions //////////////////////////////////////////////////////////
+
+// which idiom starts at pc, the memory is read as is so code in RAM works too; anything
+// but the four first opcodes is rejected on its first byte
+Fusion _8080::match_fusion(u16 pc) {
+  auto at = [&](int i) { return memory[(u16) (pc + i)]; };
+  switch (at(0)) {
+    case 0x1A:
+      if (at(1) == 0x77 && at(2) == 0x23 && at(3) == 0x13 && at(4) == 0x05 && at(5) == 0xC2 &&
+          (at(6) | (at(7) << 8)) == pc) {
+        return FUSION_BLOCK_COPY;
+      }
+      break;
+    case 0x7E:
+      if (at(1) == 0xA7 && at(2) == 0xC8) {
+        return FUSION_TEST_M;
+      }
+      break;
+    case 0x3A:
+      if (at(3) == 0xA7 && at(4) == 0xC8) {
+        return FUSION_TEST_MEMORY;
+      }
+      break;
+    case 0xCD:
+      if (memory[at(1) | (at(2) << 8)] == 0xC9) {
+        return FUSION_CALL_RET;
+      }
+      break;
+  }
+  return FUSION_NONE;
+}
 
-    while (cycles < CYCLES_PER_FRAME) {
-      if (!halted) {
-        u8 opcode = fetch_byte();
-        execute_instruction(opcode);
+// Runs a whole idiom in one dispatch with the same registers, flags, memory and cycles as
+// the single instructions. The interpreter only stops for an event between instructions
+// once cycles >= deadline, so an idiom is fused only when every instruction but its last
+// one ends before the deadline. The idiom is matched on every dispatch (nothing is cached
+// per address), so code written at run time is matched as it is now.
+bool _8080::run_fused(u16 pc, u64 deadline, u16* last) {
+  Fusion fusion = match_fusion(pc);
+
+  switch (fusion) {
+    case FUSION_BLOCK_COPY: {
+      // a copy over its own code would change the instructions that follow
+      if (cycles + 29 >= deadline || (u16) (regs.hl - pc) < 8) {
+        return false;
+      }
+      regs.a = memory[regs.de];
+      memory.write(regs.hl, regs.a);
+      regs.hl++;
+      regs.de++;
+      decrement_register(&regs.b, &regs.f);
+      regs.pc = regs.check_flag(ZERO_POS) ? pc + 8 : pc;
+      cycles += 39;
+      *last = pc + 5;
+      return true;
+    }
+    case FUSION_TEST_M:
+    case FUSION_TEST_MEMORY: {
+      int load_cycles = fusion == FUSION_TEST_M ? 7 : 13;
+      if (cycles + load_cycles + 4 >= deadline) {
+        return false;
+      }
+      u16 address = fusion == FUSION_TEST_M ? regs.hl : memory[(u16) (pc + 1)] | (memory[(u16) (pc + 2)] << 8);
+      *last = pc + (fusion == FUSION_TEST_M ? 2 : 4);
+      regs.a = memory[address];
+      bitwise_AND_register(&regs.a, regs.a, &regs.f);
+      if (regs.check_flag(ZERO_POS)) {
+        RET();
+        cycles += load_cycles + 4 + 11;
+      } else {
+        regs.pc = *last + 1;
+        cycles += load_cycles + 4 + 5;
+      }
+      return true;
+    }
+    case FUSION_CALL_RET: {
+      // the pushed return address must not land on the RET itself
+      u16 target = memory[(u16) (pc + 1)] | (memory[(u16) (pc + 2)] << 8);
+      if (cycles + 17 >= deadline || (u16) (target - (regs.sp - 2)) < 2) {
+        return false;
       }
+      regs.pc = pc + 3;
+      CALL(target);
+      cycles += 17;
+      if (target < pc && skip_idle_loops) {
+        check_idle_loop(pc, deadline);
+      }
+      RET();
+      cycles += 10;
+      *last = target;
+      return true;
     }
-    execute_interrupt(HALF_INTERRUPT);
+    default:
+      return false;
+  }
+}
+
+// the shared idle loop check on the core's registers, see idle_loop_skip
+void _8080::check_idle_loop(u16 jump, u64 deadline) {
+  regs.sync_flags();
+  u64 skipped = idle_loop_skip(idle, memory, jump, { regs.pc, regs.PSW, regs.bc, regs.de, regs.hl, regs.sp },
+                               cycles, deadline);
+  cycles += skipped;
+  idle_cycles += skipped;
+}
+
+// instruction length and cycles (as execute_instruction counts them) of the opcodes that
+// only read memory and change registers, 0 otherwise
+static u8 pure_lengths[256];
+static u8 pure_cycles[256];
+
+static void build_pure_tables() {
+  for (int op = 0x40; op < 0xC0; op++) {
+    bool writes_memory = op >= 0x70 && op <= 0x77; // MOV M,r and HLT
+    bool reads_memory = (op & 0x07) == 0x06; // MOV r,M and the ALU ops on M
+    pure_lengths[op] = writes_memory ? 0 : 1;
+    pure_cycles[op] = reads_memory ? 7 : op < 0x80 ? 5 : 4;
+  }
+  const u8 one_byte[] = {0x00, 0x03, 0x04, 0x05, 0x07, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0F, 0x13, 0x14, 0x15,
+                         0x17, 0x19, 0x1A, 0x1B, 0x1C, 0x1D, 0x1F, 0x23, 0x24, 0x25, 0x27, 0x29, 0x2B, 0x2C,
+                         0x2D, 0x2F, 0x33, 0x37, 0x39, 0x3B, 0x3C, 0x3D, 0x3F, 0xEB, 0xF9};
+  const u8 one_byte_cycles[] = {4, 5, 5, 5, 4, 10, 7, 5, 5, 5, 4, 5, 5, 5,
+                                4, 10, 7, 5, 5, 5, 4, 5, 5, 5, 4, 10, 5, 5,
+                                5, 4, 5, 4, 10, 5, 5, 5, 4, 5, 5};
+  const u8 two_bytes[] = {0x06, 0x0E, 0x16, 0x1E, 0x26, 0x2E, 0x3E, 0xC6, 0xCE, 0xD6, 0xDE, 0xE6, 0xEE, 0xF6, 0xFE};
+  const u8 three_bytes[] = {0x01, 0x11, 0x21, 0x31, 0x2A, 0x3A};
+  const u8 three_bytes_cycles[] = {10, 10, 10, 10, 16, 13};
+  for (size_t i = 0; i < sizeof(one_byte); i++) {
+    pure_lengths[one_byte[i]] = 1;
+    pure_cycles[one_byte[i]] = one_byte_cycles[i];
+  }
+  for (u8 op : two_bytes) {
+    pure_lengths[op] = 2;
+    pure_cycles[op] = 7;
+  }
+  for (size_t i = 0; i < sizeof(three_bytes); i++) {
+    pure_lengths[three_bytes[i]] = 3;
+    pure_cycles[three_bytes[i]] = three_bytes_cycles[i];
+  }
+}
+
+// the body must run straight from head to a JMP / Jcc back to head, which takes 10 cycles
+// taken or not
+static u64 pure_loop_cycles(const MemoryBus& memory, u16 head, u16 jump) {
+  static std::once_flag tables_ready;
+  std::call_once(tables_ready, build_pure_tables);
+
+  u16 pc = head;
+  u64 iteration = 10;
+  while (pc < jump) {
+    u8 opcode = memory[pc];
+    if (pure_lengths[opcode] == 0) {
+      return 0;
+    }
+    pc += pure_lengths[opcode];
+    iteration += pure_cycles[opcode];
+  }
+  u8 opcode = memory[jump];
+  bool is_jump = opcode == 0xC3 || (opcode & 0xC7) == 0xC2;
+  u16 target = memory[(u16) (jump + 1)] | (memory[(u16) (jump + 2)] << 8);
+  return pc == jump && is_jump && target == head ? iteration : 0;
+}
+
+// Polling loops like "LDA flag / ANA A / JZ loop" wait for an interrupt to change RAM.
+// When a short backward jump lands on the same head twice with identical registers and
+// the body can't write memory, do IO or touch the stack, every further iteration is
+// identical until the next event. The two visits must be one iteration apart, exactly the
+// body's cycles: a loop that was left and entered again later (through a long jump, a RET,
+// ...) may have seen anything in between. Whole iterations are skipped, the remainder is
+// still interpreted, so the interrupt lands on exactly the same instruction as without
+// skipping.
+u64 idle_loop_skip(IdleLoop& loop, const MemoryBus& memory, u16 jump, const LoopRegisters& regs, u64 cycles,
+                   u64 deadline) {
+  u16 head = regs.pc;
+  if (jump - head > IDLE_LOOP_MAX_BYTES) {
+    return 0;
+  }
+  u64 skipped = 0;
+  bool same_loop = loop.valid && loop.regs.pc == head && loop.jump == jump;
+  if (same_loop && loop.regs.psw == regs.psw && loop.regs.bc == regs.bc && loop.regs.de == regs.de &&
+      loop.regs.hl == regs.hl && loop.regs.sp == regs.sp) {
+    if (!loop.checked) {
+      loop.iteration = pure_loop_cycles(memory, head, jump);
+      loop.checked = true;
+    }
+    if (loop.iteration && cycles - loop.cycles == loop.iteration && cycles < deadline) {
+      skipped = (deadline - cycles) / loop.iteration * loop.iteration;
+    }
+  } else if (!same_loop) {
+    loop.valid = true;
+    loop.checked = false;
+    loop.jump = jump;
+  }
+  loop.cycles = cycles + skipped;
+  loop.regs = regs;
+  return skipped;
+}
 
-    while (cycles < CYCLES_PER_FRAME * 2) {
-      if (!halted) {
-        u8 opcode = fetch_byte();
-        execute_instruction(opcode);
+bool _8080::handle_event(const Event& event) {
+  switch (event.type) {
+    case EVENT_MID_SCREEN:
+      execute_interrupt(HALF_INTERRUPT);
+      return false;
+    case EVENT_VBLANK:
+      execute_interrupt(FULL_INTERRUPT);
+      frames++;
+      schedule_frame(frames);
+      return true;
+  }
+  return false;
+}
+
+void _8080::run_frame() {
+  bool frame_done = false;
+  while (!frame_done) {
+    run_until(scheduler.next_deadline());
+    frame_done = handle_event(scheduler.pop());
+  }
+
+  if (audio) {
+    audio->end_frame();
+  }
+  if (capture) {
+    u8 vram[VRAM_BYTES];
+    memory.read_block(VRAM_START, vram, VRAM_BYTES);
+    capture->submit(vram);
+  }
+  if (game_state) {
+    game_state->update(read_game_state(memory, frames));
+  }
+}
+
+u64 _8080::get_cycles() {
+  return cycles;
+}
+
+u64 _8080::get_frames() {
+  return frames;
+}
+
+u64 _8080::get_halted_cycles() {
+  return halted_cycles;
+}
+
+u64 _8080::get_idle_cycles() {
+  return idle_cycles;
+}
+
+GameState _8080::get_game_state() {
+  return read_game_state(memory, frames);
+}
+
+// 60 frames a second on wall clock time, after a long stall (a debugger, a suspended
+// laptop) it picks up from now instead of running the missed frames in a burst
+// the inputs come from the replayed movie or the keyboard, and are recorded indexed by frame
+// like the replayed ones (the frames before the first one here held nothing)
+void _8080::emulation_loop() {
+  chrono::nanoseconds frame_time(speed > 0 ? (long long) (1e9 / (FRAMES_PER_SECOND * speed)) : 0);
+  chrono::steady_clock::time_point next = chrono::steady_clock::now();
+  while (emulating.load(memory_order_relaxed) && !reached_limit()) {
+    u8 inputs = replay ? replay->get(frames) : input_mask.load(memory_order_relaxed);
+    if (recording) {
+      while (recording->size() < frames) {
+        recording->record(0);
       }
+      recording->record(inputs);
+    }
+    set_inputs(inputs);
+    if (screenshot_requested.exchange(false, memory_order_relaxed)) {
+      take_screenshot();
+    }
+    run_frame();
+    if (video) {
+      fill_video_frame(video->producer_frame());
+      video->publish();
+    }
+    if (speed <= 0) {
+      continue;
     }
-    execute_interrupt(FULL_INTERRUPT);
 
-    render();
+    next += frame_time;
+    chrono::steady_clock::time_point now = chrono::steady_clock::now();
+    if (now > next + frame_time * EMULATION_MAX_LAG_FRAMES) {
+      next = now;
+    }
+    this_thread::sleep_until(next);
+  }
+  emulating.store(false, memory_order_relaxed);
+}
+
+// screenshot_<frame>.png of the frame about to run, written by the capture's writer thread;
+// the capture is only touched on the emulation thread, a run without --capture gets one
+// that only takes screenshots
+void _8080::take_screenshot() {
+  if (!capture) {
+    capture = new FrameCapture();
+  }
+  string png_path = "screenshot_" + to_string(frames) + ".png";
+  capture->screenshot(png_path);
+  log_info("screenshot %s", png_path.c_str());
+}
+
+// the main thread handles SDL events and presents whatever frame is newest, a slow present
+// or text render never holds up the emulated frame
+void _8080::run() {
+
+  SDL_Event event;
+  bool running = true;
+  if (!video) {
+    video = new TripleBuffer();
+  }
+  emulating = true;
+  thread emulation(&_8080::emulation_loop, this);
+
+  // the emulation thread stops itself at the limits
+  while (running && emulating.load(memory_order_relaxed)) {
+    if (video->consume()) {
+      render(*video->consumer_frame());
+    } else {
+      SDL_Delay(1);
+    }
 
     // event handling
-    if ( SDL_PollEvent( &event ) ){
+    while ( SDL_PollEvent( &event ) ){
       switch( event.type ){
         case SDL_QUIT:  
           running = false;
           break;
-        case SDL_WINDOWEVENT: {
-          if(event.window.event != SDL_WINDOWEVENT_CLOSE) {
-            break;
+        case SDL_WINDOWEVENT:
+          // there is only the one window, closing it quits
+          if (event.window.event == SDL_WINDOWEVENT_CLOSE) {
+            running = false;
           }
-          SDL_Window* closed_window = SDL_GetWindowFromID(event.window.windowID);
-          if (closed_window == window) {
-            SDL_DestroyRenderer(renderer);
-            SDL_DestroyWindow(window);
-          }
-          else if (closed_window == screen->window) {
-            SDL_DestroyRenderer(screen->renderer);
-            SDL_DestroyWindow(screen->window);
-          }
-          else if (closed_window == regs->window) {
-            SDL_DestroyRenderer(screen->renderer);
-            SDL_DestroyWindow(regs->window);
-          }
-          open_windows--;
-        }
+          break;
         case SDL_KEYDOWN:
+          // F1 / F2 toggle the disassembly / registers panes, F12 asks for a screenshot
+          if (event.key.keysym.sym == F1) {
+            screen->set_panes(!screen->show_disassembly, screen->show_registers);
+          } else if (event.key.keysym.sym == F2) {
+            screen->set_panes(screen->show_disassembly, !screen->show_registers);
+          } else if (event.key.keysym.sym == F12) {
+            screenshot_requested.store(true, memory_order_relaxed);
+          }
           handle_key_press(event.key.keysym.sym);
           break;
         case SDL_KEYUP:
@@ -228,25 +645,49 @@ void _8080::run() {
           break;
       }
     }
-    SDL_Delay(time_left());
-    next_time += TICK_INTERVAL;
+    input_mask.store(get_input_bits(), memory_order_relaxed);
+  }
+  emulating = false;
+  emulation.join();
+
+  if (run_ahead_frames > 0) {
+    log_info("run-ahead: %d frames, %.1f us per frame", run_ahead, get_run_ahead_cost());
   }
+  if (audio) {
+    log_info("audio underruns: %llu, dropped samples: %llu",
+             (unsigned long long) audio->get_underruns(), (unsigned long long) audio->get_dropped_samples());
+  }
+}
+
+// run() on the calling thread without a window
+void _8080::run_headless() {
+  emulating = true;
+  emulation_loop();
+}
+
+// the atomic store is all a signal handler may do here
+void _8080::stop() {
+  emulating.store(false, memory_order_relaxed);
+}
+
+bool _8080::reached_limit() {
+  return (frame_limit > 0 && frames >= frame_limit) || (cycle_limit > 0 && cycles >= cycle_limit);
 }
 
 
 // use pc to get the next byte in memory
 u8 _8080::fetch_byte() {
-  u8 opcode = memory[regs->pc];
-  regs->pc += 1;
+  u8 opcode = memory[regs.pc];
+  regs.pc += 1;
   return opcode;
 }
 
 // fetch the next 2 bytes in memory
 u16 _8080::fetch_bytes() {
-  u8 start = memory[regs->pc];
-  u8 next = memory[regs->pc + 1];
+  u8 start = memory[regs.pc];
+  u8 next = memory[(u16) (regs.pc + 1)];
   u16 bytes = (next << 8) | start;
-  regs->pc += 2;
+  regs.pc += 2;
   return bytes;
 }
 
@@ -257,57 +698,57 @@ void _8080::execute_instruction(u8 opcode) {
     // NOP / 1 byte / 4 cycles / - - - - - /  nothing instruciton
     case 0x00: {cycles += 4; break; }
     // LXI B, d16 / 3 byte / 10 cycles / - - - - - / load preciding 16 bits into register BC
-    case 0x01: { LXI_register(&(regs->bc)); cycles += 10; break; }
+    case 0x01: { LXI_register(&(regs.bc)); cycles += 10; break; }
     // STAX (store accumulator inderectly) B / 1 byte / 7 cycles / - - - - - /  store value of A reg into memory location pointed to by BC reg_pair
-    case 0x02: { memory[regs->bc] = regs->a; cycles += 7; break; }
+    case 0x02: { memory.write(regs.bc, regs.a); cycles += 7; break; }
     // INX B / 1 byte / 5 cycles / - - - - - / (increment reg pair) / increment BC reg pair by 1
-    case 0x03: { regs->bc++; cycles += 5; break; }
+    case 0x03: { regs.bc++; cycles += 5; break; }
     // INR B / 1 byte / 5 cycles / S Z AC P - /  (incrment reg) / increment B reg by 1
-    case 0x04: { increment_register(&(regs->b), &(regs->f)); cycles += 5; break; }
+    case 0x04: { increment_register(&(regs.b), &(regs.f)); cycles += 5; break; }
     // DCR B / 1 byte / 5 cycles / S Z AC P - / (decrement reg) / decrement B reg by 1
-    case 0x05: { decrement_register(&(regs->b), &(regs->f)); cycles += 5; break; }
+    case 0x05: { decrement_register(&(regs.b), &(regs.f)); cycles += 5; break; }
     // MVI B, d8 (move immediate) / 2 byte / 7 cycle / - - - - - / move d8 value into B reg
-    case 0x06: { regs->b = fetch_byte(); cycles += 7; break; }
+    case 0x06: { regs.b = fetch_byte(); cycles += 7; break; }
     // RLC / 1 byte / 4 cycles / - - - - C / (Rotate left through carry) / shift bits of A by 1 (A << 1) then set LSB (least sig bit) of A to value in carry finally take the MSB (most sig bit) of A and make carry that value
     case 0x07: { 
       int carry = 0;
-      if ((regs->a & 0x80) == 0x80) {
-        regs->set_flag(CARRY_POS);
+      if ((regs.a & 0x80) == 0x80) {
+        regs.set_flag(CARRY_POS);
         carry = 1;
       } else {
-        regs->reset_flag(CARRY_POS);
+        regs.reset_flag(CARRY_POS);
         carry = 0;
       }
-      regs->a = (regs->a << 1) | carry; 
+      regs.a = (regs.a << 1) | carry; 
       cycles += 4; 
       break; 
     }
     // NOP / 1 byte / 4 cycles / nothing
     case 0x08: { cycles += 4; break; }
     // DAD B / 1 byte / 10 cycles / - - - - CA / (double add) / add value in BC reg pair to HL reg pair (modifies the carry flag if there is overflow)
-    case 0x09: { DAD_register(&regs->hl, &regs->bc, &(regs->f)); cycles += 10; break; }
+    case 0x09: { DAD_register(&regs.hl, &regs.bc, &(regs.f)); cycles += 10; break; }
     // LDAX B / 1 byte / 7 cycles / (load accumulator from mem) / load memory address pointed to by BC (memory[BC]) into A reg 
-    case 0x0A: { regs->a = memory[regs->bc]; cycles += 7; break; }
+    case 0x0A: { regs.a = memory[regs.bc]; cycles += 7; break; }
     // DCX B / 1 byte / 5 cyles / - - - - - / decrement BC
-    case 0x0B: { regs->bc--; cycles += 5; break; }
+    case 0x0B: { regs.bc--; cycles += 5; break; }
     // INC C / 1 byte / 5 cycles / S Z A P - / incremtent c by 1 
-    case 0x0C: { increment_register(&(regs->c), &(regs->f)); cycles += 5; break; }
+    case 0x0C: { increment_register(&(regs.c), &(regs.f)); cycles += 5; break; }
     // DCR C / 1 byte / 5 cycles / S Z AC P - / decrement c by 1
-    case 0x0D: { decrement_register(&(regs->c), &(regs->f)); cycles += 5; break; }
+    case 0x0D: { decrement_register(&(regs.c), &(regs.f)); cycles += 5; break; }
     // MVI, C, d8 / 2 bytes / 7 cycles / - - - - - / move next byte into C reg
-    case 0x0E: { regs->c = fetch_byte(); cycles += 7; break; }
+    case 0x0E: { regs.c = fetch_byte(); cycles += 7; break; }
     // RRC / 1 byte / 4 cycles / - - - - CA / rotate accumulator right
     case 0x0F: {
       // Get the lowest bit (LSB) of the accumulator to determine the carry
-      int low_bit = (regs->a & 0x01);
+      int low_bit = (regs.a & 0x01);
       // Set the carry flag based on the LSB of A
       if (low_bit == 1) {
-          regs->set_flag(CARRY_POS);
+          regs.set_flag(CARRY_POS);
       } else {
-          regs->reset_flag(CARRY_POS);
+          regs.reset_flag(CARRY_POS);
       }
-      regs->a = (regs->a >> 1);
-      regs->a |= (low_bit << 7);
+      regs.a = (regs.a >> 1);
+      regs.a |= (low_bit << 7);
       cycles += 4;
       break;
     }
@@ -317,133 +758,137 @@ void _8080::execute_instruction(u8 opcode) {
     // NOP / 1 byte / 4 cycles / - - - - - /  nothing instruciton
     case 0x10: {cycles += 4; break;}
     // LXI D, d16 / 3 bytes / 10 cycles / - - - - - / load the next 2 bytes in memory into reg-pair DE
-    case 0x11: { LXI_register(&(regs->de)); cycles += 10; break;}
+    case 0x11: { LXI_register(&(regs.de)); cycles += 10; break;}
     // STAX D / 1 byte / 7 cycles / - - - - - / contents of A are stroed in memory reference by the location in DE reg-pair
-    case 0x12: {memory[regs->de] = regs->a; cycles += 7; break; }
+    case 0x12: {memory.write(regs.de, regs.a); cycles += 7; break; }
     // INX D / 1 byte / 5 cycles / - - - - - / DE ++
-    case 0x13: {regs->de++; cycles += 5; break;}
+    case 0x13: {regs.de++; cycles += 5; break;}
     // INR D / 1 byte / 5 cycles / S Z AC P - /  (incrment reg) / increment D reg by 1
-    case 0x14: {increment_register(&(regs->d), &(regs->f)); cycles += 5; break;};
+    case 0x14: {increment_register(&(regs.d), &(regs.f)); cycles += 5; break;};
     // DCR D / 1 byte / 5 cycles / S Z AC P - / (decrement reg) / decrement D reg by 1
-    case 0x15: { decrement_register(&(regs->d), &(regs->f)); cycles += 5; break; };
+    case 0x15: { decrement_register(&(regs.d), &(regs.f)); cycles += 5; break; };
     // MVI D, d8 (move immediate) / 2 byte / 7 cycle / - - - - - / move d8 value into D reg
-    case 0x16: { regs->d = fetch_byte(); cycles += 7; break; }
+    case 0x16: { regs.d = fetch_byte(); cycles += 7; break; }
     // RAL / 1 byte / 4 cycles / - - - - C / A is rotated << 1 and the high bit replaces the carry bit while carry replaces the high bit
     case 0x17: { 
-      int cur_carry = regs->get_flag(CARRY_POS);
-      int val = (regs->a & 0x80) >> 7; 
+      int cur_carry = regs.get_flag(CARRY_POS);
+      int val = (regs.a & 0x80) >> 7; 
       if (val) {
-        regs->set_flag(CARRY_POS);
+        regs.set_flag(CARRY_POS);
       }  else {
-        regs->reset_flag(CARRY_POS);
+        regs.reset_flag(CARRY_POS);
       }
-      regs->a = (regs->a << 1) | cur_carry; 
+      regs.a = (regs.a << 1) | cur_carry; 
       cycles += 4; 
       break; 
     }
     // NOP / 1 byte / 4 cycles / nothing
     case 0x18: { cycles += 4; break; }
     // DAD D / 1 byte / 10 cycles / - - - - CA / (double add) / add value in DE reg pair to HL reg pair (modifies the carry flag if there is overflow)
-    case 0x19: { DAD_register(&(regs->hl), &(regs->de), &(regs->f)); cycles += 10; break; }
+    case 0x19: { DAD_register(&(regs.hl), &(regs.de), &(regs.f)); cycles += 10; break; }
     // LDAX D / 1 byte / 7 cycles / (load accumulator from mem) / load memory address pointed to by DE (memory[DE]) into A reg 
-    case 0x1A: { regs->a = memory[regs->de]; cycles += 7; break; }
+    case 0x1A: { regs.a = memory[regs.de]; cycles += 7; break; }
     // DCX D / 1 byte / 5 cyles / - - - - - / decrement DE
-    case 0x1B: { regs->de--; cycles += 5; break; }
+    case 0x1B: { regs.de--; cycles += 5; break; }
     // INC E / 1 byte / 5 cycles / S Z A P - / incremtent e by 1 
-    case 0x1C: { increment_register(&(regs->e), &(regs->f)); cycles += 5; break; }
+    case 0x1C: { increment_register(&(regs.e), &(regs.f)); cycles += 5; break; }
     // DCR E / 1 byte / 5 cycles / S Z AC P - / decrement e by 1
-    case 0x1D: { decrement_register(&(regs->e), &(regs->f)); cycles += 5; break; }
+    case 0x1D: { decrement_register(&(regs.e), &(regs.f)); cycles += 5; break; }
     // MVI, E, d8 / 2 bytes / 7 cycles / - - - - - / move next byte into E reg
-    case 0x1E: { regs->e = fetch_byte(); cycles += 7; break; }
+    case 0x1E: { regs.e = fetch_byte(); cycles += 7; break; }
     // RAR / 1 byte / 4 cycles / - - - - CA / rotate accumulator right
     case 0x1F: {
-      int prev_carry = regs->get_flag(CARRY_POS);
-      int val = (regs->a & 0x01);
+      int prev_carry = regs.get_flag(CARRY_POS);
+      int val = (regs.a & 0x01);
       if (val) {
-        regs->set_flag(CARRY_POS);
+        regs.set_flag(CARRY_POS);
       } else {
-        regs->reset_flag(CARRY_POS);
+        regs.reset_flag(CARRY_POS);
       }
-      regs->a = (regs->a >> 1) | (prev_carry << 7);
+      regs.a = (regs.a >> 1) | (prev_carry << 7);
       cycles += 4;
       break;
     }
 
-    case 0x21: { LXI_register(&(regs->hl)); cycles += 10; break; }
+
+    // 20 - 2F ////////////////////////////////////////////////////
+    // NOP / 1 byte / 4 cycles / - - - - - /  nothing instruction
+    case 0x20: { cycles += 4; break; }
+    case 0x21: { LXI_register(&(regs.hl)); cycles += 10; break; }
     // SHLD a16 / 3 bytes / 16 cycles / - - - - - /  memory location referenced by next 2 bytes is set to L and the next memory location after is set to H
-    case 0x22: { u16 address = fetch_bytes(); memory[address] = regs->l; memory[address + 1] = regs->h; cycles += 16; break; }
+    case 0x22: { u16 address = fetch_bytes(); memory.write(address, regs.l); memory.write(address + 1, regs.h); cycles += 16; break; }
     // INX H / 1 byte / 5 cycles / - - - - - / HL ++
-    case 0x23: { regs->hl++; cycles += 5; break; }
+    case 0x23: { regs.hl++; cycles += 5; break; }
     // INR H / 1 byte / 5 cycles / S Z AC P - /  (incrment reg) / increment H reg by 1
-    case 0x24: {increment_register(&(regs->h), &(regs->f)); cycles += 5; break;};
+    case 0x24: {increment_register(&(regs.h), &(regs.f)); cycles += 5; break;};
     // DCR H / 1 byte / 5 cycles / S Z AC P - / (decrement reg) / decrement H reg by 1
-    case 0x25: { decrement_register(&(regs->h), &(regs->f)); cycles += 5; break; }
+    case 0x25: { decrement_register(&(regs.h), &(regs.f)); cycles += 5; break; }
     // MVI H, d8 (move immediate) / 2 byte / 7 cycle / - - - - - / move d8 value into H reg
-    case 0x26: { regs->h = fetch_byte(); cycles += 7; break; }
+    case 0x26: { regs.h = fetch_byte(); cycles += 7; break; }
     // DAA / 1 byte / 4 cycle / S Z AC P CA / (decimal adjust accumulator) 
     case 0x27: {
-        u8 old_a = regs->a;
+        u8 old_a = regs.a;
         u8 correction = 0;
         bool set_ac = 0;
         bool set_cy = 0;
 
         // Lower nibble adjustment
-        if ((old_a & 0x0F) > 9 || regs->get_flag(AUX_POS)) {
+        if ((old_a & 0x0F) > 9 || regs.get_flag(AUX_POS)) {
             correction += 0x06;
             set_ac = true;
         }
 
         // Upper nibble adjustment
-        if (old_a > 0x99 || regs->get_flag(CARRY_POS)) {
+        if (old_a > 0x99 || regs.get_flag(CARRY_POS)) {
             correction += 0x60;
             set_cy = true;
         }
 
         // Perform correction
-        u16 result = (u16)regs->a + correction;
-        regs->a = result & 0xFF;
+        u16 result = (u16)regs.a + correction;
+        regs.a = result & 0xFF;
 
         // Set flags
         if (set_ac) {
-          regs->set_flag(AUX_POS);
+          regs.set_flag(AUX_POS);
         } else {
-          regs->reset_flag(AUX_POS);
+          regs.reset_flag(AUX_POS);
         }
         if (set_cy) {
-          regs->set_flag(CARRY_POS);
+          regs.set_flag(CARRY_POS);
         } else {
-          regs->reset_flag(CARRY_POS);
+          regs.reset_flag(CARRY_POS);
         }
 
-        check_set_zero_flag(regs->a);
-        check_set_sign_flag(regs->a);
-        check_set_parity_flag(regs->a);
+        check_set_zero_flag(regs.a);
+        check_set_sign_flag(regs.a);
+        check_set_parity_flag(regs.a);
         cycles += 4;
         break;
     }
     // NOP / 1 byte / 4 cycles / nothing
     case 0x28: { cycles += 4; break; }
     // DAD H / 1 byte / 10 cycles / - - - - CA / (double add) / add value in HL reg pair to HL reg pair (modifies the carry flag if there is overflow)
-    case 0x29: { DAD_register(&(regs->hl), &(regs->hl), &(regs->f)); cycles += 10; break; }
+    case 0x29: { DAD_register(&(regs.hl), &(regs.hl), &(regs.f)); cycles += 10; break; }
     // LHLD a16, / 3 byte / 16 cycles / takes 16 bit address and loads content of memory into HL
     case 0x2A: {
       u16 address = fetch_bytes();
-      regs->l = memory[address];
-      regs->h = memory[address + 1];
+      regs.l = memory[address];
+      regs.h = memory[(u16) (address + 1)];
       cycles += 16;
       break;
     }
     // DCX H / 1 byte / 5 cyles / - - - - - / decrement HL
-    case 0x2B: { regs->hl--; cycles += 5; break; }
+    case 0x2B: { regs.hl--; cycles += 5; break; }
     // INC L / 1 byte / 5 cycles / S Z A P - / incremtent L by 1 
-    case 0x2C: { increment_register(&(regs->l), &(regs->f)); cycles += 5; break; }
+    case 0x2C: { increment_register(&(regs.l), &(regs.f)); cycles += 5; break; }
     // DCR L / 1 byte / 5 cycles / S Z AC P - / decrement l by 1
-    case 0x2D: { decrement_register(&(regs->l), &(regs->f)); cycles += 5; break; }
+    case 0x2D: { decrement_register(&(regs.l), &(regs.f)); cycles += 5; break; }
     // MVI, L, d8 / 2 bytes / 7 cycles / - - - - - / move next byte into l reg
-    case 0x2E: { regs->l = fetch_byte(); cycles += 7; break; }
+    case 0x2E: { regs.l = fetch_byte(); cycles += 7; break; }
     // CMA / 1 byte / 4 cycles / - - - - - / complement accumulator
     case 0x2F:
-      regs->a = ~regs->a;
+      regs.a = ~regs.a;
       cycles += 4;
       break;
 
@@ -451,40 +896,40 @@ void _8080::execute_instruction(u8 opcode) {
     // NOP / 1 byte / 4 cycles / - - - - - /  nothing instruciton
     case 0x30:{cycles += 4; break; }
     // LXI SP, d16 / 3 bytes / 10 cycles / - - - - - / SP = (next 2 bytes)
-    case 0x31: { LXI_register(&(regs->sp)); cycles += 10;break;}
+    case 0x31: { LXI_register(&(regs.sp)); cycles += 10;break;}
     // STA, a16 / 3 bytes / 13 cycles / - - - - - / memory location referenced by next 2 bytes is set to the A reg
-    case 0x32: { u16 address = fetch_bytes(); memory[address] = regs->a; cycles += 13; break; }
+    case 0x32: { u16 address = fetch_bytes(); memory.write(address, regs.a); cycles += 13; break; }
     // INX SP / 1 byte / 5 cycles / - - - - - / SP ++
-    case 0x33: { regs->sp++; cycles += 5; break; }
+    case 0x33: { regs.sp++; cycles += 5; break; }
     // INR M / 1 byte / 10 cycles / S Z AC P - / increment value stored in memory loaction referenced by HL reg_pair
-    case 0x34: {increment_register(&(memory[regs->hl]), &(regs->f)); cycles += 10; break;}
+    case 0x34: { u8 value = memory[regs.hl]; increment_register(&value, &(regs.f)); memory.write(regs.hl, value); cycles += 10; break; }
     // DCR M / 1 byte / 10 cycles / S Z AC P - / decrement value stored in memory loaction referenced by HL reg_pair
-    case 0x35: { decrement_register(&(memory[regs->hl]), &(regs->f)); cycles += 10; break; }
+    case 0x35: { u8 value = memory[regs.hl]; decrement_register(&value, &(regs.f)); memory.write(regs.hl, value); cycles += 10; break; }
     // MVI M, d8 (move immediate) / 2 byte / 10 cycle / - - - - - / move d8 value into memory with reference in HL
-    case 0x36: { memory[regs->hl] = fetch_byte(); cycles += 10; break; }
+    case 0x36: { memory.write(regs.hl, fetch_byte()); cycles += 10; break; }
     // STC / 1 byte / 4 cycle / - - - - CA / carry bit set to 1
-    case 0x37: { regs->set_flag(CARRY_POS); cycles += 4; break; }
+    case 0x37: { regs.set_flag(CARRY_POS); cycles += 4; break; }
     // NOP / 1 byte / 4 cycles / nothing
     case 0x38: { cycles += 4; break; }
     // DAD SP / 1 byte / 10 cycles / - - - - CA / (double add) / add value in SP reg pair to HL reg pair (modifies the carry flag if there is overflow)
-    case 0x39: { DAD_register(&(regs->hl), &(regs->sp), &(regs->f)); cycles += 10; break; }
+    case 0x39: { DAD_register(&(regs.hl), &(regs.sp), &(regs.f)); cycles += 10; break; }
     // LDA a16 / 3 bytes / 13 cycles / - - - - - / load the byte in memory loaction refered to by next 2 bytes into a reg
-    case 0x3A: { regs->a = memory[fetch_bytes()]; cycles += 13; break; }
+    case 0x3A: { regs.a = memory[fetch_bytes()]; cycles += 13; break; }
     // DCX SP / 1 byte / 5 cyles / - - - - - / decrement SP
-    case 0x3B: { regs->sp--; cycles += 5; break; }
+    case 0x3B: { regs.sp--; cycles += 5; break; }
     // INC A / 1 byte / 5 cycles / S Z A P - / incremtent A by 1 
-    case 0x3C: { increment_register(&(regs->a), &(regs->f)); cycles += 5; break; }
+    case 0x3C: { increment_register(&(regs.a), &(regs.f)); cycles += 5; break; }
     // DCR A / 1 byte / 5 cycles / S Z AC P - / decrement a by 1
-    case 0x3D: { decrement_register(&(regs->a), &(regs->f)); cycles += 5; break; }
+    case 0x3D: { decrement_register(&(regs.a), &(regs.f)); cycles += 5; break; }
     // MVI A, d8 / 2 bytes / 7 cycles / - - - - - / move next byte into a reg
-    case 0x3E: { regs->a = fetch_byte(); cycles += 7; break; }
+    case 0x3E: { regs.a = fetch_byte(); cycles += 7; break; }
     // CMC / 1 byte / 4 cycles / - - - - CA / flips the cary bit
     case 0x3F: { 
-      int carry = regs->get_flag(CARRY_POS);
+      int carry = regs.get_flag(CARRY_POS);
       if (carry > 0) {
-        regs->reset_flag(CARRY_POS);
+        regs.reset_flag(CARRY_POS);
       } else {
-        regs->set_flag(CARRY_POS);
+        regs.set_flag(CARRY_POS);
       }
       cycles += 4;
       break; 
@@ -495,119 +940,119 @@ void _8080::execute_instruction(u8 opcode) {
     // MOV B,B / 1 byte / 5 cycles / - - - - - / moves B reg into B
     case 0x40: {cycles += 5; break; }
     // MOV B, C / 1 byte / 5 cycles / - - - - - / moves C reg val int B
-    case 0x41: { regs->b = regs->c; cycles += 5; break; }
+    case 0x41: { regs.b = regs.c; cycles += 5; break; }
     // MOV B, D / 1 byte / 5 cycles / - - - - - / moves D reg val int B
-    case 0x42: { regs->b = regs->d; cycles += 5; break; }
+    case 0x42: { regs.b = regs.d; cycles += 5; break; }
     // MOV B, E / 1 byte / 5 cycles / - - - - - / moves E reg val int B
-    case 0x43: { regs->b = regs->e; cycles += 5; break; }
+    case 0x43: { regs.b = regs.e; cycles += 5; break; }
     // MOV B, H / 1 byte / 5 cycles / - - - - - / moves H reg val int B
-    case 0x44: { regs->b = regs->h; cycles += 5; break; }
+    case 0x44: { regs.b = regs.h; cycles += 5; break; }
     // MOV B, L / 1 byte / 5 cycles / - - - - - / moves L reg val int B
-    case 0x45: { regs->b = regs->l; cycles += 5; break; }
+    case 0x45: { regs.b = regs.l; cycles += 5; break; }
     // MOV B, M / 1 byte / 7 cycles / - - - - - / moves value form mem locatioin pointed to by HL into B
-    case 0x46: { mov_m(&regs->b,false); cycles += 7; break; }
+    case 0x46: { mov_m(&regs.b,false); cycles += 7; break; }
     // MOV B, A / 1 byte / 5 cycles / - - - - - / moves A reg val into B
-    case 0x47: { regs->b = regs->a; cycles += 5; break; }
+    case 0x47: { regs.b = regs.a; cycles += 5; break; }
     // MOV C, B / 1 byte / 5 cycles / - - - - - / moves B reg val into C
-    case 0x48: { regs->c = regs->b; cycles += 5; break; }
+    case 0x48: { regs.c = regs.b; cycles += 5; break; }
     // MOV C, C / 1 byte / 5 cycles / - - - - - / moves C reg val into C
     case 0x49: { cycles += 5; break; }
     // MOV C, D / 1 byte / 5 cycles / - - - - - / moves D reg val into C
-    case 0x4A: { regs->c = regs->d; cycles += 5; break; }
+    case 0x4A: { regs.c = regs.d; cycles += 5; break; }
     // MOV C, E / 1 byte / 5 cycles / - - - - - / moves E reg val into C
-    case 0x4B: { regs->c = regs->e; cycles += 5; break; }
+    case 0x4B: { regs.c = regs.e; cycles += 5; break; }
     // MOV C, H / 1 byte / 5 cycles / - - - - - / moves H reg val into C
-    case 0x4C: { regs->c = regs->h; cycles += 5; break; }
+    case 0x4C: { regs.c = regs.h; cycles += 5; break; }
     // MOV C, L / 1 byte / 5 cycles / - - - - - / moves L reg val into C
-    case 0x4D: { regs->c = regs->l; cycles += 5; break; }
+    case 0x4D: { regs.c = regs.l; cycles += 5; break; }
     // MOV C, M / 1 byte / 7 cycles / - - - - - / moves value in memory location pointed to by HL reg val into C
-    case 0x4E: { mov_m(&regs->c,false); cycles += 7; break; }
+    case 0x4E: { mov_m(&regs.c,false); cycles += 7; break; }
     // MOV C, A / 1 byte / 5 cycles / - - - - - / moves A reg val into C
-    case 0x4F: { regs->c = regs->a; cycles += 5; break; }
+    case 0x4F: { regs.c = regs.a; cycles += 5; break; }
 
 
     // 50 - 5F ////////////////////////////////////////////////////
     // MOV D,B / 1 byte / 5 cycles /  moves B into D
-    case 0x50: { regs->d = regs->b; cycles += 5; break; }
+    case 0x50: { regs.d = regs.b; cycles += 5; break; }
     // MOV D, C /  1 byte / 5 cycles / moves C into D
-    case 0x51: { regs->d = regs->c; cycles += 5; break; }
+    case 0x51: { regs.d = regs.c; cycles += 5; break; }
     // MOV D, D /  1 byte / 5 cycles / moves D into D
-    case 0x52: { regs->d = regs->d; cycles += 5; break; }
+    case 0x52: { regs.d = regs.d; cycles += 5; break; }
     // MOV D, E /  1 byte / 5 cycles / moves E into D
-    case 0x53: { regs->d = regs->e; cycles += 5; break; }
+    case 0x53: { regs.d = regs.e; cycles += 5; break; }
     // MOV D, H /  1 byte / 5 cycles / moves H into D
-    case 0x54: { regs->d = regs->h; cycles += 5; break; }
+    case 0x54: { regs.d = regs.h; cycles += 5; break; }
     // MOV D, L /  1 byte / 5 cycles / moves L into D
-    case 0x55: { regs->d = regs->l; cycles += 5; break; }
+    case 0x55: { regs.d = regs.l; cycles += 5; break; }
     // MOV D, M /  1 byte / 7 cycles / moves contents in memory location spcified by HL into D reg
-    case 0x56: { mov_m(&regs->d,false);; cycles += 7; break; }
+    case 0x56: { mov_m(&regs.d,false);; cycles += 7; break; }
     // MOV D, A /  1 byte / 5 cycles / moves A into D
-    case 0x57: { regs->d = regs->a; cycles += 5; break; }
+    case 0x57: { regs.d = regs.a; cycles += 5; break; }
     // MOV E, B / 1 byte / 5 cycles / moves B into E
-    case 0x58: { regs->e = regs->b; cycles += 5; break; }
+    case 0x58: { regs.e = regs.b; cycles += 5; break; }
     // MOV E, C / 1 byte / 5 cycles / moves C into E
-    case 0x59: { regs->e = regs->c; cycles += 5; break; }
+    case 0x59: { regs.e = regs.c; cycles += 5; break; }
     // MOV E, D / 1 byte / 5 cycles / moves D into E
-    case 0x5A: { regs->e = regs->d; cycles += 5; break; }
+    case 0x5A: { regs.e = regs.d; cycles += 5; break; }
     // MOV E, E / 1 byte / 5 cycles / moves E into E
-    case 0x5B: { regs->e = regs->e; cycles += 5; break; }
+    case 0x5B: { regs.e = regs.e; cycles += 5; break; }
     // MOV E, H / 1 byte / 5 cycles / moves H into E
-    case 0x5C: { regs->e = regs->h; cycles += 5; break; }
+    case 0x5C: { regs.e = regs.h; cycles += 5; break; }
     // MOV E, L / 1 byte / 5 cycles / moves L into E
-    case 0x5D: { regs->e = regs->l; cycles += 5; break; }
+    case 0x5D: { regs.e = regs.l; cycles += 5; break; }
     // MOV E, M / 1 byte / 7 cycles / moves contents in memory location refered to by HL into E
-    case 0x5E: { mov_m(&regs->e,false); cycles += 7; break; }
+    case 0x5E: { mov_m(&regs.e,false); cycles += 7; break; }
     // MOV E, A / 1 byte / 5 cycles / moves the contents of A into E
-    case 0x5F: { regs->e = regs->a; cycles += 5; break; }
+    case 0x5F: { regs.e = regs.a; cycles += 5; break; }
 
     // 60 - 6F ////////////////////////////////////////////////////
     // MOV H,B / 1 byte / 5 cycles / moves B into H
-    case 0x60: { regs->h = regs->b; cycles += 5; break; }
+    case 0x60: { regs.h = regs.b; cycles += 5; break; }
     // MOV H,C / 1 byte / 5 cycles / moves C into H
-    case 0x61: { regs->h = regs->c; cycles += 5; break; }
+    case 0x61: { regs.h = regs.c; cycles += 5; break; }
     // MOV H,D / 1 byte / 5 cycles / moves D into H
-    case 0x62: { regs->h = regs->d; cycles += 5; break; }
+    case 0x62: { regs.h = regs.d; cycles += 5; break; }
     // MOV H,E / 1 byte / 5 cycles / moves E into H
-    case 0x63: { regs->h = regs->e; cycles += 5; break; }
+    case 0x63: { regs.h = regs.e; cycles += 5; break; }
     // MOV H,H / 1 byte / 5 cycles / moves H into H
-    case 0x64: { regs->h = regs->h; cycles += 5; break; }
+    case 0x64: { regs.h = regs.h; cycles += 5; break; }
     // MOV H,L / 1 byte / 5 cycles / moves L into H
-    case 0x65: { regs->h = regs->l; cycles += 5; break; }
+    case 0x65: { regs.h = regs.l; cycles += 5; break; }
     // MOV H,M / 1 byte / 7 cycles / moves the value in memory reference by the value in reg HL and sets it to H
-    case 0x66: { mov_m(&regs->h,false); cycles += 7; break; }
+    case 0x66: { mov_m(&regs.h,false); cycles += 7; break; }
     // MOV H,A / 1 byte / 5 cycles / moves A into H
-    case 0x67: { regs->h = regs->a; cycles += 5; break; }
+    case 0x67: { regs.h = regs.a; cycles += 5; break; }
     // MOV L,B / 1 byte / 5 cycles / moves B into L
-    case 0x68: { regs->l = regs->b; cycles += 5; break; }
+    case 0x68: { regs.l = regs.b; cycles += 5; break; }
     // MOV L,C / 1 byte / 5 cycles / moves C into L
-    case 0x69: { regs->l = regs->c; cycles += 5; break; }
+    case 0x69: { regs.l = regs.c; cycles += 5; break; }
     // MOV L,D / 1 byte / 5 cycles / moves D into L
-    case 0x6A: { regs->l = regs->d; cycles += 5; break; }
+    case 0x6A: { regs.l = regs.d; cycles += 5; break; }
     // MOV L,E / 1 byte / 5 cycles / moves E into L
-    case 0x6B: { regs->l = regs->e; cycles += 5; break; }
+    case 0x6B: { regs.l = regs.e; cycles += 5; break; }
     // MOV L,H / 1 byte / 5 cycles / moves H into L
-    case 0x6C: { regs->l = regs->h; cycles += 5; break; }
+    case 0x6C: { regs.l = regs.h; cycles += 5; break; }
     // MOV L,L / 1 byte / 5 cycles / moves L into L
-    case 0x6D: { regs->l = regs->l; cycles += 5; break; }
+    case 0x6D: { regs.l = regs.l; cycles += 5; break; }
     // MOV L,M / 1 byte / 7 cylces / moves the value in memory referenced by HL into the L reg
-    case 0x6E: { mov_m(&regs->l,false); cycles += 7; break; }
+    case 0x6E: { mov_m(&regs.l,false); cycles += 7; break; }
     // MOV L,A / 1 byte / 5 cycles / moves A into L
-    case 0x6F: { regs->l = regs->a; cycles += 5; break; }
+    case 0x6F: { regs.l = regs.a; cycles += 5; break; }
 
 
     // 70 - 7F /////////////////////////////////////////////////////
     // MOV M,B / 1 byte / 7 cycles /  moves contents in B into memory location reference by HL
-    case 0x70: { mov_m(&regs->b, true); cycles += 7; break; }
+    case 0x70: { mov_m(&regs.b, true); cycles += 7; break; }
     // MOV M,C / 1 byte / 7 cycles /  moves contents in C into memory location reference by HL
-    case 0x71: { mov_m(&regs->c, true); cycles += 7; break; }
+    case 0x71: { mov_m(&regs.c, true); cycles += 7; break; }
     // MOV M,D / 1 byte / 7 cycles /  moves contents in D into memory location reference by HL
-    case 0x72: { mov_m(&regs->d, true); cycles += 7; break; }
+    case 0x72: { mov_m(&regs.d, true); cycles += 7; break; }
     // MOV M,E / 1 byte / 7 cycles /  moves contents in E into memory location reference by HL
-    case 0x73: { mov_m(&regs->e, true); cycles += 7; break; }
+    case 0x73: { mov_m(&regs.e, true); cycles += 7; break; }
     // MOV M,H / 1 byte / 7 cycles /  moves contents in H into memory location reference by HL
-    case 0x74: { mov_m(&regs->h, true); cycles += 7; break; }
+    case 0x74: { mov_m(&regs.h, true); cycles += 7; break; }
     // MOV M,L / 1 byte / 7 cycles /  moves contents in L into memory location reference by HL
-    case 0x75: { mov_m(&regs->l,true); cycles += 7; break; }
+    case 0x75: { mov_m(&regs.l,true); cycles += 7; break; }
     // HLT / 1 byte / 7 cycles / halts until an interupt occurs
     case 0x76: {
       halted = true;  
@@ -615,119 +1060,119 @@ void _8080::execute_instruction(u8 opcode) {
       break;
     }
     // MOV M,A / 1 byte / 7 cycles /  moves contents in A into memory location reference by HL
-    case 0x77: { mov_m(&regs->a, true); cycles += 7; break; }
+    case 0x77: { mov_m(&regs.a, true); cycles += 7; break; }
     // MOV A,B / 1 byte / 5 cycles / moves B contents into A
-    case 0x78: { regs->a = regs->b; cycles += 5; break; }
+    case 0x78: { regs.a = regs.b; cycles += 5; break; }
     // MOV A,C / 1 byte / 5 cycles / moves C contents into A
-    case 0x79: { regs->a = regs->c; cycles += 5; break; }
+    case 0x79: { regs.a = regs.c; cycles += 5; break; }
     // MOV A,D / 1 byte / 5 cycles / moves D contents into A
-    case 0x7A: { regs->a = regs->d; cycles += 5; break; }
+    case 0x7A: { regs.a = regs.d; cycles += 5; break; }
     // MOV A,E / 1 byte / 5 cycles / moves E contents into A
-    case 0x7B: { regs->a = regs->e; cycles += 5; break; }
+    case 0x7B: { regs.a = regs.e; cycles += 5; break; }
     // MOV A,H / 1 byte / 5 cylcles / moves contents of H into A
-    case 0x7C: { regs->a = regs->h; cycles += 5; break; }
+    case 0x7C: { regs.a = regs.h; cycles += 5; break; }
     // MOV A,L / 1 byte / 5 cyles / moves contents of L into A
-    case 0x7D: { regs->a = regs->l; cycles += 5; break; }
+    case 0x7D: { regs.a = regs.l; cycles += 5; break; }
     // MOV A,M / 1 byte / 7 cyles / moves contents memory[HL] into A
     case 0x7E: { // MOV A, M or LD A, (HL)
-      mov_m(&regs->a, false);
+      mov_m(&regs.a, false);
       cycles += 7;
       break;
     }
     // MOV A,A / 1 byte / 5 cyles / moves contents of A into A
-    case 0x7F: { regs->a = regs->a; cycles += 5; break; }
+    case 0x7F: { regs.a = regs.a; cycles += 5; break; }
 
 
     // 80 - 8F ///////////////////////////////////////////////////////
     // ADD B / 1 byte / 4  cycles/ S Z AC P CA / adds contents of B into A
-    case 0x80: { add_register(&(regs->a), regs->b, &(regs->f)); cycles += 4; break; }
-    case 0x81: { add_register(&(regs->a), regs->c, &(regs->f)); cycles += 4; break; }
-    case 0x82: { add_register(&(regs->a), regs->d, &(regs->f)); cycles += 4; break; }
-    case 0x83: { add_register(&(regs->a), regs->e, &(regs->f)); cycles += 4; break; }
-    case 0x84: { add_register(&(regs->a), regs->h, &(regs->f)); cycles += 4; break; }
-    case 0x85: { add_register(&(regs->a), regs->l, &(regs->f)); cycles += 4; break; }
-    case 0x86: { add_register(&(regs->a), memory[regs->hl], &(regs->f)); cycles += 7; break; }
-    case 0x87: { add_register(&(regs->a), regs->a, &(regs->f)); cycles += 4; break; }
+    case 0x80: { add_register(&(regs.a), regs.b, &(regs.f)); cycles += 4; break; }
+    case 0x81: { add_register(&(regs.a), regs.c, &(regs.f)); cycles += 4; break; }
+    case 0x82: { add_register(&(regs.a), regs.d, &(regs.f)); cycles += 4; break; }
+    case 0x83: { add_register(&(regs.a), regs.e, &(regs.f)); cycles += 4; break; }
+    case 0x84: { add_register(&(regs.a), regs.h, &(regs.f)); cycles += 4; break; }
+    case 0x85: { add_register(&(regs.a), regs.l, &(regs.f)); cycles += 4; break; }
+    case 0x86: { add_register(&(regs.a), memory[regs.hl], &(regs.f)); cycles += 7; break; }
+    case 0x87: { add_register(&(regs.a), regs.a, &(regs.f)); cycles += 4; break; }
 
     // ADC B / 1 byte / 4 cycles / S Z AC P CA / B and carry are added and stored in A
-    case 0x88: { add_register(&(regs->a), (regs->b + regs->get_flag(CARRY_POS)), &(regs->f)); cycles += 4; break; }
-    case 0x89: { add_register(&(regs->a), (regs->c + regs->get_flag(CARRY_POS)), &(regs->f)); cycles += 4; break; }
-    case 0x8A: { add_register(&(regs->a), (regs->d + regs->get_flag(CARRY_POS)), &(regs->f)); cycles += 4; break; }
-    case 0x8B: { add_register(&(regs->a), (regs->e + regs->get_flag(CARRY_POS)), &(regs->f)); cycles += 4; break; }
-    case 0x8C: { add_register(&(regs->a), (regs->h + regs->get_flag(CARRY_POS)), &(regs->f)); cycles += 4; break; }
-    case 0x8D: { add_register(&(regs->a), (regs->l + regs->get_flag(CARRY_POS)), &(regs->f)); cycles += 4; break; }
-    case 0x8E: { add_register(&(regs->a), (memory[regs->hl] + regs->get_flag(CARRY_POS)), &(regs->f)); cycles += 7; break; }
-    case 0x8F: { add_register(&(regs->a), (regs->a + regs->get_flag(CARRY_POS)), &(regs->f)); cycles += 4; break; }
+    case 0x88: { add_register(&(regs.a), (regs.b + regs.get_flag(CARRY_POS)), &(regs.f)); cycles += 4; break; }
+    case 0x89: { add_register(&(regs.a), (regs.c + regs.get_flag(CARRY_POS)), &(regs.f)); cycles += 4; break; }
+    case 0x8A: { add_register(&(regs.a), (regs.d + regs.get_flag(CARRY_POS)), &(regs.f)); cycles += 4; break; }
+    case 0x8B: { add_register(&(regs.a), (regs.e + regs.get_flag(CARRY_POS)), &(regs.f)); cycles += 4; break; }
+    case 0x8C: { add_register(&(regs.a), (regs.h + regs.get_flag(CARRY_POS)), &(regs.f)); cycles += 4; break; }
+    case 0x8D: { add_register(&(regs.a), (regs.l + regs.get_flag(CARRY_POS)), &(regs.f)); cycles += 4; break; }
+    case 0x8E: { add_register(&(regs.a), (memory[regs.hl] + regs.get_flag(CARRY_POS)), &(regs.f)); cycles += 7; break; }
+    case 0x8F: { add_register(&(regs.a), (regs.a + regs.get_flag(CARRY_POS)), &(regs.f)); cycles += 4; break; }
 
 
     // 90 - 9F ////////////////////////////////////////////////////////
     // SUB B / 1 byte / 4 cycles / S Z AC P CA / subtracts the contents of B from A and store in A
-    case 0x90: { subtract_register(&(regs->a), regs->b, &(regs->f)); cycles +=4; break; }
-    case 0x91: { subtract_register(&(regs->a), regs->c, &(regs->f)); cycles +=4; break; }
-    case 0x92: { subtract_register(&(regs->a), regs->d, &(regs->f)); cycles +=4; break; }
-    case 0x93: { subtract_register(&(regs->a), regs->e, &(regs->f)); cycles +=4; break; }
-    case 0x94: { subtract_register(&(regs->a), regs->h, &(regs->f)); cycles +=4; break; }
-    case 0x95: { subtract_register(&(regs->a), regs->l, &(regs->f)); cycles +=4; break; }
-    case 0x96: {subtract_register(&(regs->a), memory[regs->hl], &(regs->f)); cycles +=7; break; }
-    case 0x97: { subtract_register(&(regs->a), regs->a, &(regs->f)); cycles +=4; break; }
+    case 0x90: { subtract_register(&(regs.a), regs.b, &(regs.f)); cycles +=4; break; }
+    case 0x91: { subtract_register(&(regs.a), regs.c, &(regs.f)); cycles +=4; break; }
+    case 0x92: { subtract_register(&(regs.a), regs.d, &(regs.f)); cycles +=4; break; }
+    case 0x93: { subtract_register(&(regs.a), regs.e, &(regs.f)); cycles +=4; break; }
+    case 0x94: { subtract_register(&(regs.a), regs.h, &(regs.f)); cycles +=4; break; }
+    case 0x95: { subtract_register(&(regs.a), regs.l, &(regs.f)); cycles +=4; break; }
+    case 0x96: {subtract_register(&(regs.a), memory[regs.hl], &(regs.f)); cycles +=7; break; }
+    case 0x97: { subtract_register(&(regs.a), regs.a, &(regs.f)); cycles +=4; break; }
 
     // SBB B / 1 byte / 4 cycles / S Z AC P CA / subtracts the contents of B and CA from A and store in A
-    case 0x98: { subtract_register(&(regs->a), (regs->b + regs->get_flag(CARRY_POS)), &(regs->f)); cycles +=4; break; } 
-    case 0x99: { subtract_register(&(regs->a), (regs->c + regs->get_flag(CARRY_POS)), &(regs->f)); cycles +=4; break; }
-    case 0x9A: { subtract_register(&(regs->a), (regs->d + regs->get_flag(CARRY_POS)), &(regs->f)); cycles +=4; break; }
-    case 0x9B: { subtract_register(&(regs->a), (regs->e + regs->get_flag(CARRY_POS)), &(regs->f)); cycles +=4; break; }
-    case 0x9C: { subtract_register(&(regs->a), (regs->h + regs->get_flag(CARRY_POS)), &(regs->f)); cycles +=4; break; }
-    case 0x9D: { subtract_register(&(regs->a), (regs->l + regs->get_flag(CARRY_POS)), &(regs->f)); cycles +=4; break; }
-    case 0x9E: { subtract_register(&(regs->a), (memory[regs->hl] + regs->get_flag(CARRY_POS)), &(regs->f)); cycles +=7; break; }
-    case 0x9F: { subtract_register(&(regs->a), (regs->a + regs->get_flag(CARRY_POS)), &(regs->f)); cycles +=4; break; }
+    case 0x98: { subtract_register(&(regs.a), (regs.b + regs.get_flag(CARRY_POS)), &(regs.f)); cycles +=4; break; } 
+    case 0x99: { subtract_register(&(regs.a), (regs.c + regs.get_flag(CARRY_POS)), &(regs.f)); cycles +=4; break; }
+    case 0x9A: { subtract_register(&(regs.a), (regs.d + regs.get_flag(CARRY_POS)), &(regs.f)); cycles +=4; break; }
+    case 0x9B: { subtract_register(&(regs.a), (regs.e + regs.get_flag(CARRY_POS)), &(regs.f)); cycles +=4; break; }
+    case 0x9C: { subtract_register(&(regs.a), (regs.h + regs.get_flag(CARRY_POS)), &(regs.f)); cycles +=4; break; }
+    case 0x9D: { subtract_register(&(regs.a), (regs.l + regs.get_flag(CARRY_POS)), &(regs.f)); cycles +=4; break; }
+    case 0x9E: { subtract_register(&(regs.a), (memory[regs.hl] + regs.get_flag(CARRY_POS)), &(regs.f)); cycles +=7; break; }
+    case 0x9F: { subtract_register(&(regs.a), (regs.a + regs.get_flag(CARRY_POS)), &(regs.f)); cycles +=4; break; }
      
 
     // A0 - AF /////////////////////////////////////////////////////////
     // ANA B / 1 byte /  4 cycles / CA Z AC S P /  bitwize and & between A and B stored in A
-    case 0xA0: { bitwise_AND_register(&(regs->a), regs->b, &(regs->f)); cycles += 4; break; }
-    case 0xA1: { bitwise_AND_register(&(regs->a), regs->c, &(regs->f)); cycles += 4; break; }
-    case 0xA2: { bitwise_AND_register(&(regs->a), regs->d, &(regs->f)); cycles += 4; break; }
-    case 0xA3: { bitwise_AND_register(&(regs->a), regs->e, &(regs->f)); cycles += 4; break; }
-    case 0xA4: { bitwise_AND_register(&(regs->a), regs->h, &(regs->f)); cycles += 4; break; }
-    case 0xA5: { bitwise_AND_register(&(regs->a), regs->l, &(regs->f)); cycles += 4; break; }
-    case 0xA6: { bitwise_AND_register(&(regs->a), memory[regs->hl], &(regs->f)); cycles += 7; break; }
-    case 0xA7: { bitwise_AND_register(&(regs->a), regs->a, &(regs->f)); cycles += 4; break; }
+    case 0xA0: { bitwise_AND_register(&(regs.a), regs.b, &(regs.f)); cycles += 4; break; }
+    case 0xA1: { bitwise_AND_register(&(regs.a), regs.c, &(regs.f)); cycles += 4; break; }
+    case 0xA2: { bitwise_AND_register(&(regs.a), regs.d, &(regs.f)); cycles += 4; break; }
+    case 0xA3: { bitwise_AND_register(&(regs.a), regs.e, &(regs.f)); cycles += 4; break; }
+    case 0xA4: { bitwise_AND_register(&(regs.a), regs.h, &(regs.f)); cycles += 4; break; }
+    case 0xA5: { bitwise_AND_register(&(regs.a), regs.l, &(regs.f)); cycles += 4; break; }
+    case 0xA6: { bitwise_AND_register(&(regs.a), memory[regs.hl], &(regs.f)); cycles += 7; break; }
+    case 0xA7: { bitwise_AND_register(&(regs.a), regs.a, &(regs.f)); cycles += 4; break; }
 
     // XRA (XOR) B / 1 byte / 4 cycles / S Z AC P CA / XOR the A and specified byte and store in A
-    case 0XA8: { bitwise_XOR_register(&(regs->a), regs->b, &(regs->f)); cycles += 4; break; }
-    case 0XA9: { bitwise_XOR_register(&(regs->a), regs->c, &(regs->f)); cycles += 4; break; }  
-    case 0XAA: { bitwise_XOR_register(&(regs->a), regs->d, &(regs->f)); cycles += 4; break; } 
-    case 0XAB: { bitwise_XOR_register(&(regs->a), regs->e, &(regs->f)); cycles += 4; break; } 
-    case 0XAC: { bitwise_XOR_register(&(regs->a), regs->h, &(regs->f)); cycles += 4; break; } 
-    case 0XAD: { bitwise_XOR_register(&(regs->a), regs->l, &(regs->f)); cycles += 4; break; } 
-    case 0XAE: { bitwise_XOR_register(&(regs->a), memory[regs->hl], &(regs->f)); cycles += 7; break; } 
-    case 0XAF: { bitwise_XOR_register(&(regs->a), regs->a, &(regs->f)); cycles += 4; break; } 
+    case 0XA8: { bitwise_XOR_register(&(regs.a), regs.b, &(regs.f)); cycles += 4; break; }
+    case 0XA9: { bitwise_XOR_register(&(regs.a), regs.c, &(regs.f)); cycles += 4; break; }  
+    case 0XAA: { bitwise_XOR_register(&(regs.a), regs.d, &(regs.f)); cycles += 4; break; } 
+    case 0XAB: { bitwise_XOR_register(&(regs.a), regs.e, &(regs.f)); cycles += 4; break; } 
+    case 0XAC: { bitwise_XOR_register(&(regs.a), regs.h, &(regs.f)); cycles += 4; break; } 
+    case 0XAD: { bitwise_XOR_register(&(regs.a), regs.l, &(regs.f)); cycles += 4; break; } 
+    case 0XAE: { bitwise_XOR_register(&(regs.a), memory[regs.hl], &(regs.f)); cycles += 7; break; } 
+    case 0XAF: { bitwise_XOR_register(&(regs.a), regs.a, &(regs.f)); cycles += 4; break; } 
 
     // B0 - BF /////////////////////////////////////////////////////////
     // ORA B / 1 byte / 4 cycles / S Z AC P CA /  The specified byte is logically ORed bit by bit with the contents of the accumulator. 
-    case 0xB0: { bitwise_OR_register(&(regs->a), regs->b, &(regs->f)); cycles += 4; break; }
-    case 0xB1: { bitwise_OR_register(&(regs->a), regs->c, &(regs->f)); cycles += 4; break; }
-    case 0xB2: { bitwise_OR_register(&(regs->a), regs->d, &(regs->f)); cycles += 4; break; }
-    case 0xB3: { bitwise_OR_register(&(regs->a), regs->e, &(regs->f)); cycles += 4; break; }
-    case 0xB4: { bitwise_OR_register(&(regs->a), regs->h, &(regs->f)); cycles += 4; break; }
-    case 0xB5: { bitwise_OR_register(&(regs->a), regs->l, &(regs->f)); cycles += 4; break; }
-    case 0xB6: { bitwise_OR_register(&(regs->a), memory[regs->hl], &(regs->f)); cycles += 7; break; }
-    case 0xB7: { bitwise_OR_register(&(regs->a), regs->a, &(regs->f)); cycles += 4; break; }
+    case 0xB0: { bitwise_OR_register(&(regs.a), regs.b, &(regs.f)); cycles += 4; break; }
+    case 0xB1: { bitwise_OR_register(&(regs.a), regs.c, &(regs.f)); cycles += 4; break; }
+    case 0xB2: { bitwise_OR_register(&(regs.a), regs.d, &(regs.f)); cycles += 4; break; }
+    case 0xB3: { bitwise_OR_register(&(regs.a), regs.e, &(regs.f)); cycles += 4; break; }
+    case 0xB4: { bitwise_OR_register(&(regs.a), regs.h, &(regs.f)); cycles += 4; break; }
+    case 0xB5: { bitwise_OR_register(&(regs.a), regs.l, &(regs.f)); cycles += 4; break; }
+    case 0xB6: { bitwise_OR_register(&(regs.a), memory[regs.hl], &(regs.f)); cycles += 7; break; }
+    case 0xB7: { bitwise_OR_register(&(regs.a), regs.a, &(regs.f)); cycles += 4; break; }
 
     // CMP B / 1 byte / 4 cycles / compare specified byte with the accumulator and set flag accourding to result
-    case 0xB8: { compare_register(&(regs->a), regs->b, &(regs->f)); cycles +=4; break; }
-    case 0xB9: { compare_register(&(regs->a), regs->c, &(regs->f)); cycles +=4; break; }
-    case 0xBA: { compare_register(&(regs->a), regs->d, &(regs->f)); cycles +=4; break; }
-    case 0xBB: { compare_register(&(regs->a), regs->e, &(regs->f)); cycles +=4; break; }
-    case 0xBC: { compare_register(&(regs->a), regs->h, &(regs->f)); cycles +=4; break; }
-    case 0xBD: { compare_register(&(regs->a), regs->l, &(regs->f)); cycles +=4; break; }
-    case 0xBE: { compare_register(&(regs->a), memory[regs->hl], &(regs->f)); cycles +=7; break; }
-    case 0xBF: { compare_register(&(regs->a), regs->a, &(regs->f)); cycles +=4; break; }
+    case 0xB8: { compare_register(&(regs.a), regs.b, &(regs.f)); cycles +=4; break; }
+    case 0xB9: { compare_register(&(regs.a), regs.c, &(regs.f)); cycles +=4; break; }
+    case 0xBA: { compare_register(&(regs.a), regs.d, &(regs.f)); cycles +=4; break; }
+    case 0xBB: { compare_register(&(regs.a), regs.e, &(regs.f)); cycles +=4; break; }
+    case 0xBC: { compare_register(&(regs.a), regs.h, &(regs.f)); cycles +=4; break; }
+    case 0xBD: { compare_register(&(regs.a), regs.l, &(regs.f)); cycles +=4; break; }
+    case 0xBE: { compare_register(&(regs.a), memory[regs.hl], &(regs.f)); cycles +=7; break; }
+    case 0xBF: { compare_register(&(regs.a), regs.a, &(regs.f)); cycles +=4; break; }
 
     // C0 - CF ////////////////////////////////////////////////////////////
     // RNZ (return if not zero) / 1 byte /  checks the zero flag is 0 pop 2 bytes from stack(address) and set the PC to this location 
     case 0xC0: {
-      if (!(regs->check_flag(ZERO_POS))) {
+      if (!(regs.check_flag(ZERO_POS))) {
         RET();
         cycles += 11;
       } else {
@@ -736,13 +1181,13 @@ void _8080::execute_instruction(u8 opcode) {
       break;
     }
     // POP B / 1 byte / 10 cycles / - - - - - / 
-    case 0xC1: { pop_register(&(regs->b), &(regs->c)); cycles += 10; break; }
+    case 0xC1: { pop_register(&(regs.b), &(regs.c)); cycles += 10; break; }
     // JNZ a16 / 3 bytes / 10 cycles / - - - - - / jump if not zero
     case 0xC2: {
-      if (!(regs->check_flag(ZERO_POS))) {
+      if (!(regs.check_flag(ZERO_POS))) {
         JMP();
       } else {
-        regs->pc += 2;
+        regs.pc += 2;
       }
       cycles += 10;
       break;
@@ -751,7 +1196,7 @@ void _8080::execute_instruction(u8 opcode) {
     case 0xC3: { JMP(); cycles += 10; break; }
     // CNZ / 3 bytes / 17/11 cycles / - - - - - / Call if not zero
     case 0xC4: {
-      if (!(regs->check_flag(ZERO_POS))) {
+      if (!(regs.check_flag(ZERO_POS))) {
         CALL(fetch_bytes());
         cycles += 17;
       } else {
@@ -761,16 +1206,16 @@ void _8080::execute_instruction(u8 opcode) {
       break;
     }
     // PUSH B / 1 byte / 11 cycles / pushes the BC pair onto the stack
-    case 0xC5: { push_register(&(regs->b), &(regs->c)); cycles += 11; break; }
+    case 0xC5: { push_register(&(regs.b), &(regs.c)); cycles += 11; break; }
     // ADI d8  / 2 bytes / 7 cycles / S AC Z P CA / add immediate to accumulator
     case 0xC6: { 
-      add_register(&(regs->a), fetch_byte(), &(regs->f)); cycles += 7; 
+      add_register(&(regs.a), fetch_byte(), &(regs.f)); cycles += 7; 
       break; } 
     // RST 0 / 1 byte / 11 cycles / jump to n * 8 memory adrees a push pc to the stack
     case 0xC7: { RST(0); cycles += 11; break; }
     // RZ / 1 byte / 11/5 cycles / return if zero
     case 0xC8: {
-      if (regs->check_flag(ZERO_POS)) {
+      if (regs.check_flag(ZERO_POS)) {
         RET();
         cycles += 11;
       } else {
@@ -782,7 +1227,7 @@ void _8080::execute_instruction(u8 opcode) {
     case 0xC9: { RET(); cycles += 10; break; }
     // JZ a16 / 3 bytes / 10 cycles / - - - - - / jump if zero
     case 0xCA: {
-      if (regs->check_flag(ZERO_POS)) {
+      if (regs.check_flag(ZERO_POS)) {
         JMP(); 
         cycles += 10; 
       } else {
@@ -795,11 +1240,11 @@ void _8080::execute_instruction(u8 opcode) {
     case 0xCB: { JMP(); cycles += 10; break;}
     // CZ a16 / 3 byte / 17/11 / call if zero
     case 0xCC: {
-      if (regs->check_flag(ZERO_POS)) {
+      if (regs.check_flag(ZERO_POS)) {
         CALL(fetch_bytes());
         cycles += 17;
       } else {
-        regs->pc += 2;
+        regs.pc += 2;
         cycles += 11;
       }
       break;
@@ -807,14 +1252,14 @@ void _8080::execute_instruction(u8 opcode) {
     // CALL / 3 bytes / 17 cycles / 
     case 0xCD: { CALL(fetch_bytes()); cycles += 17; break; }
     // ACI / 2 byte / 7 cyles / add next byte to A and the carry
-    case 0xCE: { add_register(&(regs->a), (fetch_byte() + regs->get_flag(CARRY_POS)), &(regs->f)); cycles += 7; break;}
+    case 0xCE: { add_register(&(regs.a), (fetch_byte() + regs.get_flag(CARRY_POS)), &(regs.f)); cycles += 7; break;}
     // RST 1 / 1 byte / 11 cycles / 
     case 0xCF: { RST(1); cycles += 11; break; }
 
     // D0 - DF ///////////////////////////////////////////////////////////////
     // RNC (return if no carry) / 1 byte / 11/5 cyles
     case 0xD0: {
-      if (!(regs->check_flag(CARRY_POS))) {
+      if (!(regs.check_flag(CARRY_POS))) {
         RET();
         cycles += 11;
       } else {
@@ -823,13 +1268,13 @@ void _8080::execute_instruction(u8 opcode) {
       break;
     }
     // POP D / 1 byte / 10 cycles / - - - - - / 
-    case 0xD1: { pop_register(&(regs->d), &(regs->e)); cycles += 10; break; }
+    case 0xD1: { pop_register(&(regs.d), &(regs.e)); cycles += 10; break; }
     // JNC a16 / 3 bytes / 10 cycles / - - - - - / jump if not carry
     case 0xD2: {
-      if (!(regs->check_flag(CARRY_POS))) {
+      if (!(regs.check_flag(CARRY_POS))) {
         JMP();
       } else {
-        regs->pc += 2;
+        regs.pc += 2;
       }
       cycles += 10;
       break;
@@ -837,13 +1282,13 @@ void _8080::execute_instruction(u8 opcode) {
     // OUT d8 / 2 bytes / 10 cycles / 
     case 0XD3: { 
       u8 port = fetch_byte();    
-      handle_io(port, OUT, &(regs->a));   
+      out_ports[port]->write(port, regs.a);
       cycles += 10;
       break;
     }
     // CNC / 3 bytes / 17/11 cycles / - - - - - / Call if not carry
     case 0xD4: {
-      if (!(regs->check_flag(CARRY_POS))) {
+      if (!(regs.check_flag(CARRY_POS))) {
         CALL(fetch_bytes());
         cycles += 17;
       } else {
@@ -853,14 +1298,14 @@ void _8080::execute_instruction(u8 opcode) {
       break;
     }
     // PUSH D / 1 byte / 11 cycles / pushes the DE pair onto the stack
-    case 0xD5: { push_register(&(regs->d), &(regs->e)); cycles += 11; break; }
+    case 0xD5: { push_register(&(regs.d), &(regs.e)); cycles += 11; break; }
     // SUI d8  / 2 bytes / 7 cycles / S AC Z P CA / subtract immediate to accumulator
-    case 0xD6: { subtract_register(&(regs->a), fetch_byte(), &(regs->f)); cycles += 7; break; } 
+    case 0xD6: { subtract_register(&(regs.a), fetch_byte(), &(regs.f)); cycles += 7; break; } 
     // RST 2 / 1 byte / 11 cycles / jump to n * 8 memory adrees a push pc to the stack
     case 0xD7: { RST(2); cycles += 11; break; }
     // RC / 1 byte / 11/5 cycles / return if carry
     case 0xD8: {
-      if (regs->check_flag(CARRY_POS)) {
+      if (regs.check_flag(CARRY_POS)) {
         RET();
         cycles += 11;
       } else {
@@ -872,7 +1317,7 @@ void _8080::execute_instruction(u8 opcode) {
     case 0xD9: { RET(); cycles += 10; break; }
     // JC a16 / 3 bytes / 10 cycles / - - - - - / jump if carry
     case 0xDA: {
-      if (regs->check_flag(CARRY_POS)) {
+      if (regs.check_flag(CARRY_POS)) {
         JMP(); 
         cycles += 10; 
       } else {
@@ -885,17 +1330,17 @@ void _8080::execute_instruction(u8 opcode) {
     case 0XDB: { 
       u8 port = fetch_byte();    
       // std::cout << "[DEBUG] IN instruction executed. Port: " << (int)port << "\n";
-      handle_io(port, IN, &(regs->a));
+      regs.a = in_ports[port]->read(port);
       cycles += 10;
       break;
     }
     // CC / 3 bytes / 17/11 cyles / call if carry
     case 0xDC : { 
-      if (regs->check_flag(CARRY_POS)){
+      if (regs.check_flag(CARRY_POS)){
         CALL(fetch_bytes());
         cycles += 17;
       } else {
-        regs->pc += 2;
+        regs.pc += 2;
         cycles += 11;
       }
       break;
@@ -903,14 +1348,14 @@ void _8080::execute_instruction(u8 opcode) {
     // CALL / 3 bytes / 17 cycles / 
     case 0xDD: { CALL(fetch_bytes()); cycles += 17; break; }
     // SBI / 2 byte / 7 cyles / subtract next byte to A and the carry
-    case 0xDE: { subtract_register(&(regs->a), (fetch_byte() + regs->get_flag(CARRY_POS)), &(regs->f)); cycles += 7; break;}
+    case 0xDE: { subtract_register(&(regs.a), (fetch_byte() + regs.get_flag(CARRY_POS)), &(regs.f)); cycles += 7; break;}
     // RST 3 / 1 byte / 11 cycles / 
     case 0xDF: { RST(3); cycles += 11; break; }
 
     // E0 - EF ///////////////////////////////////////////////////////////////
     // RPO / 1 byte / 11/5 cycles / If the Parity bit is zero (indicating odd parity), a return (pop 2 bytes form stack and set pc to it) operation is performed.
     case 0xE0: {
-      if (!(regs->check_flag(PARITY_POS))) {
+      if (!(regs.check_flag(PARITY_POS))) {
         RET();
         cycles += 11;
       } else {
@@ -919,31 +1364,31 @@ void _8080::execute_instruction(u8 opcode) {
       break;
     }
     // POP H / 1 byte / 10 cycles / - - - - - / 
-    case 0xE1: { pop_register(&(regs->h), &(regs->l)); cycles += 10; break; }
+    case 0xE1: { pop_register(&(regs.h), &(regs.l)); cycles += 10; break; }
     // JP0 a16 / 3 bytes / 10 cycles / - - - - - / jump if parity odd
     case 0xE2: {
-      if (!(regs->check_flag(PARITY_POS))) {
+      if (!(regs.check_flag(PARITY_POS))) {
         JMP();
       } else {
-        regs->pc += 2;
+        regs.pc += 2;
       }
       cycles += 10;
       break;
     }
     // XTHL / 1 byte / 18 cycles / - - - - - / The contents of the L register are exchanged with the contents of the memory byte whose address is held in the stack pointer SP. The contents of the H register are exchanged with the contents of the memory byte whose address is one greater than that held in the stack pointer.
     case 0xE3: {
-      u8 address1 = memory[regs->sp];
-      u8 address2 = memory[regs->sp + 1];
-      memory[regs->sp] = regs->l;
-      memory[regs->sp + 1] = regs->h;
-      regs->l = address1;
-      regs->h = address2;
+      u8 address1 = memory[regs.sp];
+      u8 address2 = memory[(u16) (regs.sp + 1)];
+      memory.write(regs.sp, regs.l);
+      memory.write(regs.sp + 1, regs.h);
+      regs.l = address1;
+      regs.h = address2;
       cycles += 18;
       break;
     }
     // CPO / 3 bytes / 17/11 cycles / - - - - - / Call if parity odd
     case 0xE4: {
-      if (!(regs->check_flag(PARITY_POS))) {
+      if (!(regs.check_flag(PARITY_POS))) {
         CALL(fetch_bytes());
         cycles += 17;
       } else {
@@ -953,14 +1398,14 @@ void _8080::execute_instruction(u8 opcode) {
       break;
     }
     // PUSH H / 1 byte / 11 cycles / pushes the HL pair onto the stack
-    case 0xE5: { push_register(&(regs->h), &(regs->l)); cycles += 11; break; }
+    case 0xE5: { push_register(&(regs.h), &(regs.l)); cycles += 11; break; }
     // ANI d8  / 2 bytes / 7 cycles / S AC Z P CA / And Immediate With Accumulator
-    case 0xE6: { bitwise_AND_register(&(regs->a), fetch_byte(), &(regs->f)); cycles += 7; break; }
+    case 0xE6: { bitwise_AND_register(&(regs.a), fetch_byte(), &(regs.f)); cycles += 7; break; }
     // RST 4 / 1 byte / 11 cycles / jump to n * 8 memory adrees a push pc to the stack
     case 0xE7: { RST(4); cycles += 11; break; }
     // RPE / 1 byte / 11/5 cycles / return if parity even
     case 0xE8: {
-      if (regs->check_flag(PARITY_POS)) {
+      if (regs.check_flag(PARITY_POS)) {
         RET();
         cycles += 11;
       } else {
@@ -970,13 +1415,13 @@ void _8080::execute_instruction(u8 opcode) {
     }
     // PCHL / 1 byte / 5 cycles / The contents of the H register replace the most significant 8 bits of the program counter, and the con- tents of the L register replace the least significant 8 bits of the program counter.
     case 0xE9: {
-      regs->pc = ((u16 ((regs->h << 8) | regs->l)));
+      regs.pc = ((u16 ((regs.h << 8) | regs.l)));
       cycles += 5;
       break;
     }
     // JPE a16 / 3 bytes / 10 cycles / - - - - - / jump if parity even
     case 0xEA: {
-      if (regs->check_flag(PARITY_POS)) {
+      if (regs.check_flag(PARITY_POS)) {
         JMP(); 
         cycles += 10; 
       } else {
@@ -987,19 +1432,19 @@ void _8080::execute_instruction(u8 opcode) {
     }
     // XCHG / 1 byte / 5 cycles / - - - - - / The 16 bits of data held in the Hand L registers are exchanged with the 16 bits of data held in the D and E registers
     case 0xEB: {
-      u16 temp_val = regs->hl;
-      regs->hl = regs->de;
-      regs->de = temp_val;
+      u16 temp_val = regs.hl;
+      regs.hl = regs.de;
+      regs.de = temp_val;
       cycles += 5;
       break;
     }
     // CPE / 3 bytes / 17/11 cyles / call if parity is even(1)
     case 0xEC : { 
-      if (regs->check_flag(PARITY_POS)){
+      if (regs.check_flag(PARITY_POS)){
         CALL(fetch_bytes());
         cycles += 17;
       } else {
-        regs->pc += 2;
+        regs.pc += 2;
         cycles += 11;
       }
       break;
@@ -1007,14 +1452,14 @@ void _8080::execute_instruction(u8 opcode) {
     // CALL / 3 bytes / 17 cycles / 
     case 0xED: { CALL(fetch_bytes()); cycles += 17; break; }
     // XRI / 2 byte / 7 cyles / xor next byte to A 
-    case 0xEE: { bitwise_XOR_register(&(regs->a), fetch_byte(), &(regs->f)); cycles += 7; break;}
+    case 0xEE: { bitwise_XOR_register(&(regs.a), fetch_byte(), &(regs.f)); cycles += 7; break;}
     // RST 5 / 1 byte / 11 cycles / 
     case 0xEF: { RST(5); cycles += 11; break; }
 
     // F0 - FF //////////////////////////////////////////////////////////////
     // RP / 1 byte / 11/5 cycles (if sign bit zero return)
     case 0xF0: {
-      if (!(regs->check_flag(SIGN_POS))) {
+      if (!(regs.check_flag(SIGN_POS))) {
         RET();
         cycles += 11;
       } else {
@@ -1023,13 +1468,13 @@ void _8080::execute_instruction(u8 opcode) {
       break;
     }
     // POP PSW / 1 byte / 10 cycles / - - - - - / 
-    case 0xF1: { pop_register(&(regs->a), &(regs->f)); cycles += 10; break; }
+    case 0xF1: { pop_register(&(regs.a), &(regs.f)); cycles += 10; break; }
     // JP a16 / 3 bytes / 10 cycles / - - - - - / jump if positive
     case 0xF2: {
-      if (!(regs->check_flag(SIGN_POS))) {
+      if (!(regs.check_flag(SIGN_POS))) {
         JMP();
       } else {
-        regs->pc += 2;
+        regs.pc += 2;
       }
       cycles += 10;
       break;
@@ -1038,7 +1483,7 @@ void _8080::execute_instruction(u8 opcode) {
     case 0xF3: { interrupt_enabled = false; cycles += 4; break; }
     // CP / 3 bytes / 17/11 cycles / - - - - - / Call if plus
     case 0xF4: {
-      if (!(regs->check_flag(SIGN_POS))) {
+      if (!(regs.check_flag(SIGN_POS))) {
         CALL(fetch_bytes());
         cycles += 17;
       } else {
@@ -1048,14 +1493,14 @@ void _8080::execute_instruction(u8 opcode) {
       break;
     }
     // PUSH PSW / 1 byte / 11 cycles / pushes the PSW pair onto the stack
-    case 0xF5: { push_register(&(regs->a), &(regs->f)); cycles += 11; break; }
+    case 0xF5: { push_register(&(regs.a), &(regs.f)); cycles += 11; break; }
     // ORI d8  / 2 bytes / 7 cycles / S AC Z P CA / OR Immediate With Accumulator
-    case 0xF6: { bitwise_OR_register(&(regs->a), fetch_byte(), &(regs->f)); cycles += 7; break; }
+    case 0xF6: { bitwise_OR_register(&(regs.a), fetch_byte(), &(regs.f)); cycles += 7; break; }
     // RST 6 / 1 byte / 11 cycles / jump to n * 8 memory adrees a push pc to the stack
     case 0xF7: { RST(6); cycles += 11; break; }
     // RM / 1 byte / 11/5 cycles / return if minus
     case 0xF8: {
-      if (regs->check_flag(SIGN_POS)) {
+      if (regs.check_flag(SIGN_POS)) {
         RET();
         cycles += 11;
       } else {
@@ -1064,10 +1509,10 @@ void _8080::execute_instruction(u8 opcode) {
       break;
     }
     // SPHL / 1 byte / 5 cycles / The 16 bits of data held in the Hand L registers replace the contents of the stack pointer SP.
-    case 0xF9: { regs->sp = regs->hl; cycles += 5; break; }
+    case 0xF9: { regs.sp = regs.hl; cycles += 5; break; }
     // JM a16 / 3 bytes / 10 cycles / - - - - - / jump if minus (sign bit is 1)
     case 0xFA: {
-      if (regs->check_flag(SIGN_POS)) {
+      if (regs.check_flag(SIGN_POS)) {
         JMP(); 
         cycles += 10; 
       } else {
@@ -1080,11 +1525,11 @@ void _8080::execute_instruction(u8 opcode) {
     case 0xFB: { interrupt_enabled = true; cycles += 4; break; }
     // CM / 3 bytes / 17/11 cyles / call if minus (sign bit = 1)
     case 0xFC : { 
-      if (regs->check_flag(SIGN_POS)){
+      if (regs.check_flag(SIGN_POS)){
         CALL(fetch_bytes());
         cycles += 17;
       } else {
-        regs->pc += 2;
+        regs.pc += 2;
         cycles += 11;
       }
       break;
@@ -1092,7 +1537,7 @@ void _8080::execute_instruction(u8 opcode) {
     // CALL / 3 bytes / 17 cycles / 
     case 0xFD: { CALL(fetch_bytes()); cycles += 17; break; }
     // CPI / 2 byte / 7 cyles / compare next byte to A 
-    case 0xFE: { compare_register(&(regs->a), fetch_byte(), &(regs->f)); cycles += 7; break;}
+    case 0xFE: { compare_register(&(regs.a), fetch_byte(), &(regs.f)); cycles += 7; break;}
     // RST 7 / 1 byte / 11 cycles / 
     case 0xFF: { RST(7); cycles += 11; break; }
   }
@@ -1100,9 +1545,9 @@ void _8080::execute_instruction(u8 opcode) {
 
 void _8080::mov_m (u8* reg, bool into_m) {
   if (into_m) {
-    memory[regs->hl] = *(reg);
+    memory.write(regs.hl, *reg);
   } else {
-    *reg = memory[regs->hl];
+    *reg = memory[regs.hl];
   }
 }
 
@@ -1114,21 +1559,30 @@ void _8080::LXI_register(u16* reg) {
 void _8080::increment_register(u8* reg, u8* flags) {
   u8 initial = *(reg);
   u16 res = initial + 1;
-  check_set_auxilary_flag(initial, res);
-  check_set_sign_flag(res);
-  check_set_zero_flag(res);
-  check_set_parity_flag(res);
+  set_result_flags(RESULT_FLAGS_NO_CARRY, initial, res);
   *reg = (u8) res;
 }
 
 void _8080::decrement_register(u8* reg, u8* flags) {
   u8 initial = *(reg); 
   u8 res = *(reg) - 1;
-  check_set_auxilary_flag(*(reg), res);
+  set_result_flags(RESULT_FLAGS_NO_CARRY, initial, res);
+  *reg = res;
+}
+
+// S Z AC P (and CY with RESULT_FLAGS) of an 8 bit result, recorded for later in lazy mode
+void _8080::set_result_flags(u8 mask, u8 initial, u16 res) {
+  if (regs.lazy_flags) {
+    regs.defer_flags(mask, initial, res);
+    return;
+  }
+  if (mask & (1 << CARRY_POS)) {
+    check_set_carry_flag(initial, res);
+  }
+  check_set_auxilary_flag(initial, res);
   check_set_sign_flag(res);
   check_set_zero_flag(res);
   check_set_parity_flag(res);
-  *reg = res;
 }
 
 void _8080::DAD_register(u16* hl, u16* reg_pair, u8* flags) {
@@ -1143,55 +1597,35 @@ void _8080::DAD_register(u16* hl, u16* reg_pair, u8* flags) {
 void _8080::add_register(u8* a, u8 val, u8* flags) {
   u8 initial = *a;
   u16 res = initial + val;
-  check_set_carry_flag(initial, res);
-  check_set_auxilary_flag(initial, res);
-  check_set_sign_flag(res);
-  check_set_zero_flag(res);
-  check_set_parity_flag(res);
+  set_result_flags(RESULT_FLAGS, initial, res);
   *a = res;
 }
 
 void _8080::subtract_register(u8* a, u8 val, u8* flags) {
   u8 initial = *a;
   u16 res = (u16) initial - val;
-  check_set_carry_flag(initial, res);
-  check_set_auxilary_flag(initial, res);
-  check_set_sign_flag(res);
-  check_set_zero_flag(res);
-  check_set_parity_flag(res);
+  set_result_flags(RESULT_FLAGS, initial, res);
   *a = res;
 }
 
 void _8080::bitwise_AND_register(u8* a, u8 val, u8* flags) {
   u8 initial = *(a);
   u16 res = *(a) & val;
-  check_set_carry_flag(initial, res);
-  check_set_auxilary_flag(initial, res);
-  check_set_sign_flag(res);
-  check_set_zero_flag(res);
-  check_set_parity_flag(res);
+  set_result_flags(RESULT_FLAGS, initial, res);
   *a = res;
 }
 
 void _8080::bitwise_XOR_register(u8* a, u8 val, u8* flags) {
   u8 initial = *(a);
   u16 res = *(a) ^ val;
-  check_set_carry_flag(initial, res);
-  check_set_auxilary_flag(initial, res);
-  check_set_sign_flag(res);
-  check_set_zero_flag(res);
-  check_set_parity_flag(res);
+  set_result_flags(RESULT_FLAGS, initial, res);
   *a = res;
 }
 
 void _8080::bitwise_OR_register(u8* a, u8 val, u8* flags) {
   u8 initial = *(a);
   u16 res = initial | val;
-  check_set_carry_flag(initial, res);
-  check_set_auxilary_flag(initial, res);
-  check_set_sign_flag(res);
-  check_set_zero_flag(res);
-  check_set_parity_flag(res);
+  set_result_flags(RESULT_FLAGS, initial, res);
   *a = res;
 }
 
@@ -1199,95 +1633,91 @@ void _8080::compare_register(u8* a, u8 val, u8* flags) {
   // note : comparison is done using subtraction
   u8 initial = *(a);
   u16 res = initial - val;
-  check_set_carry_flag(initial, res);
-  check_set_auxilary_flag(initial, res);
-  check_set_sign_flag(res);
-  check_set_zero_flag(res);
-  check_set_parity_flag(res);
-}
-
-u16 _8080::pop_stack() {
-  u8* start = &(memory[regs->sp]);
-  u16* bytes = (u16*) start;
-  regs->sp += 2;
-  return *bytes;
+  set_result_flags(RESULT_FLAGS, initial, res);
 }
 
+// PUSH / POP PSW move f as a plain byte
 void _8080::pop_register(u8* first, u8* second) {
-  // printf("POP: SP = 0x%04X\n", regs->sp);
-  // printf("    -> memory: 0x%02X is, 0x%02X is first\n", memory[regs->sp], memory[regs->sp + 1]);
-  *second = memory[regs->sp];
-  *first = memory[regs->sp + 1];
+  if (second == &regs.f) {
+    regs.sync_flags();
+  }
+  // printf("POP: SP = 0x%04X\n", regs.sp);
+  // printf("    -> memory: 0x%02X is, 0x%02X is first\n", memory[regs.sp], memory[regs.sp + 1]);
+  *second = memory[regs.sp];
+  *first = memory[(u16) (regs.sp + 1)];
   // printf("    -> Popped 0x%02X into second, 0x%02X into first\n", *second, *first);
-  regs->sp += 2;
-  // printf("    -> SP after POP = 0x%04X\n", regs->sp);
+  regs.sp += 2;
+  // printf("    -> SP after POP = 0x%04X\n", regs.sp);
 }
 
 void _8080::push_register(u8* first, u8* second) {
-  memory[regs->sp - 1] = *first;
-  memory[regs->sp - 2] = *second;
-  regs->sp -= 2;
+  if (second == &regs.f) {
+    regs.sync_flags();
+  }
+  memory.write(regs.sp - 1, *first);
+  memory.write(regs.sp - 2, *second);
+  regs.sp -= 2;
 }
 
 
 void _8080::RET() {
-  u8 low = memory[regs->sp];
-  u8 high = memory[regs->sp + 1];
+  u8 low = memory[regs.sp];
+  u8 high = memory[(u16) (regs.sp + 1)];
   u16 return_address = ((high << 8) | low);
-  regs->pc = return_address;
-  regs->sp += 2;
+  regs.pc = return_address;
+  regs.sp += 2;
 }
 
 void _8080::CALL(u16 memory_address) {
-  regs->sp -= 2;
+  regs.sp -= 2;
 
-  u8 ret_low = u8(regs->pc & 0xFF);
-  u8 ret_high = u8((regs->pc >> 8) & 0xFF);
+  u8 ret_low = u8(regs.pc & 0xFF);
+  u8 ret_high = u8((regs.pc >> 8) & 0xFF);
 
-  memory[regs->sp] = ret_low;       // Low byte
-  memory[regs->sp + 1] = ret_high;  // High byte
+  memory.write(regs.sp, ret_low);       // Low byte
+  memory.write(regs.sp + 1, ret_high);  // High byte
 
-  regs->pc = memory_address;
+  regs.pc = memory_address;
 }
 
 void _8080::JMP() {
   u16 mem_loc = fetch_bytes();
-  regs->pc = mem_loc;
+  regs.pc = mem_loc;
 }
 
 void _8080::RST(u16 n) {
   // save the pc to the stack so it can be retreived later
   interrupt_enabled = false;
-  regs->sp -= 2;
-  memory[regs->sp + 1] = (regs->pc & 0xFF00) >> 8;
-  memory[regs->sp] = regs->pc & 0x00FF;
-  regs->pc = n * 8;
+  regs.sp -= 2;
+  memory.write(regs.sp + 1, (regs.pc & 0xFF00) >> 8);
+  memory.write(regs.sp, regs.pc & 0x00FF);
+  regs.pc = n * 8;
 }
 
 void _8080::check_set_sign_flag(u16 num) {
   u16 val = num & 0xFF;
   if (val & 0x80) {
-    regs->set_flag(SIGN_POS);
+    regs.set_flag(SIGN_POS);
   } else {
-    regs->reset_flag(SIGN_POS);
+    regs.reset_flag(SIGN_POS);
   }
 }
 
 void _8080::check_set_zero_flag(u16 res) {
   u8 val = (u8) res;
   if (val == 0) {
-    regs->set_flag(ZERO_POS);
+    regs.set_flag(ZERO_POS);
   } else {
-    regs->reset_flag(ZERO_POS);
+    regs.reset_flag(ZERO_POS);
   }
 }
 
 void _8080::check_set_auxilary_flag(u8 initial, u16 res) {
     u8 operand = (u8)(res - initial);
     if (((initial & 0xF) + (operand & 0xF)) > 0xF) {
-      regs->set_flag(AUX_POS);
+      regs.set_flag(AUX_POS);
     } else {
-      regs->reset_flag(AUX_POS);
+      regs.reset_flag(AUX_POS);
     }
 }
 
@@ -1302,145 +1732,247 @@ void _8080::check_set_parity_flag(u16 num) {
   }
 
   if (count % 2 == 0) {
-    regs->set_flag(PARITY_POS);
+    regs.set_flag(PARITY_POS);
   } else {
-    regs->reset_flag(PARITY_POS);
+    regs.reset_flag(PARITY_POS);
   }
 }
 
 void _8080::check_set_carry_flag(u8 initial, u16 result) {
   // Check if the result indicates a carry has occurred
   if (result > OVERFLOW) { // Check if carry occurred 
-    regs->set_flag(CARRY_POS);
+    regs.set_flag(CARRY_POS);
   } else {
-    regs->reset_flag(CARRY_POS);
+    regs.reset_flag(CARRY_POS);
+  }
+}
+
+bool _8080::set_scaler(const ScalerConfig& config) {
+  if (!screen) {
+    return false;
+  }
+  return screen->set_scaler(config);
+}
+
+void _8080::map_port(PortType type, u8 port_num, PortDevice* device) {
+  if (!device) {
+    device = &unmapped_port;
+  }
+  if (type == IN) {
+    in_ports[port_num] = device;
+  } else {
+    out_ports[port_num] = device;
+  }
+}
+
+void _8080::map_invaders_ports() {
+  for (int port = 0; port < NUM_PORTS; port++) {
+    in_ports[port] = &unmapped_port;
+    out_ports[port] = &unmapped_port;
   }
+  // input ports
+  map_port(IN, INP0, &input_latch);
+  map_port(IN, INP1, &input_latch);
+  map_port(IN, INP2, &input_latch);
+  map_port(IN, SHFT_IN, &shift_register);
+  // output ports
+  map_port(OUT, SHFTAMNT, &shift_register);
+  map_port(OUT, SOUND1, &sound_latch);
+  map_port(OUT, SHFT_DATA, &shift_register);
+  map_port(OUT, SOUND2, &sound_latch);
+  map_port(OUT, WATCHDOG, &watchdog);
 }
 
-uint8_t offset = 0;
+void _8080::set_inputs(u8 input_bits) {
+  if (input_bits != input_latch.get_inputs()) {
+    input_latch.set_inputs(input_bits);
+  }
+}
 
-typedef union{
-    struct {
-        uint8_t low_value;
-        uint8_t high_value;
-    };
-    uint16_t value;
-} _shift_register;
+u8 _8080::get_inputs() {
+  return input_latch.get_inputs();
+}
 
-_shift_register shift_register;
+// snapshots ///////////////////////////////////////////////////////////////////
 
-#define SHIFT_AND_BITS 0b00000111
+u64 _8080::get_rom_hash() {
+  u8 rom[ROM_BYTES];
+  memory.read_block(0, rom, ROM_BYTES);
+  return hash_bytes(rom, ROM_BYTES);
+}
 
-void _8080::handle_io(u8 port_num, PortType type, u8* a) {
-  // input ports
-  if (type == IN) {
-    *a = 0;
-    switch (port_num)
-    {
-      case INP0:
-        break;
-      case INP1: { 
-        #define CREDIT 0
-        #define TWOP_START 1
-        #define ONEP_START 2
-        #define ALWAYS_ONE 3
-        #define ONEP_SHOT 4
-        #define ONEP_LEFT 5
-        #define ONEP_RIGHT 6
-        #define NOT_CONNECTED 7
-
-        uint8_t reg_a = 0;  
-
-        if (inputs[INSERT_COIN])
-            reg_a |= (1 << CREDIT);       
-        else
-            reg_a &= ~(1 << CREDIT);     
-
-        reg_a &= ~(1 << TWOP_START);      
-
-        if (inputs[SPACE_KEY])
-            reg_a |= (1 << ONEP_START);
-        else
-            reg_a &= ~(1 << ONEP_START);
-
-        reg_a |= (1 << ALWAYS_ONE);       
-
-        if (inputs[SPACE_KEY])
-            reg_a |= (1 << ONEP_SHOT);
-        else
-            reg_a &= ~(1 << ONEP_SHOT);
-
-        if (inputs[A_KEY])
-            reg_a |= (1 << ONEP_LEFT);
-        else
-            reg_a &= ~(1 << ONEP_LEFT);
-
-        if (inputs[D_KEY])
-            reg_a |= (1 << ONEP_RIGHT);
-        else
-            reg_a &= ~(1 << ONEP_RIGHT);
-
-        reg_a &= ~(1 << NOT_CONNECTED);   
-
-        *a = reg_a; 
-        break;
-      }
-      case INP2:
-        break;
-      case SHFT_IN: {
-        *a = ((shift_register.value << offset) >> 8) & 0xFF;
-        break;
-      }
-    }
+// the flags are synced so the snapshot reads the same with lazy flags on or off
+void _8080::save_state(Snapshot* snapshot) {
+  regs.sync_flags();
+  snapshot->regs = regs;
+  snapshot->cycles = cycles;
+  snapshot->frames = frames;
+  snapshot->halted_cycles = halted_cycles;
+  snapshot->idle_cycles = idle_cycles;
+  snapshot->interrupt_enabled = interrupt_enabled;
+  snapshot->halted = halted;
+  input_latch.save(&snapshot->ports);
+  shift_register.save(&snapshot->ports);
+  sound_latch.save(&snapshot->ports);
+  memory.read_block(RAM_START, snapshot->ram, RAM_BYTES);
+}
+
+void _8080::load_state(const Snapshot& snapshot) {
+  bool lazy_flags = regs.lazy_flags;
+  regs = snapshot.regs;
+  regs.lazy_flags = lazy_flags;
+  cycles = snapshot.cycles;
+  frames = snapshot.frames;
+  halted_cycles = snapshot.halted_cycles;
+  idle_cycles = snapshot.idle_cycles;
+  interrupt_enabled = snapshot.interrupt_enabled;
+  halted = snapshot.halted;
+  input_latch.restore(snapshot.ports);
+  shift_register.restore(snapshot.ports);
+  sound_latch.restore(snapshot.ports);
+  memory.write_block(RAM_START, snapshot.ram, RAM_BYTES);
+  scheduler.clear();
+  schedule_frame(frames);
+  idle = IdleLoop();
+}
+
+// forks ///////////////////////////////////////////////////////////////////////
+
+// constructing an instance (ports, scheduler, page table) costs more than the fork itself,
+// so a search that recycles its children only pays fork_into
+_8080* _8080::fork() {
+  _8080* child;
+  if (spare_children.empty()) {
+    child = new _8080(true);
+  } else {
+    child = spare_children.back();
+    spare_children.pop_back();
   }
+  fork_into(*child);
+  return child;
+}
 
-  // output ports
-  if (type == OUT) {
-    u8 value = *a;
+void _8080::recycle(_8080* child) {
+  spare_children.push_back(child);
+}
 
-    switch (port_num) {
-      case SHFTAMNT:
-        offset = value & SHIFT_AND_BITS;
-        break;
-      case SOUND1:
-        break;
-      case SHFT_DATA:
-        shift_register.low_value = shift_register.high_value;
-        shift_register.high_value = value;
-        break;
-      case SOUND2:
-        break;
-      case WATCHDOG:
-        break;
-    }
+// what load_state restores, without the 8 KB copy: the child reads this instance's pages
+// until either one writes them
+void _8080::fork_into(_8080& child) {
+  child.share_memory(*this);
+  child.regs = regs;
+  child.cycles = cycles;
+  child.frames = frames;
+  child.halted_cycles = halted_cycles;
+  child.idle_cycles = idle_cycles;
+  child.interrupt_enabled = interrupt_enabled;
+  child.halted = halted;
+  PortState ports;
+  input_latch.save(&ports);
+  shift_register.save(&ports);
+  sound_latch.save(&ports);
+  child.input_latch.restore(ports);
+  child.shift_register.restore(ports);
+  child.sound_latch.restore(ports);
+  child.scheduler.clear();
+  child.schedule_frame(frames);
+  child.skip_idle_loops = skip_idle_loops;
+  child.fuse_instructions = fuse_instructions;
+  child.test_output = test_output;
+  if (child.recompiled != recompiled) {
+    child.recompiled = recompiled;
+    child.recompiled_blocks = recompiled_blocks;
   }
-  return; 
 }
 
+bool _8080::boot_from_cache(const string& cache_dir, u64 boot_frames) {
+  u64 rom_hash = get_rom_hash();
+  string path = boot_cache_path(cache_dir, rom_hash, boot_frames);
+  Snapshot snapshot;
+  if (load_snapshot(path, &snapshot) && snapshot.rom_hash == rom_hash && snapshot.frames == boot_frames) {
+    load_state(snapshot);
+    return true;
+  }
+
+  set_inputs(0);
+  while (frames < boot_frames) {
+    run_frame();
+  }
+  save_state(&snapshot);
+  snapshot.rom_hash = rom_hash;
+  if (!save_snapshot(path, snapshot)) {
+    log_warn("could not write the boot snapshot %s", path.c_str());
+  }
+  return false;
+}
+
+// run-ahead ///////////////////////////////////////////////////////////////////
+// The game reads the inputs once or twice a frame, so a press shows up a frame or more
+// late. Running ahead with the inputs already held and showing that frame hides it; the
+// real timeline is restored afterwards so the extra frames never count.
+
+void _8080::begin_run_ahead() {
+  auto start = chrono::steady_clock::now();
+  if (!run_ahead_state) {
+    run_ahead_state = new Snapshot();
+  }
+  save_state(run_ahead_state);
+  run_ahead_audio = audio;
+  run_ahead_capture = capture;
+  run_ahead_game_state = game_state;
+  audio = nullptr;
+  capture = nullptr;
+  game_state = nullptr;
+  for (int i = 0; i < run_ahead; i++) {
+    run_frame();
+  }
+  run_ahead_frames += run_ahead;
+  run_ahead_ns += chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+}
+
+void _8080::end_run_ahead() {
+  auto start = chrono::steady_clock::now();
+  load_state(*run_ahead_state);
+  audio = run_ahead_audio;
+  capture = run_ahead_capture;
+  game_state = run_ahead_game_state;
+  run_ahead_ns += chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+}
+
+double _8080::get_run_ahead_cost() {
+  return run_ahead_frames ? run_ahead_ns / 1000.0 / run_ahead_frames : 0;
+}
+
+// BDOS calls used by the cpu test programs, output goes to test_output
 void _8080::handleCPMCall() {
-  switch (regs->c) {
+  switch (regs.c) {
+      case 0x00:
+          // system reset, jump to the warm boot vector so the test finishes
+          regs.pc = 0x0000;
+          return;
       case 0x02:
-          std::cout << static_cast<char>(regs->e);
+          *test_output << static_cast<char>(regs.e);
           break;
       case 0x09: {
-          uint16_t addr = (regs->d << 8) | regs->e;
+          uint16_t addr = regs.de;
           while (memory[addr] != '$') {
-              std::cout << static_cast<char>(memory[addr]);
+              *test_output << static_cast<char>(memory[addr]);
               addr++;
           }
           break;
       }
       default:
-          std::cerr << "Unhandled CP/M call: " << std::hex << int(regs->c) << std::endl;
+          *test_output << "Unhandled CP/M call: " << std::hex << int(regs.c) << std::dec << std::endl;
   }
 
   // Simulate RET
-  regs->pc = (memory[regs->sp + 1] << 8) | memory[regs->sp];
-  regs->sp += 2;
+  RET();
 }
 
 void _8080::execute_interrupt(int opcode) {
   if (interrupt_enabled) {
+    // the ISR may change the RAM or code a polling loop depends on
+    idle.valid = false;
     halted = false;
     interrupt_enabled = false;          
     execute_instruction(opcode);
@@ -7,11 +7,24 @@
 #include <array>
 #include <vector>
 #include <fstream>
+#include "game_state.hpp" // <functional> has to come before the _1 / _2 key macros
 #include "keys.hpp"
 #include "Screen.hpp"
-#include "Registers.hpp"
+#include "cpu_state.hpp"
+#include "RegisterPane.hpp"
 #include "instruction_list.hpp"
 #include "log.hpp"
+#include "audio.hpp"
+#include "capture.hpp"
+#include "scaler.hpp"
+#include "ports.hpp"
+#include "scheduler.hpp"
+#include "recompiled.hpp"
+#include "snapshot.hpp"
+#include "triple_buffer.hpp"
+#include "memory_bus.hpp"
+#include "movie.hpp"
+#include <atomic>
 
 #define TOTAL_BYTES_OF_MEM 65536
 #define PROGRAM_START 0X000
@@ -19,6 +32,11 @@
 #define MEMORY_END 0x4000
 #define INSTRUCTION_CUTTOFF 0x1A90
 
+#define INVADERS_H_START 0x0000
+#define INVADERS_G_START 0x0800
+#define INVADERS_F_START 0x1000
+#define INVADERS_E_START 0x1800
+
 // input ports
 #define INP0 0x00
 #define INP1 0x01
@@ -36,14 +54,50 @@
 #define FULL_INTERRUPT 0xD7
 
 #define CYCLES_PER_SECOND 2000000
-#define CYCLES_PER_FRAME CYCLES_PER_SECOND / 60
+#define FRAMES_PER_SECOND 60
+#define CYCLES_PER_FRAME (CYCLES_PER_SECOND / FRAMES_PER_SECOND)
 
 #define OVERFLOW 0xFF
 
+#define EMULATION_MAX_LAG_FRAMES 4 // behind by more and the emulation thread stops catching up
+
+#define IDLE_LOOP_MAX_BYTES 16 // longest backward jump checked for an idle loop
+
 using namespace std;
+using u64 = uint64_t;
 
 class Screen;
 
+// the registers an idle loop compares, pc is the loop head
+struct LoopRegisters {
+  u16 pc, psw, bc, de, hl, sp;
+};
+
+// the short backward loop seen last, see idle_loop_skip
+struct IdleLoop {
+  bool valid = false;
+  bool checked = false; // body already scanned
+  u64 iteration = 0; // cycles of the body and the jump back, 0 when the body has side effects
+  u16 jump;
+  u64 cycles;
+  LoopRegisters regs;
+};
+
+// the cycles to skip after a backward jump from jump landed on regs.pc: whole iterations of
+// a side effect free loop up to deadline, 0 otherwise. _8080 and every BatchInterpreter lane
+// keep their own IdleLoop and memory.
+u64 idle_loop_skip(IdleLoop& loop, const MemoryBus& memory, u16 jump, const LoopRegisters& regs, u64 cycles,
+                   u64 deadline);
+
+// multi instruction idioms the interpreter dispatches as one handler, see _8080::run_fused
+enum Fusion : u8 {
+    FUSION_NONE,
+    FUSION_BLOCK_COPY, // LDAX D / MOV M,A / INX H / INX D / DCR B / JNZ start
+    FUSION_TEST_M, // MOV A,M / ANA A / RZ
+    FUSION_TEST_MEMORY, // LDA a16 / ANA A / RZ
+    FUSION_CALL_RET // CALL a16 to a RET
+};
+
 // size is either 8, 16 or 24 depending on the instruction size
 string get_hex_string(int num);
 
@@ -65,21 +119,41 @@ enum PortType {
 };
 
 class _8080 {
+    friend struct BlockAccess; // generated blocks, see recompiled_block.hpp
+
+    public:
+        // hot state first, the registers share a cache line with the cycle counter and
+        // the interrupt flags (C++17 new keeps the alignment on the heap too)
+        alignas(64) CpuState regs;
+
     private:
-        // screen is the game screen
-        Screen* screen;
-        // window holds info about instructions that are running
-        int window_w = 150;
-        int window_h = 700;
-        int cycles = 0;
-        SDL_Window* window; 
-        SDL_Renderer* renderer;
-        TTF_Font* font;
+        u64 cycles = 0; // since power on, never reset
         bool interrupt_enabled = false;
         bool halted = false;
-        void render();
-        void fill_background();
-        void draw_instructions();
+        // screen is the game screen
+        Screen* screen = nullptr;
+        u64 frames = 0;
+        Scheduler scheduler;
+        RegisterPane* register_pane = nullptr;
+        // io devices and the IN / OUT dispatch tables, unmapped ports read 0
+        PortDevice unmapped_port;
+        InputLatch input_latch;
+        ShiftRegister shift_register;
+        SoundLatch sound_latch{&audio};
+        Watchdog watchdog;
+        PortDevice* in_ports[NUM_PORTS];
+        PortDevice* out_ports[NUM_PORTS];
+        // emulation runs on its own thread in run(), the main thread only sees the frames it
+        // publishes and hands the inputs back through input_mask
+        TripleBuffer* video = nullptr; // created by run(), headless instances never need its 22 KB
+        std::atomic<u8> input_mask{0};
+        std::atomic<bool> emulating{false};
+        std::atomic<bool> screenshot_requested{false}; // F12, the emulation thread takes it
+        void take_screenshot();
+        void emulation_loop();
+        void fill_video_frame(VideoFrame* frame);
+        void render(const VideoFrame& frame);
+        void draw_instructions(u16 pc, const u8* code); // into the disassembly pane
         u8 fetch_byte(); // fetch bytes
         u16 fetch_bytes(); // fetch next 2 bytes
         void execute_instruction(u8 opcode);
@@ -87,6 +161,7 @@ class _8080 {
         void LXI_register(u16* reg); // load next 16 bits in memory into reg specified
         void increment_register(u8* reg, u8* f_reg); // increment given reg and check flags
         void decrement_register(u8* reg, u8* f_reg); // decremtn given reg and check flags
+        void set_result_flags(u8 mask, u8 initial, u16 res); // mask is RESULT_FLAGS or RESULT_FLAGS_NO_CARRY
         void DAD_register(u16* hl, u16* reg_pair, u8* flags); // add value in reg to HL reg pair (modifies the carry flag if there is overflow)
         void add_register(u8* a, u8 val, u8* f_reg); // a (accumulator pointer), val (value being added to a) f_reg (flags reg)
         void subtract_register(u8* a, u8 val, u8* f_reg); // a (accumulator pointer), val (value being subtracted from a) f_reg (flags reg)
@@ -94,29 +169,101 @@ class _8080 {
         void bitwise_XOR_register(u8* a, u8 val, u8* f_reg); // a (accumulator pointer), val (value being added to a) f_reg (flags reg)
         void bitwise_OR_register(u8* a, u8 val, u8* f_reg); // a (accumulator pointer), val (value being added to a) f_reg (flags reg)
         void compare_register(u8* a, u8 val, u8* f_reg); // The specified byte is compared to the contents of the accumulator. The comparison is performed by internally subtracting the contents of REG from the ac- cumulator (leaving both unchanged) and setting the condi- tion bits according to the result.
-        u16 pop_stack(); // get the next 2 bytes from the current location of the sp
         void push_register(u8* first, u8* second); // load in a reg pair onto the stack it expects first and second to the the frist and second reg of theat pair
         void pop_register(u8* first, u8* second); // given 2 bytes that represent a reg pair they are set to the contents of the next 2 bytes in memory referenfced by the sp
         void RET(); // sets the pc = to the top 2 bytes on the stack
         void CALL(u16 memory_address); // (SP-1)<-PC.hi;(SP-2)<-PC.lo;SP<-SP-2;PC=adr
         void JMP(); // jump to next 16 bytes in memory
         void RST(u16 address); // pushes the contents of the pc on the stack and then jumps to a specific memory location specified by the
-        void handle_io(u8 port_num, PortType type, u8* a); // given the port number it can excute appropiate interupt
+        void map_invaders_ports();
+        void schedule_frame(u64 frame); // the screen interrupts of the given frame
+        void run_until(u64 deadline); // run whole instructions until cycles >= deadline
+        bool handle_event(const Event& event); // true at the end of a frame
+        IdleLoop idle;
+        u64 halted_cycles = 0;
+        u64 idle_cycles = 0;
+        void check_idle_loop(u16 jump, u64 deadline);
+        Fusion match_fusion(u16 pc);
+        bool run_fused(u16 pc, u64 deadline, u16* last);
+        Snapshot* run_ahead_state = nullptr; // the real frame while the run-ahead ones are shown, created on first use
+        Audio* run_ahead_audio = nullptr; // detached while running ahead
+        FrameCapture* run_ahead_capture = nullptr;
+        GameStateWatcher* run_ahead_game_state = nullptr;
+        u64 run_ahead_frames = 0;
+        u64 run_ahead_ns = 0; // spent running ahead and rolling back
+        const RecompiledProgram* recompiled = nullptr;
+        vector<const RecompiledBlock*> recompiled_blocks; // indexed by pc - rom_start
+        vector<_8080*> spare_children; // recycled fork() children, deleted with the parent
         void handleCPMCall();
         
     public:
-        Registers* regs;
-        u8* memory;
-        void load_rom(const string& file_path, u16 start_address);
+        // the ROM, RAM and whatever a program writes elsewhere, pages shared copy on write
+        // with the buses it shares, see share_memory
+        MemoryBus memory;
+        Audio* audio = nullptr; // sound ports, nullptr when muted / headless
+        FrameCapture* capture = nullptr; // video capture of every frame, nullptr when off
+        GameStateWatcher* game_state = nullptr; // updated after every frame, nullptr when off
+        bool skip_idle_loops = true; // fast forward side effect free polling loops to the next event
+        bool fuse_instructions = true; // dispatch common idioms as one handler
+        int run_ahead = 0; // frames the game screen is shown ahead of the real state, see begin_run_ahead
+        double speed = 1.0; // run() paces frames at this times 60 a second, 0 runs them unthrottled
+        u64 frame_limit = 0; // run() returns once get_frames() reaches it, 0 for no limit
+        u64 cycle_limit = 0; // run() returns after the frame get_cycles() reaches it in, 0 for no limit
+        InputMovie* replay = nullptr; // run() takes the inputs of every frame from it instead of the keys
+        InputMovie* recording = nullptr; // run() appends the inputs of every frame
+        ostream* test_output = &cout; // BDOS console output of CP/M programs
+        bool load_rom(const string& file_path, u16 start_address);
+        bool load_invaders(const string& folder); // folder must end with a '/' 
+        // the invaders ROM folder (with or without the '/'), or any other ROM image as one file
+        // loaded at PROGRAM_START; the pc starts there either way
+        bool load_program(const string& rom);
+        // memory reads what source's does (ROM, RAM, everything) until either writes a page,
+        // so instances made from one loaded template share its ROM pages
+        void share_memory(_8080& source);
+        bool use_recompiled(const RecompiledProgram* program); // nullptr goes back to the interpreter
+        bool set_scaler(const ScalerConfig& config); // window scaling / effects, no-op when headless
+        void map_port(PortType type, u8 port_num, PortDevice* device); // nullptr unmaps the port
+        void set_inputs(u8 input_bits); // arcade inputs, bit n = inputs[n]
+        u8 get_inputs();
+        u64 get_rom_hash(); // 0x0000 - 0x1FFF
+        void save_state(Snapshot* snapshot); // between run_frame calls only
+        void load_state(const Snapshot& snapshot);
+        // a headless child at this state (between run_frame calls) with the same settings and
+        // the invaders ports, its memory shared copy on write; fork() takes a child handed back
+        // with recycle() when there is one, fork_into reuses a given instance
+        _8080* fork();
+        void fork_into(_8080& child);
+        void recycle(_8080* child); // a finished fork() child, kept for the next fork() instead of deleted
+        // restores <cache_dir>/<rom hash>_<boot_frames>.snap, or runs boot_frames frames from
+        // reset with nothing pressed and writes it; true when it came from the cache
+        bool boot_from_cache(const string& cache_dir, u64 boot_frames);
+        // snapshots the real frame and runs run_ahead more with the current inputs, audio and
+        // capture and game_state detached; show the frame, then end_run_ahead rolls back
+        void begin_run_ahead();
+        void end_run_ahead();
+        double get_run_ahead_cost(); // microseconds per run-ahead frame, snapshot and rollback included
         void run();
+        void run_headless(); // run() without the window, on the calling thread
+        void stop(); // run() / run_headless() return after the current frame, run_test() after the instruction, signal handler safe
+        bool reached_limit(); // frame_limit / cycle_limit
+        void run_frame(); // emulate one frame without rendering or event handling
+        u64 get_cycles();
+        u64 get_frames();
+        u64 get_halted_cycles(); // cycles skipped in HLT
+        u64 get_idle_cycles(); // cycles skipped in idle loops
+        GameState get_game_state(); // the invaders work RAM variables as of now
         void run_test();
+        u64 run_test(u64 instruction_budget); // returns the instructions executed
+        void load_test(const string& file_path); // load a CP/M .COM program at 0x100
+        bool test_finished(); // CP/M program jumped back to the warm boot vector
+        void step_test(); // one CP/M instruction (BDOS calls at 0x0005 are serviced first)
         void check_set_zero_flag(u16 res); // return value of zero flag 
         void check_set_sign_flag(u16 num); // for u16 return value of sign flag
         void check_set_auxilary_flag(u8 num, u16 res); // return value of aux flag after a given operation
         void check_set_parity_flag(u16 num); // return value of parity flag 
         void check_set_carry_flag(u8 initial, u16 result);
         void execute_interrupt(int interupt_type);
-        _8080();
+        _8080(bool headless = false); // headless skips every SDL window / renderer
         ~_8080();
 };
 
@@ -0,0 +1,30 @@
+#ifndef REGISTER_PANE_HPP
+#define REGISTER_PANE_HPP
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_ttf.h>
+#include <cstdint>
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include "cpu_state.hpp"
+
+#define WHITE 0xFFFFFF
+#define BLACK 0x000000
+
+// the registers pane of the main window, draws a copy of the cpu state and owns nothing of it
+// but the font (the disassembly pane uses it too)
+class RegisterPane {
+
+public:
+    RegisterPane();
+    ~RegisterPane();
+
+    TTF_Font* font = nullptr;
+
+    // into the renderer's current viewport, see Screen::registers_pane
+    void render_regs(SDL_Renderer* renderer, CpuState state); // by value, pending lazy flags are synced on the copy
+    static std::string get_hex_string(CpuState& state, int reg_num);
+};
+
+#endif
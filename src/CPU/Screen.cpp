@@ -10,15 +10,53 @@ Screen::Screen() {
     pixels[i] = BACKGROUND_COLOR;
   }
 
-  window = SDL_CreateWindow("Space Invaders Emulator", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,  window_w, window_h, 0);
-
-  // shift the window to appropriate position
-  int window_x;
-  int window_y;
-  SDL_GetWindowPosition(window, &window_x, &window_y);
-  SDL_SetWindowPosition(window, window_x * 1.5, window_y);
+  window = SDL_CreateWindow("Space Invaders Emulator", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,  game_pane.w, game_pane.h, 0);
   renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
-  texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, NUM_OF_COLUMNS, NUM_OF_ROWS);
+  ScalerConfig config;
+  config.scale = SCREEN_SCALER;
+  set_scaler(config);
+}
+
+bool Screen::set_scaler(const ScalerConfig& config) {
+  bool ok = scaler.configure(NUM_OF_COLUMNS, NUM_OF_ROWS, config);
+  pixel_w = pixel_h = scaler.get_config().scale;
+  game_pane.w = scaler.get_out_width();
+  game_pane.h = scaler.get_out_height();
+  if (texture) {
+    SDL_DestroyTexture(texture);
+  }
+  texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, game_pane.w, game_pane.h);
+  layout();
+  const ScalerConfig& used = scaler.get_config();
+  log_info("screen: %dx%d, %dx %s%s%s (%s)", game_pane.w, game_pane.h, used.scale,
+           used.filter == SCALE_EPX ? "epx" : "nearest", used.scanlines ? " + scanlines" : "",
+           used.phosphor ? " + phosphor" : "", simd_level_name(scaler.get_simd_level()));
+  return ok;
+}
+
+void Screen::set_panes(bool disassembly, bool registers) {
+  show_disassembly = disassembly;
+  show_registers = registers;
+  layout();
+}
+
+// left to right: disassembly, registers, game
+void Screen::layout() {
+  int x = 0;
+  window_h = game_pane.h;
+  disassembly_pane = {x, 0, show_disassembly ? DISASSEMBLY_PANE_W : 0, DISASSEMBLY_PANE_H};
+  x += disassembly_pane.w;
+  registers_pane = {x, 0, show_registers ? REGISTERS_PANE_W : 0, REGISTERS_PANE_H};
+  x += registers_pane.w;
+  game_pane.x = x;
+  window_w = x + game_pane.w;
+  if (show_disassembly && DISASSEMBLY_PANE_H > window_h) {
+    window_h = DISASSEMBLY_PANE_H;
+  }
+  if (show_registers && REGISTERS_PANE_H > window_h) {
+    window_h = REGISTERS_PANE_H;
+  }
+  SDL_SetWindowSize(window, window_w, window_h);
 }
 
 int Screen::determine_pixel_color(int bit, int y) {
@@ -38,13 +76,13 @@ int Screen::determine_pixel_color(int bit, int y) {
 }
 
 // note: pixles are draw from bottom left vertially from VRAM
-void Screen::change_pixels(_8080* cpu) {
+void Screen::change_pixels(const u8* vram) {
   int byte_num = 1;
   u8 cur_byte = 0;
   int cur_column = 0;
   int cur_row = NUM_OF_ROWS - 1;
   for (uint16_t address = VRAM_START; address <= VRAM_END; address++) {
-    cur_byte = cpu->memory[address];
+    cur_byte = vram[address - VRAM_START];
     for (int i = 0; i < 8; i++) {
       int bit = (cur_byte >> i) & 1;
       int row = cur_row - i;
@@ -59,11 +97,31 @@ void Screen::change_pixels(_8080* cpu) {
   }
 }
 
-void Screen::render_screen(_8080* cpu) {
+void Screen::begin_frame() {
+  set_viewport(nullptr);
+  SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
   SDL_RenderClear(renderer);
-  change_pixels(cpu);
-  SDL_UpdateTexture(texture, NULL, pixels, NUM_OF_COLUMNS * sizeof(u32));
+  SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
+}
+
+void Screen::render_screen(const u8* vram) {
+  change_pixels(vram);
+  void* out;
+  int pitch;
+  if (SDL_LockTexture(texture, NULL, &out, &pitch) == 0) {
+    scaler.process(pixels, (u32*) out, pitch / sizeof(u32));
+    SDL_UnlockTexture(texture);
+  }
+  set_viewport(&game_pane);
   SDL_RenderCopy(renderer, texture, NULL, NULL);
+}
+
+void Screen::set_viewport(const SDL_Rect* pane) {
+  SDL_RenderSetViewport(renderer, pane);
+}
+
+void Screen::present() {
+  set_viewport(nullptr);
   SDL_RenderPresent(renderer);
 }
 
@@ -2,6 +2,7 @@
 #define SCREEN_HPP
 
 #include "8080.hpp"
+#include "scaler.hpp"
 #include <SDL2/SDL.h>
 #include <cstdint>
 #include <iostream>
@@ -26,29 +27,52 @@
 #define ENEMIES_CUTOFF 155
 #define TOP_CUTOFF 55
 
+// debug panes left of the game, the font is 20 px a line
+#define DISASSEMBLY_PANE_W 150
+#define DISASSEMBLY_PANE_H 700
+#define REGISTERS_PANE_W 100
+#define REGISTERS_PANE_H 330
+
 using u8 = std::uint8_t;
 using u32 = std::uint32_t;
 
 class _8080;
 
+// The emulator's only window. The disassembly, registers and game panes sit side by side
+// (the debug ones can be toggled) and are drawn through viewports of one renderer, with one
+// present per frame: begin_frame, render_screen and the panes, then present.
 class Screen {
   public:
     // pixels
     int pixel_w = 1 * SCREEN_SCALER;
     int pixel_h = 1 * SCREEN_SCALER;
-    int window_w = NUM_OF_COLUMNS* SCREEN_SCALER;
-    int window_h = NUM_OF_ROWS * SCREEN_SCALER;
+    int window_w = 0;
+    int window_h = 0;
     SDL_Window* window = nullptr;
     SDL_Renderer* renderer = nullptr;
+    SDL_Rect game_pane = {0, 0, NUM_OF_COLUMNS * SCREEN_SCALER, NUM_OF_ROWS * SCREEN_SCALER};
+    SDL_Rect disassembly_pane = {0, 0, 0, 0};
+    SDL_Rect registers_pane = {0, 0, 0, 0};
+    bool show_disassembly = true;
+    bool show_registers = true;
     Screen();
     ~Screen();
     int determine_pixel_color(int bit, int y);
-    void change_pixels(_8080* cpu);
-    void render_screen(_8080* cpu);
+    void change_pixels(const u8* vram); // the 1bpp VRAM (VRAM_START - VRAM_END)
+    void begin_frame(); // clears the whole window
+    void render_screen(const u8* vram); // into game_pane
+    void set_viewport(const SDL_Rect* pane); // nullptr for the whole window
+    void present();
+    void set_panes(bool disassembly, bool registers); // resizes the window around the panes shown
+    // the frame is scaled on the CPU into a streaming texture of the game pane's size, SDL
+    // only copies it 1:1
+    bool set_scaler(const ScalerConfig& config);
 
   private:
     SDL_Texture* texture = nullptr;  
     u32* pixels = nullptr;
+    Scaler scaler;
+    void layout();
 
 };
 
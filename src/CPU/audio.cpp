@@ -0,0 +1,286 @@
+#include "audio.hpp"
+#include <string.h>
+#include "log.hpp"
+
+// port bit -> sample, -1 for bits that are not a sound
+static const int port3_samples[8] = {SAMPLE_UFO, SAMPLE_SHOT, SAMPLE_PLAYER_DIE, SAMPLE_INVADER_DIE, SAMPLE_EXTENDED_PLAY, -1, -1, -1};
+static const int port5_samples[8] = {SAMPLE_FLEET_1, SAMPLE_FLEET_2, SAMPLE_FLEET_3, SAMPLE_FLEET_4, SAMPLE_UFO_HIT, -1, -1, -1};
+
+// ring ///////////////////////////////////////////////////////////////////////
+
+int SampleRing::push(const s16* samples, int count) {
+  uint32_t write = head.load(std::memory_order_relaxed);
+  uint32_t read = tail.load(std::memory_order_acquire);
+  int space = AUDIO_RING_SIZE - (int) (write - read);
+  if (count > space) {
+    count = space;
+  }
+  for (int i = 0; i < count; i++) {
+    buffer[(write + i) & (AUDIO_RING_SIZE - 1)] = samples[i];
+  }
+  head.store(write + count, std::memory_order_release);
+  return count;
+}
+
+int SampleRing::pop(s16* samples, int count) {
+  uint32_t read = tail.load(std::memory_order_relaxed);
+  uint32_t write = head.load(std::memory_order_acquire);
+  int available = (int) (write - read);
+  if (count > available) {
+    count = available;
+  }
+  for (int i = 0; i < count; i++) {
+    samples[i] = buffer[(read + i) & (AUDIO_RING_SIZE - 1)];
+  }
+  tail.store(read + count, std::memory_order_release);
+  return count;
+}
+
+// wav files //////////////////////////////////////////////////////////////////
+
+static uint32_t read_u32(const u8* bytes) {
+  return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((uint32_t) bytes[3] << 24);
+}
+
+static uint16_t read_u16(const u8* bytes) {
+  return bytes[0] | (bytes[1] << 8);
+}
+
+// loads an 8 or 16 bit PCM wav as mono s16 at AUDIO_RATE
+bool load_wav(const std::string& file_path, std::vector<s16>* samples) {
+  FILE* file = fopen(file_path.c_str(), "rb");
+  if (!file) {
+    return false;
+  }
+  std::vector<u8> bytes;
+  u8 chunk[4096];
+  size_t read;
+  while ((read = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+    bytes.insert(bytes.end(), chunk, chunk + read);
+  }
+  fclose(file);
+
+  if (bytes.size() < 12 || memcmp(&bytes[0], "RIFF", 4) != 0 || memcmp(&bytes[8], "WAVE", 4) != 0) {
+    return false;
+  }
+
+  uint16_t channels = 0;
+  uint32_t rate = 0;
+  uint16_t bits = 0;
+  const u8* data = nullptr;
+  uint32_t data_size = 0;
+  size_t offset = 12;
+  while (offset + 8 <= bytes.size()) {
+    uint32_t size = read_u32(&bytes[offset + 4]);
+    const u8* body = &bytes[offset + 8];
+    if (offset + 8 + size > bytes.size()) {
+      size = bytes.size() - offset - 8;
+    }
+    if (memcmp(&bytes[offset], "fmt ", 4) == 0 && size >= 16) {
+      if (read_u16(body) != 1) {
+        return false; // only plain PCM
+      }
+      channels = read_u16(body + 2);
+      rate = read_u32(body + 4);
+      bits = read_u16(body + 14);
+    } else if (memcmp(&bytes[offset], "data", 4) == 0) {
+      data = body;
+      data_size = size;
+    }
+    offset += 8 + size + (size & 1);
+  }
+  if (!data || channels == 0 || rate == 0 || (bits != 8 && bits != 16)) {
+    return false;
+  }
+
+  // down mix to mono s16
+  int frame_bytes = channels * (bits / 8);
+  size_t frames = data_size / frame_bytes;
+  std::vector<s16> mono(frames);
+  for (size_t i = 0; i < frames; i++) {
+    int sum = 0;
+    for (int c = 0; c < channels; c++) {
+      const u8* sample = data + i * frame_bytes + c * (bits / 8);
+      sum += bits == 8 ? (int(sample[0]) - 128) << 8 : int16_t(read_u16(sample));
+    }
+    mono[i] = sum / channels;
+  }
+
+  // linear resample to the mixer rate
+  size_t out_frames = (size_t) ((uint64_t) frames * AUDIO_RATE / rate);
+  samples->resize(out_frames);
+  for (size_t i = 0; i < out_frames; i++) {
+    double position = (double) i * rate / AUDIO_RATE;
+    size_t index = (size_t) position;
+    double fraction = position - index;
+    s16 a = mono[index];
+    s16 b = index + 1 < frames ? mono[index + 1] : a;
+    (*samples)[i] = (s16) (a + (b - a) * fraction);
+  }
+  return true;
+}
+
+// audio //////////////////////////////////////////////////////////////////////
+
+Audio::Audio() {
+  voices[SAMPLE_UFO].looping = true;
+}
+
+Audio::~Audio() {
+  if (device) {
+    SDL_CloseAudioDevice(device);
+  }
+  close_wav_dump();
+}
+
+bool Audio::load_samples(const std::string& folder) {
+  bool all_loaded = true;
+  for (int i = 0; i < NUM_SAMPLES; i++) {
+    std::string path = folder + std::to_string(i) + ".wav";
+    if (!load_wav(path, &voices[i].sample)) {
+      log_warn("could not load sound sample %s", path.c_str());
+      all_loaded = false;
+    }
+  }
+  return all_loaded;
+}
+
+bool Audio::open_device() {
+  if (SDL_InitSubSystem(SDL_INIT_AUDIO) != 0) {
+    log_warn("could not initialize SDL audio: %s", SDL_GetError());
+    return false;
+  }
+  SDL_AudioSpec wanted;
+  memset(&wanted, 0, sizeof(wanted));
+  wanted.freq = AUDIO_RATE;
+  wanted.format = AUDIO_S16SYS;
+  wanted.channels = 1;
+  wanted.samples = AUDIO_DEVICE_SAMPLES;
+  wanted.callback = audio_callback;
+  wanted.userdata = this;
+
+  device = SDL_OpenAudioDevice(NULL, 0, &wanted, NULL, 0);
+  if (!device) {
+    log_warn("could not open audio device: %s", SDL_GetError());
+    return false;
+  }
+  SDL_PauseAudioDevice(device, 0);
+  return true;
+}
+
+bool Audio::open_wav_dump(const std::string& file_path) {
+  close_wav_dump();
+  wav_file = fopen(file_path.c_str(), "wb");
+  if (!wav_file) {
+    log_error("could not open %s", file_path.c_str());
+    return false;
+  }
+  // sizes are patched in close_wav_dump
+  u8 header[44] = {'R', 'I', 'F', 'F', 0, 0, 0, 0, 'W', 'A', 'V', 'E',
+                   'f', 'm', 't', ' ', 16, 0, 0, 0, 1, 0, 1, 0,
+                   AUDIO_RATE & 0xFF, (AUDIO_RATE >> 8) & 0xFF, 0, 0,
+                   (AUDIO_RATE * 2) & 0xFF, ((AUDIO_RATE * 2) >> 8) & 0xFF, ((AUDIO_RATE * 2) >> 16) & 0xFF, 0,
+                   2, 0, 16, 0, 'd', 'a', 't', 'a', 0, 0, 0, 0};
+  fwrite(header, 1, sizeof(header), wav_file);
+  wav_samples = 0;
+  return true;
+}
+
+void Audio::close_wav_dump() {
+  if (!wav_file) {
+    return;
+  }
+  uint32_t data_size = wav_samples * sizeof(s16);
+  uint32_t riff_size = 36 + data_size;
+  fseek(wav_file, 4, SEEK_SET);
+  fwrite(&riff_size, 4, 1, wav_file);
+  fseek(wav_file, 40, SEEK_SET);
+  fwrite(&data_size, 4, 1, wav_file);
+  fclose(wav_file);
+  wav_file = nullptr;
+}
+
+void Audio::trigger(int sample, bool looping) {
+  Voice& voice = voices[sample];
+  voice.position = 0;
+  voice.playing = true;
+  voice.looping = looping;
+}
+
+void Audio::stop(int sample) {
+  voices[sample].playing = false;
+}
+
+// sounds start on the rising edge of their bit
+void Audio::trigger_rising(u8 old_bits, u8 new_bits, const int* samples) {
+  u8 rising = new_bits & ~old_bits;
+  for (int bit = 0; bit < 8; bit++) {
+    if (samples[bit] >= 0 && (rising & (1 << bit))) {
+      trigger(samples[bit], samples[bit] == SAMPLE_UFO);
+    }
+  }
+}
+
+void Audio::write_sound1(u8 value) {
+  trigger_rising(port3, value, port3_samples);
+  // the ufo loops until its bit is cleared
+  if ((port3 & (1 << SND_UFO)) && !(value & (1 << SND_UFO))) {
+    stop(SAMPLE_UFO);
+  }
+  port3 = value;
+}
+
+void Audio::write_sound2(u8 value) {
+  trigger_rising(port5, value, port5_samples);
+  port5 = value;
+}
+
+void Audio::end_frame() {
+  bool amp_enabled = port3 & (1 << SND_AMP_ENABLE);
+  for (int i = 0; i < AUDIO_SAMPLES_PER_FRAME; i++) {
+    int mixed = 0;
+    for (int v = 0; v < NUM_SAMPLES; v++) {
+      Voice& voice = voices[v];
+      if (!voice.playing || voice.sample.empty()) {
+        continue;
+      }
+      mixed += voice.sample[voice.position++];
+      if (voice.position >= voice.sample.size()) {
+        voice.position = 0;
+        voice.playing = voice.looping;
+      }
+    }
+    if (!amp_enabled) {
+      mixed = 0;
+    }
+    frame[i] = mixed > 32767 ? 32767 : (mixed < -32768 ? -32768 : mixed);
+  }
+
+  if (wav_file) {
+    fwrite(frame, sizeof(s16), AUDIO_SAMPLES_PER_FRAME, wav_file);
+    wav_samples += AUDIO_SAMPLES_PER_FRAME;
+  }
+  if (device) {
+    dropped_samples += AUDIO_SAMPLES_PER_FRAME - ring.push(frame, AUDIO_SAMPLES_PER_FRAME);
+  }
+}
+
+uint64_t Audio::get_underruns() {
+  return underruns.load();
+}
+
+uint64_t Audio::get_dropped_samples() {
+  return dropped_samples;
+}
+
+// runs on the SDL audio thread
+void Audio::audio_callback(void* userdata, Uint8* stream, int length) {
+  Audio* audio = (Audio*) userdata;
+  s16* samples = (s16*) stream;
+  int count = length / sizeof(s16);
+  int available = audio->ring.pop(samples, count);
+  if (available < count) {
+    memset(samples + available, 0, (count - available) * sizeof(s16));
+    audio->underruns.fetch_add(1, std::memory_order_relaxed);
+  }
+}
@@ -0,0 +1,109 @@
+#ifndef AUDIO_HPP
+#define AUDIO_HPP
+
+#include <SDL2/SDL.h>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Space Invaders sound hardware. The discrete sound board is triggered by the bits of
+// output ports 3 and 5, we play the usual recorded sample set (0.wav - 9.wav) instead.
+//
+// The emulation thread edge-detects the port bits and mixes one frame of audio at a time
+// into a lock-free single producer / single consumer ring that the SDL audio callback
+// drains. Neither side ever blocks: a full ring drops samples, an empty ring plays
+// silence and counts an underrun.
+
+#define SAMPLE_FOLDER "../invaders/sounds/"
+#define AUDIO_RATE 44100
+#define AUDIO_FRAMES_PER_SECOND 60
+#define AUDIO_SAMPLES_PER_FRAME (AUDIO_RATE / AUDIO_FRAMES_PER_SECOND)
+#define AUDIO_RING_SIZE 8192 // power of 2, ~185ms
+#define AUDIO_DEVICE_SAMPLES 512
+
+// SOUND1 (port 3) bits
+#define SND_UFO 0 // loops while the bit is set
+#define SND_SHOT 1
+#define SND_PLAYER_DIE 2
+#define SND_INVADER_DIE 3
+#define SND_EXTENDED_PLAY 4
+#define SND_AMP_ENABLE 5
+
+// SOUND2 (port 5) bits
+#define SND_FLEET_1 0
+#define SND_FLEET_2 1
+#define SND_FLEET_3 2
+#define SND_FLEET_4 3
+#define SND_UFO_HIT 4
+
+// sample numbers of the sample set
+#define SAMPLE_UFO 0
+#define SAMPLE_SHOT 1
+#define SAMPLE_PLAYER_DIE 2
+#define SAMPLE_INVADER_DIE 3
+#define SAMPLE_FLEET_1 4
+#define SAMPLE_FLEET_2 5
+#define SAMPLE_FLEET_3 6
+#define SAMPLE_FLEET_4 7
+#define SAMPLE_UFO_HIT 8
+#define SAMPLE_EXTENDED_PLAY 9
+#define NUM_SAMPLES 10
+
+using u8 = std::uint8_t;
+using s16 = std::int16_t;
+
+// lock-free ring, push only from the emulation thread and pop only from the audio thread
+class SampleRing {
+  public:
+    int push(const s16* samples, int count); // returns how many fit
+    int pop(s16* samples, int count); // returns how many were available
+
+  private:
+    s16 buffer[AUDIO_RING_SIZE];
+    std::atomic<uint32_t> head{0}; // written by the producer
+    std::atomic<uint32_t> tail{0}; // written by the consumer
+};
+
+struct Voice {
+  std::vector<s16> sample;
+  size_t position = 0;
+  bool playing = false;
+  bool looping = false;
+};
+
+class Audio {
+  public:
+    Audio();
+    ~Audio();
+    bool load_samples(const std::string& folder = SAMPLE_FOLDER);
+    bool open_device(); // SDL audio output
+    bool open_wav_dump(const std::string& file_path); // headless output
+    void write_sound1(u8 value); // OUT 3
+    void write_sound2(u8 value); // OUT 5
+    void end_frame(); // mix one emulated frame of audio
+    uint64_t get_underruns();
+    uint64_t get_dropped_samples();
+
+  private:
+    Voice voices[NUM_SAMPLES];
+    u8 port3 = 0;
+    u8 port5 = 0;
+    SampleRing ring;
+    s16 frame[AUDIO_SAMPLES_PER_FRAME];
+    SDL_AudioDeviceID device = 0;
+    FILE* wav_file = nullptr;
+    uint32_t wav_samples = 0;
+    std::atomic<uint64_t> underruns{0};
+    uint64_t dropped_samples = 0;
+    void trigger_rising(u8 old_bits, u8 new_bits, const int* samples);
+    void trigger(int sample, bool looping);
+    void stop(int sample);
+    void close_wav_dump();
+    static void audio_callback(void* userdata, Uint8* stream, int length);
+};
+
+bool load_wav(const std::string& file_path, std::vector<s16>* samples);
+
+#endif
@@ -0,0 +1,893 @@
+#include "batch.hpp"
+#include "8080.hpp"
+#include <algorithm>
+#include <string.h>
+
+// x86-64 code always has SSE2, the lanes get a second copy compiled for AVX2 that is only
+// called when the CPU has it
+#if defined(__x86_64__) && defined(__GNUC__)
+#define BATCH_X86
+#define AVX2_TARGET __attribute__((target("avx2")))
+#endif
+
+// the instruction bodies are inlined into each copy of the lane loop
+#ifdef __GNUC__
+#define LANES_INLINE inline __attribute__((always_inline))
+#else
+#define LANES_INLINE inline
+#endif
+
+// register slots, the opcode encoding's order
+#define LANE_B 0
+#define LANE_C 1
+#define LANE_D 2
+#define LANE_E 3
+#define LANE_H 4
+#define LANE_L 5
+#define LANE_M 6 // memory at HL in the encoding, the flags array takes the slot
+#define LANE_F 6
+#define LANE_A 7
+
+#define SP_PAIR 3 // rp = 3 in LXI / DAD / INX / DCX
+#define PSW_PAIR 3 // rp = 3 in PUSH / POP
+
+// runs the statements for every lane of the call, lane indexes the register arrays and i
+// the call's scratch buffers
+#define FOR_LANES(...) \
+  for (int i = 0; i < count; i++) { \
+    [[maybe_unused]] int lane = ALL ? i : list[i]; \
+    __VA_ARGS__ \
+  }
+
+// condition code (bits 3 - 5 of Jcc / Ccc / Rcc) / 2 -> the flag it tests, odd codes test for 1
+static const int condition_flags[4] = {ZERO_POS, CARRY_POS, PARITY_POS, SIGN_POS};
+
+// the only instructions that can leave the lanes at different pcs or cycle counts
+static inline bool may_diverge(u8 opcode) {
+  return opcode == 0x76 || opcode == 0xC9 || opcode == 0xD9 || opcode == 0xE9 || (opcode & 0xC7) == 0xC0 ||
+         (opcode & 0xC7) == 0xC2 || (opcode & 0xC7) == 0xC4;
+}
+
+BatchInterpreter::BatchInterpreter(int lanes) {
+  this->lanes = std::max(1, std::min(lanes, 0xFFFF));
+  for (std::vector<u8>& slot : reg) {
+    slot.assign(this->lanes, 0);
+  }
+  pc.assign(this->lanes, 0);
+  sp.assign(this->lanes, 0);
+  cycles.assign(this->lanes, 0);
+  halted_cycles.assign(this->lanes, 0);
+  idle_cycles.assign(this->lanes, 0);
+  idle.assign(this->lanes, IdleLoop());
+  interrupt_enabled.assign(this->lanes, 0);
+  halted.assign(this->lanes, 0);
+  input_bits.assign(this->lanes, 0);
+  input_port.assign(this->lanes, 0);
+  shift_value.assign(this->lanes, 0);
+  shift_offset.assign(this->lanes, 0);
+  shift_result.assign(this->lanes, 0);
+  sound1.assign(this->lanes, 0);
+  sound2.assign(this->lanes, 0);
+  memory = std::vector<MemoryBus>(this->lanes);
+  active.resize(this->lanes);
+  group.resize(this->lanes);
+  operand.resize(this->lanes);
+}
+
+BatchInterpreter::~BatchInterpreter() {}
+
+int BatchInterpreter::get_lanes() {
+  return lanes;
+}
+
+void BatchInterpreter::set_simd_level(SimdLevel level) {
+  simd = std::min(level, detect_simd_level());
+}
+
+SimdLevel BatchInterpreter::get_simd_level() {
+  return simd;
+}
+
+void BatchInterpreter::set_lockstep(bool lockstep) {
+  this->lockstep = lockstep;
+}
+
+// state //////////////////////////////////////////////////////////////////////
+
+void BatchInterpreter::load(MemoryBus& image, const Snapshot& snapshot) {
+  for (MemoryBus& lane : memory) {
+    lane.share(image);
+  }
+  rom_shared = true;
+  frames = snapshot.frames;
+  for (int lane = 0; lane < lanes; lane++) {
+    load_state(lane, snapshot);
+  }
+  together = check_together();
+}
+
+bool BatchInterpreter::load_state(int lane, const Snapshot& snapshot) {
+  if (snapshot.frames != frames) {
+    return false;
+  }
+  CpuState regs = snapshot.regs;
+  regs.sync_flags();
+  reg[LANE_A][lane] = regs.a;
+  reg[LANE_F][lane] = regs.f;
+  reg[LANE_B][lane] = regs.b;
+  reg[LANE_C][lane] = regs.c;
+  reg[LANE_D][lane] = regs.d;
+  reg[LANE_E][lane] = regs.e;
+  reg[LANE_H][lane] = regs.h;
+  reg[LANE_L][lane] = regs.l;
+  pc[lane] = regs.pc;
+  sp[lane] = regs.sp;
+  cycles[lane] = snapshot.cycles;
+  halted_cycles[lane] = snapshot.halted_cycles;
+  idle_cycles[lane] = snapshot.idle_cycles;
+  idle[lane] = IdleLoop();
+  interrupt_enabled[lane] = snapshot.interrupt_enabled;
+  halted[lane] = snapshot.halted;
+  set_inputs(lane, snapshot.ports.input_bits);
+  shift_value[lane] = snapshot.ports.shift_value;
+  shift_offset[lane] = snapshot.ports.shift_offset;
+  shift_result[lane] = ((shift_value[lane] << shift_offset[lane]) >> 8) & 0xFF;
+  sound1[lane] = snapshot.ports.sound1;
+  sound2[lane] = snapshot.ports.sound2;
+  memory[lane].write_block(RAM_START, snapshot.ram, RAM_BYTES);
+  together = false;
+  return true;
+}
+
+void BatchInterpreter::save_state(int lane, Snapshot* snapshot) {
+  CpuState regs;
+  regs.a = reg[LANE_A][lane];
+  regs.f = reg[LANE_F][lane];
+  regs.b = reg[LANE_B][lane];
+  regs.c = reg[LANE_C][lane];
+  regs.d = reg[LANE_D][lane];
+  regs.e = reg[LANE_E][lane];
+  regs.h = reg[LANE_H][lane];
+  regs.l = reg[LANE_L][lane];
+  regs.pc = pc[lane];
+  regs.sp = sp[lane];
+  snapshot->regs = regs;
+  snapshot->cycles = cycles[lane];
+  snapshot->frames = frames;
+  snapshot->halted_cycles = halted_cycles[lane];
+  snapshot->idle_cycles = idle_cycles[lane];
+  snapshot->interrupt_enabled = interrupt_enabled[lane];
+  snapshot->halted = halted[lane];
+  snapshot->ports.input_bits = input_bits[lane];
+  snapshot->ports.shift_value = shift_value[lane];
+  snapshot->ports.shift_offset = shift_offset[lane];
+  snapshot->ports.sound1 = sound1[lane];
+  snapshot->ports.sound2 = sound2[lane];
+  memory[lane].read_block(RAM_START, snapshot->ram, RAM_BYTES);
+}
+
+// the port byte comes from the same latch the scalar core reads
+void BatchInterpreter::set_inputs(int lane, u8 input_bits) {
+  InputLatch latch;
+  latch.set_inputs(input_bits);
+  this->input_bits[lane] = input_bits;
+  input_port[lane] = latch.read(INP1);
+}
+
+MemoryBus& BatchInterpreter::lane_memory(int lane) {
+  return memory[lane];
+}
+
+u64 BatchInterpreter::get_frames() {
+  return frames;
+}
+
+u64 BatchInterpreter::get_cycles(int lane) {
+  return cycles[lane];
+}
+
+double BatchInterpreter::get_lanes_per_step() {
+  return steps ? (double) lane_steps / steps : 0;
+}
+
+// instructions ///////////////////////////////////////////////////////////////
+
+// One instruction for the lanes in list (every lane when ALL), which are all at pc at
+// with the same code bytes there: opcode and word, the two bytes after it. With ALL the
+// loops run over whole arrays and vectorize, memory is a gather either way.
+template <bool ALL>
+LANES_INLINE bool BatchInterpreter::execute(u8 opcode, u16 at, u16 word, const u16* list, int count) {
+  u8* r[8];
+  for (int slot = 0; slot < 8; slot++) {
+    r[slot] = reg[slot].data();
+  }
+  u8* a = r[LANE_A];
+  u8* f = r[LANE_F];
+  u8* h = r[LANE_H];
+  u8* l = r[LANE_L];
+  u16* pcs = pc.data();
+  u16* sps = sp.data();
+  u64* cyc = cycles.data();
+  MemoryBus* mem = memory.data();
+  u8* value = operand.data();
+  u8 imm = word & 0xFF;
+  bool rom_write = false;
+
+  auto read = [mem](int lane, u16 address) -> u8 {
+    return mem[lane][address];
+  };
+  auto write = [mem, &rom_write](int lane, u16 address, u8 byte) {
+    mem[lane].write(address, byte);
+    rom_write |= address < RAM_START;
+  };
+  auto hl = [h, l](int lane) -> u16 {
+    return (h[lane] << 8) | l[lane];
+  };
+  auto push = [&](int lane, u16 word) {
+    sps[lane] -= 2;
+    write(lane, sps[lane], word & 0xFF);
+    write(lane, sps[lane] + 1, word >> 8);
+  };
+  auto pop = [&](int lane) -> u16 {
+    u16 word = read(lane, sps[lane]) | (read(lane, sps[lane] + 1) << 8);
+    sps[lane] += 2;
+    return word;
+  };
+
+  // everything that isn't a branch ends up at the shared next pc
+  u16 next = at + 1;
+  int cost = 4;
+  bool branched = false;
+
+  if (opcode >= 0x40 && opcode < 0x80 && opcode != 0x76) {
+    // MOV
+    int dst = (opcode >> 3) & 7;
+    int src = opcode & 7;
+    if (src == LANE_M) {
+      u8* to = r[dst];
+      FOR_LANES(to[lane] = read(lane, hl(lane));)
+      cost = 7;
+    } else if (dst == LANE_M) {
+      u8* from = r[src];
+      FOR_LANES(write(lane, hl(lane), from[lane]);)
+      cost = 7;
+    } else {
+      u8* to = r[dst];
+      u8* from = r[src];
+      if (dst != src) {
+        FOR_LANES(to[lane] = from[lane];)
+      }
+      cost = 5;
+    }
+  } else if ((opcode >= 0x80 && opcode < 0xC0) || (opcode & 0xC7) == 0xC6) {
+    // ADD ADC SUB SBB ANA XRA ORA CMP with a register, M or an immediate
+    int operation = (opcode >> 3) & 7;
+    int src = opcode & 7;
+    if (opcode >= 0xC0 || src == LANE_M) {
+      cost = 7;
+    }
+    if (opcode >= 0xC0) {
+      FOR_LANES(value[i] = imm;)
+      next = at + 2;
+    } else if (src == LANE_M) {
+      FOR_LANES(value[i] = read(lane, hl(lane));)
+    } else {
+      u8* from = r[src];
+      FOR_LANES(value[i] = from[lane];)
+    }
+    // the carry goes into the operand before the add / subtract, like the scalar core
+    if (operation == 1 || operation == 3) {
+      FOR_LANES(value[i] += f[lane] & 1;)
+    }
+    switch (operation) {
+      case 0:
+      case 1:
+        FOR_LANES(
+          u16 res = a[lane] + value[i];
+          f[lane] = (f[lane] & ~RESULT_FLAGS) | CpuState::result_flags(a[lane], res);
+          a[lane] = res;
+        )
+        break;
+      case 2:
+      case 3:
+        FOR_LANES(
+          u16 res = (u16) (a[lane] - value[i]);
+          f[lane] = (f[lane] & ~RESULT_FLAGS) | CpuState::result_flags(a[lane], res);
+          a[lane] = res;
+        )
+        break;
+      case 4:
+        FOR_LANES(
+          u8 res = a[lane] & value[i];
+          f[lane] = (f[lane] & ~RESULT_FLAGS) | CpuState::result_flags(a[lane], res);
+          a[lane] = res;
+        )
+        break;
+      case 5:
+        FOR_LANES(
+          u8 res = a[lane] ^ value[i];
+          f[lane] = (f[lane] & ~RESULT_FLAGS) | CpuState::result_flags(a[lane], res);
+          a[lane] = res;
+        )
+        break;
+      case 6:
+        FOR_LANES(
+          u8 res = a[lane] | value[i];
+          f[lane] = (f[lane] & ~RESULT_FLAGS) | CpuState::result_flags(a[lane], res);
+          a[lane] = res;
+        )
+        break;
+      case 7:
+        FOR_LANES(
+          u16 res = (u16) (a[lane] - value[i]);
+          f[lane] = (f[lane] & ~RESULT_FLAGS) | CpuState::result_flags(a[lane], res);
+        )
+        break;
+    }
+  } else if (opcode < 0x40 && (opcode & 7) >= 4 && (opcode & 7) <= 6) {
+    // INR / DCR / MVI
+    int slot = (opcode >> 3) & 7;
+    int kind = opcode & 7;
+    if (slot == LANE_M) {
+      cost = 10;
+      if (kind == 4) {
+        FOR_LANES(
+          u16 address = hl(lane);
+          u8 initial = read(lane, address);
+          u16 res = initial + 1;
+          f[lane] = (f[lane] & ~RESULT_FLAGS_NO_CARRY) | (CpuState::result_flags(initial, res) & RESULT_FLAGS_NO_CARRY);
+          write(lane, address, res);
+        )
+      } else if (kind == 5) {
+        FOR_LANES(
+          u16 address = hl(lane);
+          u8 initial = read(lane, address);
+          u8 res = initial - 1;
+          f[lane] = (f[lane] & ~RESULT_FLAGS_NO_CARRY) | (CpuState::result_flags(initial, res) & RESULT_FLAGS_NO_CARRY);
+          write(lane, address, res);
+        )
+      } else {
+        FOR_LANES(write(lane, hl(lane), imm);)
+        next = at + 2;
+      }
+    } else {
+      u8* to = r[slot];
+      cost = 5;
+      if (kind == 4) {
+        FOR_LANES(
+          u8 initial = to[lane];
+          u16 res = initial + 1;
+          f[lane] = (f[lane] & ~RESULT_FLAGS_NO_CARRY) | (CpuState::result_flags(initial, res) & RESULT_FLAGS_NO_CARRY);
+          to[lane] = res;
+        )
+      } else if (kind == 5) {
+        FOR_LANES(
+          u8 initial = to[lane];
+          u8 res = initial - 1;
+          f[lane] = (f[lane] & ~RESULT_FLAGS_NO_CARRY) | (CpuState::result_flags(initial, res) & RESULT_FLAGS_NO_CARRY);
+          to[lane] = res;
+        )
+      } else {
+        FOR_LANES(to[lane] = imm;)
+        cost = 7;
+        next = at + 2;
+      }
+    }
+  } else if (opcode < 0x40 && ((opcode & 0xF) == 0x1 || (opcode & 0xF) == 0x3 || (opcode & 0xF) == 0x9 ||
+                               (opcode & 0xF) == 0xB)) {
+    // LXI / INX / DAD / DCX on a register pair
+    int pair = (opcode >> 4) & 3;
+    u8* high = r[2 * pair];
+    u8* low = r[2 * pair + 1];
+    switch (opcode & 0xF) {
+      case 0x1:
+        if (pair == SP_PAIR) {
+          FOR_LANES(sps[lane] = word;)
+        } else {
+          FOR_LANES(high[lane] = word >> 8; low[lane] = word & 0xFF;)
+        }
+        cost = 10;
+        next = at + 3;
+        break;
+      case 0x3:
+      case 0xB: {
+        u16 step = (opcode & 0xF) == 0x3 ? 1 : 0xFFFF;
+        if (pair == SP_PAIR) {
+          FOR_LANES(sps[lane] += step;)
+        } else {
+          FOR_LANES(
+            u16 res = ((high[lane] << 8) | low[lane]) + step;
+            high[lane] = res >> 8;
+            low[lane] = res & 0xFF;
+          )
+        }
+        cost = 5;
+        break;
+      }
+      case 0x9:
+        FOR_LANES(
+          u32 added = pair == SP_PAIR ? sps[lane] : ((high[lane] << 8) | low[lane]);
+          u32 res = hl(lane) + added;
+          h[lane] = (res >> 8) & 0xFF;
+          l[lane] = res & 0xFF;
+          f[lane] = (f[lane] & ~(1 << CARRY_POS)) | (res > 0xFFFF);
+        )
+        cost = 10;
+        break;
+    }
+  } else {
+    switch (opcode) {
+      // NOP and the undocumented ones
+      case 0x00: case 0x08: case 0x10: case 0x18: case 0x20: case 0x28: case 0x30: case 0x38:
+        break;
+      // STAX / LDAX
+      case 0x02:
+      case 0x12: {
+        u8* high = r[opcode == 0x02 ? LANE_B : LANE_D];
+        u8* low = r[opcode == 0x02 ? LANE_C : LANE_E];
+        FOR_LANES(write(lane, (high[lane] << 8) | low[lane], a[lane]);)
+        cost = 7;
+        break;
+      }
+      case 0x0A:
+      case 0x1A: {
+        u8* high = r[opcode == 0x0A ? LANE_B : LANE_D];
+        u8* low = r[opcode == 0x0A ? LANE_C : LANE_E];
+        FOR_LANES(a[lane] = read(lane, (high[lane] << 8) | low[lane]);)
+        cost = 7;
+        break;
+      }
+      // SHLD / LHLD / STA / LDA
+      case 0x22:
+        FOR_LANES(write(lane, word, l[lane]); write(lane, word + 1, h[lane]);)
+        cost = 16;
+        next = at + 3;
+        break;
+      case 0x2A:
+        FOR_LANES(l[lane] = read(lane, word); h[lane] = read(lane, word + 1);)
+        cost = 16;
+        next = at + 3;
+        break;
+      case 0x32:
+        FOR_LANES(write(lane, word, a[lane]);)
+        cost = 13;
+        next = at + 3;
+        break;
+      case 0x3A:
+        FOR_LANES(a[lane] = read(lane, word);)
+        cost = 13;
+        next = at + 3;
+        break;
+      // RLC / RRC / RAL / RAR
+      case 0x07:
+        FOR_LANES(
+          u8 carry = a[lane] >> 7;
+          a[lane] = (a[lane] << 1) | carry;
+          f[lane] = (f[lane] & ~(1 << CARRY_POS)) | carry;
+        )
+        break;
+      case 0x0F:
+        FOR_LANES(
+          u8 carry = a[lane] & 1;
+          a[lane] = (a[lane] >> 1) | (carry << 7);
+          f[lane] = (f[lane] & ~(1 << CARRY_POS)) | carry;
+        )
+        break;
+      case 0x17:
+        FOR_LANES(
+          u8 carry = a[lane] >> 7;
+          a[lane] = (a[lane] << 1) | (f[lane] & 1);
+          f[lane] = (f[lane] & ~(1 << CARRY_POS)) | carry;
+        )
+        break;
+      case 0x1F:
+        FOR_LANES(
+          u8 carry = a[lane] & 1;
+          a[lane] = (a[lane] >> 1) | ((f[lane] & 1) << 7);
+          f[lane] = (f[lane] & ~(1 << CARRY_POS)) | carry;
+        )
+        break;
+      // DAA, S Z P come from the result alone (a zero operand sets neither AC nor CY)
+      case 0x27:
+        FOR_LANES(
+          u8 old = a[lane];
+          bool low_fix = (old & 0x0F) > 9 || (f[lane] & (1 << AUX_POS));
+          bool high_fix = old > 0x99 || (f[lane] & (1 << CARRY_POS));
+          u8 res = old + (low_fix ? 0x06 : 0) + (high_fix ? 0x60 : 0);
+          a[lane] = res;
+          f[lane] = (f[lane] & ~RESULT_FLAGS) | CpuState::result_flags(res, res) | (low_fix << AUX_POS) |
+                    (high_fix << CARRY_POS);
+        )
+        break;
+      // CMA / STC / CMC
+      case 0x2F:
+        FOR_LANES(a[lane] = ~a[lane];)
+        break;
+      case 0x37:
+        FOR_LANES(f[lane] |= 1 << CARRY_POS;)
+        break;
+      case 0x3F:
+        FOR_LANES(f[lane] ^= 1 << CARRY_POS;)
+        break;
+      // HLT, run_until moves the halted lanes to the deadline
+      case 0x76:
+        FOR_LANES(halted[lane] = 1;)
+        cost = 7;
+        break;
+      // POP / PUSH
+      case 0xC1: case 0xD1: case 0xE1: case 0xF1: {
+        int pair = (opcode >> 4) & 3;
+        u8* high = pair == PSW_PAIR ? a : r[2 * pair];
+        u8* low = pair == PSW_PAIR ? f : r[2 * pair + 1];
+        FOR_LANES(u16 popped = pop(lane); high[lane] = popped >> 8; low[lane] = popped & 0xFF;)
+        cost = 10;
+        break;
+      }
+      case 0xC5: case 0xD5: case 0xE5: case 0xF5: {
+        int pair = (opcode >> 4) & 3;
+        u8* high = pair == PSW_PAIR ? a : r[2 * pair];
+        u8* low = pair == PSW_PAIR ? f : r[2 * pair + 1];
+        FOR_LANES(push(lane, (high[lane] << 8) | low[lane]);)
+        cost = 11;
+        break;
+      }
+      // OUT / IN, the invaders port map of _8080::map_invaders_ports
+      case 0xD3:
+        switch (imm) {
+          case SHFTAMNT:
+            FOR_LANES(
+              shift_offset[lane] = a[lane] & SHIFT_AND_BITS;
+              shift_result[lane] = ((shift_value[lane] << shift_offset[lane]) >> 8) & 0xFF;
+            )
+            break;
+          case SHFT_DATA:
+            FOR_LANES(
+              shift_value[lane] = (shift_value[lane] >> 8) | (a[lane] << 8);
+              shift_result[lane] = ((shift_value[lane] << shift_offset[lane]) >> 8) & 0xFF;
+            )
+            break;
+          case SOUND1:
+            FOR_LANES(sound1[lane] = a[lane];)
+            break;
+          case SOUND2:
+            FOR_LANES(sound2[lane] = a[lane];)
+            break;
+        }
+        cost = 10;
+        next = at + 2;
+        break;
+      case 0xDB: {
+        const u8* port = imm == INP1 ? input_port.data() : imm == SHFT_IN ? shift_result.data() : nullptr;
+        if (port) {
+          FOR_LANES(a[lane] = port[lane];)
+        } else {
+          FOR_LANES(a[lane] = 0;)
+        }
+        cost = 10;
+        next = at + 2;
+        break;
+      }
+      // XTHL / XCHG / SPHL
+      case 0xE3:
+        FOR_LANES(
+          u8 low = read(lane, sps[lane]);
+          u8 high = read(lane, sps[lane] + 1);
+          write(lane, sps[lane], l[lane]);
+          write(lane, sps[lane] + 1, h[lane]);
+          l[lane] = low;
+          h[lane] = high;
+        )
+        cost = 18;
+        break;
+      case 0xEB: {
+        u8* d = r[LANE_D];
+        u8* e = r[LANE_E];
+        FOR_LANES(
+          u8 high = h[lane];
+          u8 low = l[lane];
+          h[lane] = d[lane];
+          l[lane] = e[lane];
+          d[lane] = high;
+          e[lane] = low;
+        )
+        cost = 5;
+        break;
+      }
+      case 0xF9:
+        FOR_LANES(sps[lane] = hl(lane);)
+        cost = 5;
+        break;
+      // DI / EI
+      case 0xF3:
+      case 0xFB: {
+        u8 enabled = opcode == 0xFB;
+        FOR_LANES(interrupt_enabled[lane] = enabled;)
+        break;
+      }
+
+      // branches set the pcs and cycles themselves /////////////////////////////
+      // JMP (0xCB is an undocumented copy)
+      case 0xC3:
+      case 0xCB:
+        FOR_LANES(pcs[lane] = word; cyc[lane] += 10;)
+        branched = true;
+        break;
+      // CALL (and its undocumented copies)
+      case 0xCD: case 0xDD: case 0xED: case 0xFD:
+        FOR_LANES(push(lane, at + 3); pcs[lane] = word; cyc[lane] += 17;)
+        branched = true;
+        break;
+      // RET (0xD9 is an undocumented copy)
+      case 0xC9:
+      case 0xD9:
+        FOR_LANES(pcs[lane] = pop(lane); cyc[lane] += 10;)
+        branched = true;
+        break;
+      // PCHL
+      case 0xE9:
+        FOR_LANES(pcs[lane] = hl(lane); cyc[lane] += 5;)
+        branched = true;
+        break;
+      default: {
+        branched = true;
+        int condition = (opcode >> 3) & 7;
+        int flag = condition_flags[condition >> 1];
+        u8 expected = condition & 1;
+        switch (opcode & 7) {
+          // Rcc
+          case 0:
+            FOR_LANES(
+              if (((f[lane] >> flag) & 1) == expected) {
+                pcs[lane] = pop(lane);
+                cyc[lane] += 11;
+              } else {
+                pcs[lane] = at + 1;
+                cyc[lane] += 5;
+              }
+            )
+            break;
+          // Jcc, JZ / JC / JPE / JM only take 7 cycles when they fall through
+          case 2: {
+            u16 fall_through = at + 3;
+            int fall_cost = expected ? 7 : 10;
+            FOR_LANES(
+              bool taken = ((f[lane] >> flag) & 1) == expected;
+              pcs[lane] = taken ? word : fall_through;
+              cyc[lane] += taken ? 10 : fall_cost;
+            )
+            break;
+          }
+          // Ccc
+          case 4:
+            FOR_LANES(
+              if (((f[lane] >> flag) & 1) == expected) {
+                push(lane, at + 3);
+                pcs[lane] = word;
+                cyc[lane] += 17;
+              } else {
+                pcs[lane] = at + 3;
+                cyc[lane] += 11;
+              }
+            )
+            break;
+          // RST, clears the interrupt enable like the scalar core
+          case 7: {
+            u16 target = opcode & 0x38;
+            FOR_LANES(interrupt_enabled[lane] = 0; push(lane, at + 1); pcs[lane] = target; cyc[lane] += 11;)
+            break;
+          }
+        }
+        break;
+      }
+    }
+  }
+
+  if (rom_write) {
+    rom_shared = false;
+  }
+  if (!branched) {
+    FOR_LANES(pcs[lane] = next; cyc[lane] += cost;)
+  }
+  return branched;
+}
+
+// idle loops /////////////////////////////////////////////////////////////////
+
+// the lanes of a branch at jump that went backwards, like the pc < last check of _8080::run_until
+template <bool ALL>
+LANES_INLINE bool BatchInterpreter::check_idle_loops(u16 jump, const u16* list, int count, u64 deadline) {
+  bool skipped = false;
+  FOR_LANES(
+    if (pc[lane] < jump) {
+      skipped |= check_idle_loop(lane, jump, deadline);
+    }
+  )
+  return skipped;
+}
+
+// idle_loop_skip on one lane's registers and memory, like _8080::check_idle_loop
+bool BatchInterpreter::check_idle_loop(int lane, u16 jump, u64 deadline) {
+  LoopRegisters regs = { pc[lane], (u16) (reg[LANE_A][lane] | (reg[LANE_F][lane] << 8)),
+                         (u16) ((reg[LANE_B][lane] << 8) | reg[LANE_C][lane]),
+                         (u16) ((reg[LANE_D][lane] << 8) | reg[LANE_E][lane]),
+                         (u16) ((reg[LANE_H][lane] << 8) | reg[LANE_L][lane]), sp[lane] };
+  u64 skip = idle_loop_skip(idle[lane], memory[lane], jump, regs, cycles[lane], deadline);
+  cycles[lane] += skip;
+  idle_cycles[lane] += skip;
+  return skip > 0;
+}
+
+// scheduling /////////////////////////////////////////////////////////////////
+
+// the opcode at pc at and the word after it
+LANES_INLINE void BatchInterpreter::fetch(int lane, u16 at, u8* opcode, u16* word) {
+  const MemoryBus& code = memory[lane];
+  *opcode = code[at];
+  *word = code[(u16) (at + 1)] | (code[(u16) (at + 2)] << 8);
+}
+
+// the code bytes at pc at are the ones given
+LANES_INLINE bool BatchInterpreter::same_code(int lane, u16 at, u8 opcode, u16 word) {
+  if (rom_shared && at < ROM_BYTES - 2) {
+    return true;
+  }
+  const MemoryBus& code = memory[lane];
+  return code[at] == opcode && code[(u16) (at + 1)] == (word & 0xFF) && code[(u16) (at + 2)] == (word >> 8);
+}
+
+bool BatchInterpreter::check_together() {
+  u16 at = pc[0];
+  u64 cycle = cycles[0];
+  bool same = true;
+  for (int lane = 0; lane < lanes; lane++) {
+    same &= (pc[lane] == at) & (cycles[lane] == cycle) & !halted[lane];
+  }
+  return same;
+}
+
+template <bool AVX2>
+LANES_INLINE void BatchInterpreter::run_lanes(u64 deadline) {
+  u16* active_lanes = active.data();
+  u16* group_lanes = group.data();
+  while (true) {
+    u8 opcode;
+    u16 word;
+    if (together) {
+      if (cycles[0] >= deadline) {
+        break;
+      }
+      u16 at = pc[0];
+      fetch(0, at, &opcode, &word);
+      bool same = true;
+      for (int lane = 1; lane < lanes && same; lane++) {
+        same = same_code(lane, at, opcode, word);
+      }
+      if (!same) {
+        together = false;
+        continue;
+      }
+      bool branched = execute<true>(opcode, at, word, nullptr, lanes);
+      steps++;
+      lane_steps += lanes;
+      bool skipped = branched && skip_idle_loops && check_idle_loops<true>(at, nullptr, lanes, deadline);
+      if (skipped || may_diverge(opcode)) {
+        together = check_together();
+      }
+      continue;
+    }
+
+    // the lanes still inside this part of the frame, the ones at the lowest pc go first
+    int count = 0;
+    int first = -1;
+    for (int lane = 0; lane < lanes; lane++) {
+      if (cycles[lane] < deadline && !halted[lane]) {
+        active_lanes[count++] = lane;
+        if (first < 0 || pc[lane] < pc[first]) {
+          first = lane;
+        }
+      }
+    }
+    if (count == 0) {
+      break;
+    }
+    u16 lowest = pc[first];
+    fetch(first, lowest, &opcode, &word);
+    int size = 0;
+    for (int i = 0; i < count; i++) {
+      int lane = active_lanes[i];
+      if (pc[lane] == lowest && same_code(lane, lowest, opcode, word)) {
+        group_lanes[size++] = lane;
+      }
+    }
+    if (size == lanes) {
+      if (execute<true>(opcode, lowest, word, nullptr, lanes) && skip_idle_loops) {
+        check_idle_loops<true>(lowest, nullptr, lanes, deadline);
+      }
+      together = check_together();
+    } else if (execute<false>(opcode, lowest, word, group_lanes, size) && skip_idle_loops) {
+      check_idle_loops<false>(lowest, group_lanes, size, deadline);
+    }
+    steps++;
+    lane_steps += size;
+  }
+}
+
+// one lane on its own, what set_lockstep(false) does for every lane
+void BatchInterpreter::run_lane(int lane, u64 deadline) {
+  u16 list = lane;
+  while (cycles[lane] < deadline && !halted[lane]) {
+    u8 opcode;
+    u16 word;
+    u16 at = pc[lane];
+    fetch(lane, at, &opcode, &word);
+    if (execute<false>(opcode, at, word, &list, 1) && skip_idle_loops) {
+      check_idle_loop(lane, at, deadline);
+    }
+    steps++;
+    lane_steps++;
+  }
+}
+
+#ifdef BATCH_X86
+AVX2_TARGET void BatchInterpreter::run_until_avx2(u64 deadline) {
+  run_lanes<true>(deadline);
+}
+#else
+void BatchInterpreter::run_until_avx2(u64 deadline) {
+  run_lanes<false>(deadline);
+}
+#endif
+
+// a halted lane does nothing until the next interrupt, like _8080::run_until it jumps to
+// the deadline
+void BatchInterpreter::run_until(u64 deadline) {
+  if (!lockstep) {
+    for (int lane = 0; lane < lanes; lane++) {
+      run_lane(lane, deadline);
+    }
+  } else if (simd == SIMD_AVX2) {
+    run_until_avx2(deadline);
+  } else {
+    run_lanes<false>(deadline);
+  }
+  for (int lane = 0; lane < lanes; lane++) {
+    if (halted[lane] && cycles[lane] < deadline) {
+      halted_cycles[lane] += deadline - cycles[lane];
+      cycles[lane] = deadline;
+    }
+  }
+}
+
+// _8080::execute_interrupt: RST n at the current pc, only with interrupts enabled
+void BatchInterpreter::interrupt(u8 opcode) {
+  u16 target = opcode & 0x38;
+  for (int lane = 0; lane < lanes; lane++) {
+    if (!interrupt_enabled[lane]) {
+      continue;
+    }
+    // the ISR may change the RAM or code a polling loop depends on
+    idle[lane].valid = false;
+    halted[lane] = 0;
+    interrupt_enabled[lane] = 0;
+    sp[lane] -= 2;
+    memory[lane].write(sp[lane], pc[lane] & 0xFF);
+    memory[lane].write(sp[lane] + 1, pc[lane] >> 8);
+    if (sp[lane] < RAM_START || (u16) (sp[lane] + 1) < RAM_START) {
+      rom_shared = false;
+    }
+    pc[lane] = target;
+    cycles[lane] += 11;
+  }
+  together = check_together();
+}
+
+// the same deadlines as _8080::schedule_frame, every lane is at the same frame
+void BatchInterpreter::run_frame() {
+  u64 start = frames * CYCLES_PER_SECOND / FRAMES_PER_SECOND;
+  u64 end = (frames + 1) * CYCLES_PER_SECOND / FRAMES_PER_SECOND;
+  run_until(start + (end - start) / 2);
+  interrupt(HALF_INTERRUPT);
+  run_until(end);
+  interrupt(FULL_INTERRUPT);
+  frames++;
+}
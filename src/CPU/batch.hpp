@@ -0,0 +1,101 @@
+#ifndef BATCH_HPP
+#define BATCH_HPP
+
+#include <cstdint>
+#include <vector>
+#include "scaler.hpp"
+#include "snapshot.hpp"
+#include "memory_bus.hpp"
+
+// Many instances ("lanes") of the same program stepped together. The registers are
+// structure of arrays, one array per register with an entry per lane, so an instruction
+// the lanes share is decoded once and executed as a loop over contiguous arrays that the
+// compiler turns into vector code.
+//
+// While every lane is at the same pc with the same cycle count (they all run the same
+// frame loop) the lanes run in lockstep and only branches are checked for divergence.
+// Once they split, each step gathers the lanes still inside the frame and runs the ones
+// at the lowest pc over a lane list, so lanes that fall behind catch up with the others
+// at the next common instruction and run together again.
+//
+// A lane is exactly a headless _8080 with fusion off: registers, flags, memory, cycles,
+// interrupts and the idle loops it skips match, batch_check compares them frame by frame.
+// Every lane's memory is a MemoryBus sharing the loaded image's pages, so a lane costs the
+// pages it writes (its RAM), and the lanes skip comparing code bytes while none of them
+// wrote below RAM_START.
+
+struct IdleLoop;
+
+class BatchInterpreter {
+  public:
+    BatchInterpreter(int lanes); // 1 - 65535
+    ~BatchInterpreter();
+    bool skip_idle_loops = true; // per lane, like _8080::skip_idle_loops
+    int get_lanes();
+    void set_simd_level(SimdLevel level); // capped at what the CPU supports, AVX2 runs an AVX2 copy of the lanes
+    SimdLevel get_simd_level();
+    void set_lockstep(bool lockstep); // false steps every lane on its own, the baseline batch_check compares with
+
+    // every lane shares the pages of image (an _8080's memory, the ROM loaded) and starts
+    // from snapshot
+    void load(MemoryBus& image, const Snapshot& snapshot);
+    bool load_state(int lane, const Snapshot& snapshot); // false unless taken at get_frames()
+    void save_state(int lane, Snapshot* snapshot);
+    void set_inputs(int lane, u8 input_bits);
+    void run_frame(); // every lane, both screen interrupts included
+
+    MemoryBus& lane_memory(int lane);
+    u64 get_frames();
+    u64 get_cycles(int lane);
+    double get_lanes_per_step(); // lanes each decoded instruction ran on, on average
+
+  private:
+    int lanes;
+    SimdLevel simd = detect_simd_level();
+    bool lockstep = true;
+    bool together = false; // every lane at the same pc and cycle count and none halted
+    u64 frames = 0;
+
+    // registers in opcode order: B C D E H L, the flags in slot 6 (M in the encoding), A
+    std::vector<u8> reg[8];
+    std::vector<u16> pc;
+    std::vector<u16> sp;
+    std::vector<u64> cycles;
+    std::vector<u64> halted_cycles;
+    std::vector<u64> idle_cycles;
+    std::vector<IdleLoop> idle;
+    std::vector<u8> interrupt_enabled;
+    std::vector<u8> halted;
+    // ports, the same bytes as InputLatch / ShiftRegister / SoundLatch
+    std::vector<u8> input_bits;
+    std::vector<u8> input_port; // what IN 1 reads
+    std::vector<u16> shift_value;
+    std::vector<u8> shift_offset;
+    std::vector<u8> shift_result;
+    std::vector<u8> sound1;
+    std::vector<u8> sound2;
+
+    std::vector<MemoryBus> memory; // per lane
+    bool rom_shared = false; // no lane wrote below RAM_START since load
+
+    std::vector<u16> active; // scratch lane lists
+    std::vector<u16> group;
+    std::vector<u8> operand;
+
+    u64 steps = 0; // instructions decoded
+    u64 lane_steps = 0; // and executed, summed over the lanes
+
+    void run_until(u64 deadline); // every lane runs whole instructions until cycles >= deadline
+    void run_until_avx2(u64 deadline);
+    template <bool ALL> bool execute(u8 opcode, u16 at, u16 word, const u16* list, int count); // true for a branch
+    template <bool ALL> bool check_idle_loops(u16 jump, const u16* list, int count, u64 deadline); // true if any skipped
+    bool check_idle_loop(int lane, u16 jump, u64 deadline);
+    template <bool AVX2> void run_lanes(u64 deadline);
+    void run_lane(int lane, u64 deadline);
+    void fetch(int lane, u16 at, u8* opcode, u16* word);
+    bool same_code(int lane, u16 at, u8 opcode, u16 word);
+    bool check_together();
+    void interrupt(u8 opcode);
+};
+
+#endif
@@ -0,0 +1,331 @@
+#include "capture.hpp"
+#include <algorithm>
+#include <chrono>
+#include <ctype.h>
+#include <string.h>
+#include "log.hpp"
+
+// note: VRAM is stored rotated, each byte is 8 vertical pixels going up from the bottom
+// left and every 32 bytes is one column
+void vram_to_gray(const u8* vram, u8* gray) {
+  for (int i = 0; i < CAPTURE_VRAM_BYTES; i++) {
+    u8 byte = vram[i];
+    int column = i >> 5;
+    int bottom_row = CAPTURE_HEIGHT - 1 - (i & 31) * 8;
+    for (int bit = 0; bit < 8; bit++) {
+      gray[(bottom_row - bit) * CAPTURE_WIDTH + column] = ((byte >> bit) & 1) ? 0xFF : 0x00;
+    }
+  }
+}
+
+// png ////////////////////////////////////////////////////////////////////////
+
+static uint32_t crc_table[256];
+
+static void build_crc_table() {
+  for (uint32_t n = 0; n < 256; n++) {
+    uint32_t c = n;
+    for (int k = 0; k < 8; k++) {
+      c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+    }
+    crc_table[n] = c;
+  }
+}
+
+static uint32_t crc32(uint32_t crc, const u8* bytes, size_t length) {
+  crc = ~crc;
+  for (size_t i = 0; i < length; i++) {
+    crc = crc_table[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+static void put_u32_be(std::string& out, uint32_t value) {
+  out += char(value >> 24);
+  out += char(value >> 16);
+  out += char(value >> 8);
+  out += char(value);
+}
+
+static void write_chunk(FILE* file, const char* type, const std::string& data) {
+  std::string chunk(type, 4);
+  chunk += data;
+  std::string length;
+  put_u32_be(length, data.size());
+  std::string crc;
+  put_u32_be(crc, crc32(0, (const u8*) chunk.data(), chunk.size()));
+  fwrite(length.data(), 1, 4, file);
+  fwrite(chunk.data(), 1, chunk.size(), file);
+  fwrite(crc.data(), 1, 4, file);
+}
+
+// frames are tiny, so the zlib stream uses stored (uncompressed) deflate blocks and
+// we avoid a zlib dependency
+bool write_png_gray(const std::string& file_path, const u8* gray, int width, int height) {
+  static std::once_flag crc_ready;
+  std::call_once(crc_ready, build_crc_table);
+
+  FILE* file = fopen(file_path.c_str(), "wb");
+  if (!file) {
+    return false;
+  }
+  static const u8 signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+  fwrite(signature, 1, 8, file);
+
+  std::string header;
+  put_u32_be(header, width);
+  put_u32_be(header, height);
+  header += char(8); // bit depth
+  header += char(0); // grayscale
+  header += char(0); // deflate
+  header += char(0); // adaptive filtering
+  header += char(0); // no interlace
+  write_chunk(file, "IHDR", header);
+
+  // every row starts with filter type 0
+  std::string raw;
+  raw.reserve((width + 1) * height);
+  for (int y = 0; y < height; y++) {
+    raw += char(0);
+    raw.append((const char*) gray + y * width, width);
+  }
+
+  std::string zlib;
+  zlib += char(0x78);
+  zlib += char(0x01);
+  size_t offset = 0;
+  do {
+    size_t block = std::min<size_t>(raw.size() - offset, 0xFFFF);
+    bool last = offset + block == raw.size();
+    zlib += char(last ? 1 : 0);
+    zlib += char(block & 0xFF);
+    zlib += char(block >> 8);
+    zlib += char(~block & 0xFF);
+    zlib += char((~block >> 8) & 0xFF);
+    zlib.append(raw, offset, block);
+    offset += block;
+  } while (offset < raw.size());
+
+  uint32_t a = 1;
+  uint32_t b = 0;
+  for (size_t i = 0; i < raw.size(); i++) {
+    a = (a + (u8) raw[i]) % 65521;
+    b = (b + a) % 65521;
+  }
+  put_u32_be(zlib, (b << 16) | a);
+  write_chunk(file, "IDAT", zlib);
+  write_chunk(file, "IEND", "");
+
+  bool ok = !ferror(file);
+  fclose(file);
+  return ok;
+}
+
+// capture ////////////////////////////////////////////////////////////////////
+
+FrameCapture::~FrameCapture() {
+  close();
+}
+
+bool FrameCapture::open(const std::string& path) {
+  size_t dot = path.rfind('.');
+  std::string extension = dot == std::string::npos ? "" : path.substr(dot + 1);
+  if (extension == "y4m") {
+    return open(path, CAPTURE_Y4M);
+  } else if (extension == "png") {
+    return open(path, CAPTURE_PNG);
+  }
+  return open(path, CAPTURE_RAW);
+}
+
+bool FrameCapture::open(const std::string& path, CaptureFormat format) {
+  if (streaming) {
+    close();
+  }
+  this->path = path;
+  this->format = format;
+
+  if (format == CAPTURE_PNG && !parse_png_pattern(path)) {
+    log_error("capture pattern %s needs one frame number conversion like %%06d", path.c_str());
+    return false;
+  }
+  if (format != CAPTURE_PNG) {
+    file = fopen(path.c_str(), "wb");
+    if (!file) {
+      log_error("could not open capture file %s", path.c_str());
+      return false;
+    }
+    if (format == CAPTURE_Y4M) {
+      fprintf(file, "YUV4MPEG2 W%d H%d F60:1 Ip A1:1 Cmono\n", CAPTURE_WIDTH, CAPTURE_HEIGHT);
+    }
+  }
+  streaming = true;
+  start_writer();
+  return true;
+}
+
+// the user's path never reaches printf: the one conversion is parsed here and the frame
+// number substituted by png_path
+bool FrameCapture::parse_png_pattern(const std::string& pattern) {
+  std::string text;
+  int conversions = 0;
+  for (size_t i = 0; i < pattern.size(); i++) {
+    if (pattern[i] != '%') {
+      text += pattern[i];
+      continue;
+    }
+    if (i + 1 < pattern.size() && pattern[i + 1] == '%') {
+      text += '%';
+      i++;
+      continue;
+    }
+    size_t at = i + 1;
+    bool zero_pad = at < pattern.size() && pattern[at] == '0';
+    if (zero_pad) {
+      at++;
+    }
+    int width = 0;
+    while (at < pattern.size() && isdigit((unsigned char) pattern[at]) && width < 100) {
+      width = width * 10 + (pattern[at++] - '0');
+    }
+    while (at < pattern.size() && (pattern[at] == 'l' || pattern[at] == 'h')) {
+      at++;
+    }
+    if (at == pattern.size() || (pattern[at] != 'd' && pattern[at] != 'i' && pattern[at] != 'u')) {
+      return false;
+    }
+    if (++conversions > 1) {
+      return false;
+    }
+    png_prefix = text;
+    text.clear();
+    png_width = width;
+    png_zero_pad = zero_pad;
+    i = at;
+  }
+  png_suffix = text;
+  return conversions == 1;
+}
+
+std::string FrameCapture::png_path(uint64_t frame) {
+  std::string number = std::to_string(frame);
+  if ((int) number.size() < png_width) {
+    number.insert(0, png_width - number.size(), png_zero_pad ? '0' : ' ');
+  }
+  return png_prefix + number + png_suffix;
+}
+
+void FrameCapture::start_writer() {
+  if (running) {
+    return;
+  }
+  running = true;
+  writer = std::thread(&FrameCapture::writer_loop, this);
+}
+
+void FrameCapture::close() {
+  if (running) {
+    running = false;
+    wake.notify_one();
+    writer.join();
+  }
+  if (file) {
+    fclose(file);
+    file = nullptr;
+  }
+  if (streaming) {
+    log_info("capture %s: %llu frames written, %llu dropped", path.c_str(),
+             (unsigned long long) frames_written.load(), (unsigned long long) frames_dropped);
+  }
+  streaming = false;
+}
+
+void FrameCapture::screenshot(const std::string& png_path) {
+  pending_screenshot = png_path;
+  start_writer();
+}
+
+void FrameCapture::push(const u8* vram, const std::string& screenshot_path) {
+  uint32_t write = head.load(std::memory_order_relaxed);
+  uint32_t read = tail.load(std::memory_order_acquire);
+  if (write - read == CAPTURE_QUEUE_SIZE) {
+    frames_dropped++;
+    return;
+  }
+  uint32_t slot = write & (CAPTURE_QUEUE_SIZE - 1);
+  memcpy(slots[slot], vram, CAPTURE_VRAM_BYTES);
+  slot_paths[slot] = screenshot_path;
+  slot_frames[slot] = frames_submitted;
+  head.store(write + 1, std::memory_order_release);
+  wake.notify_one();
+}
+
+void FrameCapture::submit(const u8* vram) {
+  if (streaming) {
+    push(vram, "");
+  }
+  if (!pending_screenshot.empty()) {
+    push(vram, pending_screenshot);
+    pending_screenshot.clear();
+  }
+  frames_submitted++;
+}
+
+uint64_t FrameCapture::get_frames_written() {
+  return frames_written.load();
+}
+
+uint64_t FrameCapture::get_frames_dropped() {
+  return frames_dropped;
+}
+
+void FrameCapture::writer_loop() {
+  while (true) {
+    uint32_t read = tail.load(std::memory_order_relaxed);
+    uint32_t write = head.load(std::memory_order_acquire);
+    if (read == write) {
+      if (!running) {
+        break;
+      }
+      // the producer never takes this lock, a missed notify only costs one wait
+      std::unique_lock<std::mutex> lock(wake_mutex);
+      wake.wait_for(lock, std::chrono::milliseconds(CAPTURE_IDLE_WAIT_MS));
+      continue;
+    }
+    uint32_t slot = read & (CAPTURE_QUEUE_SIZE - 1);
+    write_frame(slots[slot], slot_paths[slot], slot_frames[slot]);
+    tail.store(read + 1, std::memory_order_release);
+  }
+}
+
+void FrameCapture::write_frame(const u8* vram, const std::string& screenshot_path, uint64_t frame) {
+  u8 gray[CAPTURE_WIDTH * CAPTURE_HEIGHT];
+
+  if (!screenshot_path.empty()) {
+    vram_to_gray(vram, gray);
+    if (!write_png_gray(screenshot_path, gray, CAPTURE_WIDTH, CAPTURE_HEIGHT)) {
+      log_error("could not write screenshot %s", screenshot_path.c_str());
+    }
+    return;
+  }
+
+  switch (format) {
+    case CAPTURE_RAW:
+      fwrite(vram, 1, CAPTURE_VRAM_BYTES, file);
+      break;
+    case CAPTURE_Y4M:
+      vram_to_gray(vram, gray);
+      fputs("FRAME\n", file);
+      fwrite(gray, 1, sizeof(gray), file);
+      break;
+    case CAPTURE_PNG: {
+      std::string frame_path = png_path(frame);
+      vram_to_gray(vram, gray);
+      if (!write_png_gray(frame_path, gray, CAPTURE_WIDTH, CAPTURE_HEIGHT)) {
+        log_error("could not write %s", frame_path.c_str());
+      }
+      break;
+    }
+  }
+  frames_written++;
+}
@@ -0,0 +1,86 @@
+#ifndef CAPTURE_HPP
+#define CAPTURE_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Frame capture straight from the 1bpp VRAM (0x2400 - 0x3FFF), no SDL window needed.
+//
+// The emulation thread copies the 7 KB of VRAM into a bounded ring of slots and returns,
+// a background writer thread converts and writes the frames. When the writer falls
+// behind the frame is dropped instead of stalling emulation.
+//
+// formats:
+//   raw - the 1bpp VRAM of every frame back to back (7168 bytes per frame)
+//   y4m - upright 224x256 8 bit mono YUV4MPEG2 stream at 60 fps (ffmpeg / mpv can read it)
+//   png - one upright grayscale png per frame, the path holds one integer conversion for the
+//         frame number (shot_%06d.png: flag 0, a width, d / i / u), %% is a literal %
+
+#define CAPTURE_VRAM_BYTES 0x1C00
+#define CAPTURE_WIDTH 224
+#define CAPTURE_HEIGHT 256
+#define CAPTURE_QUEUE_SIZE 16 // power of 2
+#define CAPTURE_IDLE_WAIT_MS 5
+
+using u8 = std::uint8_t;
+
+enum CaptureFormat {
+  CAPTURE_RAW,
+  CAPTURE_Y4M,
+  CAPTURE_PNG
+};
+
+// rotated 1bpp VRAM -> upright 8 bit grayscale (224 wide, 256 high)
+void vram_to_gray(const u8* vram, u8* gray);
+bool write_png_gray(const std::string& file_path, const u8* gray, int width, int height);
+
+class FrameCapture {
+  public:
+    ~FrameCapture();
+    // picks the format from the extension (.raw / .y4m / .png) unless one is given, false
+    // when the file can't be opened or a png pattern isn't one frame number conversion
+    bool open(const std::string& path);
+    bool open(const std::string& path, CaptureFormat format);
+    void close();
+    void submit(const u8* vram); // emulation thread, never blocks
+    void screenshot(const std::string& png_path); // png of the next submitted frame, on the submit thread
+    uint64_t get_frames_written();
+    uint64_t get_frames_dropped();
+
+  private:
+    CaptureFormat format = CAPTURE_RAW;
+    std::string path;
+    FILE* file = nullptr;
+    // the png path around the frame number, which is zero padded to png_width digits or not
+    std::string png_prefix;
+    std::string png_suffix;
+    int png_width = 0;
+    bool png_zero_pad = false;
+    bool parse_png_pattern(const std::string& pattern);
+    std::string png_path(uint64_t frame);
+    u8 slots[CAPTURE_QUEUE_SIZE][CAPTURE_VRAM_BYTES];
+    std::string slot_paths[CAPTURE_QUEUE_SIZE]; // screenshot target, empty for the stream
+    uint64_t slot_frames[CAPTURE_QUEUE_SIZE];
+    std::atomic<uint32_t> head{0};
+    std::atomic<uint32_t> tail{0};
+    std::atomic<bool> running{false};
+    std::atomic<uint64_t> frames_written{0};
+    uint64_t frames_dropped = 0;
+    uint64_t frames_submitted = 0;
+    std::string pending_screenshot; // screenshot() and submit() only, both on the emulation thread
+    bool streaming = false;
+    std::mutex wake_mutex;
+    std::condition_variable wake;
+    std::thread writer;
+    void start_writer();
+    void push(const u8* vram, const std::string& screenshot_path);
+    void writer_loop();
+    void write_frame(const u8* vram, const std::string& screenshot_path, uint64_t frame);
+};
+
+#endif
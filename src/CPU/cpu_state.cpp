@@ -0,0 +1,18 @@
+#include "cpu_state.hpp"
+
+// a bit the new result doesn't set (the carry after INR / DCR) still comes from the old one
+void CpuState::defer_flags(u8 mask, u8 initial, u16 result) {
+  if (pending_flags & ~mask) {
+    sync_flags();
+  }
+  pending_flags = mask;
+  pending_initial = initial;
+  pending_result = result;
+}
+
+void CpuState::sync_flags() {
+  if (pending_flags) {
+    f = (f & ~pending_flags) | (result_flags(pending_initial, pending_result) & pending_flags);
+    pending_flags = 0;
+  }
+}
@@ -0,0 +1,120 @@
+#ifndef CPU_STATE_HPP
+#define CPU_STATE_HPP
+
+#include <cstdint>
+#include <type_traits>
+
+// The architectural 8080 state as plain data. _8080 embeds it by value next to the cycle
+// counter and interrupt flags, so a register access is one load off the core and a
+// snapshot is a single memcpy. Displaying it is RegisterPane's job.
+
+#define SIGN_POS 7
+#define ZERO_POS 6
+#define AUX_POS 4
+#define PARITY_POS 2
+#define CARRY_POS 0
+
+// flag bits an ALU result sets, INR / DCR leave the carry alone
+#define RESULT_FLAGS 0xD5
+#define RESULT_FLAGS_NO_CARRY 0xD4
+
+using u16 = uint16_t;
+using u8 = uint8_t;
+
+struct CpuState {
+  union {
+    struct {
+      u8 a;
+      u8 f;
+    };
+    u16 PSW = 0x0000;
+  };
+
+  union {
+    struct {
+      u8 c;
+      u8 b;
+    };
+    u16 bc = 0x0000;
+  };
+
+  union {
+    struct {
+      u8 e;
+      u8 d;
+    };
+    u16 de = 0x0000;
+  };
+
+  union {
+    struct {
+      u8 l;
+      u8 h;
+    };
+    u16 hl = 0x0000;
+  };
+
+  u16 pc = 0x0000; // program counter
+  u16 sp = 0x2400; // stack pointer
+
+  // lazy flags: ALU ops only record their operand and result, S Z AC P CY are computed
+  // when a flag is read. The flag accessors handle it, code that reads or writes f / PSW
+  // directly has to call sync_flags first
+  bool lazy_flags = true;
+  u8 pending_flags = 0; // bits of f still owed by the recorded result
+  u8 pending_initial = 0;
+  u16 pending_result = 0;
+
+  bool check_flag(int flag_distance) {
+    if (pending_flags & (1 << flag_distance)) {
+      sync_flags();
+    }
+    return (f >> flag_distance) & 0x1;
+  }
+
+  int get_flag(int flag_distance) {
+    return check_flag(flag_distance) ? 1 : 0;
+  }
+
+  void set_flag(int flag_distance) {
+    if (flag_distance < 0 || flag_distance > 7) {
+      return;
+    }
+    u8 mask = 1 << flag_distance;
+    pending_flags &= ~mask;
+    f |= mask;
+  }
+
+  void reset_flag(int flag_distance) {
+    if (flag_distance < 0 || flag_distance > 7) {
+      return;
+    }
+    u8 mask = ~(1 << flag_distance);
+    pending_flags &= mask;
+    f &= mask;
+  }
+
+  void defer_flags(u8 mask, u8 initial, u16 result);
+  void sync_flags();
+  static u8 result_flags(u8 initial, u16 result); // RESULT_FLAGS bits for a recorded result
+};
+
+// same rules as _8080::check_set_*_flag, branch free so the batched lanes vectorize it
+inline u8 CpuState::result_flags(u8 initial, u16 result) {
+  u8 value = (u8) result;
+  u8 operand = (u8) (result - initial);
+  u8 parity = value ^ (value >> 4);
+  parity ^= parity >> 2;
+  parity ^= parity >> 1;
+  u8 flags = 0;
+  flags |= (result > 0xFF) << CARRY_POS;
+  flags |= ((initial & 0xF) + (operand & 0xF) > 0xF) << AUX_POS;
+  flags |= (value >> 7) << SIGN_POS;
+  flags |= (value == 0) << ZERO_POS;
+  flags |= (~parity & 1) << PARITY_POS;
+  return flags;
+}
+
+static_assert(std::is_trivially_copyable<CpuState>::value, "CpuState is snapshotted with memcpy");
+
+#endif
@@ -0,0 +1,66 @@
+#include "frame_hash.hpp"
+#include <cstdio>
+#include <cinttypes>
+
+// 8 bytes per step with a multiply / xor-shift mix, finished with the splitmix64 finalizer
+u64 hash_bytes(const u8* bytes, size_t length) {
+  u64 hash = FRAME_HASH_SEED ^ length;
+  size_t i = 0;
+  for (; i + 8 <= length; i += 8) {
+    u64 word;
+    memcpy(&word, bytes + i, 8);
+    word *= 0x9E3779B97F4A7C15ULL;
+    word ^= word >> 32;
+    hash = (hash ^ word) * 0xBF58476D1CE4E5B9ULL;
+  }
+  for (; i < length; i++) {
+    hash = (hash ^ bytes[i]) * 0x100000001B3ULL;
+  }
+  hash ^= hash >> 31;
+  hash *= 0x94D049BB133111EBULL;
+  hash ^= hash >> 29;
+  return hash;
+}
+
+bool save_frame_hashes(const std::string& file_path, const std::vector<FrameHash>& hashes, bool with_ram) {
+  FILE* file = fopen(file_path.c_str(), "w");
+  if (!file) {
+    return false;
+  }
+  fprintf(file, "# frame vram_hash%s\n", with_ram ? " ram_hash" : "");
+  for (size_t i = 0; i < hashes.size(); i++) {
+    if (with_ram) {
+      fprintf(file, "%" PRIu64 " %016" PRIx64 " %016" PRIx64 "\n", hashes[i].frame, hashes[i].vram, hashes[i].ram);
+    } else {
+      fprintf(file, "%" PRIu64 " %016" PRIx64 "\n", hashes[i].frame, hashes[i].vram);
+    }
+  }
+  bool ok = !ferror(file);
+  fclose(file);
+  return ok;
+}
+
+bool load_frame_hashes(const std::string& file_path, std::vector<FrameHash>* hashes, bool* with_ram) {
+  FILE* file = fopen(file_path.c_str(), "r");
+  if (!file) {
+    return false;
+  }
+  hashes->clear();
+  *with_ram = false;
+  char line[128];
+  while (fgets(line, sizeof(line), file)) {
+    if (line[0] == '#' || line[0] == '\n') {
+      continue;
+    }
+    FrameHash hash = {0, 0, 0};
+    int fields = sscanf(line, "%" SCNu64 " %" SCNx64 " %" SCNx64, &hash.frame, &hash.vram, &hash.ram);
+    if (fields < 2) {
+      fclose(file);
+      return false;
+    }
+    *with_ram = *with_ram || fields == 3;
+    hashes->push_back(hash);
+  }
+  fclose(file);
+  return true;
+}
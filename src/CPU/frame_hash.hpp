@@ -0,0 +1,33 @@
+#ifndef FRAME_HASH_HPP
+#define FRAME_HASH_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// 64 bit hashes of the visible frame (7 KB VRAM) and optionally the whole 8 KB of RAM,
+// used by the golden frame hash regression suite. Hashing 7 KB costs well under a
+// microsecond so it can run every frame.
+//
+// hash list file: one line per frame, "<frame> <vram hash> [<ram hash>]" in hex
+
+#define FRAME_HASH_SEED 0x6A09E667F3BCC909ULL
+#define VRAM_BYTES 0x1C00
+#define RAM_BYTES 0x2000
+
+using u8 = std::uint8_t;
+using u64 = std::uint64_t;
+
+u64 hash_bytes(const u8* bytes, size_t length);
+
+struct FrameHash {
+  u64 frame;
+  u64 vram;
+  u64 ram; // 0 when RAM hashing is off
+};
+
+bool save_frame_hashes(const std::string& file_path, const std::vector<FrameHash>& hashes, bool with_ram);
+bool load_frame_hashes(const std::string& file_path, std::vector<FrameHash>* hashes, bool* with_ram);
+
+#endif
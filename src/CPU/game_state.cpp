@@ -0,0 +1,68 @@
+#include "game_state.hpp"
+
+u32 game_state_changes(const GameState& before, const GameState& after) {
+  u32 changed = 0;
+  if (before.score[0] != after.score[0] || before.score[1] != after.score[1]) {
+    changed |= GAME_FIELD_SCORE;
+  }
+  if (before.high_score != after.high_score) {
+    changed |= GAME_FIELD_HIGH_SCORE;
+  }
+  if (before.credits != after.credits) {
+    changed |= GAME_FIELD_CREDITS;
+  }
+  if (before.lives[0] != after.lives[0] || before.lives[1] != after.lives[1]) {
+    changed |= GAME_FIELD_LIVES;
+  }
+  if (before.player != after.player) {
+    changed |= GAME_FIELD_PLAYER;
+  }
+  if (before.player_x != after.player_x) {
+    changed |= GAME_FIELD_PLAYER_X;
+  }
+  if (before.aliens != after.aliens) {
+    changed |= GAME_FIELD_ALIENS;
+  }
+  if (before.playing != after.playing) {
+    changed |= GAME_FIELD_PLAYING;
+  }
+  if (before.player_alive != after.player_alive) {
+    changed |= GAME_FIELD_PLAYER_ALIVE;
+  }
+  return changed;
+}
+
+void GameStateWatcher::on_change(u32 fields, Callback callback) {
+  listeners.push_back({fields, callback});
+}
+
+u32 GameStateWatcher::update(const u8* memory, u64 frame) {
+  return update(read_game_state(memory, frame));
+}
+
+u32 GameStateWatcher::update(const GameState& next) {
+  if (!has_state) {
+    state = next;
+    has_state = true;
+    return 0;
+  }
+  u32 changed = game_state_changes(state, next);
+  GameState before = state;
+  state = next;
+  if (changed) {
+    for (const Listener& listener : listeners) {
+      if (listener.fields & changed) {
+        listener.callback(before, state, changed);
+      }
+    }
+  }
+  return changed;
+}
+
+const GameState& GameStateWatcher::get_state() {
+  return state;
+}
+
+void GameStateWatcher::reset() {
+  has_state = false;
+}
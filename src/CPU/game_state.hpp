@@ -0,0 +1,112 @@
+#ifndef GAME_STATE_HPP
+#define GAME_STATE_HPP
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// Typed view of the Space Invaders work RAM (0x2000 - 0x23FF): score, lives, credits,
+// player position, aliens left and game mode read straight from memory, a handful of
+// loads per frame and nothing rendered. The addresses are the game's own variables, so
+// this only means something for the invaders ROMs.
+//
+// GameStateWatcher compares the state after every frame with the last one and calls the
+// callbacks registered for the fields that changed (score went up, a life was lost, ...).
+
+// work RAM variables, the scores and credits are BCD
+#define GAME_PLAYER_ALIVE 0x2015 // 0xFF while the ship is alive, the explosion counts down otherwise
+#define GAME_PLAYER_X 0x201B
+#define GAME_CURRENT_PLAYER 0x2067 // MSB of the current player's data page, 0x21 or 0x22
+#define GAME_ALIENS 0x2082 // aliens left in the current player's rack
+#define GAME_CREDITS 0x20EB
+#define GAME_PLAYING 0x20EF // 1 during a game, 0 in attract mode
+#define GAME_HIGH_SCORE 0x20F4 // 2 bytes, LSB first
+#define GAME_SCORE_1 0x20F8
+#define GAME_SCORE_2 0x20FC
+#define GAME_SHIPS_1 0x21FF // ships left in reserve, player 1 / 2 data page
+#define GAME_SHIPS_2 0x22FF
+
+using u8 = std::uint8_t;
+using u16 = std::uint16_t;
+using u32 = std::uint32_t;
+using u64 = std::uint64_t;
+
+// bits of the changed field mask
+#define GAME_FIELD_SCORE 0x001 // either player's
+#define GAME_FIELD_HIGH_SCORE 0x002
+#define GAME_FIELD_CREDITS 0x004
+#define GAME_FIELD_LIVES 0x008 // either player's
+#define GAME_FIELD_PLAYER 0x010
+#define GAME_FIELD_PLAYER_X 0x020
+#define GAME_FIELD_ALIENS 0x040
+#define GAME_FIELD_PLAYING 0x080
+#define GAME_FIELD_PLAYER_ALIVE 0x100
+#define GAME_FIELD_ALL 0x1FF
+
+struct GameState {
+  u64 frame = 0;
+  u16 score[2] = {0, 0};
+  u16 high_score = 0;
+  u8 credits = 0;
+  u8 lives[2] = {0, 0};
+  u8 player = 0; // 0 or 1, whose turn it is
+  u8 player_x = 0;
+  u8 aliens = 0;
+  bool playing = false;
+  bool player_alive = false;
+};
+
+template <class Memory>
+u16 read_bcd(const Memory& memory, u16 address, int bytes) {
+  u16 value = 0;
+  for (int i = bytes - 1; i >= 0; i--) {
+    u8 digits = memory[address + i];
+    value = value * 100 + (digits >> 4) * 10 + (digits & 0xF);
+  }
+  return value;
+}
+
+// memory is the whole 64 KB address space, a flat array or a MemoryBus (_8080::memory)
+template <class Memory>
+GameState read_game_state(const Memory& memory, u64 frame) {
+  GameState state;
+  state.frame = frame;
+  state.score[0] = read_bcd(memory, GAME_SCORE_1, 2);
+  state.score[1] = read_bcd(memory, GAME_SCORE_2, 2);
+  state.high_score = read_bcd(memory, GAME_HIGH_SCORE, 2);
+  state.credits = read_bcd(memory, GAME_CREDITS, 1);
+  state.lives[0] = memory[GAME_SHIPS_1];
+  state.lives[1] = memory[GAME_SHIPS_2];
+  state.player = memory[GAME_CURRENT_PLAYER] == 0x22;
+  state.player_x = memory[GAME_PLAYER_X];
+  state.aliens = memory[GAME_ALIENS];
+  state.playing = memory[GAME_PLAYING] != 0;
+  state.player_alive = memory[GAME_PLAYER_ALIVE] == 0xFF;
+  return state;
+}
+
+u32 game_state_changes(const GameState& before, const GameState& after); // GAME_FIELD_* mask
+
+class GameStateWatcher {
+  public:
+    // before is the state after the previous frame, changed the GAME_FIELD_* bits that differ
+    using Callback = std::function<void(const GameState& before, const GameState& after, u32 changed)>;
+    void on_change(u32 fields, Callback callback); // called when any of fields changes
+    // after every frame (the emulator does it when attached), returns the changed fields;
+    // the first update only sets the baseline
+    u32 update(const GameState& next);
+    u32 update(const u8* memory, u64 frame);
+    const GameState& get_state();
+    void reset(); // the next update sets a new baseline (after loading a snapshot)
+
+  private:
+    struct Listener {
+      u32 fields;
+      Callback callback;
+    };
+    GameState state;
+    bool has_state = false;
+    std::vector<Listener> listeners;
+};
+
+#endif
@@ -42,6 +42,6 @@
 #include "keys.hpp"
 #include "Screen.hpp"
 #include "log.hpp"
-#include "Registers.hpp"
+#include "RegisterPane.hpp"
 
 #endif // HEADERS_H
\ No newline at end of file
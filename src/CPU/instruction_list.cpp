@@ -27,7 +27,7 @@ int instruction_list[256] = {
     1, //13
     1, //14
     1, //15
-    1, //16
+    2, //16
     1, //17
     1, //18
     1, //19
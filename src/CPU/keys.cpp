@@ -98,3 +98,18 @@ void handle_key_release(int keycode) {
   }
 }
 
+uint8_t get_input_bits() {
+  uint8_t bits = 0;
+  for (int i = 0; i < NUM_INPUTS; i++) {
+    if (inputs[i]) {
+      bits |= 1 << i;
+    }
+  }
+  return bits;
+}
+
+void set_input_bits(uint8_t input_bits) {
+  for (int i = 0; i < NUM_INPUTS; i++) {
+    inputs[i] = (input_bits >> i) & 1;
+  }
+}
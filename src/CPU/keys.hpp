@@ -2,6 +2,7 @@
 #define KEYS_HPP
 
 #include <iostream>
+#include <cstdint>
 
 using namespace std;
 
@@ -18,6 +19,9 @@ using namespace std;
 #define I 105
 #define LEFT_ARROW 1073741904
 #define RIGHT_ARROW 1073741903
+#define F1 1073741882 // disassembly pane
+#define F2 1073741883 // registers pane
+#define F12 1073741893 // png screenshot
 
 // new left and right arrow indexes to prevent having to make a huge array
 #define LEFT_ARROW_INDEX 0
@@ -32,6 +36,9 @@ using namespace std;
 extern bool keys[116];
 extern bool inputs[NUM_INPUTS];
 
+uint8_t get_input_bits(); // current inputs[] as a bitmask (bit n = inputs[n])
+void set_input_bits(uint8_t input_bits);
+
 void handle_key_press(int keycode);
 void handle_key_release(int keycode);
 
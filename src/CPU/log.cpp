@@ -1,15 +1,369 @@
-#include "headers.hpp"
+#include "log.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdarg.h>
+#include <stdlib.h>
 
-char* get_formated_time() {
-    time_t rawtime;
-    struct tm* timeinfo;
+#define LOG_RECORD_PAD 0xFF // level of the filler at the end of the ring before a wrap
 
-    time(&rawtime);
-    timeinfo = localtime(&rawtime);
+static const char* level_names[] = {"TRACE", "DEBUG", "INFO", "WARN", "ERROR"};
 
-    // Must be static, otherwise won't work
-    static char _retval[20];
-    strftime(_retval, sizeof(_retval), "%Y-%m-%d %H:%M:%S", timeinfo);
+// single producer (the owning thread) / single consumer (whoever holds logger.mutex)
+struct LogRing {
+  uint8_t bytes[LOG_RING_BYTES];
+  std::atomic<uint64_t> head{0}; // written by the producer
+  std::atomic<uint64_t> tail{0}; // written by the consumer
+  std::atomic<bool> owned{true}; // false once the thread exited, reused when drained
+  uint64_t reserved = 0; // producer only, end of the record being written
+  std::atomic<uint64_t> dropped{0};
+};
 
-    return _retval;
-}
\ No newline at end of file
+static struct {
+  std::mutex mutex; // the ring list and the consumer side of every ring
+  std::vector<LogRing*> rings;
+  std::thread flusher;
+  std::condition_variable wake;
+  bool stopping = false;
+  std::chrono::steady_clock::time_point steady_start;
+  time_t wall_start;
+  time_t cached_second = -1; // the formatted time only changes once a second
+  char cached_time[20];
+  uint64_t reported_drops = 0;
+} logger;
+
+static void drain_rings();
+
+static void flush_loop() {
+  std::unique_lock<std::mutex> lock(logger.mutex);
+  while (!logger.stopping) {
+    logger.wake.wait_for(lock, std::chrono::milliseconds(LOG_FLUSH_INTERVAL_MS));
+    drain_rings();
+  }
+}
+
+static void stop_logger() {
+  {
+    std::lock_guard<std::mutex> lock(logger.mutex);
+    logger.stopping = true;
+  }
+  logger.wake.notify_one();
+  if (logger.flusher.joinable()) {
+    logger.flusher.join();
+  }
+  std::lock_guard<std::mutex> lock(logger.mutex);
+  drain_rings();
+}
+
+static void start_logger() {
+  logger.steady_start = std::chrono::steady_clock::now();
+  logger.wall_start = time(nullptr);
+  logger.flusher = std::thread(flush_loop);
+  atexit(stop_logger);
+}
+
+// marks the thread's ring free for the next thread once it has been drained
+struct LogRingOwner {
+  LogRing* ring = nullptr;
+  ~LogRingOwner() {
+    if (ring) {
+      ring->owned.store(false, std::memory_order_release);
+    }
+  }
+};
+
+static thread_local LogRingOwner ring_owner;
+
+static LogRing* thread_ring() {
+  if (ring_owner.ring) {
+    return ring_owner.ring;
+  }
+  static std::once_flag started;
+  std::call_once(started, start_logger);
+  std::lock_guard<std::mutex> lock(logger.mutex);
+  for (LogRing* ring : logger.rings) {
+    if (!ring->owned.load(std::memory_order_acquire) && ring->tail.load() == ring->head.load()) {
+      ring->owned.store(true);
+      ring_owner.ring = ring;
+      return ring;
+    }
+  }
+  ring_owner.ring = new LogRing();
+  logger.rings.push_back(ring_owner.ring);
+  return ring_owner.ring;
+}
+
+uint64_t log_now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// records never wrap: when one doesn't fit before the end of the ring the rest of it is
+// padded and the record starts at the beginning
+uint8_t* log_reserve(size_t size) {
+  LogRing* ring = thread_ring();
+  uint64_t head = ring->head.load(std::memory_order_relaxed);
+  uint64_t tail = ring->tail.load(std::memory_order_acquire);
+  size_t offset = head & (LOG_RING_BYTES - 1);
+  size_t pad = offset + size > LOG_RING_BYTES ? LOG_RING_BYTES - offset : 0;
+  if (size > LOG_RING_BYTES / 2 || head + pad + size - tail > LOG_RING_BYTES) {
+    ring->dropped.fetch_add(1, std::memory_order_relaxed);
+    return nullptr;
+  }
+  if (pad) {
+    // only the size and level, the filler can be as short as 8 bytes
+    uint32_t filler_size = pad;
+    memcpy(&ring->bytes[offset], &filler_size, 4);
+    ring->bytes[offset + 4] = LOG_RECORD_PAD;
+    offset = 0;
+  }
+  ring->reserved = head + pad + size;
+  return &ring->bytes[offset];
+}
+
+void log_commit(uint8_t* record) {
+  LogRing* ring = ring_owner.ring;
+  ring->head.store(ring->reserved, std::memory_order_release);
+  if (ring->reserved - ring->tail.load(std::memory_order_relaxed) > LOG_RING_BYTES / 2) {
+    logger.wake.notify_one();
+  }
+}
+
+void log_flush() {
+  std::lock_guard<std::mutex> lock(logger.mutex);
+  drain_rings();
+}
+
+// formatting //////////////////////////////////////////////////////////////////
+
+struct LogArg {
+  LogArgType type;
+  uint64_t bits;
+  const char* text;
+  uint32_t length;
+};
+
+static bool next_arg(const uint8_t** args, const uint8_t* end, LogArg* arg) {
+  if (*args >= end) {
+    return false;
+  }
+  arg->type = (LogArgType) **args;
+  if (arg->type == LOG_ARG_STRING) {
+    memcpy(&arg->length, *args + 1, 4);
+    arg->text = (const char*) *args + 5;
+    *args += 5 + arg->length;
+  } else {
+    memcpy(&arg->bits, *args + 1, 8);
+    *args += 9;
+  }
+  return true;
+}
+
+static void append_formatted(std::string* out, const char* spec, ...) __attribute__((format(printf, 2, 3)));
+
+static void append_formatted(std::string* out, const char* spec, ...) {
+  char buffer[256];
+  va_list list;
+  va_start(list, spec);
+  int length = vsnprintf(buffer, sizeof(buffer), spec, list);
+  va_end(list);
+  if (length < 0) {
+    return;
+  }
+  if ((size_t) length < sizeof(buffer)) {
+    out->append(buffer, length);
+    return;
+  }
+  std::vector<char> large(length + 1);
+  va_start(list, spec);
+  vsnprintf(large.data(), large.size(), spec, list);
+  va_end(list);
+  out->append(large.data(), length);
+}
+
+// printf rules, one conversion at a time with the argument cast to what the conversion
+// (and its length modifier) expects; a '*' width / precision takes an argument too
+static void format_message(std::string* out, const char* format, const uint8_t* args, const uint8_t* end) {
+  for (const char* c = format; *c; c++) {
+    if (*c != '%') {
+      out->push_back(*c);
+      continue;
+    }
+    if (c[1] == '%') {
+      out->push_back('%');
+      c++;
+      continue;
+    }
+    std::string spec = "%";
+    const char* p = c + 1;
+    while (*p && strchr("-+ #0", *p)) {
+      spec.push_back(*p++);
+    }
+    for (int part = 0; part < 2; part++) {
+      if (part == 1) {
+        if (*p != '.') {
+          break;
+        }
+        spec.push_back(*p++);
+      }
+      if (*p == '*') {
+        LogArg star = {};
+        if (next_arg(&args, end, &star)) {
+          spec += std::to_string((long long) star.bits);
+        }
+        p++;
+      }
+      while (*p >= '0' && *p <= '9') {
+        spec.push_back(*p++);
+      }
+    }
+    while (*p && strchr("hlLqjzt", *p)) {
+      p++;
+    }
+    char conversion = *p;
+    if (!conversion) {
+      break;
+    }
+    c = p;
+
+    LogArg arg = {};
+    if (!next_arg(&args, end, &arg)) {
+      out->append("(missing)");
+      continue;
+    }
+    bool is_string = arg.type == LOG_ARG_STRING;
+    switch (conversion) {
+      case 's':
+        if (is_string) {
+          std::string text(arg.text, arg.length);
+          append_formatted(out, (spec + "s").c_str(), text.c_str());
+        } else {
+          out->append("(not a string)");
+        }
+        break;
+      case 'd':
+      case 'i':
+        if (!is_string) {
+          append_formatted(out, (spec + "lld").c_str(), (long long) arg.bits);
+        }
+        break;
+      case 'u':
+      case 'x':
+      case 'X':
+      case 'o':
+        if (!is_string) {
+          append_formatted(out, (spec + "ll" + conversion).c_str(), (unsigned long long) arg.bits);
+        }
+        break;
+      case 'c':
+        if (!is_string) {
+          append_formatted(out, (spec + "c").c_str(), (int) arg.bits);
+        }
+        break;
+      case 'f':
+      case 'F':
+      case 'e':
+      case 'E':
+      case 'g':
+      case 'G':
+      case 'a':
+      case 'A': {
+        double number;
+        if (arg.type == LOG_ARG_DOUBLE) {
+          memcpy(&number, &arg.bits, 8);
+        } else if (arg.type == LOG_ARG_INT) {
+          number = (double) (int64_t) arg.bits;
+        } else {
+          number = (double) arg.bits;
+        }
+        append_formatted(out, (spec + conversion).c_str(), number);
+        break;
+      }
+      case 'p':
+        append_formatted(out, (spec + "p").c_str(), (void*) (uintptr_t) arg.bits);
+        break;
+      default:
+        break;
+    }
+    if (is_string && conversion != 's') {
+      out->append(arg.text, arg.length);
+    }
+  }
+}
+
+static const char* format_time(uint64_t time) {
+  std::chrono::nanoseconds since_start =
+      std::chrono::nanoseconds(time) - logger.steady_start.time_since_epoch();
+  time_t second = logger.wall_start + std::chrono::duration_cast<std::chrono::seconds>(since_start).count();
+  if (second != logger.cached_second) {
+    struct tm parts;
+    localtime_r(&second, &parts);
+    strftime(logger.cached_time, sizeof(logger.cached_time), "%Y-%m-%d %H:%M:%S", &parts);
+    logger.cached_second = second;
+  }
+  return logger.cached_time;
+}
+
+// consumer side, logger.mutex held: every ring's records merged by time, stable per thread
+static void drain_rings() {
+  struct Pending {
+    uint64_t time;
+    size_t order;
+    size_t offset;
+  };
+  std::vector<uint8_t> copied;
+  std::vector<Pending> pending;
+  uint64_t drops = 0;
+  for (LogRing* ring : logger.rings) {
+    uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+    uint64_t head = ring->head.load(std::memory_order_acquire);
+    while (tail < head) {
+      const uint8_t* bytes = &ring->bytes[tail & (LOG_RING_BYTES - 1)];
+      uint32_t size;
+      memcpy(&size, bytes, 4);
+      if (bytes[4] != LOG_RECORD_PAD) {
+        LogRecord header;
+        memcpy(&header, bytes, sizeof(LogRecord));
+        pending.push_back({header.time, pending.size(), copied.size()});
+        copied.insert(copied.end(), bytes, bytes + size);
+      }
+      tail += size;
+    }
+    ring->tail.store(tail, std::memory_order_release);
+    drops += ring->dropped.load(std::memory_order_relaxed);
+  }
+  if (pending.empty() && drops == logger.reported_drops) {
+    return;
+  }
+  std::stable_sort(pending.begin(), pending.end(), [](const Pending& a, const Pending& b) {
+    return a.time < b.time;
+  });
+
+  std::string out;
+  for (const Pending& entry : pending) {
+    const uint8_t* bytes = &copied[entry.offset];
+    LogRecord header;
+    memcpy(&header, bytes, sizeof(LogRecord));
+    if (header.flags & LOG_PREFIX) {
+      append_formatted(&out, "%s %-5s [%s] [%s:%d] ", format_time(header.time),
+                       header.level < LOG_LEVEL_OFF ? level_names[header.level] : "?", header.func, header.file,
+                       header.line);
+    }
+    const uint8_t* args = bytes + sizeof(LogRecord);
+    format_message(&out, header.format, args, args + header.args_size);
+    if (header.flags & LOG_NEWLINE) {
+      out.push_back('\n');
+    }
+  }
+  if (drops != logger.reported_drops) {
+    append_formatted(&out, "log: %llu records dropped, a thread's ring was full\n",
+                     (unsigned long long) (drops - logger.reported_drops));
+    logger.reported_drops = drops;
+  }
+  fwrite(out.data(), 1, out.size(), stdout);
+  fflush(stdout);
+}
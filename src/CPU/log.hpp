@@ -2,10 +2,39 @@
 #define LOG_H
 
 #include <stdio.h>
+#include <stdint.h>
 #include <string.h>
 #include <time.h>
+#include <type_traits>
 
-char* get_formated_time();
+// Asynchronous logging. A log_* call copies its arguments (strings included, so temporaries
+// like .c_str() are fine) as one binary record into a lock-free ring owned by the calling
+// thread and returns. A background thread merges the rings by timestamp, formats the
+// records and writes them to stdout every LOG_FLUSH_INTERVAL_MS. Whatever is still queued
+// is written at exit; log_flush() writes it right away (before printing to stdout directly,
+// if the order matters). A ring over half full wakes the flusher early, a full one drops
+// the record and the drops are reported.
+//
+// Levels below LOG_LEVEL compile to nothing and their arguments are never evaluated:
+//   -DLOG_LEVEL=LOG_LEVEL_WARN, or cmake -DLOG_LEVEL=WARN
+
+#define LOG_LEVEL_TRACE 0
+#define LOG_LEVEL_DEBUG 1
+#define LOG_LEVEL_INFO 2
+#define LOG_LEVEL_WARN 3
+#define LOG_LEVEL_ERROR 4
+#define LOG_LEVEL_OFF 5
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_TRACE
+#endif
+
+#define LOG_RING_BYTES (1 << 20) // per thread, power of 2
+#define LOG_FLUSH_INTERVAL_MS 2
+
+// record flags
+#define LOG_PREFIX 0x1 // time, level, function and file:line before the message
+#define LOG_NEWLINE 0x2
 
 // remove path from filename
 #ifdef UNIX
@@ -16,37 +45,173 @@ char* get_formated_time();
 #define __SHORT_FILE__ __FILE__
 #endif
 
-// helper macro that can be used safely in ternaries
-#define _LOG_EXPR(...) ((void)(printf(__VA_ARGS__), fflush(stdout)))
+void log_flush(); // write everything logged so far, from any thread
+
+// binary records ////////////////////////////////////////////////////////////
+
+enum LogArgType : uint8_t {
+  LOG_ARG_INT,
+  LOG_ARG_UINT,
+  LOG_ARG_DOUBLE,
+  LOG_ARG_STRING, // u32 length, then the bytes
+  LOG_ARG_POINTER
+};
+
+// the pointers are all string literals (or __func__), only the arguments are copied; a
+// record is at most LOG_RING_BYTES / 2
+struct LogRecord {
+  uint32_t size; // header and arguments, padded to 8
+  uint8_t level;
+  uint8_t flags;
+  uint16_t args_size;
+  int line;
+  uint64_t time; // steady clock ns
+  const char* format;
+  const char* func;
+  const char* file;
+};
+
+uint8_t* log_reserve(size_t size); // in the calling thread's ring, nullptr when it is full
+void log_commit(uint8_t* record);
+uint64_t log_now();
+
+inline size_t log_arg_size(const char* value) {
+  return 5 + (value ? strlen(value) : 0);
+}
+
+inline size_t log_arg_size(char* value) {
+  return log_arg_size((const char*) value);
+}
+
+template <typename T>
+inline size_t log_arg_size(T) {
+  return 9;
+}
+
+inline void log_put_number(uint8_t** out, LogArgType type, const void* value) {
+  **out = type;
+  memcpy(*out + 1, value, 8);
+  *out += 9;
+}
+
+inline void log_put(uint8_t** out, const char* value) {
+  uint32_t length = value ? strlen(value) : 0;
+  **out = LOG_ARG_STRING;
+  memcpy(*out + 1, &length, 4);
+  memcpy(*out + 5, value ? value : "", length);
+  *out += 5 + length;
+}
+
+inline void log_put(uint8_t** out, char* value) {
+  log_put(out, (const char*) value);
+}
+
+template <typename T>
+inline typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type
+log_put(uint8_t** out, T value) {
+  int64_t number = value;
+  log_put_number(out, LOG_ARG_INT, &number);
+}
+
+template <typename T>
+inline typename std::enable_if<(std::is_integral<T>::value && !std::is_signed<T>::value) || std::is_enum<T>::value>::type
+log_put(uint8_t** out, T value) {
+  uint64_t number = (uint64_t) value;
+  log_put_number(out, LOG_ARG_UINT, &number);
+}
+
+template <typename T>
+inline typename std::enable_if<std::is_floating_point<T>::value>::type log_put(uint8_t** out, T value) {
+  double number = value;
+  log_put_number(out, LOG_ARG_DOUBLE, &number);
+}
+
+template <typename T>
+inline typename std::enable_if<std::is_pointer<T>::value>::type log_put(uint8_t** out, T value) {
+  uint64_t number = (uint64_t) (uintptr_t) value;
+  log_put_number(out, LOG_ARG_POINTER, &number);
+}
+
+inline size_t log_args_size() {
+  return 0;
+}
+
+template <typename T, typename... Args>
+inline size_t log_args_size(T first, Args... rest) {
+  return log_arg_size(first) + log_args_size(rest...);
+}
+
+inline void log_put_args(uint8_t**) {}
+
+template <typename T, typename... Args>
+inline void log_put_args(uint8_t** out, T first, Args... rest) {
+  log_put(out, first);
+  log_put_args(out, rest...);
+}
+
+template <typename... Args>
+inline void log_write(uint8_t level, uint8_t flags, const char* func, const char* file, int line,
+                      const char* format, Args... args) {
+  size_t args_size = log_args_size(args...);
+  size_t size = (sizeof(LogRecord) + args_size + 7) & ~(size_t) 7;
+  uint8_t* record = log_reserve(size);
+  if (!record) {
+    return;
+  }
+  LogRecord header = {(uint32_t) size, level, flags, (uint16_t) args_size, line, log_now(), format, func, file};
+  memcpy(record, &header, sizeof(LogRecord));
+  uint8_t* out = record + sizeof(LogRecord);
+  log_put_args(&out, args...);
+  log_commit(record);
+}
 
 // main log macros (single expression, ternary-safe)
-#define __LOG__(format, loglevel, ...) \
-    _LOG_EXPR("%s %-5s [%s] [%s:%d] " format "\n", get_formated_time(), loglevel, __func__, __SHORT_FILE__, __LINE__, ##__VA_ARGS__)
-
-#define __LOG_NONEWL__(format, loglevel, ...) \
-    _LOG_EXPR("%s %-5s [%s] [%s:%d] " format, get_formated_time(), loglevel, __func__, __SHORT_FILE__, __LINE__, ##__VA_ARGS__)
-
-#define __LOG_BARE__(format, ...) \
-    _LOG_EXPR(format "\n", ##__VA_ARGS__)
-
-#define __LOG_BARE_NONEWL_(format, ...) \
-    _LOG_EXPR(format, ##__VA_ARGS__)
-
-// specific log macros
-#define log_debug(format, ...) __LOG__(format, "DEBUG", ##__VA_ARGS__)
-#define log_trace(format, ...) __LOG__(format, "TRACE", ##__VA_ARGS__)
-#define log_warn(format, ...)  __LOG__(format, "WARN",  ##__VA_ARGS__)
-#define log_error(format, ...) __LOG__(format, "ERROR", ##__VA_ARGS__)
-#define log_info(format, ...)  __LOG__(format, "INFO",  ##__VA_ARGS__)
-#define log_log(format, ...)   __LOG_BARE__(format, ##__VA_ARGS__)
-
-// specific log macros with no new line
-#define log_debug_nonewl(format, ...) __LOG_NONEWL__(format, "DEBUG", ##__VA_ARGS__)
-#define log_trace_nonewl(format, ...) __LOG_NONEWL__(format, "TRACE", ##__VA_ARGS__)
-#define log_warn_nonewl(format, ...)  __LOG_NONEWL__(format, "WARN",  ##__VA_ARGS__)
-#define log_error_nonewl(format, ...) __LOG_NONEWL__(format, "ERROR", ##__VA_ARGS__)
-#define log_info_nonewl(format, ...)  __LOG_NONEWL__(format, "INFO",  ##__VA_ARGS__)
-#define log_log_nonewl(format, ...)   __LOG_BARE_NONEWL_(format, ##__VA_ARGS__)
+#define __LOG__(level, flags, format, ...) \
+    log_write(level, flags, __func__, __SHORT_FILE__, __LINE__, "" format, ##__VA_ARGS__)
 
-#endif // LOG_H
+#if LOG_LEVEL <= LOG_LEVEL_TRACE
+#define log_trace(format, ...) __LOG__(LOG_LEVEL_TRACE, LOG_PREFIX | LOG_NEWLINE, format, ##__VA_ARGS__)
+#define log_trace_nonewl(format, ...) __LOG__(LOG_LEVEL_TRACE, LOG_PREFIX, format, ##__VA_ARGS__)
+#else
+#define log_trace(format, ...) ((void) 0)
+#define log_trace_nonewl(format, ...) ((void) 0)
+#endif
+
+#if LOG_LEVEL <= LOG_LEVEL_DEBUG
+#define log_debug(format, ...) __LOG__(LOG_LEVEL_DEBUG, LOG_PREFIX | LOG_NEWLINE, format, ##__VA_ARGS__)
+#define log_debug_nonewl(format, ...) __LOG__(LOG_LEVEL_DEBUG, LOG_PREFIX, format, ##__VA_ARGS__)
+#else
+#define log_debug(format, ...) ((void) 0)
+#define log_debug_nonewl(format, ...) ((void) 0)
+#endif
 
+// log_log is the bare message at info level
+#if LOG_LEVEL <= LOG_LEVEL_INFO
+#define log_info(format, ...) __LOG__(LOG_LEVEL_INFO, LOG_PREFIX | LOG_NEWLINE, format, ##__VA_ARGS__)
+#define log_info_nonewl(format, ...) __LOG__(LOG_LEVEL_INFO, LOG_PREFIX, format, ##__VA_ARGS__)
+#define log_log(format, ...) __LOG__(LOG_LEVEL_INFO, LOG_NEWLINE, format, ##__VA_ARGS__)
+#define log_log_nonewl(format, ...) __LOG__(LOG_LEVEL_INFO, 0, format, ##__VA_ARGS__)
+#else
+#define log_info(format, ...) ((void) 0)
+#define log_info_nonewl(format, ...) ((void) 0)
+#define log_log(format, ...) ((void) 0)
+#define log_log_nonewl(format, ...) ((void) 0)
+#endif
+
+#if LOG_LEVEL <= LOG_LEVEL_WARN
+#define log_warn(format, ...) __LOG__(LOG_LEVEL_WARN, LOG_PREFIX | LOG_NEWLINE, format, ##__VA_ARGS__)
+#define log_warn_nonewl(format, ...) __LOG__(LOG_LEVEL_WARN, LOG_PREFIX, format, ##__VA_ARGS__)
+#else
+#define log_warn(format, ...) ((void) 0)
+#define log_warn_nonewl(format, ...) ((void) 0)
+#endif
+
+#if LOG_LEVEL <= LOG_LEVEL_ERROR
+#define log_error(format, ...) __LOG__(LOG_LEVEL_ERROR, LOG_PREFIX | LOG_NEWLINE, format, ##__VA_ARGS__)
+#define log_error_nonewl(format, ...) __LOG__(LOG_LEVEL_ERROR, LOG_PREFIX, format, ##__VA_ARGS__)
+#else
+#define log_error(format, ...) ((void) 0)
+#define log_error_nonewl(format, ...) ((void) 0)
+#endif
+
+#endif // LOG_H
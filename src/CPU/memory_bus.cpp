@@ -0,0 +1,119 @@
+#include "memory_bus.hpp"
+#include <algorithm>
+#include <string.h>
+
+// every page nobody wrote yet, never counted, freed or owned
+static MemoryPage zero_page;
+
+static void release(MemoryPage* page) {
+  if (page != &zero_page && page->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    delete page;
+  }
+}
+
+MemoryBus::MemoryBus() {
+  for (MemoryPage*& page : pages) {
+    page = &zero_page;
+  }
+}
+
+MemoryBus::~MemoryBus() {
+  for (MemoryPage* page : pages) {
+    release(page);
+  }
+}
+
+// a page the other buses have all let go of is taken over as is, anything else is copied
+u8* MemoryBus::writable(int page) {
+  MemoryPage* shared = pages[page];
+  if (shared != &zero_page && shared->refs.load(std::memory_order_acquire) == 1) {
+    owned |= 1ULL << page;
+    return shared->bytes;
+  }
+  MemoryPage* copy = new MemoryPage;
+  memcpy(copy->bytes, shared->bytes, PAGE_BYTES);
+  release(shared);
+  pages[page] = copy;
+  owned |= 1ULL << page;
+  return copy->bytes;
+}
+
+// writing the byte that is already there leaves the page shared
+void MemoryBus::write_shared(u16 address, u8 value) {
+  int page = address >> PAGE_BITS;
+  if (pages[page]->bytes[address & PAGE_MASK] != value) {
+    writable(page)[address & PAGE_MASK] = value;
+  }
+}
+
+void MemoryBus::read_block(u16 address, u8* out, size_t bytes) const {
+  while (bytes > 0) {
+    size_t offset = address & PAGE_MASK;
+    size_t chunk = std::min(bytes, (size_t) PAGE_BYTES - offset);
+    memcpy(out, pages[address >> PAGE_BITS]->bytes + offset, chunk);
+    out += chunk;
+    bytes -= chunk;
+    address += chunk;
+  }
+}
+
+// like write, a range that is already there leaves a shared page shared
+void MemoryBus::write_block(u16 address, const u8* in, size_t bytes) {
+  while (bytes > 0) {
+    int page = address >> PAGE_BITS;
+    size_t offset = address & PAGE_MASK;
+    size_t chunk = std::min(bytes, (size_t) PAGE_BYTES - offset);
+    if ((owned >> page) & 1) {
+      memcpy(pages[page]->bytes + offset, in, chunk);
+    } else if (memcmp(pages[page]->bytes + offset, in, chunk) != 0) {
+      memcpy(writable(page) + offset, in, chunk);
+    }
+    in += chunk;
+    bytes -= chunk;
+    address += chunk;
+  }
+}
+
+// source may not be running on another thread while its pages are counted; a page both
+// already point at keeps its count, so sharing again with a fork's parent only touches the
+// pages either one wrote since
+void MemoryBus::share(MemoryBus& source) {
+  if (&source == this) {
+    return;
+  }
+  for (int i = 0; i < NUM_PAGES; i++) {
+    MemoryPage* page = source.pages[i];
+    if (page == pages[i]) {
+      continue;
+    }
+    if (page != &zero_page) {
+      page->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+    release(pages[i]);
+    pages[i] = page;
+  }
+  owned = 0;
+  source.owned = 0;
+}
+
+void MemoryBus::clear() {
+  for (MemoryPage*& page : pages) {
+    release(page);
+    page = &zero_page;
+  }
+  owned = 0;
+}
+
+const MemoryPage* MemoryBus::page(u16 address) const {
+  return pages[address >> PAGE_BITS];
+}
+
+size_t MemoryBus::private_bytes() const {
+  size_t bytes = 0;
+  for (const MemoryPage* page : pages) {
+    if (page != &zero_page && page->refs.load(std::memory_order_relaxed) == 1) {
+      bytes += PAGE_BYTES;
+    }
+  }
+  return bytes;
+}
@@ -0,0 +1,77 @@
+#ifndef MEMORY_BUS_HPP
+#define MEMORY_BUS_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// The 64 KB address space as 64 pages of 1 KB, each a pointer to a reference counted page.
+// Pages are shared copy on write: share() points every page of a bus at the pages of
+// another one, and the first write to a page a bus doesn't own gives it a private copy.
+// A write of the byte the page already holds copies nothing. Pages nobody wrote yet are
+// all one static zero page, so instances loaded from one ROM image share its ROM and an
+// instance only pays for the pages it changed (the 8 KB of RAM for invaders).
+//
+// A read is two dependent loads, like the flat array it replaces; a write also tests the
+// owned bit. A bus is run by one thread at a time, the pages it shares can be read by
+// others, since nobody writes a page while it is shared.
+
+#define MEMORY_BYTES 0x10000
+#define PAGE_BITS 10
+#define PAGE_BYTES (1 << PAGE_BITS)
+#define PAGE_MASK (PAGE_BYTES - 1)
+#define NUM_PAGES (MEMORY_BYTES / PAGE_BYTES)
+
+// the copy on write path stays out of the interpreter's opcode switch, even with LTO
+#ifdef __GNUC__
+#define BUS_SLOW_PATH __attribute__((noinline, cold))
+#else
+#define BUS_SLOW_PATH
+#endif
+
+using u8 = std::uint8_t;
+using u16 = std::uint16_t;
+using u32 = std::uint32_t;
+using u64 = std::uint64_t;
+
+struct MemoryPage {
+  std::atomic<u32> refs{1}; // buses pointing at it
+  u8 bytes[PAGE_BYTES];
+};
+
+class MemoryBus {
+  public:
+    MemoryBus(); // every page the zero page
+    ~MemoryBus();
+    MemoryBus(const MemoryBus&) = delete;
+    MemoryBus& operator=(const MemoryBus&) = delete;
+
+    u8 operator[](u16 address) const {
+      return pages[address >> PAGE_BITS]->bytes[address & PAGE_MASK];
+    }
+    void write(u16 address, u8 value) {
+      int page = address >> PAGE_BITS;
+      if ((owned >> page) & 1) {
+        pages[page]->bytes[address & PAGE_MASK] = value;
+      } else {
+        write_shared(address, value);
+      }
+    }
+    // whole ranges, wrapping at the end of the address space
+    void read_block(u16 address, u8* out, size_t bytes) const;
+    void write_block(u16 address, const u8* in, size_t bytes);
+
+    void share(MemoryBus& source); // this bus reads what source holds, both copy on their next write
+    void clear(); // back to all zeroes
+    const MemoryPage* page(u16 address) const; // the same page means the same bytes
+    size_t private_bytes() const; // in pages no other bus points at
+
+  private:
+    MemoryPage* pages[NUM_PAGES];
+    u64 owned = 0; // bit per page this bus holds the only reference to
+
+    BUS_SLOW_PATH void write_shared(u16 address, u8 value); // to a page this bus doesn't own
+    u8* writable(int page);
+};
+
+#endif
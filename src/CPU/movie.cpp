@@ -0,0 +1,84 @@
+#include "movie.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include "keys.hpp"
+
+// letter for each inputs[] index
+static const char input_letters[NUM_INPUTS] = {'L', 'R', 'S', 'C'};
+
+static std::string bits_to_letters(u8 bits) {
+  std::string letters;
+  for (int i = 0; i < NUM_INPUTS; i++) {
+    if (bits & (1 << i)) {
+      letters += input_letters[i];
+    }
+  }
+  return letters.empty() ? "-" : letters;
+}
+
+bool InputMovie::load(const std::string& file_path) {
+  FILE* file = fopen(file_path.c_str(), "r");
+  if (!file) {
+    return false;
+  }
+  frames.clear();
+  char line[128];
+  while (fgets(line, sizeof(line), file)) {
+    if (line[0] == '#' || line[0] == '\n') {
+      continue;
+    }
+    char* cursor = nullptr;
+    long count = strtol(line, &cursor, 10);
+    u8 bits = 0;
+    for (; *cursor && *cursor != '\n'; cursor++) {
+      for (int i = 0; i < NUM_INPUTS; i++) {
+        if (*cursor == input_letters[i]) {
+          bits |= 1 << i;
+        }
+      }
+    }
+    frames.insert(frames.end(), count > 0 ? count : 0, bits);
+  }
+  fclose(file);
+  return true;
+}
+
+bool InputMovie::save(const std::string& file_path) {
+  FILE* file = fopen(file_path.c_str(), "w");
+  if (!file) {
+    return false;
+  }
+  fprintf(file, "# <frames> <inputs>  L left, R right, S shoot / start, C coin, - nothing\n");
+  size_t i = 0;
+  while (i < frames.size()) {
+    size_t run = 1;
+    while (i + run < frames.size() && frames[i + run] == frames[i]) {
+      run++;
+    }
+    fprintf(file, "%zu %s\n", run, bits_to_letters(frames[i]).c_str());
+    i += run;
+  }
+  bool ok = !ferror(file);
+  fclose(file);
+  return ok;
+}
+
+void InputMovie::record(u8 input_bits) {
+  frames.push_back(input_bits);
+}
+
+u8 InputMovie::get(size_t frame) {
+  return frame < frames.size() ? frames[frame] : 0;
+}
+
+size_t InputMovie::size() {
+  return frames.size();
+}
+
+size_t InputMovie::first_pressed() {
+  size_t frame = 0;
+  while (frame < frames.size() && frames[frame] == 0) {
+    frame++;
+  }
+  return frame;
+}
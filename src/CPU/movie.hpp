@@ -0,0 +1,31 @@
+#ifndef MOVIE_HPP
+#define MOVIE_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Input movies: the state of the arcade inputs for every frame as a bitmask
+// (bit n = inputs[n]), replayed through _8080::set_inputs so runs are deterministic.
+//
+// text format, one run of identical frames per line:
+//   # comment
+//   <frames> <inputs>     inputs: L left, R right, S shoot / start, C coin, - nothing
+//   e.g. "30 LS" holds left and shoot for 30 frames
+
+using u8 = std::uint8_t;
+
+class InputMovie {
+  public:
+    bool load(const std::string& file_path);
+    bool save(const std::string& file_path);
+    void record(u8 input_bits);
+    u8 get(size_t frame); // nothing pressed past the end
+    size_t size();
+    size_t first_pressed(); // the first frame with something pressed, size() if none
+
+  private:
+    std::vector<u8> frames;
+};
+
+#endif
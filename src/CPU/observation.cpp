@@ -0,0 +1,352 @@
+#include "observation.hpp"
+#include <algorithm>
+#include <string.h>
+
+// x86-64 always has SSE2, AVX2 is compiled per function and only called when the CPU has it
+#if defined(__x86_64__) && defined(__GNUC__)
+#define OBSERVATION_X86
+#include <immintrin.h>
+#define AVX2_TARGET __attribute__((target("avx2")))
+#endif
+
+#define COLUMN_BYTES 32 // one upright column of VRAM, bottom up
+#define PITCH OBSERVATION_PACKED_PITCH
+
+using u64 = std::uint64_t;
+
+// the 8 bytes of a block go up the packed frame: byte b is row 255 - 8k - b of the 8
+// columns starting at x0
+static inline void store_block(u8* out, int x0, int k, u64 block) {
+  u8* bottom = out + (OBSERVATION_HEIGHT - 1 - 8 * k) * PITCH + x0 / 8;
+  for (int b = 0; b < 8; b++) {
+    bottom[-b * PITCH] = (u8) (block >> (8 * b));
+  }
+}
+
+// scalar kernels, the reference is capture's vram_to_gray /////////////////////
+
+// bit b of byte j <-> bit j of byte b
+static inline u64 transpose_bits(u64 x) {
+  u64 t = (x ^ (x >> 7)) & 0x00AA00AA00AA00AAULL;
+  x ^= t ^ (t << 7);
+  t = (x ^ (x >> 14)) & 0x0000CCCC0000CCCCULL;
+  x ^= t ^ (t << 14);
+  t = (x ^ (x >> 28)) & 0x00000000F0F0F0F0ULL;
+  x ^= t ^ (t << 28);
+  return x;
+}
+
+// byte j of a block is column x0 + 7 - j, so after the transpose the leftmost pixel is the top bit
+static void transpose_scalar(const u8* vram, u8* out) {
+  for (int x0 = 0; x0 < OBSERVATION_WIDTH; x0 += 8) {
+    for (int k = 0; k < COLUMN_BYTES; k++) {
+      u64 block = 0;
+      for (int j = 0; j < 8; j++) {
+        block |= (u64) vram[(x0 + 7 - j) * COLUMN_BYTES + k] << (8 * j);
+      }
+      store_block(out, x0, k, transpose_bits(block));
+    }
+  }
+}
+
+static void expand_row_scalar(const u8* row, u8* out, u8 on) {
+  for (int x = 0; x < OBSERVATION_WIDTH; x++) {
+    out[x] = (row[x >> 3] >> (7 - (x & 7))) & 1 ? on : 0;
+  }
+}
+
+static void accumulate_row_scalar(const u8* row, u8* counts) {
+  for (int x = 0; x < OBSERVATION_WIDTH; x++) {
+    counts[x] += (row[x >> 3] >> (7 - (x & 7))) & 1;
+  }
+}
+
+// pairs of columns, 0 - 4 lit pixels -> 0, 64, 128, 192, 255
+static void pool_pairs_scalar(const u8* counts, u8* out) {
+  for (int x = 0; x < OBSERVATION_HALF_WIDTH; x++) {
+    out[x] = std::min((counts[2 * x] + counts[2 * x + 1]) * 64, 255);
+  }
+}
+
+#ifdef OBSERVATION_X86
+
+// sse2 ////////////////////////////////////////////////////////////////////////
+
+static inline __m128i transpose_bits_sse2(__m128i x) {
+  __m128i t = _mm_and_si128(_mm_xor_si128(x, _mm_srli_epi64(x, 7)), _mm_set1_epi64x(0x00AA00AA00AA00AALL));
+  x = _mm_xor_si128(x, _mm_xor_si128(t, _mm_slli_epi64(t, 7)));
+  t = _mm_and_si128(_mm_xor_si128(x, _mm_srli_epi64(x, 14)), _mm_set1_epi64x(0x0000CCCC0000CCCCLL));
+  x = _mm_xor_si128(x, _mm_xor_si128(t, _mm_slli_epi64(t, 14)));
+  t = _mm_and_si128(_mm_xor_si128(x, _mm_srli_epi64(x, 28)), _mm_set1_epi64x(0x00000000F0F0F0F0LL));
+  return _mm_xor_si128(x, _mm_xor_si128(t, _mm_slli_epi64(t, 28)));
+}
+
+// 16 bytes of 8 columns are byte transposed with three rounds of unpacks, which leaves
+// blocks k and k + 1 in the two 64 bit lanes of each vector
+static void transpose_sse2(const u8* vram, u8* out) {
+  for (int x0 = 0; x0 < OBSERVATION_WIDTH; x0 += 8) {
+    for (int half = 0; half < 2; half++) {
+      __m128i c[8];
+      for (int j = 0; j < 8; j++) {
+        c[j] = _mm_loadu_si128((const __m128i*) (vram + (x0 + 7 - j) * COLUMN_BYTES + half * 16));
+      }
+      __m128i a[8];
+      for (int j = 0; j < 4; j++) {
+        a[2 * j] = _mm_unpacklo_epi8(c[2 * j], c[2 * j + 1]); // k 0 - 7
+        a[2 * j + 1] = _mm_unpackhi_epi8(c[2 * j], c[2 * j + 1]); // k 8 - 15
+      }
+      __m128i b[8];
+      for (int j = 0; j < 2; j++) {
+        b[4 * j] = _mm_unpacklo_epi16(a[4 * j], a[4 * j + 2]); // k 0 - 3
+        b[4 * j + 1] = _mm_unpackhi_epi16(a[4 * j], a[4 * j + 2]); // k 4 - 7
+        b[4 * j + 2] = _mm_unpacklo_epi16(a[4 * j + 1], a[4 * j + 3]); // k 8 - 11
+        b[4 * j + 3] = _mm_unpackhi_epi16(a[4 * j + 1], a[4 * j + 3]); // k 12 - 15
+      }
+      for (int i = 0; i < 4; i++) {
+        __m128i low = transpose_bits_sse2(_mm_unpacklo_epi32(b[i], b[i + 4])); // k 4i, 4i + 1
+        __m128i high = transpose_bits_sse2(_mm_unpackhi_epi32(b[i], b[i + 4])); // k 4i + 2, 4i + 3
+        u64 blocks[4];
+        _mm_storeu_si128((__m128i*) blocks, low);
+        _mm_storeu_si128((__m128i*) (blocks + 2), high);
+        for (int n = 0; n < 4; n++) {
+          store_block(out, x0, half * 16 + 4 * i + n, blocks[n]);
+        }
+      }
+    }
+  }
+}
+
+// 16 pixels from 2 packed bytes, 0xFF where lit
+static inline __m128i bit_mask_sse2(const u8* row) {
+  __m128i v = _mm_cvtsi32_si128(row[0] | (row[1] << 8));
+  v = _mm_unpacklo_epi8(v, v);
+  v = _mm_unpacklo_epi16(v, v);
+  v = _mm_unpacklo_epi32(v, v);
+  __m128i bits = _mm_set_epi8(1, 2, 4, 8, 16, 32, 64, (char) 0x80, 1, 2, 4, 8, 16, 32, 64, (char) 0x80);
+  return _mm_cmpeq_epi8(_mm_and_si128(v, bits), bits);
+}
+
+static void expand_row_sse2(const u8* row, u8* out, u8 on) {
+  __m128i value = _mm_set1_epi8((char) on);
+  for (int x = 0; x < OBSERVATION_WIDTH; x += 16) {
+    _mm_storeu_si128((__m128i*) (out + x), _mm_and_si128(bit_mask_sse2(row + x / 8), value));
+  }
+}
+
+// the mask is -1 where lit
+static void accumulate_row_sse2(const u8* row, u8* counts) {
+  for (int x = 0; x < OBSERVATION_WIDTH; x += 16) {
+    __m128i sum = _mm_loadu_si128((const __m128i*) (counts + x));
+    _mm_storeu_si128((__m128i*) (counts + x), _mm_sub_epi8(sum, bit_mask_sse2(row + x / 8)));
+  }
+}
+
+// the pair sums in 16 bit lanes, times 64 and packed back with saturation (256 -> 255)
+static void pool_pairs_sse2(const u8* counts, u8* out) {
+  __m128i low_bytes = _mm_set1_epi16(0x00FF);
+  for (int x = 0; x < OBSERVATION_WIDTH; x += 32) {
+    __m128i first = _mm_loadu_si128((const __m128i*) (counts + x));
+    __m128i second = _mm_loadu_si128((const __m128i*) (counts + x + 16));
+    first = _mm_add_epi16(_mm_and_si128(first, low_bytes), _mm_srli_epi16(first, 8));
+    second = _mm_add_epi16(_mm_and_si128(second, low_bytes), _mm_srli_epi16(second, 8));
+    _mm_storeu_si128((__m128i*) (out + x / 2),
+                     _mm_packus_epi16(_mm_slli_epi16(first, 6), _mm_slli_epi16(second, 6)));
+  }
+}
+
+// avx2 ////////////////////////////////////////////////////////////////////////
+
+AVX2_TARGET static inline __m256i transpose_bits_avx2(__m256i x) {
+  __m256i t = _mm256_and_si256(_mm256_xor_si256(x, _mm256_srli_epi64(x, 7)), _mm256_set1_epi64x(0x00AA00AA00AA00AALL));
+  x = _mm256_xor_si256(x, _mm256_xor_si256(t, _mm256_slli_epi64(t, 7)));
+  t = _mm256_and_si256(_mm256_xor_si256(x, _mm256_srli_epi64(x, 14)), _mm256_set1_epi64x(0x0000CCCC0000CCCCLL));
+  x = _mm256_xor_si256(x, _mm256_xor_si256(t, _mm256_slli_epi64(t, 14)));
+  t = _mm256_and_si256(_mm256_xor_si256(x, _mm256_srli_epi64(x, 28)), _mm256_set1_epi64x(0x00000000F0F0F0F0LL));
+  return _mm256_xor_si256(x, _mm256_xor_si256(t, _mm256_slli_epi64(t, 28)));
+}
+
+// the sse2 transpose on whole columns: the unpacks stay inside their 128 bit lanes, so
+// the low lane holds blocks k, k + 1 and the high lane blocks k + 16, k + 17
+AVX2_TARGET static void transpose_avx2(const u8* vram, u8* out) {
+  for (int x0 = 0; x0 < OBSERVATION_WIDTH; x0 += 8) {
+    __m256i c[8];
+    for (int j = 0; j < 8; j++) {
+      c[j] = _mm256_loadu_si256((const __m256i*) (vram + (x0 + 7 - j) * COLUMN_BYTES));
+    }
+    __m256i a[8];
+    for (int j = 0; j < 4; j++) {
+      a[2 * j] = _mm256_unpacklo_epi8(c[2 * j], c[2 * j + 1]);
+      a[2 * j + 1] = _mm256_unpackhi_epi8(c[2 * j], c[2 * j + 1]);
+    }
+    __m256i b[8];
+    for (int j = 0; j < 2; j++) {
+      b[4 * j] = _mm256_unpacklo_epi16(a[4 * j], a[4 * j + 2]);
+      b[4 * j + 1] = _mm256_unpackhi_epi16(a[4 * j], a[4 * j + 2]);
+      b[4 * j + 2] = _mm256_unpacklo_epi16(a[4 * j + 1], a[4 * j + 3]);
+      b[4 * j + 3] = _mm256_unpackhi_epi16(a[4 * j + 1], a[4 * j + 3]);
+    }
+    for (int i = 0; i < 4; i++) {
+      __m256i low = transpose_bits_avx2(_mm256_unpacklo_epi32(b[i], b[i + 4]));
+      __m256i high = transpose_bits_avx2(_mm256_unpackhi_epi32(b[i], b[i + 4]));
+      u64 blocks[8];
+      _mm256_storeu_si256((__m256i*) blocks, low);
+      _mm256_storeu_si256((__m256i*) (blocks + 4), high);
+      int k = 4 * i;
+      store_block(out, x0, k, blocks[0]);
+      store_block(out, x0, k + 1, blocks[1]);
+      store_block(out, x0, k + 16, blocks[2]);
+      store_block(out, x0, k + 17, blocks[3]);
+      store_block(out, x0, k + 2, blocks[4]);
+      store_block(out, x0, k + 3, blocks[5]);
+      store_block(out, x0, k + 18, blocks[6]);
+      store_block(out, x0, k + 19, blocks[7]);
+    }
+  }
+}
+
+// 32 pixels from 4 packed bytes, the shuffle spreads each byte over 8 lanes
+AVX2_TARGET static inline __m256i bit_mask_avx2(const u8* row) {
+  int four;
+  memcpy(&four, row, 4);
+  __m256i spread = _mm256_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+                                    2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+  __m256i v = _mm256_shuffle_epi8(_mm256_set1_epi32(four), spread);
+  __m256i bits = _mm256_set1_epi64x(0x0102040810204080LL);
+  return _mm256_cmpeq_epi8(_mm256_and_si256(v, bits), bits);
+}
+
+AVX2_TARGET static void expand_row_avx2(const u8* row, u8* out, u8 on) {
+  __m256i value = _mm256_set1_epi8((char) on);
+  for (int x = 0; x < OBSERVATION_WIDTH; x += 32) {
+    _mm256_storeu_si256((__m256i*) (out + x), _mm256_and_si256(bit_mask_avx2(row + x / 8), value));
+  }
+}
+
+AVX2_TARGET static void accumulate_row_avx2(const u8* row, u8* counts) {
+  for (int x = 0; x < OBSERVATION_WIDTH; x += 32) {
+    __m256i sum = _mm256_loadu_si256((const __m256i*) (counts + x));
+    _mm256_storeu_si256((__m256i*) (counts + x), _mm256_sub_epi8(sum, bit_mask_avx2(row + x / 8)));
+  }
+}
+
+#endif
+
+// dispatch ////////////////////////////////////////////////////////////////////
+
+static void transpose(SimdLevel simd, const u8* vram, u8* out) {
+#ifdef OBSERVATION_X86
+  if (simd == SIMD_AVX2) {
+    transpose_avx2(vram, out);
+    return;
+  } else if (simd == SIMD_SSE2) {
+    transpose_sse2(vram, out);
+    return;
+  }
+#endif
+  transpose_scalar(vram, out);
+}
+
+static void expand_row(SimdLevel simd, const u8* row, u8* out, u8 on) {
+#ifdef OBSERVATION_X86
+  if (simd == SIMD_AVX2) {
+    expand_row_avx2(row, out, on);
+    return;
+  } else if (simd == SIMD_SSE2) {
+    expand_row_sse2(row, out, on);
+    return;
+  }
+#endif
+  expand_row_scalar(row, out, on);
+}
+
+static void accumulate_row(SimdLevel simd, const u8* row, u8* counts) {
+#ifdef OBSERVATION_X86
+  if (simd == SIMD_AVX2) {
+    accumulate_row_avx2(row, counts);
+    return;
+  } else if (simd == SIMD_SSE2) {
+    accumulate_row_sse2(row, counts);
+    return;
+  }
+#endif
+  accumulate_row_scalar(row, counts);
+}
+
+// 224 counts is 112 outputs, too short for the 256 bit pack to pay off
+static void pool_pairs(SimdLevel simd, const u8* counts, u8* out) {
+#ifdef OBSERVATION_X86
+  if (simd != SIMD_SCALAR) {
+    pool_pairs_sse2(counts, out);
+    return;
+  }
+#endif
+  pool_pairs_scalar(counts, out);
+}
+
+// observer ////////////////////////////////////////////////////////////////////
+
+void Observer::set_simd_level(SimdLevel level) {
+  simd = std::min(level, detect_simd_level());
+}
+
+SimdLevel Observer::get_simd_level() {
+  return simd;
+}
+
+void Observer::packed(const u8* vram, u8* out) {
+  transpose(simd, vram, out);
+}
+
+void Observer::gray(const u8* vram, u8* out) {
+  transpose(simd, vram, frame);
+  for (int y = 0; y < OBSERVATION_HEIGHT; y++) {
+    expand_row(simd, frame + y * PITCH, out + y * OBSERVATION_WIDTH, 0xFF);
+  }
+}
+
+void Observer::gray_half(const u8* vram, u8* out) {
+  transpose(simd, vram, frame);
+  for (int y = 0; y < OBSERVATION_HALF_HEIGHT; y++) {
+    memset(counts, 0, sizeof(counts));
+    accumulate_row(simd, frame + 2 * y * PITCH, counts);
+    accumulate_row(simd, frame + (2 * y + 1) * PITCH, counts);
+    pool_pairs(simd, counts, out + y * OBSERVATION_HALF_WIDTH);
+  }
+}
+
+// cell (i, j) covers columns [224 i / 84, 224 (i + 1) / 84) and the same for the rows,
+// so a cell is 2 - 3 x 3 - 4 pixels and its value only depends on the area and lit pixels
+struct SmallCells {
+  int left[OBSERVATION_SMALL_SIZE + 1];
+  u8 value[13][13]; // [area][lit]
+  SmallCells() {
+    for (int i = 0; i <= OBSERVATION_SMALL_SIZE; i++) {
+      left[i] = i * OBSERVATION_WIDTH / OBSERVATION_SMALL_SIZE;
+    }
+    for (int area = 1; area <= 12; area++) {
+      for (int lit = 0; lit <= area; lit++) {
+        value[area][lit] = (lit * 255 + area / 2) / area;
+      }
+    }
+  }
+};
+
+void Observer::gray_84(const u8* vram, u8* out) {
+  static const SmallCells cells;
+  transpose(simd, vram, frame);
+  for (int j = 0; j < OBSERVATION_SMALL_SIZE; j++) {
+    int top = j * OBSERVATION_HEIGHT / OBSERVATION_SMALL_SIZE;
+    int bottom = (j + 1) * OBSERVATION_HEIGHT / OBSERVATION_SMALL_SIZE;
+    memset(counts, 0, sizeof(counts));
+    for (int y = top; y < bottom; y++) {
+      accumulate_row(simd, frame + y * PITCH, counts);
+    }
+    u8* out_row = out + j * OBSERVATION_SMALL_SIZE;
+    for (int i = 0; i < OBSERVATION_SMALL_SIZE; i++) {
+      int left = cells.left[i];
+      int right = cells.left[i + 1];
+      int lit = counts[left] + counts[left + 1] + (right - left == 3 ? counts[left + 2] : 0);
+      out_row[i] = cells.value[(right - left) * (bottom - top)][lit];
+    }
+  }
+}
@@ -0,0 +1,47 @@
+#ifndef OBSERVATION_HPP
+#define OBSERVATION_HPP
+
+#include <cstdint>
+#include "scaler.hpp"
+
+// Observations for learning agents straight from the rotated 1bpp VRAM (0x2400 - 0x3FFF),
+// without going through the ARGB screen. Everything is upright (224 wide, 256 high) and
+// written into the caller's buffer, nothing is allocated per call.
+//
+//   packed - 1bpp, 28 bytes per row, the most significant bit is the leftmost pixel
+//   gray   - 8 bit, 0 or 255
+//   half   - 112x128 8 bit, the mean of each 2x2 block (0, 64, 128, 192, 255)
+//   84x84  - 8 bit, the mean of each cell (2 - 3 pixels wide, 3 - 4 high), rounded
+//
+// the VRAM is column major (32 bytes per upright column, bottom up), so every kernel starts
+// with an 8x8 bit matrix transpose; the SSE2 / AVX2 versions transpose 2 / 4 blocks at once
+// and expand the bits 16 / 32 pixels at a time. observation_check checks them against the
+// scalar reference
+
+#define OBSERVATION_VRAM_BYTES 0x1C00
+#define OBSERVATION_WIDTH 224
+#define OBSERVATION_HEIGHT 256
+#define OBSERVATION_PACKED_PITCH (OBSERVATION_WIDTH / 8)
+#define OBSERVATION_PACKED_BYTES (OBSERVATION_PACKED_PITCH * OBSERVATION_HEIGHT)
+#define OBSERVATION_HALF_WIDTH (OBSERVATION_WIDTH / 2)
+#define OBSERVATION_HALF_HEIGHT (OBSERVATION_HEIGHT / 2)
+#define OBSERVATION_SMALL_SIZE 84
+
+using u8 = std::uint8_t;
+
+class Observer {
+  public:
+    void set_simd_level(SimdLevel level); // capped at what the CPU supports
+    SimdLevel get_simd_level();
+    void packed(const u8* vram, u8* out); // OBSERVATION_PACKED_BYTES
+    void gray(const u8* vram, u8* out); // OBSERVATION_WIDTH * OBSERVATION_HEIGHT
+    void gray_half(const u8* vram, u8* out); // OBSERVATION_HALF_WIDTH * OBSERVATION_HALF_HEIGHT
+    void gray_84(const u8* vram, u8* out); // OBSERVATION_SMALL_SIZE * OBSERVATION_SMALL_SIZE
+
+  private:
+    SimdLevel simd = detect_simd_level();
+    u8 frame[OBSERVATION_PACKED_BYTES]; // the packed frame the pooled kernels start from
+    u8 counts[OBSERVATION_WIDTH]; // lit pixels per column over a band of rows
+};
+
+#endif
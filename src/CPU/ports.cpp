@@ -0,0 +1,102 @@
+#include "ports.hpp"
+#include "8080.hpp"
+
+// input latch ////////////////////////////////////////////////////////////////
+
+InputLatch::InputLatch() {
+  set_inputs(0);
+}
+
+void InputLatch::set_inputs(u8 input_bits) {
+  this->input_bits = input_bits;
+  bool coin = input_bits & (1 << INSERT_COIN);
+  bool shoot = input_bits & (1 << SPACE_KEY);
+  bool left = input_bits & (1 << A_KEY);
+  bool right = input_bits & (1 << D_KEY);
+
+  // space doubles as the one player start button
+  port_bytes[INP0] = 0;
+  port_bytes[INP1] = (coin << CREDIT) | (shoot << ONEP_START) | (1 << ALWAYS_ONE) |
+                     (shoot << ONEP_SHOT) | (left << ONEP_LEFT) | (right << ONEP_RIGHT);
+  port_bytes[INP2] = 0;
+}
+
+u8 InputLatch::get_inputs() {
+  return input_bits;
+}
+
+u8 InputLatch::read(u8 port) {
+  return port_bytes[port];
+}
+
+void InputLatch::save(PortState* state) {
+  state->input_bits = input_bits;
+}
+
+void InputLatch::restore(const PortState& state) {
+  set_inputs(state.input_bits);
+}
+
+// shift register /////////////////////////////////////////////////////////////
+
+u8 ShiftRegister::read(u8 port) {
+  return result;
+}
+
+void ShiftRegister::write(u8 port, u8 value) {
+  if (port == SHFTAMNT) {
+    offset = value & SHIFT_AND_BITS;
+  } else {
+    this->value = (this->value >> 8) | (value << 8);
+  }
+  result = ((this->value << offset) >> 8) & 0xFF;
+}
+
+void ShiftRegister::save(PortState* state) {
+  state->shift_value = value;
+  state->shift_offset = offset;
+}
+
+void ShiftRegister::restore(const PortState& state) {
+  value = state.shift_value;
+  offset = state.shift_offset;
+  result = ((value << offset) >> 8) & 0xFF;
+}
+
+// sound latch ////////////////////////////////////////////////////////////////
+
+SoundLatch::SoundLatch(Audio** audio) : audio(audio) {}
+
+void SoundLatch::write(u8 port, u8 value) {
+  if (port == SOUND1) {
+    sound1 = value;
+    if (*audio) {
+      (*audio)->write_sound1(value);
+    }
+  } else {
+    sound2 = value;
+    if (*audio) {
+      (*audio)->write_sound2(value);
+    }
+  }
+}
+
+void SoundLatch::save(PortState* state) {
+  state->sound1 = sound1;
+  state->sound2 = sound2;
+}
+
+void SoundLatch::restore(const PortState& state) {
+  sound1 = state.sound1;
+  sound2 = state.sound2;
+}
+
+// watchdog ///////////////////////////////////////////////////////////////////
+
+void Watchdog::write(u8 port, u8 value) {
+  resets++;
+}
+
+uint64_t Watchdog::get_resets() {
+  return resets;
+}
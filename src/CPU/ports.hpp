@@ -0,0 +1,100 @@
+#ifndef PORTS_HPP
+#define PORTS_HPP
+
+#include <cstdint>
+
+// The arcade board's IN / OUT hardware as devices plugged into a 256 entry dispatch
+// table per port direction. Every _8080 owns its own devices, so several instances
+// never share a shift register or input state.
+//
+// IN 1 and IN 3 are read constantly by the game's main loop, so devices keep the
+// byte a read returns ready and only rebuild it when their inputs change.
+
+#define NUM_PORTS 256
+
+// INP1 bits
+#define CREDIT 0
+#define TWOP_START 1
+#define ONEP_START 2
+#define ALWAYS_ONE 3
+#define ONEP_SHOT 4
+#define ONEP_LEFT 5
+#define ONEP_RIGHT 6
+#define NOT_CONNECTED 7
+
+#define SHIFT_AND_BITS 0b00000111
+
+using u8 = std::uint8_t;
+using u16 = std::uint16_t;
+
+class Audio;
+
+// the bytes latched in the devices, plain data so a snapshot can copy it
+struct PortState {
+  u8 input_bits;
+  u16 shift_value;
+  u8 shift_offset;
+  u8 sound1;
+  u8 sound2;
+};
+
+class PortDevice {
+  public:
+    virtual ~PortDevice() {}
+    virtual u8 read(u8 port) { return 0; }
+    virtual void write(u8 port, u8 value) {}
+};
+
+// INP0 / INP1 / INP2, the bytes are rebuilt by set_inputs only
+class InputLatch : public PortDevice {
+  public:
+    InputLatch();
+    void set_inputs(u8 input_bits); // bit n = inputs[n]
+    u8 get_inputs();
+    u8 read(u8 port) override;
+    void save(PortState* state);
+    void restore(const PortState& state);
+
+  private:
+    u8 input_bits = 0;
+    u8 port_bytes[3];
+};
+
+// SHFTAMNT / SHFT_DATA in, SHFT_IN out, the result is shifted on write
+class ShiftRegister : public PortDevice {
+  public:
+    u8 read(u8 port) override;
+    void write(u8 port, u8 value) override;
+    void save(PortState* state);
+    void restore(const PortState& state);
+
+  private:
+    u16 value = 0;
+    u8 offset = 0;
+    u8 result = 0;
+};
+
+// SOUND1 / SOUND2, latched and forwarded to the audio engine when there is one
+class SoundLatch : public PortDevice {
+  public:
+    SoundLatch(Audio** audio);
+    void write(u8 port, u8 value) override;
+    void save(PortState* state);
+    void restore(const PortState& state); // the audio engine is not told, nothing retriggers
+
+  private:
+    Audio** audio;
+    u8 sound1 = 0;
+    u8 sound2 = 0;
+};
+
+class Watchdog : public PortDevice {
+  public:
+    void write(u8 port, u8 value) override;
+    uint64_t get_resets();
+
+  private:
+    uint64_t resets = 0;
+};
+
+#endif
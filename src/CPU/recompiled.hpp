@@ -0,0 +1,41 @@
+#ifndef RECOMPILED_HPP
+#define RECOMPILED_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+// Alternate execution engine for a fixed ROM: invaders_recompiler discovers the code of
+// a ROM image by recursive descent from the reset and RST vectors and emits one C++
+// function per basic block. _8080::use_recompiled plugs the generated program in, pcs
+// without a block (RAM code, code only reached through PCHL) stay on the interpreter.
+//
+// Blocks run straight-line code without fetch / decode and check the cycle deadline
+// after every instruction, so interrupts land on exactly the same instruction as with
+// the interpreter. The instruction ending a block (jumps, calls, returns, RST, HLT)
+// runs through the interpreter itself.
+
+class _8080;
+
+using u16 = std::uint16_t;
+using u64 = std::uint64_t;
+
+// returns true when the block ran its final instruction, false when it stopped at the
+// deadline or fell through into the next block
+typedef bool (*BlockFunction)(_8080* cpu, u64 deadline);
+
+struct RecompiledBlock {
+  u16 start;
+  u16 last; // address of the final instruction
+  BlockFunction run;
+};
+
+struct RecompiledProgram {
+  const char* name;
+  u64 rom_hash; // hash_bytes of the ROM the blocks were generated from
+  u16 rom_start;
+  u16 rom_size;
+  const RecompiledBlock* blocks;
+  size_t num_blocks;
+};
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef RECOMPILED_BLOCK_HPP
+#define RECOMPILED_BLOCK_HPP
+
+#include "8080.hpp"
+#include "recompiled.hpp"
+
+// what generated blocks may touch inside an _8080, the helpers are the interpreter's own
+// so the flags come out exactly the same
+struct BlockAccess {
+  static u64& cycles(_8080* cpu) { return cpu->cycles; }
+  static void execute(_8080* cpu, u8 opcode) { cpu->execute_instruction(opcode); }
+  static void increment(_8080* cpu, u8* reg) { cpu->increment_register(reg, &cpu->regs.f); }
+  static void decrement(_8080* cpu, u8* reg) { cpu->decrement_register(reg, &cpu->regs.f); }
+  static void add(_8080* cpu, u8 val) { cpu->add_register(&cpu->regs.a, val, &cpu->regs.f); }
+  static void subtract(_8080* cpu, u8 val) { cpu->subtract_register(&cpu->regs.a, val, &cpu->regs.f); }
+  static void bitwise_and(_8080* cpu, u8 val) { cpu->bitwise_AND_register(&cpu->regs.a, val, &cpu->regs.f); }
+  static void bitwise_xor(_8080* cpu, u8 val) { cpu->bitwise_XOR_register(&cpu->regs.a, val, &cpu->regs.f); }
+  static void bitwise_or(_8080* cpu, u8 val) { cpu->bitwise_OR_register(&cpu->regs.a, val, &cpu->regs.f); }
+  static void compare(_8080* cpu, u8 val) { cpu->compare_register(&cpu->regs.a, val, &cpu->regs.f); }
+  static void dad(_8080* cpu, u16* reg_pair) { cpu->DAD_register(&cpu->regs.hl, reg_pair, &cpu->regs.f); }
+  static void push(_8080* cpu, u8* first, u8* second) { cpu->push_register(first, second); }
+  static void pop(_8080* cpu, u8* first, u8* second) { cpu->pop_register(first, second); }
+};
+
+#endif
@@ -0,0 +1,409 @@
+#include "scaler.hpp"
+#include <algorithm>
+#include <string.h>
+#include "log.hpp"
+
+// x86-64 always has SSE2, AVX2 is compiled per function and only called when the CPU has it
+#if defined(__x86_64__) && defined(__GNUC__)
+#define SCALER_X86
+#include <immintrin.h>
+#define AVX2_TARGET __attribute__((target("avx2")))
+#endif
+
+#define OPAQUE 0xFF000000u
+#define HALF_MASK 0x7F7F7F7Fu
+#define DECAY_MASK ((0xFFu >> PHOSPHOR_DECAY_SHIFT) * 0x01010101u)
+
+SimdLevel detect_simd_level() {
+#ifdef SCALER_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return SIMD_AVX2;
+  }
+  return SIMD_SSE2;
+#else
+  return SIMD_SCALAR;
+#endif
+}
+
+const char* simd_level_name(SimdLevel level) {
+  switch (level) {
+    case SIMD_AVX2:
+      return "avx2";
+    case SIMD_SSE2:
+      return "sse2";
+    default:
+      return "scalar";
+  }
+}
+
+// scalar kernels, the reference ///////////////////////////////////////////////
+
+static u32 max_bytes(u32 a, u32 b) {
+  u32 result = 0;
+  for (int shift = 0; shift < 32; shift += 8) {
+    result |= std::max((a >> shift) & 0xFF, (b >> shift) & 0xFF) << shift;
+  }
+  return result;
+}
+
+static void phosphor_scalar(u32* persistence, const u32* frame, int count) {
+  for (int i = 0; i < count; i++) {
+    u32 trail = persistence[i] - ((persistence[i] >> PHOSPHOR_DECAY_SHIFT) & DECAY_MASK);
+    persistence[i] = max_bytes(frame[i], trail);
+  }
+}
+
+static void expand_row_scalar(const u32* row, int width, int scale, u32* out) {
+  for (int x = 0; x < width; x++) {
+    for (int k = 0; k < scale; k++) {
+      out[x * scale + k] = row[x];
+    }
+  }
+}
+
+static void darken_row_scalar(u32* row, int count) {
+  for (int i = 0; i < count; i++) {
+    row[i] = ((row[i] >> 1) & HALF_MASK) | OPAQUE;
+  }
+}
+
+// E is replaced by a neighbour only where it sits on a diagonal edge:
+//   A B C      E0 E1
+//   D E F  ->  E2 E3
+//   G H I
+static void scale2x_scalar(const u32* above, const u32* row, const u32* below, int width, int begin, int end,
+                           u32* out0, u32* out1) {
+  for (int x = begin; x < end; x++) {
+    u32 b = above[x];
+    u32 h = below[x];
+    u32 d = row[x > 0 ? x - 1 : x];
+    u32 e = row[x];
+    u32 f = row[x < width - 1 ? x + 1 : x];
+    if (b != h && d != f) {
+      out0[2 * x] = d == b ? d : e;
+      out0[2 * x + 1] = b == f ? f : e;
+      out1[2 * x] = d == h ? d : e;
+      out1[2 * x + 1] = h == f ? f : e;
+    } else {
+      out0[2 * x] = out0[2 * x + 1] = out1[2 * x] = out1[2 * x + 1] = e;
+    }
+  }
+}
+
+#ifdef SCALER_X86
+
+// sse2 ////////////////////////////////////////////////////////////////////////
+
+static int phosphor_sse2(u32* persistence, const u32* frame, int count) {
+  const __m128i decay_mask = _mm_set1_epi32(DECAY_MASK);
+  int i = 0;
+  for (; i + 4 <= count; i += 4) {
+    __m128i trail = _mm_loadu_si128((const __m128i*) (persistence + i));
+    trail = _mm_sub_epi8(trail, _mm_and_si128(_mm_srli_epi32(trail, PHOSPHOR_DECAY_SHIFT), decay_mask));
+    __m128i pixels = _mm_loadu_si128((const __m128i*) (frame + i));
+    _mm_storeu_si128((__m128i*) (persistence + i), _mm_max_epu8(pixels, trail));
+  }
+  return i;
+}
+
+static int expand_row_sse2(const u32* row, int width, int scale, u32* out) {
+  if (scale != 2 && scale != 4) {
+    return 0;
+  }
+  int x = 0;
+  for (; x + 4 <= width; x += 4) {
+    __m128i pixels = _mm_loadu_si128((const __m128i*) (row + x));
+    u32* dst = out + x * scale;
+    if (scale == 2) {
+      _mm_storeu_si128((__m128i*) dst, _mm_unpacklo_epi32(pixels, pixels));
+      _mm_storeu_si128((__m128i*) (dst + 4), _mm_unpackhi_epi32(pixels, pixels));
+    } else {
+      _mm_storeu_si128((__m128i*) dst, _mm_shuffle_epi32(pixels, 0x00));
+      _mm_storeu_si128((__m128i*) (dst + 4), _mm_shuffle_epi32(pixels, 0x55));
+      _mm_storeu_si128((__m128i*) (dst + 8), _mm_shuffle_epi32(pixels, 0xAA));
+      _mm_storeu_si128((__m128i*) (dst + 12), _mm_shuffle_epi32(pixels, 0xFF));
+    }
+  }
+  return x;
+}
+
+static int darken_row_sse2(u32* row, int count) {
+  const __m128i half_mask = _mm_set1_epi32(HALF_MASK);
+  const __m128i opaque = _mm_set1_epi32(OPAQUE);
+  int i = 0;
+  for (; i + 4 <= count; i += 4) {
+    __m128i pixels = _mm_loadu_si128((const __m128i*) (row + i));
+    pixels = _mm_or_si128(_mm_and_si128(_mm_srli_epi32(pixels, 1), half_mask), opaque);
+    _mm_storeu_si128((__m128i*) (row + i), pixels);
+  }
+  return i;
+}
+
+// picks x where mask is set, e elsewhere
+static __m128i select_sse2(__m128i mask, __m128i x, __m128i e) {
+  return _mm_xor_si128(e, _mm_and_si128(_mm_xor_si128(x, e), mask));
+}
+
+// columns 1 .. up to width - 1, the edges need the clamped neighbours of the scalar version
+static int scale2x_sse2(const u32* above, const u32* row, const u32* below, int width, u32* out0, u32* out1) {
+  int x = 1;
+  for (; x + 4 <= width - 1; x += 4) {
+    __m128i b = _mm_loadu_si128((const __m128i*) (above + x));
+    __m128i h = _mm_loadu_si128((const __m128i*) (below + x));
+    __m128i d = _mm_loadu_si128((const __m128i*) (row + x - 1));
+    __m128i e = _mm_loadu_si128((const __m128i*) (row + x));
+    __m128i f = _mm_loadu_si128((const __m128i*) (row + x + 1));
+    __m128i edge = _mm_andnot_si128(_mm_or_si128(_mm_cmpeq_epi32(b, h), _mm_cmpeq_epi32(d, f)), _mm_set1_epi32(-1));
+    __m128i e0 = select_sse2(_mm_and_si128(edge, _mm_cmpeq_epi32(d, b)), d, e);
+    __m128i e1 = select_sse2(_mm_and_si128(edge, _mm_cmpeq_epi32(b, f)), f, e);
+    __m128i e2 = select_sse2(_mm_and_si128(edge, _mm_cmpeq_epi32(d, h)), d, e);
+    __m128i e3 = select_sse2(_mm_and_si128(edge, _mm_cmpeq_epi32(h, f)), f, e);
+    _mm_storeu_si128((__m128i*) (out0 + 2 * x), _mm_unpacklo_epi32(e0, e1));
+    _mm_storeu_si128((__m128i*) (out0 + 2 * x + 4), _mm_unpackhi_epi32(e0, e1));
+    _mm_storeu_si128((__m128i*) (out1 + 2 * x), _mm_unpacklo_epi32(e2, e3));
+    _mm_storeu_si128((__m128i*) (out1 + 2 * x + 4), _mm_unpackhi_epi32(e2, e3));
+  }
+  return x;
+}
+
+// avx2 ////////////////////////////////////////////////////////////////////////
+
+AVX2_TARGET static int phosphor_avx2(u32* persistence, const u32* frame, int count) {
+  const __m256i decay_mask = _mm256_set1_epi32(DECAY_MASK);
+  int i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m256i trail = _mm256_loadu_si256((const __m256i*) (persistence + i));
+    trail = _mm256_sub_epi8(trail, _mm256_and_si256(_mm256_srli_epi32(trail, PHOSPHOR_DECAY_SHIFT), decay_mask));
+    __m256i pixels = _mm256_loadu_si256((const __m256i*) (frame + i));
+    _mm256_storeu_si256((__m256i*) (persistence + i), _mm256_max_epu8(pixels, trail));
+  }
+  return i;
+}
+
+// output vector j of a block takes source pixel (8j + k) / scale in lane k, any scale works
+AVX2_TARGET static int expand_row_avx2(const u32* row, int width, int scale, u32* out) {
+  __m256i lanes[SCALER_MAX_SCALE];
+  for (int j = 0; j < scale; j++) {
+    int index[8];
+    for (int k = 0; k < 8; k++) {
+      index[k] = (8 * j + k) / scale;
+    }
+    lanes[j] = _mm256_loadu_si256((const __m256i*) index);
+  }
+  int x = 0;
+  for (; x + 8 <= width; x += 8) {
+    __m256i pixels = _mm256_loadu_si256((const __m256i*) (row + x));
+    u32* dst = out + x * scale;
+    for (int j = 0; j < scale; j++) {
+      _mm256_storeu_si256((__m256i*) (dst + 8 * j), _mm256_permutevar8x32_epi32(pixels, lanes[j]));
+    }
+  }
+  return x;
+}
+
+AVX2_TARGET static int darken_row_avx2(u32* row, int count) {
+  const __m256i half_mask = _mm256_set1_epi32(HALF_MASK);
+  const __m256i opaque = _mm256_set1_epi32(OPAQUE);
+  int i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m256i pixels = _mm256_loadu_si256((const __m256i*) (row + i));
+    pixels = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(pixels, 1), half_mask), opaque);
+    _mm256_storeu_si256((__m256i*) (row + i), pixels);
+  }
+  return i;
+}
+
+AVX2_TARGET static __m256i select_avx2(__m256i mask, __m256i x, __m256i e) {
+  return _mm256_xor_si256(e, _mm256_and_si256(_mm256_xor_si256(x, e), mask));
+}
+
+// the 256 bit unpacks stay inside their 128 bit lanes, the permutes put the pixels back in order
+AVX2_TARGET static void store_pairs_avx2(u32* out, __m256i left, __m256i right) {
+  __m256i low = _mm256_unpacklo_epi32(left, right);
+  __m256i high = _mm256_unpackhi_epi32(left, right);
+  _mm256_storeu_si256((__m256i*) out, _mm256_permute2x128_si256(low, high, 0x20));
+  _mm256_storeu_si256((__m256i*) (out + 8), _mm256_permute2x128_si256(low, high, 0x31));
+}
+
+AVX2_TARGET static int scale2x_avx2(const u32* above, const u32* row, const u32* below, int width, u32* out0,
+                                    u32* out1) {
+  int x = 1;
+  for (; x + 8 <= width - 1; x += 8) {
+    __m256i b = _mm256_loadu_si256((const __m256i*) (above + x));
+    __m256i h = _mm256_loadu_si256((const __m256i*) (below + x));
+    __m256i d = _mm256_loadu_si256((const __m256i*) (row + x - 1));
+    __m256i e = _mm256_loadu_si256((const __m256i*) (row + x));
+    __m256i f = _mm256_loadu_si256((const __m256i*) (row + x + 1));
+    __m256i edge = _mm256_andnot_si256(_mm256_or_si256(_mm256_cmpeq_epi32(b, h), _mm256_cmpeq_epi32(d, f)),
+                                       _mm256_set1_epi32(-1));
+    __m256i e0 = select_avx2(_mm256_and_si256(edge, _mm256_cmpeq_epi32(d, b)), d, e);
+    __m256i e1 = select_avx2(_mm256_and_si256(edge, _mm256_cmpeq_epi32(b, f)), f, e);
+    __m256i e2 = select_avx2(_mm256_and_si256(edge, _mm256_cmpeq_epi32(d, h)), d, e);
+    __m256i e3 = select_avx2(_mm256_and_si256(edge, _mm256_cmpeq_epi32(h, f)), f, e);
+    store_pairs_avx2(out0 + 2 * x, e0, e1);
+    store_pairs_avx2(out1 + 2 * x, e2, e3);
+  }
+  return x;
+}
+
+#endif
+
+// dispatch, each simd kernel returns how far it got and the scalar one does the rest ///
+
+static void phosphor(SimdLevel simd, u32* persistence, const u32* frame, int count) {
+  int done = 0;
+#ifdef SCALER_X86
+  if (simd == SIMD_AVX2) {
+    done = phosphor_avx2(persistence, frame, count);
+  } else if (simd == SIMD_SSE2) {
+    done = phosphor_sse2(persistence, frame, count);
+  }
+#endif
+  phosphor_scalar(persistence + done, frame + done, count - done);
+}
+
+static void expand_row(SimdLevel simd, const u32* row, int width, int scale, u32* out) {
+  int done = 0;
+#ifdef SCALER_X86
+  if (simd == SIMD_AVX2) {
+    done = expand_row_avx2(row, width, scale, out);
+  } else if (simd == SIMD_SSE2) {
+    done = expand_row_sse2(row, width, scale, out);
+  }
+#endif
+  expand_row_scalar(row + done, width - done, scale, out + done * scale);
+}
+
+static void darken_row(SimdLevel simd, u32* row, int count) {
+  int done = 0;
+#ifdef SCALER_X86
+  if (simd == SIMD_AVX2) {
+    done = darken_row_avx2(row, count);
+  } else if (simd == SIMD_SSE2) {
+    done = darken_row_sse2(row, count);
+  }
+#endif
+  darken_row_scalar(row + done, count - done);
+}
+
+static void scale2x_row(SimdLevel simd, const u32* above, const u32* row, const u32* below, int width, u32* out0,
+                        u32* out1) {
+  int done = 0;
+#ifdef SCALER_X86
+  if (simd == SIMD_AVX2) {
+    done = scale2x_avx2(above, row, below, width, out0, out1);
+  } else if (simd == SIMD_SSE2) {
+    done = scale2x_sse2(above, row, below, width, out0, out1);
+  }
+#endif
+  if (done > 1) {
+    scale2x_scalar(above, row, below, width, 0, 1, out0, out1);
+    scale2x_scalar(above, row, below, width, done, width, out0, out1);
+  } else {
+    scale2x_scalar(above, row, below, width, 0, width, out0, out1);
+  }
+}
+
+// scaler //////////////////////////////////////////////////////////////////////
+
+bool Scaler::configure(int width, int height, const ScalerConfig& config) {
+  this->width = width;
+  this->height = height;
+  this->config = config;
+  bool ok = true;
+  if (this->config.scale < 1 || this->config.scale > SCALER_MAX_SCALE) {
+    log_warn("scale %d is out of range (1 - %d), using 1", config.scale, SCALER_MAX_SCALE);
+    this->config.scale = 1;
+    ok = false;
+  }
+  if (this->config.filter == SCALE_EPX && this->config.scale != 2 && this->config.scale != 4) {
+    log_warn("epx scales by 2 or 4, not %d, using nearest", this->config.scale);
+    this->config.filter = SCALE_NEAREST;
+    ok = false;
+  }
+  epx_2x.assign(this->config.filter == SCALE_EPX && this->config.scale == 4 ? width * height * 4 : 0, 0);
+  persistence.assign(this->config.phosphor ? width * height : 0, 0);
+  has_persistence = false;
+  return ok;
+}
+
+void Scaler::set_simd_level(SimdLevel level) {
+  simd = std::min(level, detect_simd_level());
+}
+
+SimdLevel Scaler::get_simd_level() {
+  return simd;
+}
+
+const ScalerConfig& Scaler::get_config() {
+  return config;
+}
+
+int Scaler::get_out_width() {
+  return width * config.scale;
+}
+
+int Scaler::get_out_height() {
+  return height * config.scale;
+}
+
+void Scaler::reset() {
+  has_persistence = false;
+}
+
+void Scaler::process(const u32* frame, u32* out, int out_pitch) {
+  const u32* source = frame;
+  if (config.phosphor) {
+    if (!has_persistence) {
+      memcpy(persistence.data(), frame, persistence.size() * sizeof(u32));
+      has_persistence = true;
+    } else {
+      phosphor(simd, persistence.data(), frame, width * height);
+    }
+    source = persistence.data();
+  }
+
+  if (config.filter == SCALE_EPX && config.scale == 4) {
+    scale_epx(source, width, height, epx_2x.data(), width * 2);
+    scale_epx(epx_2x.data(), width * 2, height * 2, out, out_pitch);
+  } else if (config.filter == SCALE_EPX) {
+    scale_epx(source, width, height, out, out_pitch);
+  } else {
+    scale_nearest(source, width, height, config.scale, out, out_pitch);
+  }
+
+  if (config.scanlines && config.scale >= 2) {
+    darken_scanlines(out, out_pitch);
+  }
+}
+
+// one expanded row, copied down scale - 1 times
+void Scaler::scale_nearest(const u32* source, int source_w, int source_h, int scale, u32* out, int out_pitch) {
+  int out_w = source_w * scale;
+  for (int y = 0; y < source_h; y++) {
+    u32* first = out + (size_t) y * scale * out_pitch;
+    expand_row(simd, source + (size_t) y * source_w, source_w, scale, first);
+    for (int k = 1; k < scale; k++) {
+      memcpy(first + (size_t) k * out_pitch, first, out_w * sizeof(u32));
+    }
+  }
+}
+
+// the rows outside the frame repeat the edge rows
+void Scaler::scale_epx(const u32* source, int source_w, int source_h, u32* out, int out_pitch) {
+  for (int y = 0; y < source_h; y++) {
+    const u32* row = source + (size_t) y * source_w;
+    const u32* above = y > 0 ? row - source_w : row;
+    const u32* below = y < source_h - 1 ? row + source_w : row;
+    u32* out0 = out + (size_t) y * 2 * out_pitch;
+    scale2x_row(simd, above, row, below, source_w, out0, out0 + out_pitch);
+  }
+}
+
+void Scaler::darken_scanlines(u32* out, int out_pitch) {
+  int out_w = get_out_width();
+  for (int y = 0; y < height; y++) {
+    darken_row(simd, out + ((size_t) y * config.scale + config.scale - 1) * out_pitch, out_w);
+  }
+}
@@ -0,0 +1,70 @@
+#ifndef SCALER_HPP
+#define SCALER_HPP
+
+#include <cstdint>
+#include <vector>
+
+// CPU side upscaling of the ARGB8888 frame, so the window only ever gets a 1:1 copy of a
+// streaming texture and SDL never stretches (the software renderer does that slowly).
+//
+// pipeline, all integer and in place per row:
+//   phosphor  - every pixel keeps the brighter of itself and 3/4 of last frame's value
+//   scale     - integer Nx nearest, or scale2x (EPX) for 2x / scale4x (scale2x twice) for 4x
+//   scanlines - the last output row of every source row at half brightness (N >= 2)
+//
+// the kernels have SSE2 and AVX2 versions picked at runtime, the scalar ones are the
+// reference they are checked against (scaler_check)
+
+#define SCALER_MAX_SCALE 8
+#define PHOSPHOR_DECAY_SHIFT 2 // each frame a lit pixel loses 1 / 2^shift of its brightness
+
+using u32 = std::uint32_t;
+
+enum ScaleFilter {
+  SCALE_NEAREST,
+  SCALE_EPX
+};
+
+enum SimdLevel {
+  SIMD_SCALAR,
+  SIMD_SSE2,
+  SIMD_AVX2
+};
+
+struct ScalerConfig {
+  int scale = 2;
+  ScaleFilter filter = SCALE_NEAREST;
+  bool scanlines = false;
+  bool phosphor = false;
+};
+
+SimdLevel detect_simd_level();
+const char* simd_level_name(SimdLevel level);
+
+class Scaler {
+  public:
+    // false (and nearest 1x..8x kept) when the config can't be done, EPX needs 2x or 4x
+    bool configure(int width, int height, const ScalerConfig& config);
+    void set_simd_level(SimdLevel level); // capped at what the CPU supports
+    SimdLevel get_simd_level();
+    const ScalerConfig& get_config();
+    int get_out_width();
+    int get_out_height();
+    // out_pitch is in pixels, the frame of a locked streaming texture can be written directly
+    void process(const u32* frame, u32* out, int out_pitch);
+    void reset(); // forget the phosphor trails
+
+  private:
+    ScalerConfig config;
+    SimdLevel simd = detect_simd_level();
+    int width = 0;
+    int height = 0;
+    std::vector<u32> persistence; // phosphor state at source resolution
+    std::vector<u32> epx_2x; // first pass of scale4x
+    bool has_persistence = false;
+    void scale_nearest(const u32* source, int source_w, int source_h, int scale, u32* out, int out_pitch);
+    void scale_epx(const u32* source, int source_w, int source_h, u32* out, int out_pitch);
+    void darken_scanlines(u32* out, int out_pitch);
+};
+
+#endif
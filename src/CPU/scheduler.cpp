@@ -0,0 +1,34 @@
+#include "scheduler.hpp"
+#include <algorithm>
+
+// min-heap ordering, std heaps keep the largest element on top
+static bool later(const Event& first, const Event& second) {
+  if (first.cycle != second.cycle) {
+    return first.cycle > second.cycle;
+  }
+  return first.order > second.order;
+}
+
+void Scheduler::schedule(u64 cycle, EventType type) {
+  heap.push_back({cycle, scheduled++, type});
+  std::push_heap(heap.begin(), heap.end(), later);
+}
+
+u64 Scheduler::next_deadline() {
+  return heap.empty() ? UINT64_MAX : heap.front().cycle;
+}
+
+Event Scheduler::pop() {
+  std::pop_heap(heap.begin(), heap.end(), later);
+  Event event = heap.back();
+  heap.pop_back();
+  return event;
+}
+
+void Scheduler::clear() {
+  heap.clear();
+}
+
+bool Scheduler::empty() {
+  return heap.empty();
+}
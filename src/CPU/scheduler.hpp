@@ -0,0 +1,40 @@
+#ifndef SCHEDULER_HPP
+#define SCHEDULER_HPP
+
+#include <cstdint>
+#include <vector>
+
+// Events keyed by absolute CPU cycle. The CPU runs until the earliest deadline, handles
+// the event at the first instruction boundary at or past it and asks for the next one,
+// so the interpreter loop only ever compares the cycle count against one number.
+//
+// Deadlines are absolute, an instruction running past one never shifts later events.
+// Events due on the same cycle come out in the order they were scheduled.
+
+using u64 = std::uint64_t;
+
+enum EventType {
+  EVENT_MID_SCREEN, // half way through the frame's cycles, RST 1
+  EVENT_VBLANK // at the end of the frame's cycles, RST 2
+};
+
+struct Event {
+  u64 cycle;
+  u64 order;
+  EventType type;
+};
+
+class Scheduler {
+  public:
+    void schedule(u64 cycle, EventType type);
+    u64 next_deadline(); // UINT64_MAX when nothing is scheduled
+    Event pop(); // earliest event, only valid when one is scheduled
+    void clear();
+    bool empty();
+
+  private:
+    std::vector<Event> heap;
+    u64 scheduled = 0;
+};
+
+#endif
@@ -0,0 +1,46 @@
+#include "snapshot.hpp"
+#include <cstdio>
+#include <cinttypes>
+#include <sys/stat.h>
+#include <unistd.h>
+
+std::string boot_cache_path(const std::string& cache_dir, u64 rom_hash, u64 frames) {
+  char name[64];
+  snprintf(name, sizeof(name), "%016" PRIx64 "_%" PRIu64 ".snap", rom_hash, frames);
+  std::string path = cache_dir;
+  if (!path.empty() && path.back() != '/') {
+    path += '/';
+  }
+  return path + name;
+}
+
+// written to a temporary file first, batch jobs booting at the same time never read half
+// a snapshot
+bool save_snapshot(const std::string& file_path, const Snapshot& snapshot) {
+  size_t slash = file_path.rfind('/');
+  if (slash != std::string::npos && slash > 0) {
+    mkdir(file_path.substr(0, slash).c_str(), 0755);
+  }
+  std::string temp_path = file_path + "." + std::to_string(getpid());
+  FILE* file = fopen(temp_path.c_str(), "wb");
+  if (!file) {
+    return false;
+  }
+  bool ok = fwrite(&snapshot, sizeof(Snapshot), 1, file) == 1;
+  ok = fclose(file) == 0 && ok;
+  if (!ok || rename(temp_path.c_str(), file_path.c_str()) != 0) {
+    remove(temp_path.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool load_snapshot(const std::string& file_path, Snapshot* snapshot) {
+  FILE* file = fopen(file_path.c_str(), "rb");
+  if (!file) {
+    return false;
+  }
+  bool ok = fread(snapshot, sizeof(Snapshot), 1, file) == 1;
+  fclose(file);
+  return ok && snapshot->magic == SNAPSHOT_MAGIC && snapshot->version == SNAPSHOT_VERSION;
+}
@@ -0,0 +1,47 @@
+#ifndef SNAPSHOT_HPP
+#define SNAPSHOT_HPP
+
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include "cpu_state.hpp"
+#include "ports.hpp"
+#include "frame_hash.hpp"
+
+// Machine state between two frames: registers, counters, the latched port bytes and the
+// 8 KB of RAM. The ROM is left out (it never changes) and so is the scheduler, at a frame
+// boundary both interrupts of the next frame are pending so it is rebuilt from the frame
+// number. Plain data, taking or restoring one is a memcpy of a little over 8 KB.
+//
+// boot cache: <cache dir>/<rom hash>_<frames>.snap is the state after the ROM ran that
+// many frames from reset with nothing pressed, so new instances skip the self test. The
+// file is the struct as is, it is only meant for the machine that wrote it.
+
+#define SNAPSHOT_MAGIC 0x50414E53 // "SNAP"
+#define SNAPSHOT_VERSION 2
+#define ROM_BYTES 0x2000 // 0x0000 - 0x1FFF, what the rom hash covers
+
+using u32 = std::uint32_t;
+
+struct Snapshot {
+  u32 magic = SNAPSHOT_MAGIC;
+  u32 version = SNAPSHOT_VERSION;
+  u64 rom_hash = 0;
+  u64 cycles = 0;
+  u64 frames = 0;
+  u64 halted_cycles = 0; // counted within cycles, restored with them
+  u64 idle_cycles = 0;
+  CpuState regs;
+  bool interrupt_enabled = false;
+  bool halted = false;
+  PortState ports;
+  u8 ram[RAM_BYTES];
+};
+
+static_assert(std::is_trivially_copyable<Snapshot>::value, "Snapshot is saved with memcpy / fwrite");
+
+std::string boot_cache_path(const std::string& cache_dir, u64 rom_hash, u64 frames);
+bool save_snapshot(const std::string& file_path, const Snapshot& snapshot); // creates the folder, atomic rename
+bool load_snapshot(const std::string& file_path, Snapshot* snapshot); // false when missing or from another version
+
+#endif
@@ -0,0 +1,296 @@
+#include "trace.hpp"
+#include <algorithm>
+
+TraceState capture_trace_state(_8080* cpu) {
+  CpuState* regs = &cpu->regs;
+  regs->sync_flags();
+  TraceState state;
+  state.pc = regs->pc;
+  state.sp = regs->sp;
+  state.a = regs->a;
+  state.f = regs->f;
+  state.b = regs->b;
+  state.c = regs->c;
+  state.d = regs->d;
+  state.e = regs->e;
+  state.h = regs->h;
+  state.l = regs->l;
+  return state;
+}
+
+bool trace_states_equal(const TraceState& a, const TraceState& b) {
+  return a.pc == b.pc && a.sp == b.sp && a.a == b.a && a.f == b.f &&
+         a.b == b.b && a.c == b.c && a.d == b.d && a.e == b.e &&
+         a.h == b.h && a.l == b.l;
+}
+
+std::string format_trace_state(const TraceState& state) {
+  char text[96];
+  snprintf(text, sizeof(text), "PC=%04X SP=%04X A=%02X F=%02X B=%02X C=%02X D=%02X E=%02X H=%02X L=%02X",
+           state.pc, state.sp, state.a, state.f, state.b, state.c, state.d, state.e, state.h, state.l);
+  return std::string(text);
+}
+
+bool parse_trace_state(const std::string& line, TraceState* state) {
+  unsigned pc, sp, a, f, b, c, d, e, h, l;
+  if (sscanf(line.c_str(), " PC=%x SP=%x A=%x F=%x B=%x C=%x D=%x E=%x H=%x L=%x", &pc, &sp, &a, &f, &b, &c, &d,
+             &e, &h, &l) != 10 || pc > 0xFFFF || sp > 0xFFFF || (a | f | b | c | d | e | h | l) > 0xFF) {
+    return false;
+  }
+  *state = { (u16) pc, (u16) sp, (u8) a, (u8) f, (u8) b, (u8) c, (u8) d, (u8) e, (u8) h, (u8) l };
+  return true;
+}
+
+// recorder ///////////////////////////////////////////////////////////////////
+
+TraceRecorder::TraceRecorder(u32 interval) : interval(interval) {
+  if (this->interval == 0) {
+    this->interval = TRACE_DEFAULT_INTERVAL;
+  }
+}
+
+void TraceRecorder::add_full_window(u64 start, u64 count) {
+  TraceWindow window = {start, count};
+  full_windows.push_back(window);
+}
+
+void TraceRecorder::write_full() {
+  if (block.empty()) {
+    return;
+  }
+  u8 tag = TRACE_FULL;
+  u32 count = block.size();
+  fwrite(&tag, sizeof(tag), 1, file);
+  fwrite(&count, sizeof(count), 1, file);
+  fwrite(block.data(), sizeof(TraceState), block.size(), file);
+  block.clear();
+}
+
+void TraceRecorder::write_hash() {
+  if (hashed == 0) {
+    return;
+  }
+  u8 tag = TRACE_HASH;
+  fwrite(&tag, sizeof(tag), 1, file);
+  fwrite(&hashed, sizeof(hashed), 1, file);
+  fwrite(&hash, sizeof(hash), 1, file);
+  hashed = 0;
+  hash = TRACE_HASH_SEED;
+}
+
+bool TraceRecorder::open(const std::string& file_path) {
+  file = fopen(file_path.c_str(), "wb");
+  if (!file) {
+    log_error("could not open trace file %s", file_path.c_str());
+    return false;
+  }
+  fwrite(TRACE_MAGIC, 1, 8, file);
+
+  std::sort(full_windows.begin(), full_windows.end(), [](const TraceWindow& x, const TraceWindow& y) {
+    return x.start < y.start;
+  });
+  block.clear();
+  block.reserve(TRACE_FULL_BLOCK);
+  window = 0;
+  index = 0;
+  hash = TRACE_HASH_SEED;
+  hashed = 0;
+  return true;
+}
+
+void TraceRecorder::add(const TraceState& state) {
+  while (window < full_windows.size() && index >= full_windows[window].start + full_windows[window].count) {
+    window++;
+  }
+  bool full = window < full_windows.size() && index >= full_windows[window].start;
+
+  if (full) {
+    write_hash();
+    block.push_back(state);
+    if (block.size() == TRACE_FULL_BLOCK) {
+      write_full();
+    }
+  } else {
+    write_full();
+    hash = hash_trace_state(hash, state);
+    hashed++;
+    if (hashed == interval) {
+      write_hash();
+    }
+  }
+  index++;
+}
+
+long long TraceRecorder::close() {
+  write_full();
+  write_hash();
+  u8 tag = TRACE_END;
+  fwrite(&tag, sizeof(tag), 1, file);
+  fwrite(&index, sizeof(index), 1, file);
+
+  bool ok = !ferror(file);
+  fclose(file);
+  file = nullptr;
+  return ok ? (long long) index : -1;
+}
+
+long long TraceRecorder::record(_8080* cpu, const std::string& file_path) {
+  if (!open(file_path)) {
+    return -1;
+  }
+  while (!cpu->test_finished()) {
+    cpu->step_test();
+    add(capture_trace_state(cpu));
+  }
+  return close();
+}
+
+// checker ////////////////////////////////////////////////////////////////////
+
+void TraceChecker::push_history(const TraceState& state) {
+  history[history_count % TRACE_CONTEXT] = state;
+  history_count++;
+}
+
+void TraceChecker::print_history() {
+  u64 shown = std::min<u64>(history_count, TRACE_CONTEXT);
+  for (u64 i = history_count - shown; i < history_count; i++) {
+    log_log("  #%llu  %s", (unsigned long long) i, format_trace_state(history[i % TRACE_CONTEXT]).c_str());
+  }
+}
+
+void TraceChecker::report_full_divergence(u64 index, const TraceState& expected, const TraceState& found) {
+  log_error("trace diverged at instruction %llu", (unsigned long long) index);
+  print_history();
+  log_log("  expected %s", format_trace_state(expected).c_str());
+  log_log("  found    %s", format_trace_state(found).c_str());
+
+  std::string fields;
+  if (expected.pc != found.pc) fields += " PC";
+  if (expected.sp != found.sp) fields += " SP";
+  if (expected.a != found.a) fields += " A";
+  if (expected.f != found.f) fields += " F";
+  if (expected.b != found.b) fields += " B";
+  if (expected.c != found.c) fields += " C";
+  if (expected.d != found.d) fields += " D";
+  if (expected.e != found.e) fields += " E";
+  if (expected.h != found.h) fields += " H";
+  if (expected.l != found.l) fields += " L";
+  log_log("  differs in:%s", fields.c_str());
+}
+
+void TraceChecker::report_hash_divergence(u64 start, u32 count, const TraceState& first, const TraceState& last) {
+  log_error("checkpoint mismatch in instructions [%llu, %llu)", (unsigned long long) start, (unsigned long long) (start + count));
+  print_history();
+  log_log("  window start %s", format_trace_state(first).c_str());
+  log_log("  window end   %s", format_trace_state(last).c_str());
+  log_log("  re-record the reference with --full %llu:%u to find the exact instruction", (unsigned long long) start, count);
+}
+
+void TraceChecker::report_length_divergence(u64 index, bool finished_early) {
+  if (finished_early) {
+    log_error("program finished after %llu instructions but the trace continues", (unsigned long long) index);
+  } else {
+    log_error("trace ends at instruction %llu but the program is still running", (unsigned long long) index);
+  }
+  print_history();
+}
+
+bool TraceChecker::check(_8080* cpu, const std::string& file_path) {
+  FILE* file = fopen(file_path.c_str(), "rb");
+  if (!file) {
+    log_error("could not open trace file %s", file_path.c_str());
+    return false;
+  }
+
+  char magic[8];
+  if (fread(magic, 1, 8, file) != 8 || memcmp(magic, TRACE_MAGIC, 8) != 0) {
+    log_error("%s is not a trace file", file_path.c_str());
+    fclose(file);
+    return false;
+  }
+
+  history_count = 0;
+  std::vector<TraceState> block;
+  u64 index = 0;
+  bool ok = true;
+  bool done = false;
+
+  while (ok && !done) {
+    int tag = fgetc(file);
+    u32 count = 0;
+
+    switch (tag) {
+      case TRACE_FULL: {
+        if (fread(&count, sizeof(count), 1, file) != 1) { ok = false; break; }
+        block.resize(count);
+        if (fread(block.data(), sizeof(TraceState), count, file) != count) { ok = false; break; }
+        for (u32 i = 0; i < count && ok; i++) {
+          if (cpu->test_finished()) {
+            report_length_divergence(index, true);
+            ok = false;
+            break;
+          }
+          cpu->step_test();
+          TraceState state = capture_trace_state(cpu);
+          if (!trace_states_equal(state, block[i])) {
+            report_full_divergence(index, block[i], state);
+            ok = false;
+            break;
+          }
+          push_history(state);
+          index++;
+        }
+        break;
+      }
+      case TRACE_HASH: {
+        u64 expected = 0;
+        if (fread(&count, sizeof(count), 1, file) != 1 || fread(&expected, sizeof(expected), 1, file) != 1) { ok = false; break; }
+        u64 hash = TRACE_HASH_SEED;
+        TraceState first = capture_trace_state(cpu);
+        TraceState state = first;
+        // only the tail of a checkpoint window is kept as context
+        u32 context_start = count > TRACE_CONTEXT ? count - TRACE_CONTEXT : 0;
+        for (u32 i = 0; i < count; i++) {
+          if (cpu->test_finished()) {
+            report_length_divergence(index + i, true);
+            ok = false;
+            break;
+          }
+          cpu->step_test();
+          state = capture_trace_state(cpu);
+          hash = hash_trace_state(hash, state);
+          if (i >= context_start) {
+            push_history(state);
+          }
+        }
+        if (ok && hash != expected) {
+          report_hash_divergence(index, count, first, state);
+          ok = false;
+        }
+        index += count;
+        break;
+      }
+      case TRACE_END: {
+        u64 total = 0;
+        if (fread(&total, sizeof(total), 1, file) != 1) { ok = false; break; }
+        if (!cpu->test_finished() || total != index) {
+          report_length_divergence(index, false);
+          ok = false;
+        }
+        done = true;
+        break;
+      }
+      default:
+        log_error("corrupt trace file %s at instruction %llu", file_path.c_str(), (unsigned long long) index);
+        ok = false;
+        break;
+    }
+  }
+
+  fclose(file);
+  if (ok) {
+    log_info("trace matched for %llu instructions", (unsigned long long) index);
+  }
+  return ok;
+}
@@ -0,0 +1,119 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "8080.hpp"
+
+// Golden trace files used for lockstep differential testing of the core.
+//
+// A trace is the cpu state (PC, SP, registers, flags) after every instruction of a
+// CP/M program. Storing that for the full 8080EXM run would be tens of GB, so most
+// of the run is stored as hashed checkpoints (one 64 bit hash per TRACE_DEFAULT_INTERVAL
+// instructions) and only the requested windows are stored in full.
+//
+// file layout (little endian):
+//   "8080TRC1"
+//   'F' u32 count, count * TraceState   -> full compare window
+//   'H' u32 count, u64 hash             -> checkpoint over the next count states
+//   'E' u64 total_instructions          -> end of the program
+// a TraceState is 12 bytes: u16 pc, u16 sp, then a f b c d e h l; the hash is
+// hash_trace_state over the states of the checkpoint, starting from TRACE_HASH_SEED
+//
+// Traces of other emulators come in as text, one line per instruction with the state after
+// it, the first line after the first instruction at 0x100 (what format_trace_state prints):
+//   PC=0103 SP=0000 A=00 F=02 B=00 C=00 D=00 E=00 H=00 L=00
+// F is the byte PUSH PSW stores (bit 1 set, bits 3 and 5 clear). Blank lines and lines
+// starting with '#' are skipped.
+
+#define TRACE_MAGIC "8080TRC1"
+#define TRACE_FULL 'F'
+#define TRACE_HASH 'H'
+#define TRACE_END 'E'
+#define TRACE_DEFAULT_INTERVAL (1 << 20)
+#define TRACE_FULL_BLOCK 4096 // max states written per 'F' record
+#define TRACE_CONTEXT 8 // states printed before a divergence
+
+#define TRACE_HASH_SEED 0xCBF29CE484222325ULL
+#define TRACE_HASH_PRIME 0x100000001B3ULL
+
+using u64 = uint64_t;
+using u32 = uint32_t;
+
+struct TraceState {
+  u16 pc;
+  u16 sp;
+  u8 a;
+  u8 f;
+  u8 b;
+  u8 c;
+  u8 d;
+  u8 e;
+  u8 h;
+  u8 l;
+};
+
+// [start, start + count) in instructions
+struct TraceWindow {
+  u64 start;
+  u64 count;
+};
+
+TraceState capture_trace_state(_8080* cpu);
+bool trace_states_equal(const TraceState& a, const TraceState& b);
+std::string format_trace_state(const TraceState& state);
+bool parse_trace_state(const std::string& line, TraceState* state); // a format_trace_state line
+
+// two multiplies per instruction, cheap enough to keep the checker near interpreter speed
+inline u64 hash_trace_state(u64 hash, const TraceState& state) {
+  u64 low = u64(state.pc) | (u64(state.sp) << 16) | (u64(state.a) << 32) | (u64(state.f) << 40) | (u64(state.b) << 48) | (u64(state.c) << 56);
+  u64 high = u64(state.d) | (u64(state.e) << 8) | (u64(state.h) << 16) | (u64(state.l) << 24);
+  hash = (hash ^ low) * TRACE_HASH_PRIME;
+  hash = (hash ^ high) * TRACE_HASH_PRIME;
+  return hash;
+}
+
+// writes a trace, from a loaded CP/M program run to completion or from states added one
+// instruction at a time (open, add..., close)
+class TraceRecorder {
+  public:
+    TraceRecorder(u32 interval = TRACE_DEFAULT_INTERVAL);
+    void add_full_window(u64 start, u64 count); // before open / record
+    // returns the number of instructions recorded or -1 if the file could not be written
+    long long record(_8080* cpu, const std::string& file_path);
+    bool open(const std::string& file_path);
+    void add(const TraceState& state); // the state after the next instruction
+    long long close(); // like record
+
+  private:
+    u32 interval;
+    std::vector<TraceWindow> full_windows;
+    FILE* file = nullptr;
+    std::vector<TraceState> block;
+    size_t window = 0;
+    u64 index = 0;
+    u64 hash = TRACE_HASH_SEED;
+    u32 hashed = 0;
+    void write_full();
+    void write_hash();
+};
+
+// runs a loaded CP/M program against a recorded trace and stops at the first divergence
+class TraceChecker {
+  public:
+    // returns true when every full window and checkpoint matched
+    bool check(_8080* cpu, const std::string& file_path);
+
+  private:
+    TraceState history[TRACE_CONTEXT]; // last states of the golden trace
+    u64 history_count = 0;
+    void push_history(const TraceState& state);
+    void print_history();
+    void report_full_divergence(u64 index, const TraceState& expected, const TraceState& found);
+    void report_hash_divergence(u64 start, u32 count, const TraceState& first, const TraceState& last);
+    void report_length_divergence(u64 index, bool finished_early);
+};
+
+#endif
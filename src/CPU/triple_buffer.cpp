@@ -0,0 +1,24 @@
+#include "triple_buffer.hpp"
+
+VideoFrame* TripleBuffer::producer_frame() {
+  return &frames[back];
+}
+
+// release so the consumer sees the whole frame once it sees the index
+void TripleBuffer::publish() {
+  u8 previous = middle.exchange(back | TRIPLE_BUFFER_FRESH, std::memory_order_acq_rel);
+  back = previous & ~TRIPLE_BUFFER_FRESH;
+}
+
+bool TripleBuffer::consume() {
+  if (!(middle.load(std::memory_order_relaxed) & TRIPLE_BUFFER_FRESH)) {
+    return false;
+  }
+  u8 previous = middle.exchange(front, std::memory_order_acq_rel);
+  front = previous & ~TRIPLE_BUFFER_FRESH;
+  return true;
+}
+
+const VideoFrame* TripleBuffer::consumer_frame() {
+  return &frames[front];
+}
@@ -0,0 +1,40 @@
+#ifndef TRIPLE_BUFFER_HPP
+#define TRIPLE_BUFFER_HPP
+
+#include <atomic>
+#include <cstdint>
+#include "cpu_state.hpp"
+#include "frame_hash.hpp"
+
+// Hands finished frames from the emulation thread to the main thread without a lock.
+// Of the three buffers the producer owns one, the consumer owns one and the third is
+// swapped through an atomic index with a fresh bit. Neither side ever waits: a slow
+// present just means the frames in between are dropped, the consumer always gets the
+// newest complete one.
+
+#define DISASSEMBLY_BYTES 128 // code from pc for the instruction window, 35 instructions max
+#define TRIPLE_BUFFER_FRESH 0x4 // set in middle when the producer published since the last consume
+
+// what the main thread draws: the 1bpp VRAM plus the state for the debug windows
+struct VideoFrame {
+  u64 frame = 0;
+  u8 vram[VRAM_BYTES];
+  CpuState regs;
+  u8 code[DISASSEMBLY_BYTES];
+};
+
+class TripleBuffer {
+  public:
+    VideoFrame* producer_frame(); // fill it in, then publish
+    void publish();
+    bool consume(); // true when a newer frame came in since the last call
+    const VideoFrame* consumer_frame();
+
+  private:
+    VideoFrame frames[3];
+    u8 back = 0; // producer
+    u8 front = 1; // consumer
+    std::atomic<u8> middle{2};
+};
+
+#endif
@@ -0,0 +1,171 @@
+#include <sys/stat.h>
+#include <stdlib.h>
+#include <string.h>
+#include "./CPU/8080.hpp"
+
+// drives the sound ports of a headless instance through OUT 3 / OUT 5 and checks the wav
+// dump of the mixer, no audio device needed
+//
+//   audio_check <output dir>
+//
+// every sample of the set is written as a constant level of its own, so each mixed frame
+// is a few runs of known values: sounds start on a rising edge only, a held bit doesn't
+// retrigger, the ufo loops until its bit clears and nothing plays without the amp bit
+// exit code 0 = the dump matched, 1 = not, 2 = usage / file error
+
+#define CHECK_RATE AUDIO_RATE
+#define FRAME_SAMPLES AUDIO_SAMPLES_PER_FRAME
+
+void print_usage() {
+  printf("usage: audio_check <output dir>\n");
+}
+
+// sample n: level 100 * (n + 1), 1000 + 100 * n samples long
+int sample_level(int sample) {
+  return 100 * (sample + 1);
+}
+
+int sample_length(int sample) {
+  return 1000 + 100 * sample;
+}
+
+void put_u32(u8* bytes, uint32_t value) {
+  for (int i = 0; i < 4; i++) {
+    bytes[i] = (u8) (value >> (8 * i));
+  }
+}
+
+bool write_sample(const string& path, int level, int length) {
+  u8 header[44] = {'R', 'I', 'F', 'F', 0, 0, 0, 0, 'W', 'A', 'V', 'E', 'f', 'm', 't', ' ', 16, 0, 0, 0, 1, 0, 1, 0,
+                   0, 0, 0, 0, 0, 0, 0, 0, 2, 0, 16, 0, 'd', 'a', 't', 'a', 0, 0, 0, 0};
+  put_u32(header + 4, 36 + length * 2);
+  put_u32(header + 24, CHECK_RATE);
+  put_u32(header + 28, CHECK_RATE * 2);
+  put_u32(header + 40, length * 2);
+  FILE* file = fopen(path.c_str(), "wb");
+  if (!file) {
+    return false;
+  }
+  fwrite(header, 1, sizeof(header), file);
+  vector<s16> samples(length, (s16) level);
+  fwrite(samples.data(), sizeof(s16), samples.size(), file);
+  fclose(file);
+  return true;
+}
+
+// what the program writes before halting for the rest of the frame, and the mixed frame
+// that should come out as runs of (samples, level)
+struct AudioStep {
+  u8 sound1;
+  u8 sound2_first;
+  u8 sound2_second;
+  vector<pair<int, int>> runs;
+};
+
+#define AMP (1 << SND_AMP_ENABLE)
+#define SHOT (1 << SND_SHOT)
+#define UFO (1 << SND_UFO)
+#define FLEET (1 << SND_FLEET_1)
+
+vector<AudioStep> audio_steps() {
+  int shot = sample_level(SAMPLE_SHOT);
+  int fleet = sample_level(SAMPLE_FLEET_1);
+  int ufo = sample_level(SAMPLE_UFO);
+  int shot_left = sample_length(SAMPLE_SHOT) - FRAME_SAMPLES;
+  int fleet_left = sample_length(SAMPLE_FLEET_1) - FRAME_SAMPLES;
+  return {
+    { AMP, 0, 0, {{FRAME_SAMPLES, 0}} }, // amp on, nothing playing
+    { AMP | SHOT, 0, 0, {{FRAME_SAMPLES, shot}} }, // rising edge starts the shot
+    { AMP | SHOT, 0, 0, {{shot_left, shot}, {FRAME_SAMPLES - shot_left, 0}} }, // held, plays out
+    { AMP, 0, FLEET, {{FRAME_SAMPLES, fleet}} },
+    { AMP, 0, FLEET, {{FRAME_SAMPLES, fleet}} }, // cleared and set again, starts over
+    { AMP | UFO, FLEET, FLEET, {{fleet_left, fleet + ufo}, {FRAME_SAMPLES - fleet_left, ufo}} },
+    { AMP | UFO, FLEET, FLEET, {{FRAME_SAMPLES, ufo}} }, // past the ufo's end, it loops
+    { AMP, FLEET, FLEET, {{FRAME_SAMPLES, 0}} }, // ufo bit cleared
+    { SHOT, FLEET, FLEET, {{FRAME_SAMPLES, 0}} }, // amp off silences the shot
+  };
+}
+
+// MVI A,sound1 / OUT 3 / MVI A,first / OUT 5 / MVI A,second / OUT 5 / HLT at 0, then one frame
+void run_step(_8080* _8080_, const AudioStep& step) {
+  const u8 program[] = { 0x3E, step.sound1, 0xD3, SOUND1, 0x3E, step.sound2_first, 0xD3, SOUND2,
+                         0x3E, step.sound2_second, 0xD3, SOUND2, 0x76 };
+  _8080_->memory.write_block(0, program, sizeof(program));
+  Snapshot snapshot;
+  _8080_->save_state(&snapshot);
+  snapshot.regs.pc = 0;
+  snapshot.halted = false;
+  snapshot.interrupt_enabled = false;
+  _8080_->load_state(snapshot);
+  _8080_->run_frame();
+}
+
+bool check_dump(const string& path, const vector<AudioStep>& steps) {
+  ifstream file(path, ios::binary);
+  string bytes((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+  size_t data_bytes = steps.size() * FRAME_SAMPLES * sizeof(s16);
+  if (bytes.size() != 44 + data_bytes || bytes.compare(0, 4, "RIFF") != 0 || bytes.compare(8, 4, "WAVE") != 0) {
+    log_error("%s: %zu bytes, expected a wav of %zu", path.c_str(), bytes.size(), 44 + data_bytes);
+    return false;
+  }
+  uint32_t riff_size;
+  uint32_t rate;
+  uint32_t data_size;
+  memcpy(&riff_size, &bytes[4], 4);
+  memcpy(&rate, &bytes[24], 4);
+  memcpy(&data_size, &bytes[40], 4);
+  if (riff_size != 36 + data_bytes || rate != AUDIO_RATE || data_size != data_bytes) {
+    log_error("%s: riff size %u, rate %u, data size %u", path.c_str(), riff_size, rate, data_size);
+    return false;
+  }
+
+  const s16* samples = (const s16*) &bytes[44];
+  for (size_t frame = 0; frame < steps.size(); frame++) {
+    int at = 0;
+    for (const pair<int, int>& run : steps[frame].runs) {
+      for (int i = 0; i < run.first; i++, at++) {
+        s16 sample = samples[frame * FRAME_SAMPLES + at];
+        if (sample != run.second) {
+          log_error("frame %zu sample %d is %d, expected %d", frame, at, sample, run.second);
+          return false;
+        }
+      }
+    }
+  }
+  return true;
+}
+
+int main(int argc, char** argv) {
+  if (argc != 2) {
+    print_usage();
+    return 2;
+  }
+  string dir = argv[1];
+  mkdir(dir.c_str(), 0755);
+  string samples_dir = dir + "/samples/";
+  mkdir(samples_dir.c_str(), 0755);
+  for (int i = 0; i < NUM_SAMPLES; i++) {
+    if (!write_sample(samples_dir + to_string(i) + ".wav", sample_level(i), sample_length(i))) {
+      log_error("could not write the samples to %s", samples_dir.c_str());
+      return 2;
+    }
+  }
+
+  string dump = dir + "/dump.wav";
+  _8080* _8080_ = new _8080(true);
+  _8080_->audio = new Audio();
+  if (!_8080_->audio->load_samples(samples_dir) || !_8080_->audio->open_wav_dump(dump)) {
+    delete _8080_;
+    return 2;
+  }
+  vector<AudioStep> steps = audio_steps();
+  for (const AudioStep& step : steps) {
+    run_step(_8080_, step);
+  }
+  // the dump is finished when the audio goes
+  delete _8080_;
+
+  bool same = check_dump(dump, steps);
+  printf("audio: %zu frames through ports 3 / 5 %s\n", steps.size(), same ? "match" : "differ");
+  return same ? 0 : 1;
+}
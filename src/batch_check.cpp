@@ -0,0 +1,283 @@
+#include <chrono>
+#include <stdlib.h>
+#include <string.h>
+#include "./CPU/8080.hpp"
+#include "./CPU/movie.hpp"
+#include "./CPU/batch.hpp"
+
+// checks the batched interpreter against one scalar _8080 per lane (fusion off, like the
+// lanes) and compares their throughput
+//
+//   batch_check <rom> <movie> [--lanes N] [--frames N] [--fuzz N]
+//
+// replay: the first half of the lanes plays the movie, every other lane plays it a few
+//         frames late, so the lanes run together and apart; state and RAM after every frame
+// fuzz:   N frames of random code, registers and RAM (half the lanes from the same state with
+//         the same inputs), the whole 64 KB after every frame
+// timing: lane frames per second of the scalar instances and the batch, with and without
+//         idle loop skipping, every lane with the movie's inputs and with the late inputs
+// exit code 0 = every lane matched, 1 = not, 2 = usage / file error
+
+void print_usage() {
+  printf("usage: batch_check <rom> <movie> [--lanes N] [--frames N] [--fuzz N]\n");
+}
+
+// the movie for lane, the odd ones of the second half a few frames late
+u8 lane_inputs(InputMovie& movie, int lane, int lanes, u64 frame) {
+  if (lane < lanes / 2 || lane % 2 == 0) {
+    return movie.get(frame);
+  }
+  u64 late = 1 + lane % 7;
+  return frame < late ? 0 : movie.get(frame - late);
+}
+
+_8080* scalar_instance(MemoryBus& image, const Snapshot& snapshot) {
+  _8080* _8080_ = new _8080(true);
+  _8080_->fuse_instructions = false;
+  _8080_->memory.share(image);
+  _8080_->load_state(snapshot);
+  return _8080_;
+}
+
+bool same_state(Snapshot& x, Snapshot& y) {
+  CpuState& p = x.regs;
+  CpuState& q = y.regs;
+  return p.PSW == q.PSW && p.bc == q.bc && p.de == q.de && p.hl == q.hl && p.pc == q.pc && p.sp == q.sp &&
+         x.cycles == y.cycles && x.frames == y.frames && x.halted_cycles == y.halted_cycles &&
+         x.idle_cycles == y.idle_cycles && x.interrupt_enabled == y.interrupt_enabled && x.halted == y.halted &&
+         x.ports.input_bits == y.ports.input_bits && x.ports.shift_value == y.ports.shift_value &&
+         x.ports.shift_offset == y.ports.shift_offset && x.ports.sound1 == y.ports.sound1 &&
+         x.ports.sound2 == y.ports.sound2 && memcmp(x.ram, y.ram, RAM_BYTES) == 0;
+}
+
+// runs the batch and the scalar lanes side by side, false at the first lane that differs
+bool compare(BatchInterpreter& batch, vector<_8080*>& scalars, u64 frames, bool whole_memory,
+             const function<u8(int, u64)>& inputs) {
+  Snapshot expected;
+  Snapshot actual;
+  vector<u8> expected_memory(MEMORY_BYTES);
+  vector<u8> actual_memory(MEMORY_BYTES);
+  for (u64 frame = 0; frame < frames; frame++) {
+    for (int lane = 0; lane < batch.get_lanes(); lane++) {
+      batch.set_inputs(lane, inputs(lane, frame));
+      scalars[lane]->set_inputs(inputs(lane, frame));
+      scalars[lane]->run_frame();
+    }
+    batch.run_frame();
+    for (int lane = 0; lane < batch.get_lanes(); lane++) {
+      scalars[lane]->save_state(&expected);
+      batch.save_state(lane, &actual);
+      bool same = same_state(expected, actual);
+      if (same && whole_memory) {
+        scalars[lane]->memory.read_block(0, expected_memory.data(), MEMORY_BYTES);
+        batch.lane_memory(lane).read_block(0, actual_memory.data(), MEMORY_BYTES);
+        same = expected_memory == actual_memory;
+      }
+      if (!same) {
+        log_error("lane %d differs after frame %llu: pc %04X / %04X, cycles %llu / %llu, a %02X / %02X, f %02X / %02X",
+                  lane, (unsigned long long) frame, expected.regs.pc, actual.regs.pc,
+                  (unsigned long long) expected.cycles, (unsigned long long) actual.cycles, expected.regs.a,
+                  actual.regs.a, expected.regs.f, actual.regs.f);
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+bool check_replay(MemoryBus& image, const Snapshot& boot, InputMovie& movie, int lanes, u64 frames) {
+  BatchInterpreter batch(lanes);
+  batch.load(image, boot);
+  vector<_8080*> scalars;
+  for (int lane = 0; lane < lanes; lane++) {
+    scalars.push_back(scalar_instance(image, boot));
+  }
+  bool same = compare(batch, scalars, frames, false, [&](int lane, u64 frame) {
+    return lane_inputs(movie, lane, lanes, frame);
+  });
+  for (_8080* scalar : scalars) {
+    delete scalar;
+  }
+  if (same) {
+    log_info("replay: %d lanes match for %llu frames, %.1f lanes per instruction", lanes,
+             (unsigned long long) frames, batch.get_lanes_per_step());
+  }
+  return same;
+}
+
+bool check_fuzz(int lanes, u64 frames) {
+  u32 seed = 0x8080;
+  auto random = [&]() {
+    seed = seed * 1664525u + 1013904223u;
+    return (u8) (seed >> 24);
+  };
+  auto random_state = [&](Snapshot* snapshot) {
+    CpuState regs;
+    regs.PSW = random() | (random() << 8);
+    regs.bc = random() | (random() << 8);
+    regs.de = random() | (random() << 8);
+    regs.hl = random() | (random() << 8);
+    regs.pc = random() | (random() << 8);
+    regs.sp = random() | (random() << 8);
+    snapshot->regs = regs;
+    snapshot->interrupt_enabled = random() & 1;
+    snapshot->ports.input_bits = random() & 0x0F;
+    snapshot->ports.shift_value = random() | (random() << 8);
+    snapshot->ports.shift_offset = random() & SHIFT_AND_BITS;
+    for (u8& byte : snapshot->ram) {
+      byte = random();
+    }
+  };
+
+  vector<u8> bytes(MEMORY_BYTES);
+  for (u8& byte : bytes) {
+    byte = random();
+  }
+  MemoryBus image;
+  image.write_block(0, bytes.data(), MEMORY_BYTES);
+  Snapshot shared;
+  random_state(&shared);
+  BatchInterpreter batch(lanes);
+  batch.load(image, shared);
+  vector<_8080*> scalars;
+  for (int lane = 0; lane < lanes; lane++) {
+    Snapshot own = shared;
+    if (lane >= lanes / 2) {
+      random_state(&own);
+      batch.load_state(lane, own);
+    }
+    scalars.push_back(scalar_instance(image, own));
+  }
+  vector<u8> inputs(lanes * frames);
+  for (u8& bits : inputs) {
+    bits = random() & 0x0F;
+  }
+  // the lanes from the shared state get the same inputs, so they run together for a while
+  bool same = compare(batch, scalars, frames, true, [&](int lane, u64 frame) {
+    return inputs[frame * lanes + (lane < lanes / 2 ? 0 : lane)];
+  });
+  for (_8080* scalar : scalars) {
+    delete scalar;
+  }
+  if (same) {
+    log_info("fuzz: %d lanes of random code match for %llu frames, %.2f lanes per instruction", lanes,
+             (unsigned long long) frames, batch.get_lanes_per_step());
+  }
+  return same;
+}
+
+// lane frames per second, the interpreter alone or with idle loop skipping and fusion
+double time_scalar(MemoryBus& image, const Snapshot& boot, int lanes, u64 frames, bool skip,
+                   const function<u8(int, u64)>& inputs) {
+  vector<_8080*> scalars;
+  for (int lane = 0; lane < lanes; lane++) {
+    scalars.push_back(scalar_instance(image, boot));
+    scalars.back()->skip_idle_loops = skip;
+    scalars.back()->fuse_instructions = skip;
+  }
+  auto start = chrono::steady_clock::now();
+  for (int lane = 0; lane < lanes; lane++) {
+    for (u64 frame = 0; frame < frames; frame++) {
+      scalars[lane]->set_inputs(inputs(lane, frame));
+      scalars[lane]->run_frame();
+    }
+  }
+  double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  for (_8080* scalar : scalars) {
+    delete scalar;
+  }
+  return lanes * frames / seconds;
+}
+
+double time_batch(MemoryBus& image, const Snapshot& boot, int lanes, u64 frames, bool skip, bool lockstep,
+                  SimdLevel level, const function<u8(int, u64)>& inputs, double* lanes_per_step) {
+  BatchInterpreter batch(lanes);
+  batch.skip_idle_loops = skip;
+  batch.set_lockstep(lockstep);
+  batch.set_simd_level(level);
+  batch.load(image, boot);
+  auto start = chrono::steady_clock::now();
+  for (u64 frame = 0; frame < frames; frame++) {
+    for (int lane = 0; lane < lanes; lane++) {
+      batch.set_inputs(lane, inputs(lane, frame));
+    }
+    batch.run_frame();
+  }
+  double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  *lanes_per_step = batch.get_lanes_per_step();
+  return lanes * frames / seconds;
+}
+
+void report_timings(MemoryBus& image, const Snapshot& boot, InputMovie& movie, int lanes, u64 frames) {
+  function<u8(int, u64)> same_inputs = [&](int, u64 frame) { return movie.get(frame); };
+  function<u8(int, u64)> late_inputs = [&](int lane, u64 frame) { return lane_inputs(movie, lane, lanes, frame); };
+  struct Inputs {
+    const char* name;
+    function<u8(int, u64)>* inputs;
+  };
+  for (Inputs run : {Inputs{"same inputs", &same_inputs}, Inputs{"late inputs", &late_inputs}}) {
+    log_info("%s, %d lanes:", run.name, lanes);
+    for (bool skip : {false, true}) {
+      double scalar = time_scalar(image, boot, lanes, frames, skip, *run.inputs);
+      double per_step = 0;
+      double alone = time_batch(image, boot, lanes, frames, skip, false, SIMD_SSE2, *run.inputs, &per_step);
+      log_info("  %s: scalar %.0f frames/s, batch one lane at a time %.0f",
+               skip ? "idle skip (+ fusion in the scalar core)" : "interpreter", scalar, alone);
+      SimdLevel best = detect_simd_level();
+      for (int level = min((int) best, (int) SIMD_SSE2); level <= best; level++) {
+        double together = time_batch(image, boot, lanes, frames, skip, true, (SimdLevel) level, *run.inputs,
+                                     &per_step);
+        log_info("    lockstep %s: %.0f frames/s, %.2fx the scalar instances, %.1f lanes per instruction",
+                 simd_level_name((SimdLevel) level), together, together / scalar, per_step);
+      }
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  if (argc < 3) {
+    print_usage();
+    return 2;
+  }
+  string rom = argv[1];
+  string movie_file = argv[2];
+  int lanes = 16;
+  u64 frames = 240;
+  u64 fuzz_frames = 30;
+  for (int i = 3; i < argc; i++) {
+    if (strcmp(argv[i], "--lanes") == 0 && i + 1 < argc) {
+      lanes = max(1, atoi(argv[++i]));
+    } else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+      frames = strtoull(argv[++i], nullptr, 0);
+    } else if (strcmp(argv[i], "--fuzz") == 0 && i + 1 < argc) {
+      fuzz_frames = strtoull(argv[++i], nullptr, 0);
+    } else {
+      print_usage();
+      return 2;
+    }
+  }
+
+  InputMovie movie;
+  if (!movie.load(movie_file)) {
+    log_error("could not load movie %s", movie_file.c_str());
+    return 2;
+  }
+  _8080* _8080_ = new _8080(true);
+  if (!_8080_->load_program(rom)) {
+    delete _8080_;
+    return 2;
+  }
+  MemoryBus image;
+  image.share(_8080_->memory);
+  Snapshot boot;
+  _8080_->save_state(&boot);
+  delete _8080_;
+
+  bool same = check_replay(image, boot, movie, lanes, frames);
+  same = check_fuzz(lanes, fuzz_frames) && same;
+  if (!same) {
+    return 1;
+  }
+  report_timings(image, boot, movie, lanes, frames);
+  return 0;
+}
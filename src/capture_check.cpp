@@ -0,0 +1,192 @@
+#include <sys/stat.h>
+#include <stdlib.h>
+#include <string.h>
+#include "./CPU/8080.hpp"
+#include "./CPU/movie.hpp"
+
+// captures a few frames of a headless instance in every format and checks the files
+//
+//   capture_check <rom> <movie> <output dir> [--frames N]
+//
+// raw: the VRAM of every frame back to back
+// y4m: the header, then FRAME and the upright grayscale of every frame
+// png: one file per frame named from the pattern, byte for byte what write_png_gray makes of
+//      the frame; patterns without exactly one frame number conversion are refused, and a
+//      screenshot is the png of the frame submitted after it
+// exit code 0 = every file matched, 1 = not, 2 = usage / file error
+
+void print_usage() {
+  printf("usage: capture_check <rom> <movie> <output dir> [--frames N]\n");
+}
+
+bool read_file(const string& path, string* contents) {
+  ifstream file(path, ios::binary);
+  if (!file) {
+    return false;
+  }
+  contents->assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+  return true;
+}
+
+// runs the movie with the capture open, the VRAM of every frame in vrams; false when the
+// capture did not open or dropped a frame
+bool capture_frames(const string& rom, InputMovie& movie, u64 frames, const string& path, vector<string>* vrams) {
+  _8080* _8080_ = new _8080(true);
+  if (!_8080_->load_program(rom)) {
+    delete _8080_;
+    return false;
+  }
+  _8080_->capture = new FrameCapture();
+  if (!_8080_->capture->open(path)) {
+    delete _8080_;
+    return false;
+  }
+  for (u64 frame = 0; frame < frames; frame++) {
+    _8080_->set_inputs(movie.get(frame));
+    _8080_->run_frame();
+    string vram(VRAM_BYTES, '\0');
+    _8080_->memory.read_block(VRAM_START, (u8*) &vram[0], VRAM_BYTES);
+    vrams->push_back(vram);
+  }
+  _8080_->capture->close();
+  bool complete = _8080_->capture->get_frames_written() == frames && _8080_->capture->get_frames_dropped() == 0;
+  if (!complete) {
+    log_error("%s: %llu of %llu frames written", path.c_str(),
+              (unsigned long long) _8080_->capture->get_frames_written(), (unsigned long long) frames);
+  }
+  delete _8080_;
+  return complete;
+}
+
+string gray_frame(const string& vram) {
+  string gray(CAPTURE_WIDTH * CAPTURE_HEIGHT, '\0');
+  vram_to_gray((const u8*) vram.data(), (u8*) &gray[0]);
+  return gray;
+}
+
+bool check_file(const string& path, const string& expected) {
+  string actual;
+  if (!read_file(path, &actual)) {
+    log_error("%s was not written", path.c_str());
+    return false;
+  }
+  if (actual != expected) {
+    log_error("%s: %zu bytes, expected %zu, or different contents", path.c_str(), actual.size(), expected.size());
+    return false;
+  }
+  return true;
+}
+
+bool check_raw(const string& rom, InputMovie& movie, u64 frames, const string& dir) {
+  vector<string> vrams;
+  string path = dir + "/capture.raw";
+  if (!capture_frames(rom, movie, frames, path, &vrams)) {
+    return false;
+  }
+  string expected;
+  for (const string& vram : vrams) {
+    expected += vram;
+  }
+  return check_file(path, expected);
+}
+
+bool check_y4m(const string& rom, InputMovie& movie, u64 frames, const string& dir) {
+  vector<string> vrams;
+  string path = dir + "/capture.y4m";
+  if (!capture_frames(rom, movie, frames, path, &vrams)) {
+    return false;
+  }
+  string expected = "YUV4MPEG2 W" + to_string(CAPTURE_WIDTH) + " H" + to_string(CAPTURE_HEIGHT) + " F60:1 Ip A1:1 Cmono\n";
+  for (const string& vram : vrams) {
+    expected += "FRAME\n" + gray_frame(vram);
+  }
+  return check_file(path, expected);
+}
+
+bool check_png(const string& rom, InputMovie& movie, u64 frames, const string& dir) {
+  vector<string> vrams;
+  if (!capture_frames(rom, movie, frames, dir + "/shot_%04d.png", &vrams)) {
+    return false;
+  }
+  bool same = true;
+  string reference_path = dir + "/reference.png";
+  for (u64 frame = 0; frame < frames; frame++) {
+    char name[32];
+    snprintf(name, sizeof(name), "/shot_%04llu.png", (unsigned long long) frame);
+    string expected;
+    string gray = gray_frame(vrams[frame]);
+    if (!write_png_gray(reference_path, (const u8*) gray.data(), CAPTURE_WIDTH, CAPTURE_HEIGHT) ||
+        !read_file(reference_path, &expected)) {
+      log_error("could not write %s", reference_path.c_str());
+      return false;
+    }
+    same = check_file(dir + name, expected) && same;
+  }
+
+  // a screenshot (F12) is the png of the next frame submitted, without a capture open
+  FrameCapture shot;
+  string screenshot_path = dir + "/screenshot.png";
+  remove(screenshot_path.c_str());
+  shot.screenshot(screenshot_path);
+  shot.submit((const u8*) vrams[frames - 1].data());
+  shot.close();
+  string expected;
+  read_file(reference_path, &expected); // still the last frame's
+  same = check_file(screenshot_path, expected) && same;
+
+  // %% is a literal %, the width pads with spaces without the 0 flag
+  vrams.clear();
+  if (!capture_frames(rom, movie, 1, dir + "/100%%_%3u.png", &vrams) || !ifstream(dir + "/100%_  0.png")) {
+    log_error("%s/100%%_%%3u.png did not write 100%%_  0.png", dir.c_str());
+    same = false;
+  }
+
+  const char* refused[] = { "/name.png", "/shot_%s.png", "/shot_%d_%d.png", "/shot_%x.png", "/shot_%06d%.png" };
+  for (const char* pattern : refused) {
+    FrameCapture capture;
+    if (capture.open(dir + pattern)) {
+      log_error("the png pattern %s was accepted", pattern);
+      same = false;
+    }
+  }
+  return same;
+}
+
+int main(int argc, char** argv) {
+  if (argc < 4) {
+    print_usage();
+    return 2;
+  }
+  string rom = argv[1];
+  string movie_file = argv[2];
+  string dir = argv[3];
+  u64 frames = 8;
+  for (int i = 4; i < argc; i++) {
+    if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+      frames = max(1ULL, strtoull(argv[++i], nullptr, 0));
+    } else {
+      print_usage();
+      return 2;
+    }
+  }
+  // the writer drops frames it can't keep up with, a ring's worth never does
+  frames = min<u64>(frames, CAPTURE_QUEUE_SIZE);
+
+  InputMovie movie;
+  if (!movie.load(movie_file)) {
+    log_error("could not load movie %s", movie_file.c_str());
+    return 2;
+  }
+  mkdir(dir.c_str(), 0755);
+  struct stat info;
+  if (stat(dir.c_str(), &info) != 0 || !S_ISDIR(info.st_mode)) {
+    log_error("%s is not a directory", dir.c_str());
+    return 2;
+  }
+
+  bool same = check_raw(rom, movie, frames, dir);
+  same = check_y4m(rom, movie, frames, dir) && same;
+  same = check_png(rom, movie, frames, dir) && same;
+  printf("capture: %llu frames of raw, y4m and png %s\n", (unsigned long long) frames, same ? "match" : "differ");
+  return same ? 0 : 1;
+}
@@ -0,0 +1,272 @@
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <algorithm>
+#include <dirent.h>
+#include <stdlib.h>
+#include <string.h>
+#include "./CPU/8080.hpp"
+
+// runs the CP/M cpu test programs concurrently, one headless instance per program, and
+// compares their console output with <test dir>/expected/<program>.txt
+//
+//   cpm_conformance <test dir> [--jobs N] [--budget N] [--eager-flags] [program.COM ...]
+//
+// exit code 0 = every program matched its expected output, 1 = failure / timeout, 2 = usage
+
+#define SLICE_INSTRUCTIONS (1 << 24) // budget checks and progress updates happen per slice
+#define PROGRESS_INTERVAL_MS 5000
+#define DEFAULT_BUDGET 10000000000ULL
+
+struct RomBudget {
+  const char* name;
+  u64 instructions;
+};
+
+// roughly 2x the instructions each program needs to finish
+static const RomBudget rom_budgets[] = {
+  {"TST8080.COM", 2000},
+  {"8080PRE.COM", 4000},
+  {"CPUTEST.COM", 100000000ULL},
+  {"8080EXM.COM", 6000000000ULL},
+  {"8080EXER.COM", 6000000000ULL},
+};
+
+struct ConformanceJob {
+  string name;
+  string path;
+  string expected_path;
+  u64 budget = DEFAULT_BUDGET;
+  bool lazy_flags = true;
+  std::atomic<u64> executed{0};
+  std::atomic<bool> done{false};
+  bool timed_out = false;
+  bool passed = false;
+  double seconds = 0;
+  string output;
+  string failure;
+};
+
+u64 budget_for(const string& name) {
+  for (size_t i = 0; i < sizeof(rom_budgets) / sizeof(rom_budgets[0]); i++) {
+    if (name == rom_budgets[i].name) {
+      return rom_budgets[i].instructions;
+    }
+  }
+  return DEFAULT_BUDGET;
+}
+
+bool read_file(const string& path, string* contents) {
+  ifstream file(path, ios::binary);
+  if (!file) {
+    return false;
+  }
+  stringstream stream;
+  stream << file.rdbuf();
+  *contents = stream.str();
+  return true;
+}
+
+// CP/M prints CR LF (plus the odd NUL / BEL), the expected files are plain text
+string normalize_console_output(const string& text) {
+  string result;
+  result.reserve(text.size());
+  for (size_t i = 0; i < text.size(); i++) {
+    if (text[i] == '\n' || text[i] == '\t' || (u8) text[i] >= 0x20) {
+      result += text[i];
+    }
+  }
+  return result;
+}
+
+// describes the first line where the output differs from the expected text
+string first_difference(const string& expected, const string& actual) {
+  stringstream expected_lines(expected);
+  stringstream actual_lines(actual);
+  string expected_line;
+  string actual_line;
+  int line = 1;
+  while (true) {
+    bool has_expected = (bool) getline(expected_lines, expected_line);
+    bool has_actual = (bool) getline(actual_lines, actual_line);
+    if (!has_expected && !has_actual) {
+      return "";
+    }
+    if (!has_expected || !has_actual || expected_line != actual_line) {
+      stringstream message;
+      message << "line " << line << "\n    expected: " << (has_expected ? expected_line : "<end of output>")
+              << "\n    actual:   " << (has_actual ? actual_line : "<end of output>");
+      return message.str();
+    }
+    line++;
+  }
+}
+
+void run_job(ConformanceJob* job) {
+  auto start = chrono::steady_clock::now();
+
+  stringstream output;
+  _8080* _8080_ = new _8080(true);
+  _8080_->test_output = &output;
+  _8080_->regs.lazy_flags = job->lazy_flags;
+  _8080_->load_test(job->path);
+
+  while (!_8080_->test_finished() && job->executed < job->budget) {
+    u64 slice = min<u64>(SLICE_INSTRUCTIONS, job->budget - job->executed);
+    job->executed += _8080_->run_test(slice);
+  }
+  job->timed_out = !_8080_->test_finished();
+  delete _8080_;
+
+  job->output = output.str();
+  job->seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+  string expected;
+  if (job->timed_out) {
+    job->failure = "instruction budget of " + to_string(job->budget) + " exhausted";
+  } else if (!read_file(job->expected_path, &expected)) {
+    job->failure = "missing expected output " + job->expected_path;
+  } else {
+    job->failure = first_difference(normalize_console_output(expected), normalize_console_output(job->output));
+  }
+  job->passed = job->failure.empty();
+}
+
+vector<string> list_programs(const string& directory) {
+  vector<string> programs;
+  DIR* dir = opendir(directory.c_str());
+  if (!dir) {
+    return programs;
+  }
+  while (dirent* entry = readdir(dir)) {
+    string name = entry->d_name;
+    if (name.size() > 4 && name.compare(name.size() - 4, 4, ".COM") == 0) {
+      programs.push_back(name);
+    }
+  }
+  closedir(dir);
+  sort(programs.begin(), programs.end());
+  return programs;
+}
+
+void print_usage() {
+  printf("usage: cpm_conformance <test dir> [--jobs N] [--budget N] [--eager-flags] [program.COM ...]\n");
+}
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    print_usage();
+    return 2;
+  }
+
+  string directory = argv[1];
+  unsigned jobs_count = max(1u, thread::hardware_concurrency());
+  u64 budget_override = 0;
+  bool lazy_flags = true;
+  vector<string> programs;
+
+  for (int i = 2; i < argc; i++) {
+    if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+      jobs_count = max(1, atoi(argv[++i]));
+    } else if (strcmp(argv[i], "--budget") == 0 && i + 1 < argc) {
+      budget_override = strtoull(argv[++i], nullptr, 0);
+    } else if (strcmp(argv[i], "--eager-flags") == 0) {
+      lazy_flags = false;
+    } else if (argv[i][0] == '-') {
+      print_usage();
+      return 2;
+    } else {
+      programs.push_back(argv[i]);
+    }
+  }
+  if (programs.empty()) {
+    programs = list_programs(directory);
+  }
+  if (programs.empty()) {
+    log_error("no .COM programs found in %s", directory.c_str());
+    return 2;
+  }
+
+  vector<ConformanceJob*> jobs;
+  for (size_t i = 0; i < programs.size(); i++) {
+    ConformanceJob* job = new ConformanceJob();
+    job->name = programs[i];
+    job->path = directory + "/" + programs[i];
+    job->expected_path = directory + "/expected/" + programs[i].substr(0, programs[i].size() - 4) + ".txt";
+    job->budget = budget_override ? budget_override : budget_for(programs[i]);
+    job->lazy_flags = lazy_flags;
+    if (!ifstream(job->path)) {
+      log_error("could not open %s", job->path.c_str());
+      return 2;
+    }
+    jobs.push_back(job);
+  }
+
+  // longest programs first so the pass takes about as long as the slowest one
+  sort(jobs.begin(), jobs.end(), [](const ConformanceJob* a, const ConformanceJob* b) {
+    return a->budget > b->budget;
+  });
+
+  auto start = chrono::steady_clock::now();
+  std::atomic<size_t> next_job{0};
+  std::atomic<size_t> finished{0};
+  mutex progress_mutex;
+  condition_variable progress_signal;
+
+  vector<thread> workers;
+  jobs_count = min<unsigned>(jobs_count, jobs.size());
+  for (unsigned i = 0; i < jobs_count; i++) {
+    workers.push_back(thread([&]() {
+      size_t index;
+      while ((index = next_job++) < jobs.size()) {
+        run_job(jobs[index]);
+        jobs[index]->done = true;
+        lock_guard<mutex> lock(progress_mutex);
+        finished++;
+        progress_signal.notify_one();
+      }
+    }));
+  }
+
+  // progress checkpoints while the long exercisers run
+  {
+    unique_lock<mutex> lock(progress_mutex);
+    while (finished < jobs.size()) {
+      if (progress_signal.wait_for(lock, chrono::milliseconds(PROGRESS_INTERVAL_MS)) == cv_status::timeout) {
+        for (size_t i = 0; i < jobs.size(); i++) {
+          if (!jobs[i]->done) {
+            printf("[progress] %-14s %8.1fM instructions\n", jobs[i]->name.c_str(), jobs[i]->executed / 1e6);
+          }
+        }
+        fflush(stdout);
+      }
+    }
+  }
+  for (size_t i = 0; i < workers.size(); i++) {
+    workers[i].join();
+  }
+  log_flush(); // the workers' log lines before the summary
+
+  int failures = 0;
+  for (size_t i = 0; i < jobs.size(); i++) {
+    ConformanceJob* job = jobs[i];
+    printf("%-14s %s  %12llu instructions  %7.2fs\n", job->name.c_str(), job->passed ? "PASS" : "FAIL",
+           (unsigned long long) job->executed.load(), job->seconds);
+    if (!job->passed) {
+      printf("  %s\n", job->failure.c_str());
+      // keep the full output around for inspection
+      ofstream(job->name + ".actual.txt", ios::binary) << job->output;
+      failures++;
+    }
+    delete job;
+  }
+  printf("%d of %zu programs passed in %.2fs\n", (int) (jobs.size() - failures), jobs.size(),
+         chrono::duration<double>(chrono::steady_clock::now() - start).count());
+
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,205 @@
+#include <iostream>
+#include <chrono>
+#include <stdlib.h>
+#include <string.h>
+#include "./CPU/8080.hpp"
+#include "./CPU/frame_hash.hpp"
+#include "./CPU/movie.hpp"
+
+// the frame_hashes_recompiled build runs the same checks on generated blocks
+#ifdef RECOMPILED_PROGRAM
+extern const RecompiledProgram RECOMPILED_PROGRAM;
+#endif
+
+// golden frame hash regression suite: replays an input movie headless and hashes VRAM
+// (and optionally RAM) after every frame
+//
+//   frame_hashes record <rom> <movie> <hashes> [--frames N] [--ram] [--no-idle-skip] [--no-fusion]
+//   frame_hashes check  <rom> <movie> <hashes> [--no-idle-skip] [--no-fusion] [--boot-cache DIR] [--boot-frames N]
+//                      [--run-ahead N]
+//
+// --boot-cache starts the check from the cached boot snapshot (written on the first run),
+// the movie must have nothing pressed before frame --boot-frames (default 60)
+// --run-ahead runs N frames ahead after every frame and rolls back: the real frames must
+// still match, and the run-ahead frame must match frame + N wherever the inputs are held
+//
+// <rom> is either the invaders ROM folder or a single binary loaded at 0x0000
+// exit code 0 = every frame matched, 1 = mismatch, 2 = usage / file error
+
+void print_usage() {
+  printf("usage: frame_hashes record <rom> <movie> <hashes> [--frames N] [--ram] [--no-idle-skip] [--no-fusion]\n");
+  printf("       frame_hashes check  <rom> <movie> <hashes> [--no-idle-skip] [--no-fusion] [--boot-cache DIR] [--boot-frames N]\n");
+  printf("                                                                   [--run-ahead N]\n");
+}
+
+FrameHash hash_frame(_8080* _8080_, u64 frame, bool with_ram) {
+  FrameHash hash;
+  hash.frame = frame;
+  u8 ram[RAM_BYTES];
+  _8080_->memory.read_block(RAM_START, ram, RAM_BYTES);
+  hash.vram = hash_bytes(ram + (VRAM_START - RAM_START), VRAM_BYTES);
+  hash.ram = with_ram ? hash_bytes(ram, RAM_BYTES) : 0;
+  return hash;
+}
+
+int main(int argc, char** argv) {
+  if (argc < 5) {
+    print_usage();
+    return 2;
+  }
+
+  string mode = argv[1];
+  string rom = argv[2];
+  string movie_file = argv[3];
+  string hash_file = argv[4];
+  u64 frames = 0;
+  bool with_ram = false;
+  bool skip_idle_loops = true;
+  bool fuse_instructions = true;
+  string boot_cache;
+  u64 boot_frames = 60;
+  int run_ahead = 0;
+
+  for (int i = 5; i < argc; i++) {
+    if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+      frames = strtoull(argv[++i], nullptr, 0);
+    } else if (strcmp(argv[i], "--ram") == 0) {
+      with_ram = true;
+    } else if (strcmp(argv[i], "--no-idle-skip") == 0) {
+      skip_idle_loops = false;
+    } else if (strcmp(argv[i], "--no-fusion") == 0) {
+      fuse_instructions = false;
+    } else if (strcmp(argv[i], "--boot-cache") == 0 && i + 1 < argc) {
+      boot_cache = argv[++i];
+    } else if (strcmp(argv[i], "--boot-frames") == 0 && i + 1 < argc) {
+      boot_frames = strtoull(argv[++i], nullptr, 0);
+    } else if (strcmp(argv[i], "--run-ahead") == 0 && i + 1 < argc) {
+      run_ahead = atoi(argv[++i]);
+    } else {
+      print_usage();
+      return 2;
+    }
+  }
+
+  InputMovie movie;
+  if (!movie.load(movie_file)) {
+    log_error("could not load movie %s", movie_file.c_str());
+    return 2;
+  }
+
+  vector<FrameHash> golden;
+  if (mode == "check") {
+    if (!load_frame_hashes(hash_file, &golden, &with_ram)) {
+      log_error("could not load frame hashes %s", hash_file.c_str());
+      return 2;
+    }
+    frames = golden.size();
+  } else if (mode != "record") {
+    print_usage();
+    return 2;
+  }
+  if (frames == 0) {
+    frames = movie.size();
+  }
+  if (run_ahead > 0 && mode != "check") {
+    log_error("--run-ahead only works with check");
+    return 2;
+  }
+  if (!boot_cache.empty()) {
+    for (u64 frame = 0; frame < boot_frames; frame++) {
+      if (mode != "check" || movie.get(frame) != 0 || frame >= frames) {
+        log_error("--boot-cache only checks movies with nothing pressed for the first %llu frames",
+                  (unsigned long long) boot_frames);
+        return 2;
+      }
+    }
+  }
+
+  _8080* _8080_ = new _8080(true);
+  _8080_->skip_idle_loops = skip_idle_loops;
+  _8080_->fuse_instructions = fuse_instructions;
+  _8080_->run_ahead = run_ahead;
+  if (!_8080_->load_program(rom)) {
+    delete _8080_;
+    return 2;
+  }
+#ifdef RECOMPILED_PROGRAM
+  if (!_8080_->use_recompiled(&RECOMPILED_PROGRAM)) {
+    delete _8080_;
+    return 2;
+  }
+#endif
+
+  if (!boot_cache.empty()) {
+    auto boot_start = chrono::steady_clock::now();
+    bool cached = _8080_->boot_from_cache(boot_cache, boot_frames);
+    double boot_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - boot_start).count();
+    log_info("booted to frame %llu in %.3f ms (%s)", (unsigned long long) boot_frames, boot_ms,
+             cached ? "from the cache" : "cache written");
+  }
+
+  vector<FrameHash> hashes;
+  hashes.reserve(frames);
+  int result = 0;
+  u64 run_ahead_checked = 0;
+  auto start = chrono::steady_clock::now();
+
+  for (u64 frame = _8080_->get_frames(); frame < frames; frame++) {
+    _8080_->set_inputs(movie.get(frame));
+    _8080_->run_frame();
+    FrameHash hash = hash_frame(_8080_, frame, with_ram);
+
+    if (mode == "check") {
+      const FrameHash& expected = golden[frame];
+      if (hash.vram != expected.vram || (with_ram && hash.ram != expected.ram)) {
+        log_error("frame %llu differs: vram %016llx (expected %016llx)%s", (unsigned long long) frame,
+                  (unsigned long long) hash.vram, (unsigned long long) expected.vram,
+                  hash.vram == expected.vram ? ", ram differs" : "");
+        result = 1;
+        break;
+      }
+    }
+    hashes.push_back(hash);
+
+    if (run_ahead > 0) {
+      // the run-ahead frames hold this frame's inputs, comparable when the movie holds them too
+      bool held = frame + run_ahead < frames;
+      for (int i = 1; i <= run_ahead && held; i++) {
+        held = movie.get(frame + i) == movie.get(frame);
+      }
+      _8080_->begin_run_ahead();
+      u64 ahead = hash_frame(_8080_, frame + run_ahead, false).vram;
+      _8080_->end_run_ahead();
+      if (held && ahead != golden[frame + run_ahead].vram) {
+        log_error("run-ahead frame %llu differs: vram %016llx (expected %016llx)",
+                  (unsigned long long) (frame + run_ahead), (unsigned long long) ahead,
+                  (unsigned long long) golden[frame + run_ahead].vram);
+        result = 1;
+        break;
+      }
+      run_ahead_checked += held;
+    }
+  }
+
+  double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  log_info("%zu frames in %.2fs (%.0f frames/s)", hashes.size(), seconds, hashes.size() / seconds);
+  log_info("cycles skipped: %llu halted, %llu idle of %llu", (unsigned long long) _8080_->get_halted_cycles(),
+           (unsigned long long) _8080_->get_idle_cycles(), (unsigned long long) _8080_->get_cycles());
+
+  if (run_ahead > 0) {
+    log_info("run-ahead: %d frames, %.1f us per frame, %llu run-ahead frames matched", run_ahead,
+             _8080_->get_run_ahead_cost(), (unsigned long long) run_ahead_checked);
+  }
+
+  if (mode == "record") {
+    if (!save_frame_hashes(hash_file, hashes, with_ram)) {
+      log_error("could not write %s", hash_file.c_str());
+      result = 2;
+    }
+  } else if (result == 0) {
+    log_info("all %zu frames match", hashes.size());
+  }
+
+  delete _8080_;
+  return result;
+}
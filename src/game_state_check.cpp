@@ -0,0 +1,170 @@
+#include <chrono>
+#include <stdlib.h>
+#include <string.h>
+#include "./CPU/8080.hpp"
+#include "./CPU/movie.hpp"
+#include "./CPU/game_state.hpp"
+
+// game state introspection over the invaders work RAM
+//
+//   game_state_check                                    decodes a synthetic RAM image, checks the
+//                                                       change notifications and times the read
+//   game_state_check <rom> <movie> [--frames N] [--expect-playing]
+//                                                       replays the movie headless and prints every
+//                                                       change (player x moves left out)
+//
+// --expect-playing fails the replay unless a game got started
+// exit code 0 = ok, 1 = check failed, 2 = usage / file error
+
+#define READ_REPEATS 10000000
+
+void print_usage() {
+  printf("usage: game_state_check\n");
+  printf("       game_state_check <rom> <movie> [--frames N] [--expect-playing]\n");
+}
+
+string describe(const GameState& state) {
+  char text[160];
+  snprintf(text, sizeof(text), "score %04u / %04u  high %04u  credits %02u  lives %u / %u  player %d  x %3u  aliens %2u  %s%s",
+           state.score[0], state.score[1], state.high_score, state.credits, state.lives[0], state.lives[1],
+           state.player + 1, state.player_x, state.aliens, state.playing ? "playing" : "attract",
+           state.player_alive ? "" : " (ship down)");
+  return text;
+}
+
+int check(bool passed, const char* what) {
+  if (!passed) {
+    log_error("%s", what);
+  }
+  return passed ? 0 : 1;
+}
+
+int self_check() {
+  vector<u8> memory(0x10000, 0);
+  int failures = 0;
+
+  memory[GAME_SCORE_1] = 0x50;
+  memory[GAME_SCORE_1 + 1] = 0x12;
+  memory[GAME_SCORE_2] = 0x90;
+  memory[GAME_SCORE_2 + 1] = 0x09;
+  memory[GAME_HIGH_SCORE] = 0x00;
+  memory[GAME_HIGH_SCORE + 1] = 0x37;
+  memory[GAME_CREDITS] = 0x15;
+  memory[GAME_SHIPS_1] = 3;
+  memory[GAME_SHIPS_2] = 2;
+  memory[GAME_CURRENT_PLAYER] = 0x22;
+  memory[GAME_PLAYER_X] = 0x40;
+  memory[GAME_ALIENS] = 55;
+  memory[GAME_PLAYING] = 1;
+  memory[GAME_PLAYER_ALIVE] = 0xFF;
+
+  GameState state = read_game_state(memory.data(), 7);
+  log_info("%s", describe(state).c_str());
+  failures += check(state.frame == 7, "frame not set");
+  failures += check(state.score[0] == 1250 && state.score[1] == 990, "scores are not decoded as BCD");
+  failures += check(state.high_score == 3700, "high score is not decoded as BCD");
+  failures += check(state.credits == 15, "credits are not decoded as BCD");
+  failures += check(state.lives[0] == 3 && state.lives[1] == 2, "wrong lives");
+  failures += check(state.player == 1, "0x22 is player 2's data page");
+  failures += check(state.player_x == 0x40 && state.aliens == 55, "wrong player x / aliens");
+  failures += check(state.playing && state.player_alive, "wrong game mode / ship state");
+
+  GameStateWatcher watcher;
+  int score_calls = 0;
+  int lives_calls = 0;
+  u32 last_changed = 0;
+  watcher.on_change(GAME_FIELD_SCORE, [&](const GameState& before, const GameState& after, u32 changed) {
+    failures += check(after.score[1] - before.score[1] == 20, "callback before / after don't match the write");
+    last_changed = changed;
+    score_calls++;
+  });
+  watcher.on_change(GAME_FIELD_LIVES, [&](const GameState&, const GameState&, u32) {
+    lives_calls++;
+  });
+  failures += check(watcher.update(memory.data(), 1) == 0, "the first update is not just the baseline");
+  failures += check(watcher.update(memory.data(), 2) == 0, "nothing written but a change reported");
+  memory[GAME_SCORE_2] = 0x10; // 990 -> 1010, the carry has to cross both BCD bytes
+  memory[GAME_SCORE_2 + 1] = 0x10;
+  memory[GAME_PLAYER_X] = 0x41;
+  u32 changed = watcher.update(memory.data(), 3);
+  failures += check(changed == (GAME_FIELD_SCORE | GAME_FIELD_PLAYER_X), "wrong change mask");
+  failures += check(score_calls == 1 && lives_calls == 0, "callbacks not called for exactly their fields");
+  failures += check(last_changed == changed, "callback got a different mask");
+  failures += check(watcher.get_state().frame == 3 && watcher.get_state().score[1] == 1010, "watcher state not updated");
+
+  // what a reward computation pays per step
+  u64 sum = 0;
+  auto start = chrono::steady_clock::now();
+  for (int i = 0; i < READ_REPEATS; i++) {
+    memory[GAME_SCORE_1] = (u8) i;
+    GameState read = read_game_state(memory.data(), i);
+    sum += read.score[0] + read.lives[0] + read.aliens;
+  }
+  double ns = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / READ_REPEATS;
+  log_info("read_game_state: %.1f ns (checksum %llu)", ns, (unsigned long long) sum);
+
+  if (failures == 0) {
+    log_info("game state decoding and notifications ok");
+  }
+  return failures == 0 ? 0 : 1;
+}
+
+int main(int argc, char** argv) {
+  if (argc == 1) {
+    return self_check();
+  }
+  if (argc < 3) {
+    print_usage();
+    return 2;
+  }
+
+  string rom = argv[1];
+  string movie_file = argv[2];
+  u64 frames = 0;
+  bool expect_playing = false;
+  for (int i = 3; i < argc; i++) {
+    if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+      frames = strtoull(argv[++i], nullptr, 0);
+    } else if (strcmp(argv[i], "--expect-playing") == 0) {
+      expect_playing = true;
+    } else {
+      print_usage();
+      return 2;
+    }
+  }
+
+  InputMovie movie;
+  if (!movie.load(movie_file)) {
+    log_error("could not load movie %s", movie_file.c_str());
+    return 2;
+  }
+  if (frames == 0) {
+    frames = movie.size();
+  }
+
+  _8080* _8080_ = new _8080(true);
+  if (!_8080_->load_program(rom)) {
+    delete _8080_;
+    return 2;
+  }
+  GameStateWatcher watcher;
+  bool played = false;
+  watcher.on_change(GAME_FIELD_ALL & ~GAME_FIELD_PLAYER_X, [&](const GameState&, const GameState& after, u32) {
+    log_info("frame %5llu: %s", (unsigned long long) after.frame, describe(after).c_str());
+    played |= after.playing;
+  });
+  _8080_->game_state = &watcher;
+
+  for (u64 frame = 0; frame < frames; frame++) {
+    _8080_->set_inputs(movie.get(frame));
+    _8080_->run_frame();
+  }
+  log_info("after %llu frames: %s", (unsigned long long) frames, describe(_8080_->get_game_state()).c_str());
+  delete _8080_;
+
+  if (expect_playing && !played) {
+    log_error("no game was started");
+    return 1;
+  }
+  return 0;
+}
@@ -2,65 +2,273 @@
 #include <SDL2/SDL.h>
 #include "./CPU/8080.hpp"
 #include "./CPU/Screen.hpp"
+#include "./CPU/movie.hpp"
+#include <chrono>
+#include <ctime>
 #include <signal.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <unistd.h>
 
+// defaults relative to build/
+#define INVADERS_FOLDER "../invaders/"
+#define BOOT_CACHE_FOLDER "../boot_cache/"
+#define BOOT_FRAMES 120
 
-#define ROM_FILE_STRING "./invaders/invaders"
-#define INVADERS_H_START 0x0000
-#define INVADERS_G_START 0x0800
-#define INVADERS_F_START 0x1000
-#define INVADERS_E_START 0x1800
+// generated at build time by invaders_recompiler when the ROMs are present
+#ifdef INVADERS_RECOMPILED
+extern const RecompiledProgram invaders_program;
+#endif
 
-#define INVADERS_H_FILE "../invaders/invaders.h"
-#define INVADERS_G_FILE "../invaders/invaders.g"
-#define INVADERS_F_FILE "../invaders/invaders.f"
-#define INVADERS_E_FILE "../invaders/invaders.e"
+void print_usage() {
+  printf("usage: Space_Invaders_Emulator [options]\n"
+         "  --rom DIR|FILE      invaders ROM folder (default %s) or a ROM image loaded at 0\n"
+         "  --test FILE         run a CP/M program (e.g. ../cpu_tests/8080EXM.COM) headless instead\n"
+         "  --headless          no window, no audio\n"
+         "  --speed N           N times real speed (default 1), 0 runs unthrottled\n"
+         "  --frames N          exit after N frames\n"
+         "  --cycles N          exit after the frame that reaches N cycles\n"
+         "  --movie FILE        take the inputs from a movie instead of the keyboard\n"
+         "  --record FILE       save the inputs of the run as a movie\n"
+         "  --boot-cache [DIR]  start from the snapshot %d frames after reset (default %s)\n"
+         "  --run-ahead N       show the game N frames ahead\n"
+         "  --capture FILE      capture every frame (.raw, .y4m or a .png pattern)\n"
+         "  --wav FILE          write the mixed sound to a wav, headless too\n"
+         "  --samples DIR       the sample set for --headless --wav (default %s)\n"
+         "  --scale N           window scale 1 - 8, --epx for scale2x / scale4x\n"
+         "  --scanlines, --phosphor\n",
+         INVADERS_FOLDER, BOOT_FRAMES, BOOT_CACHE_FOLDER, SAMPLE_FOLDER);
+}
 
-#define TEST1_FILE "../cpu_tests/8080EXM.COM"
-#define TEST2_FILE "../cpu_tests/8080EXER.COM"
-#define TEST3_FILE "../cpu_tests/CPUTEST.COM"
-#define TEST4_FILE "../cpu_tests/TST8080.COM" // working
-#define TEST5_FILE "../cpu_tests/8080PRE.COM" // working
+// the instance Ctrl+C stops, nullptr exits straight away (during the setup)
+_8080* running_instance = nullptr;
 
+// only async signal safe calls: exit() would run the logger's atexit handler, which locks its
+// mutex and joins its thread from inside the handler
 void handle_sigint(int sig) {
-    printf("\n[!] Caught signal %d (Ctrl+C), exiting cleanly.\n", sig);
-    fflush(stdout);
-    exit(0);
+  (void) sig;
+  if (running_instance) {
+    running_instance->stop();
+    return;
+  }
+  const char message[] = "\n[!] Caught Ctrl+C, exiting.\n";
+  if (write(STDOUT_FILENO, message, sizeof(message) - 1) < 0) {
+    _exit(1);
+  }
+  _exit(0);
 }
 
 void setup_signal_handlers() {
-    signal(SIGINT, handle_sigint);
+  signal(SIGINT, handle_sigint);
+}
+
+// the invaders folder, or any other ROM image as one file loaded at 0
+bool setup_space_invaders(_8080* _8080_, const string& rom) {
+  if (!_8080_->load_program(rom)) {
+    return false;
+  }
+#ifdef INVADERS_RECOMPILED
+  // the blocks check the ROM hash, any other image stays on the interpreter with a warning
+  _8080_->use_recompiled(&invaders_program);
+#endif
+  return true;
+}
+
+// starts from the snapshot taken boot_frames frames after reset, the first run writes it
+void setup_boot_cache(_8080* _8080_, const string& cache_dir, u64 boot_frames) {
+  if (_8080_->boot_from_cache(cache_dir, boot_frames)) {
+    log_info("booted from %s", boot_cache_path(cache_dir, _8080_->get_rom_hash(), boot_frames).c_str());
+  }
+}
+
+void setup_test(_8080* _8080_, const string& test_file) {
+  // CP/M programs are loaded at 0x100
+  _8080_->load_test(test_file);
+}
+
+// capture format comes from the extension: .raw (1bpp VRAM), .y4m or .png (printf pattern)
+// note: SDL_VIDEODRIVER=dummy runs without a display
+bool setup_capture(_8080* _8080_, const string& capture_file) {
+  _8080_->capture = new FrameCapture();
+  return _8080_->capture->open(capture_file);
+}
+
+// headless instances have no audio, they get a mixer that only writes the wav
+bool setup_wav_dump(_8080* _8080_, const string& wav_file, const string& sample_folder) {
+  if (!_8080_->audio) {
+    _8080_->audio = new Audio();
+    _8080_->audio->load_samples(sample_folder);
+  }
+  return _8080_->audio->open_wav_dump(wav_file);
+}
+
+// the window is scaled on the CPU, e.g. 4x scale4x with scanlines: 4, SCALE_EPX, true, false
+void setup_scaler(_8080* _8080_, int scale, ScaleFilter filter, bool scanlines, bool phosphor) {
+  ScalerConfig config;
+  config.scale = scale;
+  config.filter = filter;
+  config.scanlines = scanlines;
+  config.phosphor = phosphor;
+  _8080_->set_scaler(config);
 }
 
-// note this is indicated by pc but I have this for debugging
-u16 space_invaders_start_address = 0x0000;
+// the counters when the run started and the clocks
+struct RunStart {
+  u64 frames;
+  u64 cycles;
+  u64 skipped_cycles; // halted or in idle loops
+  chrono::steady_clock::time_point time;
+  clock_t cpu_time;
+};
 
-void setup_space_invaders(_8080* _8080_) {
-  _8080_->regs->pc = space_invaders_start_address;
-  _8080_->load_rom(INVADERS_H_FILE, INVADERS_H_START);
-  _8080_->load_rom(INVADERS_G_FILE, INVADERS_G_START);
-  _8080_->load_rom(INVADERS_F_FILE, INVADERS_F_START);
-  _8080_->load_rom(INVADERS_E_FILE, INVADERS_E_START);
+RunStart start_run(_8080* _8080_) {
+  return { _8080_->get_frames(), _8080_->get_cycles(), _8080_->get_halted_cycles() + _8080_->get_idle_cycles(),
+           chrono::steady_clock::now(), clock() };
 }
 
-void setup_test(_8080* _8080_) {
-  // Load the cpudiag.bin file at 0x100
-  _8080_->load_rom(TEST1_FILE, 0x100);
-  _8080_->regs->pc = 0x0100;
-  _8080_->memory[0x0006] = 0x00;
-  _8080_->memory[0x0007] = 0x24;
+// what the run emulated against the wall clock and the process' CPU time (every thread)
+void print_stats(_8080* _8080_, const RunStart& start) {
+  double seconds = chrono::duration<double>(chrono::steady_clock::now() - start.time).count();
+  double cpu_seconds = (double) (clock() - start.cpu_time) / CLOCKS_PER_SEC;
+  u64 cycles = _8080_->get_cycles() - start.cycles;
+  u64 skipped = _8080_->get_halted_cycles() + _8080_->get_idle_cycles() - start.skipped_cycles;
+  double mhz = seconds > 0 ? cycles / seconds / 1e6 : 0;
+  printf("%llu frames, %llu cycles (%llu skipped idle) in %.3f s: %.2f emulated MHz (%.1fx real time), "
+         "host cpu %.3f s\n", (unsigned long long) (_8080_->get_frames() - start.frames), (unsigned long long) cycles,
+         (unsigned long long) skipped, seconds, mhz, mhz * 1e6 / CYCLES_PER_SECOND, cpu_seconds);
 }
 
-int main() {
-  // Registers* regs = new Registers();
-  // cout << " \n the value is "<< (int)regs->f << endl;
-  _8080* _8080_ = new _8080();
+int main(int argc, char** argv) {
+  string rom = INVADERS_FOLDER;
+  string test_file;
+  bool headless = false;
+  double speed = 1.0;
+  u64 frame_limit = 0;
+  u64 cycle_limit = 0;
+  string movie_file;
+  string record_file;
+  string boot_cache;
+  int run_ahead = 0;
+  string capture_file;
+  string wav_file;
+  string sample_folder = SAMPLE_FOLDER;
+  int scale = 0;
+  ScaleFilter filter = SCALE_NEAREST;
+  bool scanlines = false;
+  bool phosphor = false;
+  for (int i = 1; i < argc; i++) {
+    bool has_value = i + 1 < argc;
+    if (strcmp(argv[i], "--rom") == 0 && has_value) {
+      rom = argv[++i];
+    } else if (strcmp(argv[i], "--test") == 0 && has_value) {
+      test_file = argv[++i];
+    } else if (strcmp(argv[i], "--headless") == 0) {
+      headless = true;
+    } else if (strcmp(argv[i], "--speed") == 0 && has_value) {
+      speed = atof(argv[++i]);
+    } else if (strcmp(argv[i], "--frames") == 0 && has_value) {
+      frame_limit = strtoull(argv[++i], nullptr, 0);
+    } else if (strcmp(argv[i], "--cycles") == 0 && has_value) {
+      cycle_limit = strtoull(argv[++i], nullptr, 0);
+    } else if (strcmp(argv[i], "--movie") == 0 && has_value) {
+      movie_file = argv[++i];
+    } else if (strcmp(argv[i], "--record") == 0 && has_value) {
+      record_file = argv[++i];
+    } else if (strcmp(argv[i], "--boot-cache") == 0) {
+      boot_cache = has_value && argv[i + 1][0] != '-' ? argv[++i] : BOOT_CACHE_FOLDER;
+    } else if (strcmp(argv[i], "--run-ahead") == 0 && has_value) {
+      run_ahead = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--capture") == 0 && has_value) {
+      capture_file = argv[++i];
+    } else if (strcmp(argv[i], "--wav") == 0 && has_value) {
+      wav_file = argv[++i];
+    } else if (strcmp(argv[i], "--samples") == 0 && has_value) {
+      sample_folder = argv[++i];
+      if (sample_folder.back() != '/') {
+        sample_folder += '/';
+      }
+    } else if (strcmp(argv[i], "--scale") == 0 && has_value) {
+      scale = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--epx") == 0) {
+      filter = SCALE_EPX;
+    } else if (strcmp(argv[i], "--scanlines") == 0) {
+      scanlines = true;
+    } else if (strcmp(argv[i], "--phosphor") == 0) {
+      phosphor = true;
+    } else {
+      print_usage();
+      return 2;
+    }
+  }
+
+  InputMovie movie;
+  if (!movie_file.empty() && !movie.load(movie_file)) {
+    log_error("could not load movie %s", movie_file.c_str());
+    return 2;
+  }
+  InputMovie recording;
+
+  _8080* _8080_ = new _8080(headless || !test_file.empty());
   setup_signal_handlers();
-  setup_space_invaders(_8080_);
-  _8080_->run();
-  // setup_test(_8080_);
-  // _8080_->run_test();
-  return 0;
-}
\ No newline at end of file
+
+  if (!test_file.empty()) {
+    setup_test(_8080_, test_file);
+    RunStart start = start_run(_8080_);
+    running_instance = _8080_;
+    _8080_->run_test();
+    running_instance = nullptr;
+    printf("\n");
+    print_stats(_8080_, start);
+    delete _8080_;
+    return 0;
+  }
+
+  if (!setup_space_invaders(_8080_, rom)) {
+    delete _8080_;
+    return 2;
+  }
+  // the snapshot is booted with nothing pressed, it would drop the movie's early inputs
+  if (!boot_cache.empty() && !movie_file.empty() && movie.first_pressed() < BOOT_FRAMES) {
+    log_warn("%s presses inputs in frame %zu, before the boot snapshot at %d, booting without it",
+             movie_file.c_str(), movie.first_pressed(), BOOT_FRAMES);
+  } else if (!boot_cache.empty()) {
+    setup_boot_cache(_8080_, boot_cache, BOOT_FRAMES);
+  }
+  if (!capture_file.empty() && !setup_capture(_8080_, capture_file)) {
+    delete _8080_;
+    return 2;
+  }
+  if (!wav_file.empty() && !setup_wav_dump(_8080_, wav_file, sample_folder)) {
+    delete _8080_;
+    return 2;
+  }
+  if (scale > 0) {
+    setup_scaler(_8080_, scale, filter, scanlines, phosphor);
+  }
+  _8080_->run_ahead = run_ahead;
+  _8080_->speed = speed;
+  _8080_->frame_limit = frame_limit;
+  _8080_->cycle_limit = cycle_limit;
+  _8080_->replay = movie_file.empty() ? nullptr : &movie;
+  _8080_->recording = record_file.empty() ? nullptr : &recording;
+
+  // from after the setup and boot, so the stats are the run's alone
+  RunStart start = start_run(_8080_);
+  running_instance = _8080_;
+  if (headless) {
+    _8080_->run_headless();
+  } else {
+    _8080_->run();
+  }
+  running_instance = nullptr;
+  print_stats(_8080_, start);
+
+  int result = 0;
+  if (!record_file.empty() && !recording.save(record_file)) {
+    log_error("could not save movie %s", record_file.c_str());
+    result = 1;
+  }
+  delete _8080_;
+  return result;
+}
@@ -0,0 +1,319 @@
+#include <chrono>
+#include <memory>
+#include <stdlib.h>
+#include <string.h>
+#include "./CPU/8080.hpp"
+#include "./CPU/movie.hpp"
+
+// checks the copy on write memory bus and what instances sharing one ROM image cost
+//
+//   memory_check <rom> <movie> [--instances N] [--frames N] [--children N] [--depth N]
+//
+// bus:       copy on write between two buses, writes that change nothing, block wrap
+// instances: N headless instances share the pages of one loaded template and replay the
+//            movie; the RAM of every one after every frame against a standalone instance
+// footprint: bytes per instance, the object plus the pages it had to copy
+// fork:      along the movie, children forked every frame with other inputs run depth frames
+//            each, against a copy restored from a snapshot; the parent must not see them
+// timing:    forks per second and search nodes (a fork and its depth frames) per second at
+//            that branching factor, fork (recycling the children) / fork_into against
+//            save_state + load_state
+// exit code 0 = everything matched, 1 = not, 2 = usage / file error
+
+void print_usage() {
+  printf("usage: memory_check <rom> <movie> [--instances N] [--frames N] [--children N] [--depth N]\n");
+}
+
+bool expect(bool condition, const char* what) {
+  if (!condition) {
+    log_error("bus: %s", what);
+  }
+  return condition;
+}
+
+bool check_bus() {
+  bool ok = true;
+  unique_ptr<MemoryBus> source(new MemoryBus());
+  ok = expect((*source)[0x1234] == 0 && source->private_bytes() == 0, "a new bus is not all shared zeroes") && ok;
+
+  vector<u8> image(4 * PAGE_BYTES);
+  for (size_t i = 0; i < image.size(); i++) {
+    image[i] = (u8) (i * 7 + 3);
+  }
+  source->write_block(0, image.data(), image.size());
+  ok = expect(source->private_bytes() == image.size(), "the written pages are not private") && ok;
+
+  MemoryBus copy;
+  copy.share(*source);
+  ok = expect(copy.page(0) == source->page(0) && copy.private_bytes() == 0, "share copied pages") && ok;
+
+  copy.write(0x0010, image[0x0010]);
+  ok = expect(copy.page(0) == source->page(0), "writing the same byte copied the page") && ok;
+  copy.write(0x0010, image[0x0010] ^ 0xFF);
+  ok = expect(copy.page(0) != source->page(0) && copy.page(PAGE_BYTES) == source->page(PAGE_BYTES),
+              "a write copied the wrong pages") && ok;
+  ok = expect(copy[0x0010] == (u8) (image[0x0010] ^ 0xFF) && (*source)[0x0010] == image[0x0010],
+              "a write reached the other bus") && ok;
+
+  // the source's page lost its other reference, it writes it in place from here
+  const MemoryPage* page = source->page(0);
+  source->write(0x0020, 0x55);
+  ok = expect(source->page(0) == page && copy[0x0020] == image[0x0020], "the source did not take its page back") && ok;
+
+  copy.write(PAGE_BYTES + 1, 0xAA);
+  ok = expect((*source)[PAGE_BYTES + 1] == image[PAGE_BYTES + 1], "a second page write reached the source") && ok;
+
+  // the pages outlive the bus they came from
+  MemoryBus late;
+  late.share(*source);
+  source.reset();
+  ok = expect(late[0x0020] == 0x55 && late[3 * PAGE_BYTES] == image[3 * PAGE_BYTES], "a shared page was freed") && ok;
+
+  u8 in[4] = { 1, 2, 3, 4 };
+  u8 out[4] = {};
+  late.write_block(0xFFFE, in, 4);
+  late.read_block(0xFFFE, out, 4);
+  ok = expect(memcmp(in, out, 4) == 0 && late[0xFFFF] == 2 && late[0x0000] == 3 && late[0x0001] == 4,
+              "blocks do not wrap at 64 KB") && ok;
+
+  late.clear();
+  ok = expect(late[0x0001] == 0 && late.private_bytes() == 0, "clear left pages behind") && ok;
+  return ok;
+}
+
+bool same_ram(_8080* x, _8080* y) {
+  u8 expected[RAM_BYTES];
+  u8 actual[RAM_BYTES];
+  x->memory.read_block(RAM_START, expected, RAM_BYTES);
+  y->memory.read_block(RAM_START, actual, RAM_BYTES);
+  return memcmp(expected, actual, RAM_BYTES) == 0;
+}
+
+bool check_instances(const string& rom, InputMovie& movie, int count, u64 frames) {
+  _8080* reference = new _8080(true);
+  _8080* source = new _8080(true);
+  if (!reference->load_program(rom) || !source->load_program(rom)) {
+    delete reference;
+    delete source;
+    return false;
+  }
+  Snapshot boot;
+  source->save_state(&boot);
+
+  vector<_8080*> instances;
+  for (int i = 0; i < count; i++) {
+    _8080* instance = new _8080(true);
+    instance->share_memory(*source);
+    instance->load_state(boot);
+    instances.push_back(instance);
+  }
+
+  bool same = true;
+  auto start = chrono::steady_clock::now();
+  for (u64 frame = 0; frame < frames && same; frame++) {
+    reference->set_inputs(movie.get(frame));
+    reference->run_frame();
+    for (int i = 0; i < count && same; i++) {
+      instances[i]->set_inputs(movie.get(frame));
+      instances[i]->run_frame();
+      if (!same_ram(reference, instances[i])) {
+        log_error("instance %d differs from the standalone one in frame %llu", i, (unsigned long long) frame);
+        same = false;
+      }
+    }
+  }
+  double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+  // nothing writes the ROM, so every instance still reads the template's copy
+  for (int i = 0; i < count && same; i++) {
+    if (instances[i]->memory.page(PROGRAM_START) != source->memory.page(PROGRAM_START)) {
+      log_error("instance %d copied the ROM", i);
+      same = false;
+    }
+  }
+
+  if (same) {
+    size_t private_bytes = 0;
+    for (_8080* instance : instances) {
+      private_bytes += instance->memory.private_bytes();
+    }
+    size_t shared_bytes = 0;
+    for (u32 address = 0; address < MEMORY_BYTES; address += PAGE_BYTES) {
+      if (source->memory.page(address)->refs.load() > 1) {
+        shared_bytes += PAGE_BYTES;
+      }
+    }
+    double per_instance = sizeof(_8080) + (double) private_bytes / count;
+    printf("%d instances, %llu frames: %.0f bytes an instance (%zu object + %.0f copied pages), "
+           "%zu bytes of the template shared, %.0f instance frames/s\n",
+           count, (unsigned long long) frames, per_instance, sizeof(_8080), (double) private_bytes / count,
+           shared_bytes, count * frames / seconds);
+  }
+
+  for (_8080* instance : instances) {
+    delete instance;
+  }
+  delete reference;
+  delete source;
+  return same;
+}
+
+bool same_state(_8080* x, _8080* y) {
+  Snapshot p;
+  Snapshot q;
+  x->save_state(&p);
+  y->save_state(&q);
+  return p.regs.PSW == q.regs.PSW && p.regs.bc == q.regs.bc && p.regs.de == q.regs.de && p.regs.hl == q.regs.hl &&
+         p.regs.pc == q.regs.pc && p.regs.sp == q.regs.sp && p.cycles == q.cycles && p.frames == q.frames &&
+         p.halted_cycles == q.halted_cycles && p.idle_cycles == q.idle_cycles &&
+         p.interrupt_enabled == q.interrupt_enabled && p.halted == q.halted &&
+         p.ports.input_bits == q.ports.input_bits && p.ports.shift_value == q.ports.shift_value &&
+         p.ports.shift_offset == q.ports.shift_offset && p.ports.sound1 == q.ports.sound1 &&
+         p.ports.sound2 == q.ports.sound2 && memcmp(p.ram, q.ram, RAM_BYTES) == 0;
+}
+
+// the inputs of child i, every combination of the low bits the movie doesn't already hold
+u8 child_inputs(InputMovie& movie, u64 frame, int child) {
+  return movie.get(frame) ^ (u8) child;
+}
+
+void run_child(_8080* child, u8 inputs, int depth) {
+  child->set_inputs(inputs);
+  for (int i = 0; i < depth; i++) {
+    child->run_frame();
+  }
+}
+
+bool check_fork(_8080* parent, InputMovie& movie, u64 frames, int children, int depth) {
+  _8080* restored = new _8080(true);
+  restored->share_memory(*parent);
+  Snapshot before;
+  bool same = true;
+  for (u64 frame = 0; frame < frames && same; frame++) {
+    parent->save_state(&before);
+    for (int i = 0; i < children && same; i++) {
+      _8080* child = parent->fork();
+      restored->load_state(before);
+      run_child(child, child_inputs(movie, frame, i), depth);
+      run_child(restored, child_inputs(movie, frame, i), depth);
+      if (!same_state(child, restored)) {
+        log_error("child %d forked in frame %llu differs from the restored snapshot", i, (unsigned long long) frame);
+        same = false;
+      }
+      parent->recycle(child);
+    }
+    restored->load_state(before);
+    if (same && !same_state(parent, restored)) {
+      log_error("the children changed their parent in frame %llu", (unsigned long long) frame);
+      same = false;
+    }
+    parent->set_inputs(movie.get(frame));
+    parent->run_frame();
+  }
+  delete restored;
+  return same;
+}
+
+// nodes of a search that branches children ways every frame of the movie
+void report_fork_timings(_8080* parent, InputMovie& movie, u64 frames, int children, int depth) {
+  Snapshot start;
+  parent->save_state(&start);
+  vector<_8080*> reused;
+  for (int i = 0; i < children; i++) {
+    reused.push_back(new _8080(true));
+    reused[i]->share_memory(*parent);
+  }
+  Snapshot snapshot;
+  const char* names[] = { "fork", "fork_into", "snapshot" };
+  for (int mode = 0; mode < 3; mode++) {
+    parent->load_state(start);
+    double branch_seconds = 0;
+    double total_seconds = 0;
+    size_t copied_bytes = 0;
+    for (u64 frame = 0; frame < frames; frame++) {
+      for (int i = 0; i < children; i++) {
+        auto begin = chrono::steady_clock::now();
+        _8080* child = reused[i];
+        if (mode == 0) {
+          child = parent->fork();
+        } else if (mode == 1) {
+          parent->fork_into(*child);
+        } else {
+          if (i == 0) {
+            parent->save_state(&snapshot);
+          }
+          child->load_state(snapshot);
+        }
+        auto branched = chrono::steady_clock::now();
+        run_child(child, child_inputs(movie, frame, i), depth);
+        copied_bytes += mode == 2 ? RAM_BYTES : child->memory.private_bytes();
+        if (mode == 0) {
+          parent->recycle(child);
+        }
+        auto end = chrono::steady_clock::now();
+        branch_seconds += chrono::duration<double>(branched - begin).count();
+        total_seconds += chrono::duration<double>(end - begin).count();
+      }
+      parent->set_inputs(movie.get(frame));
+      parent->run_frame();
+    }
+    double branches = (double) frames * children;
+    printf("%-10s %10.0f branches/s  %8.0f nodes/s  %5.1f KB copied a node (%d children x %d frames)\n",
+           names[mode], branches / branch_seconds, branches / total_seconds, copied_bytes / branches / 1024,
+           children, depth);
+  }
+  for (_8080* child : reused) {
+    delete child;
+  }
+  parent->load_state(start);
+}
+
+int main(int argc, char** argv) {
+  if (argc < 3) {
+    print_usage();
+    return 2;
+  }
+  string rom = argv[1];
+  string movie_file = argv[2];
+  int instances = 100;
+  u64 frames = 120;
+  int children = 8;
+  int depth = 4;
+  for (int i = 3; i < argc; i++) {
+    if (strcmp(argv[i], "--instances") == 0 && i + 1 < argc) {
+      instances = max(1, atoi(argv[++i]));
+    } else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+      frames = strtoull(argv[++i], nullptr, 0);
+    } else if (strcmp(argv[i], "--children") == 0 && i + 1 < argc) {
+      children = max(1, atoi(argv[++i]));
+    } else if (strcmp(argv[i], "--depth") == 0 && i + 1 < argc) {
+      depth = max(1, atoi(argv[++i]));
+    } else {
+      print_usage();
+      return 2;
+    }
+  }
+
+  InputMovie movie;
+  if (!movie.load(movie_file)) {
+    log_error("could not load movie %s", movie_file.c_str());
+    return 2;
+  }
+  bool same = check_bus();
+  same = check_instances(rom, movie, instances, frames) && same;
+
+  _8080* parent = new _8080(true);
+  if (!parent->load_program(rom)) {
+    delete parent;
+    return 2;
+  }
+  Snapshot boot;
+  parent->save_state(&boot);
+  same = check_fork(parent, movie, frames, children, depth) && same;
+  if (same) {
+    parent->load_state(boot);
+    report_fork_timings(parent, movie, frames, children, depth);
+  }
+  delete parent;
+  return same ? 0 : 1;
+}
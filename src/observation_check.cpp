@@ -0,0 +1,169 @@
+#include <chrono>
+#include <stdlib.h>
+#include <string.h>
+#include "./CPU/8080.hpp"
+#include "./CPU/movie.hpp"
+#include "./CPU/observation.hpp"
+
+// checks the observation kernels at every SIMD level against references built from
+// capture's vram_to_gray, and reports the microseconds per frame of each
+//
+//   observation_check <rom> <movie> [--frames N] [--repeat N]
+//
+// the frames are the movie's VRAM after every frame plus as many random ones, so every
+// bit pattern shows up; --repeat runs each kernel that many times over them for the timings
+// exit code 0 = identical output, 1 = not, 2 = usage / file error
+
+#define OUTPUT_BYTES (OBSERVATION_WIDTH * OBSERVATION_HEIGHT)
+
+typedef void (Observer::*Kernel)(const u8* vram, u8* out);
+
+struct KernelInfo {
+  const char* name;
+  Kernel kernel;
+  size_t size;
+};
+
+static const KernelInfo kernels[] = {
+  {"packed", &Observer::packed, OBSERVATION_PACKED_BYTES},
+  {"gray", &Observer::gray, OBSERVATION_WIDTH * OBSERVATION_HEIGHT},
+  {"half", &Observer::gray_half, OBSERVATION_HALF_WIDTH * OBSERVATION_HALF_HEIGHT},
+  {"84x84", &Observer::gray_84, OBSERVATION_SMALL_SIZE * OBSERVATION_SMALL_SIZE},
+};
+
+void print_usage() {
+  printf("usage: observation_check <rom> <movie> [--frames N] [--repeat N]\n");
+}
+
+// the definitions, straight from the upright grayscale frame
+void reference(int index, const u8* gray, u8* out) {
+  if (index == 0) {
+    memset(out, 0, OBSERVATION_PACKED_BYTES);
+    for (int i = 0; i < OUTPUT_BYTES; i++) {
+      if (gray[i]) {
+        out[i / 8] |= 0x80 >> (i % 8);
+      }
+    }
+  } else if (index == 1) {
+    memcpy(out, gray, OUTPUT_BYTES);
+  } else if (index == 2) {
+    for (int y = 0; y < OBSERVATION_HALF_HEIGHT; y++) {
+      for (int x = 0; x < OBSERVATION_HALF_WIDTH; x++) {
+        const u8* top = gray + 2 * y * OBSERVATION_WIDTH + 2 * x;
+        int lit = (top[0] + top[1] + top[OBSERVATION_WIDTH] + top[OBSERVATION_WIDTH + 1]) / 255;
+        out[y * OBSERVATION_HALF_WIDTH + x] = min(lit * 64, 255);
+      }
+    }
+  } else {
+    for (int j = 0; j < OBSERVATION_SMALL_SIZE; j++) {
+      for (int i = 0; i < OBSERVATION_SMALL_SIZE; i++) {
+        int top = j * OBSERVATION_HEIGHT / OBSERVATION_SMALL_SIZE;
+        int bottom = (j + 1) * OBSERVATION_HEIGHT / OBSERVATION_SMALL_SIZE;
+        int left = i * OBSERVATION_WIDTH / OBSERVATION_SMALL_SIZE;
+        int right = (i + 1) * OBSERVATION_WIDTH / OBSERVATION_SMALL_SIZE;
+        int lit = 0;
+        for (int y = top; y < bottom; y++) {
+          for (int x = left; x < right; x++) {
+            lit += gray[y * OBSERVATION_WIDTH + x] != 0;
+          }
+        }
+        int area = (right - left) * (bottom - top);
+        out[j * OBSERVATION_SMALL_SIZE + i] = (lit * 255 + area / 2) / area;
+      }
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  if (argc < 3) {
+    print_usage();
+    return 2;
+  }
+  string rom = argv[1];
+  string movie_file = argv[2];
+  u64 frame_count = 120;
+  int repeat = 10;
+  for (int i = 3; i < argc; i++) {
+    if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+      frame_count = strtoull(argv[++i], nullptr, 0);
+    } else if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) {
+      repeat = max(1, atoi(argv[++i]));
+    } else {
+      print_usage();
+      return 2;
+    }
+  }
+
+  InputMovie movie;
+  if (!movie.load(movie_file)) {
+    log_error("could not load movie %s", movie_file.c_str());
+    return 2;
+  }
+  _8080* _8080_ = new _8080(true);
+  if (!_8080_->load_program(rom)) {
+    delete _8080_;
+    return 2;
+  }
+  vector<vector<u8>> frames;
+  for (u64 frame = 0; frame < frame_count; frame++) {
+    _8080_->set_inputs(movie.get(frame));
+    _8080_->run_frame();
+    vector<u8> vram(OBSERVATION_VRAM_BYTES);
+    _8080_->memory.read_block(VRAM_START, vram.data(), OBSERVATION_VRAM_BYTES);
+    frames.push_back(vram);
+  }
+  delete _8080_;
+  u32 seed = 0x8080;
+  for (u64 frame = 0; frame < frame_count; frame++) {
+    vector<u8> vram(OBSERVATION_VRAM_BYTES);
+    for (u8& byte : vram) {
+      seed = seed * 1664525u + 1013904223u;
+      byte = seed >> 24;
+    }
+    frames.push_back(vram);
+  }
+
+  SimdLevel best = detect_simd_level();
+  log_info("%zu frames, best kernels: %s", frames.size(), simd_level_name(best));
+  vector<u8> gray(OUTPUT_BYTES);
+  vector<u8> expected(OUTPUT_BYTES);
+  vector<u8> out(OUTPUT_BYTES);
+  int result = 0;
+
+  for (int k = 0; k < (int) (sizeof(kernels) / sizeof(kernels[0])); k++) {
+    const KernelInfo& info = kernels[k];
+    string line = info.name;
+    for (int level = SIMD_SCALAR; level <= best; level++) {
+      Observer observer;
+      observer.set_simd_level((SimdLevel) level);
+      for (size_t f = 0; f < frames.size(); f++) {
+        vram_to_gray(frames[f].data(), gray.data());
+        reference(k, gray.data(), expected.data());
+        (observer.*info.kernel)(frames[f].data(), out.data());
+        if (memcmp(out.data(), expected.data(), info.size) != 0) {
+          log_error("%s: %s output of frame %zu differs from the reference", info.name,
+                    simd_level_name((SimdLevel) level), f);
+          result = 1;
+          break;
+        }
+      }
+      auto start = chrono::steady_clock::now();
+      for (int r = 0; r < repeat; r++) {
+        for (const vector<u8>& vram : frames) {
+          (observer.*info.kernel)(vram.data(), out.data());
+        }
+      }
+      double us = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count() /
+                  (repeat * frames.size());
+      char timing[64];
+      snprintf(timing, sizeof(timing), "%s %s %.2f", level == SIMD_SCALAR ? ":" : ",",
+               simd_level_name((SimdLevel) level), us);
+      line += timing;
+    }
+    log_info("%s us/frame", line.c_str());
+  }
+  if (result == 0) {
+    log_info("every kernel matches the reference");
+  }
+  return result;
+}
@@ -0,0 +1,424 @@
+#include <iostream>
+#include <set>
+#include <sys/stat.h>
+#include <stdlib.h>
+#include <string.h>
+#include "./CPU/8080.hpp"
+#include "./CPU/frame_hash.hpp"
+
+// static recompiler: turns a fixed ROM image into C++ basic block functions for
+// _8080::use_recompiled, see CPU/recompiled.hpp
+//
+//   invaders_recompiler <rom> <output.cpp> [--name NAME]
+//
+// <rom> is either the invaders ROM folder (0x0000 - 0x1FFF) or a single binary loaded
+// at 0x0000. Code is discovered by recursive descent from the reset and RST vectors.
+
+#define INVADERS_ROM_SIZE 0x2000
+#define NUM_RST_VECTORS 8
+
+static const char* reg_names[8] = {"r->b", "r->c", "r->d", "r->e", "r->h", "r->l", "m[r->hl]", "r->a"};
+static const char* pair_names[4] = {"r->bc", "r->de", "r->hl", "r->sp"};
+static const char* push_pairs[4] = {"&r->b, &r->c", "&r->d, &r->e", "&r->h, &r->l", "&r->a, &r->f"};
+static const char* alu_helpers[8] = {"add", "add", "subtract", "subtract", "bitwise_and", "bitwise_xor", "bitwise_or", "compare"};
+
+void print_usage() {
+  printf("usage: invaders_recompiler <rom> <output.cpp> [--name NAME]\n");
+}
+
+// _8080::load_program and the size it loads, the blocks cover exactly that
+bool load_program(_8080* _8080_, const string& rom, u16* size) {
+  struct stat info;
+  if (stat(rom.c_str(), &info) != 0) {
+    log_error("could not find %s", rom.c_str());
+    return false;
+  }
+  if (S_ISDIR(info.st_mode)) {
+    *size = INVADERS_ROM_SIZE;
+  } else if (info.st_size == 0 || info.st_size > RAM_START) {
+    log_error("%s does not fit below RAM", rom.c_str());
+    return false;
+  } else {
+    *size = info.st_size;
+  }
+  return _8080_->load_program(rom);
+}
+
+bool is_jump(u8 opcode) {
+  return opcode == 0xC3 || opcode == 0xCB || (opcode & 0xC7) == 0xC2;
+}
+
+bool is_call(u8 opcode) {
+  return (opcode & 0xCF) == 0xCD || (opcode & 0xC7) == 0xC4;
+}
+
+bool is_return(u8 opcode) {
+  return opcode == 0xC9 || opcode == 0xD9 || (opcode & 0xC7) == 0xC0;
+}
+
+bool is_rst(u8 opcode) {
+  return (opcode & 0xC7) == 0xC7;
+}
+
+// instructions that end a basic block, they run through the interpreter
+bool ends_block(u8 opcode) {
+  return is_jump(opcode) || is_call(opcode) || is_return(opcode) || is_rst(opcode) || opcode == 0xE9 || opcode == 0x76;
+}
+
+// does execution continue at the next instruction (directly or after returning)
+bool falls_through(u8 opcode) {
+  return !(opcode == 0xC3 || opcode == 0xCB || opcode == 0xC9 || opcode == 0xD9 || opcode == 0xE9);
+}
+
+// condition flag of the conditional jumps, calls and returns (NZ Z NC C PO PE P M)
+static const int condition_flags[4] = {ZERO_POS, CARRY_POS, PARITY_POS, SIGN_POS};
+static const char* condition_names[4] = {"ZERO_POS", "CARRY_POS", "PARITY_POS", "SIGN_POS"};
+
+// what the interpreter does with an instruction, measured on a scratch cpu so the
+// blocks always agree with execute_instruction
+struct Measured {
+  int cycles;
+  bool branched;
+};
+
+Measured measure(u8 opcode, u8 flags) {
+  _8080 scratch(true);
+  scratch.memory.write(0x100, opcode);
+  scratch.memory.write(0x101, 0x34);
+  scratch.memory.write(0x102, 0x12);
+  scratch.memory.write(0x2300, 0x21);
+  scratch.memory.write(0x2301, 0x43);
+  scratch.regs.pc = 0x100;
+  scratch.regs.hl = 0x2100;
+  scratch.regs.sp = 0x2300;
+  scratch.regs.f = flags;
+  u64 before = scratch.get_cycles();
+  scratch.step_test();
+  Measured measured;
+  measured.cycles = (int) (scratch.get_cycles() - before);
+  measured.branched = scratch.regs.pc != 0x100 + instruction_list[opcode];
+  return measured;
+}
+
+// C++ for one instruction that stays inside the block, empty when it must be interpreted
+string emit_inline(const u8* code) {
+  u8 opcode = code[0];
+  u16 word = code[1] | (code[2] << 8);
+  char line[128];
+
+  if (opcode >= 0x40 && opcode < 0x80 && opcode != 0x76) {
+    int to = (opcode >> 3) & 7;
+    int from = opcode & 7;
+    if (to == from) {
+      return "";
+    }
+    if (to == 6) {
+      snprintf(line, sizeof(line), "m.write(r->hl, %s);", reg_names[from]);
+    } else {
+      snprintf(line, sizeof(line), "%s = %s;", reg_names[to], reg_names[from]);
+    }
+    return line;
+  }
+  if (opcode >= 0x80 && opcode < 0xC0) {
+    int operation = (opcode >> 3) & 7;
+    bool with_carry = operation == 1 || operation == 3;
+    snprintf(line, sizeof(line), "BlockAccess::%s(cpu, %s%s);", alu_helpers[operation], reg_names[opcode & 7],
+             with_carry ? " + r->get_flag(CARRY_POS)" : "");
+    return line;
+  }
+  if ((opcode & 0xC7) == 0xC6) {
+    int operation = (opcode >> 3) & 7;
+    bool with_carry = operation == 1 || operation == 3;
+    snprintf(line, sizeof(line), "BlockAccess::%s(cpu, 0x%02X%s);", alu_helpers[operation], code[1],
+             with_carry ? " + r->get_flag(CARRY_POS)" : "");
+    return line;
+  }
+  if (opcode < 0x40) {
+    int reg = (opcode >> 3) & 7;
+    int pair = (opcode >> 4) & 3;
+    switch (opcode & 0x0F) {
+      case 0x01:
+        snprintf(line, sizeof(line), "%s = 0x%04X;", pair_names[pair], word);
+        return line;
+      case 0x03:
+        snprintf(line, sizeof(line), "%s++;", pair_names[pair]);
+        return line;
+      case 0x09:
+        snprintf(line, sizeof(line), "BlockAccess::dad(cpu, &%s);", pair_names[pair]);
+        return line;
+      case 0x0B:
+        snprintf(line, sizeof(line), "%s--;", pair_names[pair]);
+        return line;
+    }
+    // M goes through a local, memory is only written through the bus
+    switch (opcode & 0x07) {
+      case 0x04:
+      case 0x05: {
+        const char* helper = (opcode & 0x07) == 0x04 ? "increment" : "decrement";
+        if (reg == 6) {
+          snprintf(line, sizeof(line), "{ u8 value = m[r->hl]; BlockAccess::%s(cpu, &value); m.write(r->hl, value); }",
+                   helper);
+        } else {
+          snprintf(line, sizeof(line), "BlockAccess::%s(cpu, &%s);", helper, reg_names[reg]);
+        }
+        return line;
+      }
+      case 0x06:
+        if (reg == 6) {
+          snprintf(line, sizeof(line), "m.write(r->hl, 0x%02X);", code[1]);
+        } else {
+          snprintf(line, sizeof(line), "%s = 0x%02X;", reg_names[reg], code[1]);
+        }
+        return line;
+    }
+    switch (opcode) {
+      case 0x00: case 0x08: case 0x10: case 0x18: case 0x20: case 0x28: case 0x30: case 0x38:
+        return "";
+      case 0x02: return "m.write(r->bc, r->a);";
+      case 0x0A: return "r->a = m[r->bc];";
+      case 0x12: return "m.write(r->de, r->a);";
+      case 0x1A: return "r->a = m[r->de];";
+      case 0x32:
+        snprintf(line, sizeof(line), "m.write(0x%04X, r->a);", word);
+        return line;
+      case 0x3A:
+        snprintf(line, sizeof(line), "r->a = m[0x%04X];", word);
+        return line;
+      case 0x22:
+        if (word == 0xFFFF) {
+          return "";
+        }
+        snprintf(line, sizeof(line), "m.write(0x%04X, r->l); m.write(0x%04X, r->h);", word, word + 1);
+        return line;
+      case 0x2A:
+        if (word == 0xFFFF) {
+          return "";
+        }
+        snprintf(line, sizeof(line), "r->l = m[0x%04X]; r->h = m[0x%04X];", word, word + 1);
+        return line;
+    }
+    return "";
+  }
+  switch (opcode) {
+    case 0xC1: case 0xD1: case 0xE1: case 0xF1:
+      snprintf(line, sizeof(line), "BlockAccess::pop(cpu, %s);", push_pairs[(opcode >> 4) & 3]);
+      return line;
+    case 0xC5: case 0xD5: case 0xE5: case 0xF5:
+      snprintf(line, sizeof(line), "BlockAccess::push(cpu, %s);", push_pairs[(opcode >> 4) & 3]);
+      return line;
+    case 0xEB:
+      return "{ u16 hl = r->hl; r->hl = r->de; r->de = hl; }";
+    case 0xF9:
+      return "r->sp = r->hl;";
+  }
+  return "";
+}
+
+// jumps, calls and returns end a block without going through the interpreter, the stack
+// accesses mirror _8080::CALL / _8080::RET
+string emit_branch(u8 opcode, u16 target, u16 next) {
+  char line[256];
+  if (is_jump(opcode)) {
+    snprintf(line, sizeof(line), "r->pc = 0x%04X;", target);
+  } else if (is_call(opcode)) {
+    snprintf(line, sizeof(line), "r->sp -= 2; m.write(r->sp, 0x%02X); m.write(r->sp + 1, 0x%02X); r->pc = 0x%04X;",
+             next & 0xFF, next >> 8, target);
+  } else {
+    snprintf(line, sizeof(line), "r->pc = (m[(u16) (r->sp + 1)] << 8) | m[r->sp]; r->sp += 2;");
+  }
+  return line;
+}
+
+string emit_terminator(const u8* code, u16 pc) {
+  u8 opcode = code[0];
+  u16 target = code[1] | (code[2] << 8);
+  u16 next = pc + instruction_list[opcode];
+  if (!is_jump(opcode) && !is_call(opcode) && !is_return(opcode)) {
+    return "";
+  }
+  char line[512];
+
+  bool conditional = (opcode & 0xC7) == 0xC0 || (opcode & 0xC7) == 0xC2 || (opcode & 0xC7) == 0xC4;
+  if (!conditional) {
+    Measured taken = measure(opcode, 0);
+    snprintf(line, sizeof(line), "%s cycles += %d;", emit_branch(opcode, target, next).c_str(), taken.cycles);
+    return line;
+  }
+
+  // only inline the condition when the interpreter branches on exactly that flag
+  int condition = (opcode >> 3) & 7;
+  int flag = condition_flags[condition >> 1];
+  Measured clear = measure(opcode, 0);
+  Measured set = measure(opcode, 1 << flag);
+  if (clear.branched == set.branched) {
+    return "";
+  }
+  Measured taken = set.branched ? set : clear;
+  Measured not_taken = set.branched ? clear : set;
+  snprintf(line, sizeof(line), "if (%sr->check_flag(%s)) { %s cycles += %d; } else { r->pc = 0x%04X; cycles += %d; }",
+           set.branched ? "" : "!", condition_names[condition >> 1], emit_branch(opcode, target, next).c_str(),
+           taken.cycles, next, not_taken.cycles);
+  return line;
+}
+
+bool is_nop(u8 opcode) {
+  bool mov_to_itself = opcode >= 0x40 && opcode < 0x80 && ((opcode >> 3) & 7) == (opcode & 7) && opcode != 0x76;
+  return opcode == 0x00 || opcode == 0x08 || opcode == 0x10 || opcode == 0x18 || opcode == 0x20 ||
+         opcode == 0x28 || opcode == 0x30 || opcode == 0x38 || mov_to_itself;
+}
+
+int main(int argc, char** argv) {
+  if (argc < 3) {
+    print_usage();
+    return 2;
+  }
+  string rom = argv[1];
+  string output = argv[2];
+  string name = "invaders_program";
+  for (int i = 3; i < argc; i++) {
+    if (strcmp(argv[i], "--name") == 0 && i + 1 < argc) {
+      name = argv[++i];
+    } else {
+      print_usage();
+      return 2;
+    }
+  }
+
+  _8080* _8080_ = new _8080(true);
+  u16 size = 0;
+  if (!load_program(_8080_, rom, &size)) {
+    delete _8080_;
+    return 2;
+  }
+  vector<u8> image(MEMORY_BYTES);
+  _8080_->memory.read_block(0, image.data(), MEMORY_BYTES);
+  const u8* memory = image.data();
+
+  // recursive descent, every reachable instruction start and every branch target
+  set<u16> instructions;
+  set<u16> leaders;
+  vector<u16> work;
+  for (int rst = 0; rst < NUM_RST_VECTORS; rst++) {
+    if (rst * 8 < size) {
+      work.push_back(rst * 8);
+      leaders.insert(rst * 8);
+    }
+  }
+  while (!work.empty()) {
+    u16 pc = work.back();
+    work.pop_back();
+    while (pc < size && !instructions.count(pc)) {
+      u8 opcode = memory[pc];
+      int length = instruction_list[opcode];
+      if (pc + length > size) {
+        break;
+      }
+      instructions.insert(pc);
+      u16 target = memory[pc + 1] | (memory[pc + 2] << 8);
+      if (length == 3 && (is_jump(opcode) || is_call(opcode))) {
+        leaders.insert(target);
+        work.push_back(target);
+      } else if (is_rst(opcode)) {
+        leaders.insert(opcode & 0x38);
+        work.push_back(opcode & 0x38);
+      }
+      pc += length;
+      if (ends_block(opcode)) {
+        if (falls_through(opcode)) {
+          leaders.insert(pc);
+          work.push_back(pc);
+        }
+        break;
+      }
+    }
+  }
+
+  int cycles[256];
+  for (int opcode = 0; opcode < 256; opcode++) {
+    cycles[opcode] = measure(opcode, 0).cycles;
+  }
+
+  FILE* file = fopen(output.c_str(), "w");
+  if (!file) {
+    log_error("could not write %s", output.c_str());
+    delete _8080_;
+    return 2;
+  }
+  fprintf(file, "// generated by invaders_recompiler from %s, do not edit\n", rom.c_str());
+  fprintf(file, "#include \"CPU/recompiled_block.hpp\"\n\n");
+
+  vector<pair<u16, u16>> blocks;
+  int interpreted = 0;
+  for (u16 start : leaders) {
+    if (start >= size || !instructions.count(start)) {
+      continue;
+    }
+    fprintf(file, "static bool block_%04X(_8080* cpu, u64 deadline) {\n", start);
+    fprintf(file, "  CpuState* r = &cpu->regs;\n");
+    fprintf(file, "  MemoryBus& m = cpu->memory;\n");
+    fprintf(file, "  u64& cycles = BlockAccess::cycles(cpu);\n");
+    fprintf(file, "  (void) m;\n");
+
+    u16 pc = start;
+    while (true) {
+      u8 opcode = memory[pc];
+      int length = instruction_list[opcode];
+      u16 next = pc + length;
+      fprintf(file, "  // %04X:", pc);
+      for (int i = 0; i < length; i++) {
+        fprintf(file, " %02X", memory[pc + i]);
+      }
+      fprintf(file, "\n");
+
+      if (ends_block(opcode)) {
+        string code = emit_terminator(&memory[pc], pc);
+        if (!code.empty()) {
+          fprintf(file, "  %s\n", code.c_str());
+        } else {
+          fprintf(file, "  r->pc = 0x%04X;\n", (u16) (pc + 1));
+          fprintf(file, "  BlockAccess::execute(cpu, 0x%02X);\n", opcode);
+        }
+        fprintf(file, "  return true;\n");
+        blocks.push_back(make_pair(start, pc));
+        break;
+      }
+
+      string code = emit_inline(&memory[pc]);
+      if (!code.empty()) {
+        fprintf(file, "  %s\n", code.c_str());
+        fprintf(file, "  cycles += %d;\n", cycles[opcode]);
+      } else if (is_nop(opcode)) {
+        fprintf(file, "  cycles += %d;\n", cycles[opcode]);
+      } else {
+        fprintf(file, "  r->pc = 0x%04X;\n", (u16) (pc + 1));
+        fprintf(file, "  BlockAccess::execute(cpu, 0x%02X);\n", opcode);
+        interpreted++;
+      }
+      fprintf(file, "  if (cycles >= deadline) { r->pc = 0x%04X; return false; }\n", next);
+
+      // fall into the next block
+      if (leaders.count(next) || !instructions.count(next)) {
+        fprintf(file, "  r->pc = 0x%04X;\n", next);
+        fprintf(file, "  return false;\n");
+        blocks.push_back(make_pair(start, pc));
+        break;
+      }
+      pc = next;
+    }
+    fprintf(file, "}\n\n");
+  }
+
+  fprintf(file, "static const RecompiledBlock blocks[] = {\n");
+  for (auto& block : blocks) {
+    fprintf(file, "  {0x%04X, 0x%04X, block_%04X},\n", block.first, block.second, block.first);
+  }
+  fprintf(file, "};\n\n");
+  fprintf(file, "extern const RecompiledProgram %s = {\"%s\", 0x%016llXULL, 0x%04X, 0x%04X, blocks, %zu};\n",
+          name.c_str(), name.c_str(), (unsigned long long) hash_bytes(memory, size), PROGRAM_START, size, blocks.size());
+  fclose(file);
+
+  log_info("%s: %zu instructions in %zu blocks, %d interpreted inside blocks", output.c_str(), instructions.size(),
+           blocks.size(), interpreted);
+  delete _8080_;
+  return 0;
+}
@@ -0,0 +1,162 @@
+#include <chrono>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "./CPU/scaler.hpp"
+#include "./CPU/log.hpp"
+#include "./CPU/frame_hash.hpp"
+
+// checks the SSE2 / AVX2 scaler kernels against the scalar ones on every config and
+// reports the frames per second of each, single threaded
+//
+//   scaler_check [--frames N] [--min-fps N]
+//
+// the frames are synthetic: a few hundred invader sized blocks in the game's colours
+// drifting over black, so the EPX edges and the phosphor trails all get exercised
+// exit code 0 = identical output (and every 4x config at or above --min-fps), 1 = not
+
+#define FRAME_W 224
+#define FRAME_H 256
+#define BLOCKS 300
+#define PITCH_PADDING 16 // streaming textures may have a pitch wider than the frame
+
+static const u32 palette[] = {0xFF42E9F4, 0xFF62DE6D, 0xFFF83B3A, 0xFFDB55DD, 0xFFFFFFFF};
+
+struct Block {
+  int x, y, w, h, dx, dy;
+  u32 color;
+};
+
+static u32 next_random(u32* state) {
+  *state = *state * 1664525u + 1013904223u;
+  return *state >> 8;
+}
+
+std::vector<std::vector<u32>> make_frames(int count) {
+  u32 seed = 0x8080;
+  std::vector<Block> blocks(BLOCKS);
+  for (Block& block : blocks) {
+    block.w = 1 + next_random(&seed) % 16;
+    block.h = 1 + next_random(&seed) % 8;
+    block.x = next_random(&seed) % FRAME_W;
+    block.y = next_random(&seed) % FRAME_H;
+    block.dx = (int) (next_random(&seed) % 5) - 2;
+    block.dy = (int) (next_random(&seed) % 3) - 1;
+    block.color = palette[next_random(&seed) % 5];
+  }
+
+  std::vector<std::vector<u32>> frames(count, std::vector<u32>(FRAME_W * FRAME_H, 0xFF000000));
+  for (int i = 0; i < count; i++) {
+    for (Block& block : blocks) {
+      for (int y = 0; y < block.h; y++) {
+        for (int x = 0; x < block.w; x++) {
+          // every other column of a block is left out so single pixel steps show up too
+          if ((x + y) % 3 != 0) {
+            int px = (block.x + x) % FRAME_W;
+            int py = (block.y + y) % FRAME_H;
+            frames[i][py * FRAME_W + px] = block.color;
+          }
+        }
+      }
+      block.x = (block.x + block.dx + FRAME_W) % FRAME_W;
+      block.y = (block.y + block.dy + FRAME_H) % FRAME_H;
+    }
+  }
+  return frames;
+}
+
+std::string describe(const ScalerConfig& config) {
+  char text[64];
+  snprintf(text, sizeof(text), "%dx %s%s%s", config.scale, config.filter == SCALE_EPX ? "epx" : "nearest",
+           config.scanlines ? " scanlines" : "", config.phosphor ? " phosphor" : "");
+  return text;
+}
+
+// runs every frame through a fresh scaler and hashes every output frame into one value
+u64 output_hash(const ScalerConfig& config, SimdLevel level, const std::vector<std::vector<u32>>& frames) {
+  Scaler scaler;
+  scaler.configure(FRAME_W, FRAME_H, config);
+  scaler.set_simd_level(level);
+  int pitch = scaler.get_out_width() + PITCH_PADDING;
+  std::vector<u32> out((size_t) pitch * scaler.get_out_height(), 0);
+  u64 hash = 0;
+  for (const std::vector<u32>& frame : frames) {
+    scaler.process(frame.data(), out.data(), pitch);
+    hash = hash * 31 + hash_bytes((const u8*) out.data(), out.size() * sizeof(u32));
+  }
+  return hash;
+}
+
+double frames_per_second(const ScalerConfig& config, SimdLevel level, const std::vector<std::vector<u32>>& frames) {
+  Scaler scaler;
+  scaler.configure(FRAME_W, FRAME_H, config);
+  scaler.set_simd_level(level);
+  int pitch = scaler.get_out_width() + PITCH_PADDING;
+  std::vector<u32> out((size_t) pitch * scaler.get_out_height(), 0);
+  auto start = std::chrono::steady_clock::now();
+  for (const std::vector<u32>& frame : frames) {
+    scaler.process(frame.data(), out.data(), pitch);
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  return frames.size() / seconds;
+}
+
+int main(int argc, char** argv) {
+  int frame_count = 120;
+  double min_fps = 0;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+      frame_count = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--min-fps") == 0 && i + 1 < argc) {
+      min_fps = atof(argv[++i]);
+    } else {
+      printf("usage: scaler_check [--frames N] [--min-fps N]\n");
+      return 1;
+    }
+  }
+
+  std::vector<std::vector<u32>> frames = make_frames(frame_count);
+  std::vector<ScalerConfig> configs;
+  for (int scale = 1; scale <= SCALER_MAX_SCALE; scale++) {
+    for (int effects = 0; effects < 4; effects++) {
+      for (int filter = SCALE_NEAREST; filter <= SCALE_EPX; filter++) {
+        if (filter == SCALE_EPX && scale != 2 && scale != 4) {
+          continue;
+        }
+        ScalerConfig config;
+        config.scale = scale;
+        config.filter = (ScaleFilter) filter;
+        config.scanlines = effects & 1;
+        config.phosphor = effects & 2;
+        configs.push_back(config);
+      }
+    }
+  }
+
+  SimdLevel best = detect_simd_level();
+  log_info("%zu configs, %d frames, best kernels: %s", configs.size(), frame_count, simd_level_name(best));
+  int result = 0;
+  for (const ScalerConfig& config : configs) {
+    u64 expected = output_hash(config, SIMD_SCALAR, frames);
+    double fps = frames_per_second(config, SIMD_SCALAR, frames);
+    std::string line = describe(config) + ": scalar " + std::to_string((int) fps);
+    for (int level = SIMD_SSE2; level <= best; level++) {
+      if (output_hash(config, (SimdLevel) level, frames) != expected) {
+        log_error("%s: %s output differs from scalar", describe(config).c_str(), simd_level_name((SimdLevel) level));
+        result = 1;
+      }
+      fps = frames_per_second(config, (SimdLevel) level, frames);
+      line += std::string(", ") + simd_level_name((SimdLevel) level) + " " + std::to_string((int) fps);
+    }
+    log_info("%s frames/s", line.c_str());
+    if (config.scale == 4 && fps < min_fps) {
+      log_error("%s: %.0f frames/s is below %.0f", describe(config).c_str(), fps, min_fps);
+      result = 1;
+    }
+  }
+  if (result == 0) {
+    log_info("all kernels match the scalar reference");
+  }
+  return result;
+}
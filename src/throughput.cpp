@@ -0,0 +1,98 @@
+#include <chrono>
+#include <sstream>
+#include <stdlib.h>
+#include <string.h>
+#include "./CPU/8080.hpp"
+#include "./CPU/movie.hpp"
+
+// emulator throughput of one build, single threaded, for comparing build configurations
+// (the throughput_report target runs it in every build it is given)
+//
+//   throughput <program.COM> <rom> <movie> [--instructions N] [--frames N]
+//
+// cpm:    runs the CP/M program for N instructions (default 100M), or until it ends
+// frames: replays the movie (looping) for N frames (default 36000) with idle loop skipping
+//         off, so every emulated cycle is interpreted
+//
+// the last line is what the report parses:
+//   throughput: <M instructions/s> MIPS, <frames/s> frames/s
+
+#define DEFAULT_INSTRUCTIONS 100000000ULL
+#define DEFAULT_FRAMES 36000
+#define SLICE_INSTRUCTIONS (1 << 24)
+
+void print_usage() {
+  printf("usage: throughput <program.COM> <rom> <movie> [--instructions N] [--frames N]\n");
+}
+
+int main(int argc, char** argv) {
+  if (argc < 4) {
+    print_usage();
+    return 2;
+  }
+
+  string program = argv[1];
+  string rom = argv[2];
+  string movie_file = argv[3];
+  u64 instructions = DEFAULT_INSTRUCTIONS;
+  u64 frames = DEFAULT_FRAMES;
+
+  for (int i = 4; i < argc; i++) {
+    if (strcmp(argv[i], "--instructions") == 0 && i + 1 < argc) {
+      instructions = strtoull(argv[++i], nullptr, 0);
+    } else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+      frames = strtoull(argv[++i], nullptr, 0);
+    } else {
+      print_usage();
+      return 2;
+    }
+  }
+
+  InputMovie movie;
+  if (!movie.load(movie_file) || movie.size() == 0) {
+    log_error("could not load movie %s", movie_file.c_str());
+    return 2;
+  }
+
+  // cpm ////////////////////////////////////////////////////////////////////////
+
+  stringstream output; // the program's console, not checked here
+  _8080* _8080_ = new _8080(true);
+  _8080_->test_output = &output;
+  _8080_->load_test(program);
+  u64 executed = 0;
+  auto start = chrono::steady_clock::now();
+  while (!_8080_->test_finished() && executed < instructions) {
+    executed += _8080_->run_test(min<u64>(SLICE_INSTRUCTIONS, instructions - executed));
+  }
+  double cpm_seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  double mips = executed / cpm_seconds / 1e6;
+  log_info("cpm: %llu instructions, %llu cycles in %.2fs (%.1f M instructions/s, %.1f MHz)",
+           (unsigned long long) executed, (unsigned long long) _8080_->get_cycles(), cpm_seconds, mips,
+           _8080_->get_cycles() / cpm_seconds / 1e6);
+  delete _8080_;
+
+  // frames /////////////////////////////////////////////////////////////////////
+
+  _8080_ = new _8080(true);
+  _8080_->skip_idle_loops = false;
+  if (!_8080_->load_program(rom)) {
+    delete _8080_;
+    return 2;
+  }
+  start = chrono::steady_clock::now();
+  for (u64 frame = 0; frame < frames; frame++) {
+    _8080_->set_inputs(movie.get(frame % movie.size()));
+    _8080_->run_frame();
+  }
+  double frame_seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  double frames_per_second = frames / frame_seconds;
+  log_info("frames: %llu frames in %.2fs (%.0f frames/s, %.0fx real time), %llu of %llu cycles halted",
+           (unsigned long long) frames, frame_seconds, frames_per_second, frames_per_second / 60,
+           (unsigned long long) _8080_->get_halted_cycles(), (unsigned long long) _8080_->get_cycles());
+  delete _8080_;
+
+  log_flush();
+  printf("throughput: %.1f MIPS, %.0f frames/s\n", mips, frames_per_second);
+  return 0;
+}
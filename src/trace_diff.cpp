@@ -0,0 +1,144 @@
+#include <iostream>
+#include <fstream>
+#include <stdlib.h>
+#include <string.h>
+#include "./CPU/8080.hpp"
+#include "./CPU/trace.hpp"
+
+// lockstep differential testing against a golden trace
+//
+//   trace_diff record <program.COM> <trace> [--interval N] [--full START:COUNT]...
+//   trace_diff check  <program.COM> <trace>
+//   trace_diff export <program.COM> <text>
+//   trace_diff import <text> <trace> [--interval N] [--full START:COUNT]...
+//
+// export writes this core's state after every instruction as text, import turns a text
+// trace (from this core or another emulator, the format is in trace.hpp) into a trace file
+// exit code 0 = traces match, 1 = divergence, 2 = usage / file error
+
+void print_usage() {
+  printf("usage: trace_diff record <program.COM> <trace> [--interval N] [--full START:COUNT]...\n");
+  printf("       trace_diff check  <program.COM> <trace>\n");
+  printf("       trace_diff export <program.COM> <text>\n");
+  printf("       trace_diff import <text> <trace> [--interval N] [--full START:COUNT]...\n");
+}
+
+// --interval / --full from argv[first] on, false on anything else
+bool parse_recorder_options(int argc, char** argv, int first, TraceRecorder* recorder) {
+  u32 interval = TRACE_DEFAULT_INTERVAL;
+  vector<TraceWindow> windows;
+  for (int i = first; i < argc; i += 2) {
+    if (i + 1 >= argc) {
+      return false;
+    }
+    if (strcmp(argv[i], "--interval") == 0) {
+      interval = strtoul(argv[i + 1], nullptr, 0);
+    } else if (strcmp(argv[i], "--full") == 0) {
+      TraceWindow window = {0, 0};
+      char* end = nullptr;
+      window.start = strtoull(argv[i + 1], &end, 0);
+      if (*end == ':') {
+        window.count = strtoull(end + 1, nullptr, 0);
+      }
+      windows.push_back(window);
+    } else {
+      return false;
+    }
+  }
+  *recorder = TraceRecorder(interval);
+  for (size_t i = 0; i < windows.size(); i++) {
+    recorder->add_full_window(windows[i].start, windows[i].count);
+  }
+  return true;
+}
+
+int export_trace(_8080* _8080_, const string& text_file) {
+  ofstream text(text_file);
+  if (!text) {
+    log_error("could not open %s", text_file.c_str());
+    return 2;
+  }
+  u64 index = 0;
+  while (!_8080_->test_finished()) {
+    _8080_->step_test();
+    text << format_trace_state(capture_trace_state(_8080_)) << '\n';
+    index++;
+  }
+  if (!text) {
+    log_error("could not write %s", text_file.c_str());
+    return 2;
+  }
+  log_info("exported %llu instructions into %s", (unsigned long long) index, text_file.c_str());
+  return 0;
+}
+
+int import_trace(const string& text_file, const string& trace_file, TraceRecorder& recorder) {
+  ifstream text(text_file);
+  if (!text) {
+    log_error("could not open %s", text_file.c_str());
+    return 2;
+  }
+  if (!recorder.open(trace_file)) {
+    return 2;
+  }
+  string line;
+  for (u64 number = 1; getline(text, line); number++) {
+    if (line.empty() || line[0] == '#' || line == "\r") {
+      continue;
+    }
+    TraceState state;
+    if (!parse_trace_state(line, &state)) {
+      log_error("%s:%llu is not a trace line: %s", text_file.c_str(), (unsigned long long) number, line.c_str());
+      recorder.close();
+      return 2;
+    }
+    recorder.add(state);
+  }
+  long long imported = recorder.close();
+  if (imported < 0) {
+    return 2;
+  }
+  log_info("imported %lld instructions into %s", imported, trace_file.c_str());
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  if (argc < 4) {
+    print_usage();
+    return 2;
+  }
+
+  string mode = argv[1];
+  TraceRecorder recorder;
+  if ((mode == "record" || mode == "import") && !parse_recorder_options(argc, argv, 4, &recorder)) {
+    print_usage();
+    return 2;
+  }
+  if (mode == "import") {
+    return import_trace(argv[2], argv[3], recorder);
+  }
+
+  string program = argv[2];
+  string trace_file = argv[3];
+  _8080* _8080_ = new _8080(true);
+  _8080_->load_test(program);
+
+  int result = 2;
+  if (mode == "record") {
+    long long recorded = recorder.record(_8080_, trace_file);
+    if (recorded >= 0) {
+      log_info("recorded %lld instructions into %s", recorded, trace_file.c_str());
+      result = 0;
+    }
+  } else if (mode == "check") {
+    TraceChecker checker;
+    result = checker.check(_8080_, trace_file) ? 0 : 1;
+  } else if (mode == "export") {
+    result = export_trace(_8080_, trace_file);
+  } else {
+    print_usage();
+  }
+
+  delete _8080_;
+  return result;
+}
@@ -0,0 +1,17 @@
+; idle loop regression for the Space Invaders hardware (no game ROM needed)
+;
+; a short countdown loop that is left and entered again through a long backward jump
+; reaches its head with the same registers every pass, but the passes are not one
+; iteration apart: INR M runs in between. Interrupts stay off, so the hashes recorded
+; with idle loop skipping must match a run without it.
+
+        ORG 0
+        LXI SP,2400H
+        LXI H,2400H         ; first VRAM byte
+AGAIN:  MVI B,2
+LOOP:   DCR B
+        JNZ LOOP
+        INR M               ; counts the passes into VRAM
+        DB 0,0,0,0,0,0,0,0  ; NOPs, the jump back is longer than IDLE_LOOP_MAX_BYTES
+        DB 0,0,0,0,0,0,0,0
+        JMP AGAIN
@@ -0,0 +1,132 @@
+; frame hash test program for the Space Invaders hardware (no game ROM needed)
+;
+; exercises both interrupts, the shift register, IN 1, PUSH/POP PSW, the ALU flags, a
+; polling loop, the fused idioms (block copy, MOV A,M / LDA + ANA A / RZ, CALL to a RET)
+; and HLT, and draws the results into VRAM so every frame hash depends on them
+;
+; RAM: 2000h frame counter (word), 2002h mid screen counter, 2003h last IN 1,
+;      2004h vblank draw pointer (word), 2006h pattern seed, 2007h tests passed,
+;      2010h - 2017h copied pattern
+
+        ORG 0
+        JMP START
+        ORG 8
+        JMP MID             ; RST 1 - mid screen interrupt
+        ORG 10H
+        JMP VBLANK          ; RST 2 - vblank interrupt
+
+START:  LXI SP,2400H
+        LXI H,2400H
+        SHLD 2004H
+        MVI A,1
+        STA 2006H
+        EI
+
+; main loop: mix the counters into the seed and fill half a VRAM column with it
+MAIN:   LDA 2002H
+        MOV B,A
+        LDA 2006H
+        ADD B
+        DAA
+        RLC
+        MOV C,A
+        LDA 2003H
+        XRA C
+        STA 2006H
+        LHLD 2000H          ; column = frame & 7Fh
+        MOV A,L
+        ANI 7FH
+        MOV L,A
+        MVI H,0
+        DAD H
+        DAD H
+        DAD H
+        DAD H
+        DAD H
+        LXI D,2400H
+        DAD D
+        MVI B,16
+        LDA 2006H
+FILL:   MOV M,A
+        INX H
+        RRC
+        SBI 3
+        DCR B
+        JNZ FILL
+
+; copy the pattern table into RAM and count the tests that don't return early
+        LXI D,PATTERN
+        LXI H,2010H
+        MVI B,8
+COPY:   LDAX D
+        MOV M,A
+        INX H
+        INX D
+        DCR B
+        JNZ COPY
+        CALL TESTS
+        CALL STUB
+
+; idle until the mid screen interrupt, then halt until vblank
+        LDA 2002H
+        MOV C,A
+WAIT:   LDA 2002H
+        CMP C
+        JZ WAIT
+        HLT
+        JMP MAIN
+
+TESTS:  LXI H,2003H
+        MOV A,M
+        ANA A
+        RZ
+        LDA 2002H
+        ANA A
+        RZ
+        LXI H,2007H
+        INR M
+STUB:   RET
+
+PATTERN: DB 81H,42H,24H,18H,18H,24H,42H,81H
+
+MID:    PUSH PSW
+        LDA 2002H
+        INR A
+        STA 2002H
+        POP PSW
+        EI
+        RET
+
+VBLANK: PUSH PSW
+        PUSH B
+        PUSH D
+        PUSH H
+        LHLD 2000H
+        INX H
+        SHLD 2000H
+        MOV A,L             ; shift register: (frame << 3) >> 8
+        OUT 4
+        MOV A,H
+        OUT 4
+        MVI A,3
+        OUT 2
+        IN 3
+        MOV B,A
+        IN 1
+        STA 2003H
+        XRA B
+        MOV C,A
+        LHLD 2004H          ; the draw pointer walks the whole VRAM
+        MOV M,C
+        INX H
+        MOV A,H
+        CPI 40H
+        JNZ VBDONE
+        MVI H,24H
+VBDONE: SHLD 2004H
+        POP H
+        POP D
+        POP B
+        POP PSW
+        EI
+        RET